@@ -468,59 +468,35 @@ bool execute_list_mode_run(unsigned int run_num, const configuration& cfg,
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 
-    std::cout << LOG("INFO") << "Checking that the run is finalized in all the modules."
-              << std::endl;
-    bool all_modules_finished = false;
-    const unsigned int max_finalize_attempts = 50;
-    for (unsigned int counter = 0; counter < max_finalize_attempts; counter++) {
-        for (unsigned short k = 0; k < cfg.num_modules(); k++) {
-            if (Pixie16CheckRunStatus(k) == 1) {
-                all_modules_finished = false;
-            } else {
-                all_modules_finished = true;
-            }
-        }
-        if (all_modules_finished) {
-            break;
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
-
-    if (!all_modules_finished) {
-        std::cout << LOG("ERROR") << "All modules did not stop their runs properly!" << std::endl;
-        return false;
-    }
-
-    std::cout << LOG("INFO") << "List-mode run finished in "
-              << std::chrono::duration_cast<std::chrono::duration<double>>(
-                     std::chrono::steady_clock::now() - run_start_time)
-                     .count()
-              << " s" << std::endl;
-
-    std::cout << LOG("INFO")
-              << "Reading the final words from the External FIFO and the run statistics."
-              << std::endl;
+    /*
+     * End the run in each module and drain its External FIFO. The call returns once the last
+     * of the data has been appended to the module's file so there is no need to wait and poll
+     * the FIFO status.
+     */
+    std::cout << LOG("INFO") << "Ending the run and draining the External FIFOs." << std::endl;
     for (unsigned short mod_num = 0; mod_num < cfg.num_modules(); mod_num++) {
-        while (true) {
-            if (!verify_api_return_value(Pixie16CheckExternalFIFOStatus(&num_fifo_words, mod_num),
-                                         "Pixie16CheckExternalFIFOStatus", false))
-                return false;
-
-            std::cout << LOG("INFO") << "External FIFO has " << num_fifo_words << " words."
-                      << std::endl;
-
-            if (num_fifo_words == 0) {
-                break;
-            }
+        output_streams[mod_num]->close();
+        module_drain_counts drain_counts;
+        if (!verify_api_return_value(
+                PixieEndRunDrain(
+                    mod_num,
+                    generate_filename(mod_num, "list-mode-run" + std::to_string(run_num) + "-recs",
+                                      "bin")
+                        .c_str(),
+                    &drain_counts),
+                "PixieEndRunDrain", false))
+            return false;
 
-            std::vector<uint32_t> data(num_fifo_words, 0xDEADBEEF);
-            if (!verify_api_return_value(
-                    Pixie16ReadDataFromExternalFIFO(data.data(), num_fifo_words, mod_num),
-                    "Pixie16ReadDataFromExternalFIFO", false))
-                return false;
-            output_streams[mod_num]->write(reinterpret_cast<char*>(data.data()),
-                                           num_fifo_words * sizeof(uint32_t));
+        std::cout << LOG("INFO") << "Module " << mod_num << " drained "
+                  << drain_counts.drained << " words in " << drain_counts.usecs
+                  << " us, wrote " << drain_counts.written << " final words, read "
+                  << drain_counts.dma_in << " words in the run." << std::endl;
+        if (drain_counts.dropped != 0 || drain_counts.lost != 0) {
+            std::cout << LOG("ERROR") << "Module " << mod_num << " dropped "
+                      << drain_counts.dropped << " words and lost " << drain_counts.lost
+                      << " words." << std::endl;
         }
+
         if (!output_statistics_data(cfg.modules[mod_num],
                                     "list-mode-run" + std::to_string(run_num) + "-stats")) {
             return false;
@@ -20,13 +20,21 @@
  * @brief Ingests a list-mode data file and validates its contents. Part of P16-502.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include <args/args.hxx>
@@ -34,6 +42,8 @@
 
 #include "pixie/data/list_mode.hpp"
 
+namespace list_mode = xia::pixie::data::list_mode;
+
 struct LOG {
     explicit LOG(const std::string& type) {
         type_ = type;
@@ -71,6 +81,8 @@ struct config {
 using configs = std::vector<config>;
 
 struct channel_info {
+    size_t crate;
+    size_t slot;
     size_t id;
     size_t count;
     double cps;
@@ -82,10 +94,50 @@ struct channel_info {
     double time_min;
     double time_max;
     double trace_length_ave;
+
+    channel_info(const list_mode::record& record)
+        : crate(record.crate_id), slot(record.slot_id), id(record.channel_number), count(0),
+          cps(0), energy_ave(0), energy_min(record.energy), energy_max(record.energy),
+          event_length_ave(0), header_length_ave(0), time_min(record.time.count()),
+          time_max(record.time.count()), trace_length_ave(0) {}
+
+    void add(const list_mode::record& record) {
+        count++;
+        energy_ave += record.energy;
+        trace_length_ave += record.trace_length;
+        header_length_ave += record.header_length;
+        event_length_ave += record.event_length;
+        energy_max = std::max(energy_max, record.energy);
+        energy_min = std::min(energy_min, record.energy);
+        time_max = std::max(time_max, record.time.count());
+        time_min = std::min(time_min, record.time.count());
+    }
+
+    void merge(const channel_info& other) {
+        count += other.count;
+        energy_ave += other.energy_ave;
+        trace_length_ave += other.trace_length_ave;
+        header_length_ave += other.header_length_ave;
+        event_length_ave += other.event_length_ave;
+        energy_max = std::max(energy_max, other.energy_max);
+        energy_min = std::min(energy_min, other.energy_min);
+        time_max = std::max(time_max, other.time_max);
+        time_min = std::min(time_min, other.time_min);
+    }
+
+    void finish() {
+        energy_ave /= count;
+        cps = count / (time_max - time_min);
+        header_length_ave /= count;
+        trace_length_ave /= count;
+        event_length_ave /= count;
+    }
 };
 
 void to_json(nlohmann::json& j, const channel_info& ch) {
     j = nlohmann::json{
+        {"crate", ch.crate},
+        {"slot", ch.slot},
         {"id", ch.id},
         {"count", ch.count},
         {"count_per_second", ch.cps},
@@ -97,7 +149,7 @@ void to_json(nlohmann::json& j, const channel_info& ch) {
     };
 }
 
-using channel_id = size_t;
+using channel_id = std::tuple<size_t, size_t, size_t>;
 using channel_stats = std::map<channel_id, channel_info>;
 
 void verify_json_slot(const nlohmann::json& node) {
@@ -132,15 +184,176 @@ void read_config(const std::string& file, configs& cfgs) {
         mod_cfg.frequency = element["frequency"];
         cfgs.push_back(mod_cfg);
     }
+
+    if (cfgs.empty()) {
+        throw std::invalid_argument("No slots defined in the configuration.");
+    }
 }
 
-double calculate_duration_in_seconds(const std::chrono::system_clock::time_point& start,
-                                     const std::chrono::system_clock::time_point& end) {
+double calculate_duration_in_seconds(const std::chrono::steady_clock::time_point& start,
+                                     const std::chrono::steady_clock::time_point& end) {
     return std::chrono::duration<double>(end - start).count();
 }
 
+/*
+ * A run of consecutive events from one slot in a chunk.
+ */
+struct segment {
+    size_t cfg;
+    size_t start;
+    size_t length;
+};
+
+/*
+ * A fixed size block of the file holding only complete events. The words of
+ * a partial event at the end of a read are carried to the next chunk.
+ */
+struct chunk {
+    list_mode::buffer words;
+    size_t size;
+    std::vector<segment> segments;
+
+    explicit chunk(size_t words_) : words(words_), size(0) {}
+};
+
+/*
+ * A blocking queue of chunks. The reader and the workers pass a fixed set of
+ * chunks between them so memory does not grow with the file size.
+ */
+struct chunk_queue {
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<chunk*> chunks;
+    bool closed = false;
+
+    void push(chunk* c) {
+        std::lock_guard<std::mutex> guard(lock);
+        chunks.push_back(c);
+        cond.notify_one();
+    }
+
+    chunk* pop() {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [this] { return closed || !chunks.empty(); });
+        if (chunks.empty()) {
+            return nullptr;
+        }
+        auto c = chunks.front();
+        chunks.pop_front();
+        return c;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        cond.notify_all();
+    }
+};
+
+/*
+ * Stage times in seconds. The decode and accumulate times are the sum over
+ * the worker threads.
+ */
+struct stage_times {
+    double read = 0;
+    double split = 0;
+    double decode = 0;
+    double accumulate = 0;
+    double merge = 0;
+};
+
+struct worker_state {
+    channel_stats stats;
+    size_t records = 0;
+    double decode = 0;
+    double accumulate = 0;
+    std::string error;
+};
+
+/*
+ * Walks the event headers of the chunk's words, finds each event's slot
+ * configuration and groups the events into segments. Returns the number of
+ * words holding complete events.
+ */
+size_t split_chunk(chunk& c, const configs& cfgs, size_t& last_cfg) {
+    c.segments.clear();
+    size_t pos = 0;
+    list_mode::event_header header;
+    while (pos < c.size) {
+        auto word = c.words[pos];
+        size_t cfg = cfgs.size();
+        for (size_t tried = 0; tried < cfgs.size(); ++tried) {
+            auto candidate = (last_cfg + tried) % cfgs.size();
+            auto& slot_cfg = cfgs[candidate];
+            list_mode::decode_event_header(word, slot_cfg.revision, slot_cfg.frequency, header);
+            if (header.slot_id == slot_cfg.slot) {
+                cfg = candidate;
+                break;
+            }
+        }
+        if (cfg == cfgs.size()) {
+            throw xia::pixie::error::error(
+                xia::pixie::error::code::invalid_slot_id,
+                "no configuration for event slot at word " + std::to_string(pos));
+        }
+        if (header.event_length == 0 || header.event_length > c.words.size()) {
+            throw xia::pixie::error::error(
+                xia::pixie::error::code::invalid_event_length,
+                "bad event length: " + std::to_string(header.event_length));
+        }
+        if (pos + header.event_length > c.size) {
+            break;
+        }
+        last_cfg = cfg;
+        if (!c.segments.empty() && c.segments.back().cfg == cfg) {
+            c.segments.back().length += header.event_length;
+        } else {
+            c.segments.push_back({cfg, pos, header.event_length});
+        }
+        pos += header.event_length;
+    }
+    return pos;
+}
+
+void process_chunks(chunk_queue& work, chunk_queue& free_chunks, const configs& cfgs,
+                    worker_state& state, std::atomic_bool& failed) {
+    list_mode::records records;
+    list_mode::buffer leftovers;
+    while (auto c = work.pop()) {
+        if (!failed) {
+            try {
+                for (auto& seg : c->segments) {
+                    auto& slot_cfg = cfgs[seg.cfg];
+                    auto start = std::chrono::steady_clock::now();
+                    list_mode::decode_data_block(&c->words[seg.start], seg.length,
+                                                 slot_cfg.revision, slot_cfg.frequency, records,
+                                                 leftovers);
+                    auto decoded = std::chrono::steady_clock::now();
+                    for (const auto& record : records) {
+                        auto key = std::make_tuple(record.crate_id, record.slot_id,
+                                                   record.channel_number);
+                        auto stat_rec = state.stats.find(key);
+                        if (stat_rec == state.stats.end()) {
+                            stat_rec = state.stats.emplace(key, channel_info(record)).first;
+                        }
+                        stat_rec->second.add(record);
+                    }
+                    state.records += records.size();
+                    state.decode += calculate_duration_in_seconds(start, decoded);
+                    state.accumulate += calculate_duration_in_seconds(
+                        decoded, std::chrono::steady_clock::now());
+                }
+            } catch (std::exception& e) {
+                state.error = e.what();
+                failed = true;
+            }
+        }
+        free_chunks.push(c);
+    }
+}
+
 int main(int argc, char** argv) {
-    auto first_start = std::chrono::system_clock::now();
+    auto first_start = std::chrono::steady_clock::now();
     auto start = first_start;
     args::ArgumentParser parser("Validates list-mode data files produced by the example software.");
     parser.LongSeparator("=");
@@ -154,6 +367,12 @@ int main(int argc, char** argv) {
     args::ValueFlag<std::string> input_flag(arguments, "input_file",
                                             "The input file we'll attempt to decode.",
                                             {'i', "input-file"}, args::Options::Required);
+    args::ValueFlag<size_t> threads_flag(
+        arguments, "threads", "The number of decode threads. Defaults to the number of cores.",
+        {'t', "threads"});
+    args::ValueFlag<size_t> chunk_flag(arguments, "chunk_size",
+                                       "The size of a read-ahead chunk in MiB. Defaults to 4.",
+                                       {'s', "chunk-size"}, 4);
 
     try {
         parser.ParseCLI(argc, argv);
@@ -176,85 +395,120 @@ int main(int argc, char** argv) {
     }
 
     std::cout << LOG("INFO") << "Finished reading config in "
-              << calculate_duration_in_seconds(start, std::chrono::system_clock::now()) << " s."
+              << calculate_duration_in_seconds(start, std::chrono::steady_clock::now()) << " s."
               << std::endl;
 
-    start = std::chrono::system_clock::now();
-    std::cout << LOG("INFO") << "Starting to parse " << input_flag.Get() << std::endl;
+    size_t num_threads = std::thread::hardware_concurrency();
+    if (threads_flag) {
+        num_threads = threads_flag.Get();
+    }
+    num_threads = std::max(num_threads, size_t(1));
+    size_t chunk_words = std::max(chunk_flag.Get(), size_t(1)) * 1024 * 1024 / 4;
 
-    std::ifstream input(input_flag.Get(), std::ios::in | std::ios::binary | std::ios::ate);
-    xia::pixie::data::list_mode::records records;
-    xia::pixie::data::list_mode::buffer remainder;
-    try {
-        if (input.fail()) {
-            throw std::ios_base::failure("open: " + input_flag.Get() + ": " + std::strerror(errno));
+    std::cout << LOG("INFO") << "Starting to parse " << input_flag.Get() << " with "
+              << num_threads << " threads" << std::endl;
+
+    std::ifstream input(input_flag.Get(), std::ios::in | std::ios::binary);
+    if (input.fail()) {
+        std::cout << LOG("ERROR") << "open: " << input_flag.Get() << ": " << std::strerror(errno)
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    /*
+     * Two chunks per thread keep the workers busy while the reader fills the
+     * next chunk.
+     */
+    std::vector<std::unique_ptr<chunk>> pool;
+    chunk_queue free_chunks;
+    chunk_queue work;
+    for (size_t c = 0; c < num_threads * 2; ++c) {
+        pool.emplace_back(new chunk(chunk_words));
+        free_chunks.push(pool.back().get());
+    }
+
+    std::atomic_bool failed(false);
+    std::vector<worker_state> states(num_threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < num_threads; ++t) {
+        workers.emplace_back(process_chunks, std::ref(work), std::ref(free_chunks),
+                             std::cref(cfgs), std::ref(states[t]), std::ref(failed));
+    }
+
+    stage_times times;
+    list_mode::buffer remainder;
+    size_t bytes_read = 0;
+    size_t last_cfg = 0;
+    std::string read_error;
+    start = std::chrono::steady_clock::now();
+
+    while (!failed) {
+        auto c = free_chunks.pop();
+        auto read_start = std::chrono::steady_clock::now();
+        std::copy(remainder.begin(), remainder.end(), c->words.begin());
+        auto space = c->words.size() - remainder.size();
+        input.read(reinterpret_cast<char*>(&c->words[remainder.size()]), space * 4);
+        auto got = size_t(input.gcount());
+        bytes_read += got;
+        c->size = remainder.size() + got / 4;
+        auto split_start = std::chrono::steady_clock::now();
+        times.read += calculate_duration_in_seconds(read_start, split_start);
+        size_t complete = 0;
+        try {
+            complete = split_chunk(*c, cfgs, last_cfg);
+        } catch (std::exception& e) {
+            read_error = e.what();
+            failed = true;
+        }
+        remainder.assign(c->words.begin() + complete, c->words.begin() + c->size);
+        times.split += calculate_duration_in_seconds(split_start, std::chrono::steady_clock::now());
+        if (complete > 0 && !failed) {
+            work.push(c);
+        } else {
+            free_chunks.push(c);
+        }
+        if (got < space * 4) {
+            break;
         }
+    }
+    input.close();
 
-        auto size = input.tellg();
-        /*
-         * We divide by 4 in the vector size as we're wanting to read 32-bit ints, which are read
-         * using a char data type.
-         */
-        xia::pixie::data::list_mode::buffer data(size / 4, 0);
-        input.seekg(0);
-        input.read(reinterpret_cast<char*>(&data.data()[0]), size);
-        input.close();
-
-        xia::pixie::data::list_mode::decode_data_block(data, cfgs[0].revision, cfgs[0].frequency,
-                                                       records, remainder);
-    } catch (std::ios_base::failure& failure) {
-        std::cout << LOG("ERROR") << failure.what() << std::endl;
-    } catch (xia::pixie::error::error& sdkerr) {
-        std::cout << LOG("ERROR") << sdkerr.what() << std::endl;
+    work.close();
+    for (auto& worker : workers) {
+        worker.join();
     }
+    auto processed = std::chrono::steady_clock::now();
+    auto process_time = calculate_duration_in_seconds(start, processed);
 
-    std::cout << LOG("INFO") << "Total records processed : " << records.size() << std::endl;
+    if (!read_error.empty()) {
+        std::cout << LOG("ERROR") << read_error << std::endl;
+    }
 
     channel_stats stats;
-    for (const auto& record : records) {
-        auto stat_rec = stats.find(record.channel_number);
-        if (stat_rec == stats.end()) {
-            stats[record.channel_number] = {record.channel_number,
-                                            1,
-                                            0,
-                                            record.energy,
-                                            record.energy,
-                                            record.energy,
-                                            static_cast<double>(record.event_length),
-                                            static_cast<double>(record.header_length),
-                                            record.time.count(),
-                                            record.time.count(),
-                                            static_cast<double>(record.trace_length)};
-        } else {
-            auto ch = &stat_rec->second;
-            ch->count++;
-            ch->energy_ave += record.energy;
-            ch->trace_length_ave += record.trace_length;
-            ch->header_length_ave += record.header_length;
-            ch->event_length_ave += record.event_length;
-
-            if (record.energy > ch->energy_max) {
-                ch->energy_max = record.energy;
-            }
-            if (record.energy < ch->energy_min) {
-                ch->energy_min = record.energy;
-            }
-            if (record.time.count() > ch->time_max) {
-                ch->time_max = record.time.count();
-            }
-            if (record.time.count() < ch->time_min) {
-                ch->time_min = record.time.count();
+    size_t total_records = 0;
+    for (auto& state : states) {
+        if (!state.error.empty()) {
+            std::cout << LOG("ERROR") << state.error << std::endl;
+        }
+        total_records += state.records;
+        times.decode += state.decode;
+        times.accumulate += state.accumulate;
+        for (auto& stat : state.stats) {
+            auto stat_rec = stats.find(stat.first);
+            if (stat_rec == stats.end()) {
+                stats.emplace(stat.first, stat.second);
+            } else {
+                stat_rec->second.merge(stat.second);
             }
         }
     }
+    times.merge = calculate_duration_in_seconds(processed, std::chrono::steady_clock::now());
+
+    std::cout << LOG("INFO") << "Total records processed : " << total_records << std::endl;
 
     for (auto& stat : stats) {
         auto ch = &stat.second;
-        ch->energy_ave /= ch->count;
-        ch->cps = ch->count / (ch->time_max - ch->time_min);
-        ch->header_length_ave /= ch->count;
-        ch->trace_length_ave /= ch->count;
-        ch->event_length_ave /= ch->count;
+        ch->finish();
         nlohmann::json j = *ch;
         std::cout << LOG("INFO") << j.dump() << std::endl;
     }
@@ -262,9 +516,24 @@ int main(int argc, char** argv) {
     if (!remainder.empty()) {
         std::cout << LOG("WARN") << "Leftover Words: " << remainder.size() << std::endl;
     }
+    if (bytes_read % 4 != 0) {
+        std::cout << LOG("WARN") << "Leftover Bytes: " << bytes_read % 4 << std::endl;
+    }
+
+    nlohmann::json timing = {
+        {"read", times.read},
+        {"split", times.split},
+        {"decode", times.decode},
+        {"accumulate", times.accumulate},
+        {"merge", times.merge},
+        {"total", process_time},
+        {"threads", num_threads},
+        {"bytes", bytes_read},
+        {"MB_per_second", process_time > 0 ? double(bytes_read) / process_time / 1e6 : 0}};
+    std::cout << LOG("INFO") << "Stage times (s): " << timing.dump() << std::endl;
 
     std::cout << LOG("INFO") << "Finished execution in "
-              << calculate_duration_in_seconds(first_start, std::chrono::system_clock::now())
+              << calculate_duration_in_seconds(first_start, std::chrono::steady_clock::now())
               << " s." << std::endl;
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -24,12 +24,15 @@
 #define PIXIE_BUFFER_H
 
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <deque>
 #include <forward_list>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 #include <pixie/error.hpp>
@@ -77,6 +80,27 @@ typedef buffer* buffer_ptr;
 */
 typedef std::shared_ptr<buffer> handle;
 
+/**
+ * @brief Lock counts of a pool or queue.
+ *
+ * The counts are updated with the lock held. The wait for a contended
+ * lock is always timed and timing how long the lock is held can be
+ * enabled when benchmarking.
+ */
+struct lock_stats {
+    size_t acquires;
+    size_t contended;
+    uint64_t wait_nsecs;
+    uint64_t hold_nsecs;
+    uint64_t max_hold_nsecs;
+
+    lock_stats();
+
+    void clear();
+
+    void output(std::ostream& out) const;
+};
+
 /**
  * @brief The buffer pool to manage the buffer workers.
  */
@@ -108,6 +132,20 @@ struct pool {
     size_t number;
     size_t size;
 
+    /**
+     * @brief The lowest number of free buffers since the pool was created
+     *     or the low count was reset.
+     */
+    size_t low_count();
+    void reset_low_count();
+
+    /**
+     * @brief Time how long the lock is held.
+     */
+    void time_locks(bool enable);
+    lock_stats lock_counts();
+    void clear_lock_counts();
+
     void output(std::ostream& out);
 
 private:
@@ -115,14 +153,21 @@ private:
     void release(buffer_ptr buf);
 
     std::atomic_size_t count_;
+    size_t low_count_;
 
     std::forward_list<buffer_ptr> buffers;
 
     lock_type lock;
+    lock_stats locking;
+    bool time_holds;
 };
 
 /**
  * @brief Buffer queue for allocating work to the workers.
+ *
+ * The buffers in the queue can be shared, for example with a @ref
+ * recorder. A copy does not change a buffer and compacting skips shared
+ * buffers.
  */
 struct queue {
     typedef std::deque<handle> handles;
@@ -130,6 +175,10 @@ struct queue {
     queue();
 
     void push(handle buf);
+    /**
+     * @brief Pop the buffer at the front of the queue. Any data copied
+     *     from the buffer is removed from it.
+     */
     handle pop();
 
     size_t copy(buffer& to);
@@ -142,8 +191,22 @@ struct queue {
     size_t size();
     size_t count();
 
+    /**
+     * @brief The largest size of the queue since it was created or the
+     *     maximum size was reset.
+     */
+    size_t max_size();
+    void reset_max_size();
+
     void flush();
 
+    /**
+     * @brief Time how long the lock is held.
+     */
+    void time_locks(bool enable);
+    lock_stats lock_counts();
+    void clear_lock_counts();
+
     void output(std::ostream& out);
 
 private:
@@ -153,13 +216,114 @@ private:
 
     handles buffers;
     lock_type lock;
+    lock_stats locking;
+    bool time_holds;
+    /*
+     * Offset of the data not copied in the front buffer.
+     */
+    size_t head;
+    size_t size_;
+    size_t max_size_;
+};
+
+/**
+ * @brief A bounded ring of the most recent buffers.
+ *
+ * The ring holds a handle to each buffer recorded so there is no copy of
+ * the data. A buffer less than half full is copied so small reads do not
+ * hold pool buffers. Buffers are released back to their pool when they
+ * leave the ring. The ring is bounded by the number of words and the age
+ * of the oldest buffer.
+ *
+ * A dump writes the buffers recorded around a trigger time to a file. The
+ * dump runs in its own thread and waits until the period after the
+ * trigger time has been recorded. The buffers being written are held by
+ * the dump until it finishes.
+ */
+struct recorder {
+    typedef std::chrono::steady_clock clock;
+    typedef clock::time_point time_point;
+    typedef std::shared_future<size_t> dump_result;
+
+    struct entry {
+        time_point time;
+        handle buf;
+    };
+    typedef std::deque<entry> entries;
+
+    recorder();
+    ~recorder();
+
+    /**
+     * @brief The most pool buffers of `buffer_words` a ring bounded to
+     *     `max_words` holds.
+     */
+    static size_t pinned_buffers(const size_t max_words, const size_t buffer_words);
+
+    /**
+     * @brief Set the bounds. Zero words disables the recorder and zero
+     *     seconds has no age limit.
+     */
+    void configure(const size_t max_words, const double seconds);
+
+    bool enabled() const {
+        return enabled_.load();
+    }
+
+    /**
+     * @brief Record a buffer. Empty buffers are ignored.
+     */
+    void record(handle buf);
+    void record(handle buf, time_point when);
+
+    /**
+     * @brief Dump the data recorded from `before` seconds before to
+     *     `after` seconds after the trigger time to a file. The result is
+     *     the number of words written and any error is thrown when the
+     *     result is read.
+     */
+    dump_result dump(const std::string& path, time_point trigger, const double before,
+        const double after);
+
+    /**
+     * @brief Wait for the dumps to finish. Dumps waiting for the period
+     *     after their trigger time write the data recorded so far.
+     */
+    void wait();
+
+    /**
+     * @brief Wait for any dumps and release the buffers.
+     */
+    void clear();
+
+    size_t count();
+    size_t size();
+
+    void output(std::ostream& out);
+
+private:
+    size_t write(const std::string& path, time_point trigger, const double before,
+        const double after);
+    void evict(time_point now);
+
+    entries ring;
+    lock_type lock;
+    size_t max_words;
+    double seconds;
     size_t size_;
+    std::atomic_bool enabled_;
+    std::atomic_bool stopping;
+
+    std::vector<dump_result> dumps;
+    lock_type dumps_lock;
 };
 
 }  // namespace buffer
 }  // namespace xia
 
+std::ostream& operator<<(std::ostream& out, const xia::buffer::lock_stats& stats);
 std::ostream& operator<<(std::ostream& out, xia::buffer::pool& pool);
 std::ostream& operator<<(std::ostream& out, xia::buffer::queue& queue);
+std::ostream& operator<<(std::ostream& out, xia::buffer::recorder& recorder);
 
 #endif  // PIXIE_BUFFER_H
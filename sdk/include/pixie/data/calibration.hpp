@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file calibration.hpp
+ * @brief Defines the energy calibration and gain matching of decoded events.
+ */
+
+#ifndef PIXIESDK_CALIBRATION_HPP
+#define PIXIESDK_CALIBRATION_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <pixie/data/columnar.hpp>
+#include <pixie/error.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+/**
+ * @brief Energy calibration and gain matching of columnar event batches.
+ *
+ * A table holds the calibration of each crate, slot and channel. The
+ * energy is calibrated with a polynomial and then gain matched with a
+ * gain and offset. The two steps are folded into one polynomial per
+ * channel when the table is changed so applying a calibration is a
+ * single polynomial per event. The QDC sums are scaled by a gain.
+ *
+ * The table is applied to runs of events of the same channel. Each run
+ * is a tight loop over contiguous values with the channel's coefficients
+ * held in registers and the loop vectorizes. Group the events of a
+ * batch by channel with `columnar::batch::group_by_channel` to get the
+ * longest runs. The batches can come from the stream decoder online or a
+ * columnar file reader offline.
+ */
+namespace calibration {
+
+/*
+ * Local error
+ */
+using error = pixie::error::error;
+
+/**
+ * @brief The number of energy polynomial terms, the polynomial is cubic.
+ */
+static constexpr size_t terms = 4;
+
+/**
+ * @brief The calibration of a channel.
+ */
+struct channel_calibration {
+    uint8_t crate;
+    uint8_t slot;
+    uint8_t channel;
+    /**
+     * @brief Energy polynomial, the constant term is first.
+     */
+    std::array<double, terms> energy;
+    /**
+     * @brief Gain matching applied after the energy polynomial.
+     */
+    double gain;
+    double offset;
+    /**
+     * @brief The QDC sum gain.
+     */
+    double qdc_gain;
+
+    channel_calibration();
+};
+
+using channel_calibrations = std::vector<channel_calibration>;
+
+/**
+ * @brief A table of channel calibrations.
+ *
+ * Channels without a calibration are left unchanged.
+ */
+class table {
+public:
+    table();
+
+    /**
+     * @brief Set the energy polynomial of a channel. There can be up to
+     *     `terms` coefficients, the constant term is first.
+     */
+    void set_energy(uint8_t crate, uint8_t slot, uint8_t channel,
+        const std::vector<double>& coefficients);
+    /**
+     * @brief Set the gain matching of a channel.
+     */
+    void set_gain(uint8_t crate, uint8_t slot, uint8_t channel, double gain,
+        double offset = 0);
+    /**
+     * @brief Set the QDC sum gain of a channel.
+     */
+    void set_qdc_gain(uint8_t crate, uint8_t slot, uint8_t channel, double gain);
+    /**
+     * @brief Set a channel's calibration.
+     */
+    void set(const channel_calibration& cal);
+
+    /**
+     * @brief Is the channel calibrated?
+     */
+    bool has(uint8_t crate, uint8_t slot, uint8_t channel) const;
+    /**
+     * @brief Get a channel's calibration.
+     */
+    const channel_calibration& get(uint8_t crate, uint8_t slot, uint8_t channel) const;
+    /**
+     * @brief The channel calibrations.
+     */
+    const channel_calibrations& channels() const;
+    size_t size() const;
+    void clear();
+
+    /**
+     * @brief Calibrate an energy.
+     */
+    double energy(uint8_t crate, uint8_t slot, uint8_t channel, double value) const;
+
+    /**
+     * @brief Calibrate the energy column of a batch in place. The batch
+     *     needs the energy, crate, slot and channel columns.
+     */
+    void apply(columnar::batch& events) const;
+    /**
+     * @brief Calibrate the QDC sums of a batch. The output has
+     *     `columnar::qdc_sums` values per event. The batch needs the QDC,
+     *     crate, slot and channel columns.
+     */
+    void apply_qdc(const columnar::batch& events, std::vector<double>& qdc) const;
+
+    /**
+     * @brief Load and save the table as JSON.
+     */
+    void load(const std::string& file);
+    void save(const std::string& file) const;
+
+private:
+    channel_calibration& find_or_add(uint8_t crate, uint8_t slot, uint8_t channel);
+    void fold(size_t row);
+    template<typename Apply>
+    void runs(const columnar::batch& events, Apply apply) const;
+
+    /*
+     * The calibrations and their folded energy polynomials and QDC gains
+     * by row. Row 0 is the identity for channels without a calibration.
+     */
+    channel_calibrations cals;
+    std::vector<std::array<double, terms>> polys;
+    std::vector<double> qdc_gains;
+    /*
+     * Key to row.
+     */
+    std::vector<uint32_t> rows;
+};
+
+}  // namespace calibration
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  //PIXIESDK_CALIBRATION_HPP
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/** @file channel_key.hpp
+ * @brief Defines the channel key the data stages index their channels with.
+ */
+
+#ifndef PIXIESDK_CHANNEL_KEY_HPP
+#define PIXIESDK_CHANNEL_KEY_HPP
+
+#include <cstddef>
+#include <string>
+
+#include <pixie/error.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+/**
+ * @brief Per-channel tables index a flat vector with a channel key.
+ *
+ * The key packs the crate, slot and channel number into 16 bits. The
+ * crate has 4 bits, the slot and channel 6 bits each.
+ */
+namespace channel_key {
+static constexpr size_t max_crates = 16;
+static constexpr size_t max_slots = 64;
+static constexpr size_t max_channels = 64;
+
+/**
+ * @brief Is the channel in the key's range?
+ */
+inline bool valid(size_t crate, size_t slot, size_t channel) {
+    return crate < max_crates && slot < max_slots && channel < max_channels;
+}
+
+/**
+ * @brief The key of a valid channel.
+ */
+inline size_t make(size_t crate, size_t slot, size_t channel) {
+    return (crate << 12) | (slot << 6) | channel;
+}
+
+/**
+ * @brief Check the channel is in the key's range.
+ * @param label The error message label.
+ * @throws xia::pixie::error::error if the channel is not valid.
+ */
+inline void check(const char* label, size_t crate, size_t slot, size_t channel) {
+    if (!valid(crate, slot, channel)) {
+        throw pixie::error::error(pixie::error::code::invalid_value,
+            std::string(label) + ": invalid channel: crate=" + std::to_string(crate) +
+                " slot=" + std::to_string(slot) + " channel=" + std::to_string(channel));
+    }
+}
+}  // namespace channel_key
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  //PIXIESDK_CHANNEL_KEY_HPP
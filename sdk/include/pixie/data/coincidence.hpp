@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file coincidence.hpp
+ * @brief Defines a host software coincidence trigger for list-mode data.
+ */
+
+#ifndef PIXIESDK_COINCIDENCE_HPP
+#define PIXIESDK_COINCIDENCE_HPP
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <pixie/data/list_mode.hpp>
+#include <pixie/error.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+/**
+ * @brief A host software trigger that keeps the list-mode events in
+ *     coincidence.
+ *
+ * The trigger sits between the FIFO readers and the recorder. Each module
+ * is a stream and the raw FIFO words of a stream are pushed as they are
+ * read. A push walks the event headers and indexes the complete events by
+ * their time stamp, a partial event at the end of a block is carried to the
+ * next push. The events are not decoded.
+ *
+ * Processing merges the streams in time order. A group opens with an
+ * event and holds the events within the window of that event. A closed
+ * group is accepted if it has the multiplicity of channels and meets each
+ * required channel group. The words of the accepted events are copied to
+ * the output unchanged and in time order.
+ *
+ * An event can be merged once every stream has an event pending or has
+ * finished, a later push cannot hold an earlier event. A quiet stream
+ * stops the merge until a stream has the maximum pending events. A
+ * stream's events must be in time order.
+ *
+ * Streams can be pushed from different threads, typically the FIFO reader
+ * of each module, and the indexing runs in the pushing thread. Process the
+ * trigger from one thread.
+ */
+namespace coincidence {
+
+/*
+ * Local error
+ */
+using error = pixie::error::error;
+
+/**
+ * @brief A channel.
+ */
+struct channel {
+    uint8_t crate;
+    uint8_t slot;
+    uint8_t channel_number;
+
+    channel(uint8_t crate = 0, uint8_t slot = 0, uint8_t channel_number = 0);
+};
+
+/**
+ * @brief A required channel group. An accepted event group has events from
+ *     at least the multiplicity of the group's channels.
+ */
+struct channel_group {
+    std::vector<channel> channels;
+    size_t multiplicity;
+
+    channel_group();
+};
+
+/**
+ * @brief The trigger settings. Times are in seconds.
+ */
+struct config {
+    /**
+     * @brief The coincidence window from the first event of a group.
+     */
+    double window;
+    /**
+     * @brief The number of different channels in an accepted group.
+     */
+    size_t multiplicity;
+    /**
+     * @brief The channel groups an accepted group has to meet.
+     */
+    std::vector<channel_group> groups;
+    /**
+     * @brief A stream with this many events pending does not wait for a
+     *     quiet stream.
+     */
+    size_t max_pending;
+
+    config();
+};
+
+/**
+ * @brief The trigger counts.
+ */
+struct counts {
+    size_t events;
+    size_t accepted_events;
+    size_t rejected_events;
+    size_t accepted_groups;
+    size_t rejected_groups;
+    size_t words_in;
+    size_t words_out;
+    /**
+     * @brief Events earlier than the group being built. They are added to
+     *     the group.
+     */
+    size_t out_of_order;
+    /**
+     * @brief Merges that did not wait for a quiet stream.
+     */
+    size_t forced;
+
+    counts();
+
+    void clear();
+    double accept_fraction() const;
+
+    void output(std::ostream& out) const;
+};
+
+/**
+ * @brief The coincidence trigger.
+ */
+class trigger {
+public:
+    /**
+     * @brief The maximum number of required channel groups.
+     */
+    static const size_t max_groups;
+
+    trigger(const config& cfg = config());
+
+    trigger(const trigger&) = delete;
+    trigger& operator=(const trigger&) = delete;
+
+    /**
+     * @brief Add a module's stream before the run starts.
+     * @param revision The firmware revision used to collect the data.
+     * @param frequency The module's ADC sampling frequency.
+     * @return The stream's handle.
+     */
+    size_t add_stream(size_t revision, size_t frequency);
+
+    /**
+     * @brief Push a block of a stream's FIFO words. The block does not
+     *     have to be an integer number of events.
+     */
+    void push(size_t stream, const uint32_t* data, size_t len);
+    void push(size_t stream, const list_mode::buffer& data);
+
+    /**
+     * @brief The stream has no more data for this run.
+     */
+    void finish(size_t stream);
+
+    /**
+     * @brief Merge the pending events and append the words of the accepted
+     *     events to the output.
+     * @return The number of words appended.
+     */
+    size_t process(list_mode::buffer& out);
+
+    /**
+     * @brief Finish all streams and process the pending events. A partial
+     *     event left at the end of a stream is dropped and counted in the
+     *     words in.
+     */
+    size_t flush(list_mode::buffer& out);
+
+    /**
+     * @brief Clear the streams and counts for a new run. The streams are
+     *     kept.
+     */
+    void clear();
+
+    size_t streams() const;
+    counts stats() const;
+
+    const config cfg;
+
+private:
+    /*
+     * An indexed event, the time is in nanoseconds.
+     */
+    struct event {
+        uint64_t time;
+        uint32_t offset;
+        uint32_t length;
+        uint32_t key;
+    };
+
+    /*
+     * A pushed block of words and its complete events.
+     */
+    struct block {
+        list_mode::buffer words;
+        std::vector<event> events;
+    };
+
+    struct stream {
+        size_t revision;
+        size_t frequency;
+        uint64_t tick;
+
+        std::mutex lock;
+        std::vector<block> incoming;
+        list_mode::buffer partial;
+        size_t words_in;
+        bool finished;
+
+        std::deque<block> blocks;
+        size_t next;
+        size_t pending;
+        bool done;
+
+        stream(size_t revision, size_t frequency);
+        bool empty() const;
+        const event& head() const;
+    };
+
+    struct member {
+        const uint32_t* words;
+        uint32_t length;
+    };
+
+    void take();
+    bool merge(stream*& next);
+    void add(stream& source, list_mode::buffer& out);
+    void close(list_mode::buffer& out);
+
+    std::vector<std::unique_ptr<stream>> streams_;
+
+    std::vector<uint64_t> membership;
+    std::vector<size_t> group_hits;
+    uint64_t window;
+
+    /*
+     * The open group.
+     */
+    bool open;
+    uint64_t start;
+    std::vector<member> members;
+    std::vector<uint32_t> keys;
+    std::vector<block> retired;
+
+    /*
+     * The counts are updated by the processing thread and published at the
+     * end of each pass.
+     */
+    counts merged;
+    mutable std::mutex counts_lock;
+    counts published;
+};
+
+}  // namespace coincidence
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  //PIXIESDK_COINCIDENCE_HPP
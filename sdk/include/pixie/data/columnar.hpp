@@ -0,0 +1,364 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file columnar.hpp
+ * @brief Defines a chunked, columnar file format for decoded list-mode events.
+ */
+
+#ifndef PIXIESDK_COLUMNAR_HPP
+#define PIXIESDK_COLUMNAR_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <pixie/data/list_mode.hpp>
+#include <pixie/error.hpp>
+#include <pixie/os_compat.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+/**
+ * @brief Chunked columnar storage of decoded list-mode events.
+ *
+ * Events are grouped into chunks. Each chunk stores every field of its
+ * events as a contiguous column block and carries an index of the
+ * minimum and maximum time, slot and channel of its events. Traces are
+ * variable length and are kept in a separate trace stream file so the
+ * event file only holds fixed width columns.
+ *
+ * A reader loads only the columns it is asked for and skips the chunks
+ * whose index does not overlap its filter. Analysis that needs only the
+ * energy of one channel reads the energy and channel columns of the
+ * chunks holding that channel and nothing else.
+ *
+ * The files use the host's byte order. A byte order marker in the file
+ * header rejects files written on a host with a different order.
+ */
+namespace columnar {
+
+/*
+ * Local error
+ */
+using error = pixie::error::error;
+
+/**
+ * @brief The columns in a file. The values are bits and can be combined
+ *     to select the columns a reader loads.
+ */
+enum column : uint32_t {
+    /**
+     * @brief Event time in seconds, double
+     */
+    time = 1 << 0,
+    /**
+     * @brief Energy, double
+     */
+    energy = 1 << 1,
+    /**
+     * @brief Crate id, 8 bits
+     */
+    crate = 1 << 2,
+    /**
+     * @brief Slot id, 8 bits
+     */
+    slot = 1 << 3,
+    /**
+     * @brief Channel number, 8 bits
+     */
+    channel = 1 << 4,
+    /**
+     * @brief CFD fractional time in seconds, double
+     */
+    cfd = 1 << 5,
+    /**
+     * @brief Finish code, out of range, CFD forced and CFD source, 8 bits
+     */
+    flags = 1 << 6,
+    /**
+     * @brief External time stamp, double
+     */
+    external_time = 1 << 7,
+    /**
+     * @brief The 8 QDC sums, 32 bits each
+     */
+    qdc = 1 << 8,
+    /**
+     * @brief The 3 energy sums, 32 bits each, and the filter baseline, double
+     */
+    esums = 1 << 9,
+    /**
+     * @brief Trace lengths in the event file and samples in the trace stream
+     */
+    trace = 1 << 10,
+    /**
+     * @brief All the columns
+     */
+    all = (1 << 11) - 1
+};
+
+/**
+ * @brief A mask of columns.
+ */
+using columns = uint32_t;
+
+/**
+ * @brief The number of QDC sums stored per event.
+ */
+static constexpr size_t qdc_sums = 8;
+/**
+ * @brief The number of energy sums stored per event.
+ */
+static constexpr size_t energy_sums = 3;
+
+/**
+ * @brief Bits in the flags column.
+ */
+enum flag : uint8_t {
+    finish_code = 1 << 0,
+    trace_out_of_range = 1 << 1,
+    cfd_forced_trigger = 1 << 2,
+    /**
+     * @brief The CFD trigger source is held in the top bits.
+     */
+    cfd_source_shift = 4
+};
+
+/**
+ * @brief A batch of events held as columns.
+ *
+ * A column's vector is empty if the column is not in `present`. The QDC
+ * and energy sum columns hold a fixed number of values per event, events
+ * without the values are zero. The trace of event `n` is the samples from
+ * `trace_offset[n]` to `trace_offset[n + 1]`.
+ */
+struct batch {
+    using samples = std::vector<uint16_t>;
+
+    size_t size;
+    columns present;
+
+    std::vector<double> time;
+    std::vector<double> energy;
+    std::vector<uint8_t> crate;
+    std::vector<uint8_t> slot;
+    std::vector<uint8_t> channel;
+    std::vector<double> cfd;
+    std::vector<uint8_t> flags;
+    std::vector<double> external_time;
+    std::vector<uint32_t> qdc;
+    std::vector<uint32_t> esums;
+    std::vector<double> baseline;
+    std::vector<size_t> trace_offset;
+    samples trace;
+
+    batch();
+
+    /**
+     * @brief Clear the batch and set the columns it holds.
+     */
+    void clear(columns cols = column::all);
+    /**
+     * @brief Append a decoded record to the present columns.
+     */
+    void append(const list_mode::record& rec);
+    /**
+     * @brief Convert an event back to a record. Fields of columns not
+     *     present are left at their defaults. The filter time is the time
+     *     less the CFD fractional time.
+     */
+    void get(size_t event, list_mode::record& rec) const;
+    /**
+     * @brief Is the column present?
+     */
+    bool has(column col) const;
+    /**
+     * @brief Reorder the events so the events of a crate, slot and channel
+     *     are next to each other. The order of the events of a channel is
+     *     kept. The batch needs the crate, slot and channel columns.
+     */
+    void group_by_channel();
+};
+
+/**
+ * @brief The index entry of a chunk
+ */
+struct chunk_index {
+    size_t events;
+    columns present;
+    double time_min;
+    double time_max;
+    uint16_t slot_min;
+    uint16_t slot_max;
+    uint16_t channel_min;
+    uint16_t channel_max;
+    /*
+     * Offset and length of the chunk in the event file and its samples in
+     * the trace stream.
+     */
+    uint64_t offset;
+    uint64_t length;
+    uint64_t trace_offset;
+    uint64_t trace_length;
+
+    chunk_index();
+};
+
+/**
+ * @brief The chunk index of a file.
+ */
+using chunk_indexes = std::vector<chunk_index>;
+
+/**
+ * @brief A filter to select chunks by the range of their events.
+ *
+ * A chunk is read if any part of its time, slot and channel ranges fall
+ * in the filter's ranges. The filter selects chunks, the events in a
+ * chunk that is read are not filtered.
+ */
+struct filter {
+    double time_min;
+    double time_max;
+    uint16_t slot_min;
+    uint16_t slot_max;
+    uint16_t channel_min;
+    uint16_t channel_max;
+
+    filter();
+
+    void time_range(double min, double max);
+    void slots(uint16_t min, uint16_t max);
+    void channels(uint16_t min, uint16_t max);
+
+    bool selects(const chunk_index& index) const;
+};
+
+/**
+ * @brief The trace stream file name for an event file.
+ */
+std::string trace_stream_name(const std::string& name);
+
+/**
+ * @brief Writes decoded events to a columnar file.
+ *
+ * Events are buffered until a chunk is full and then the chunk is
+ * written. Closing the writer flushes the last partial chunk and writes
+ * the chunk index at the end of the file. A file without the index, for
+ * example a writer that did not close, can still be read, the reader
+ * rebuilds the index from the chunk headers.
+ */
+class writer {
+public:
+    static constexpr size_t default_chunk_events = 65536;
+
+    writer(const std::string& name, size_t chunk_events = default_chunk_events);
+    ~writer();
+
+    writer(const writer&) = delete;
+    writer& operator=(const writer&) = delete;
+
+    /**
+     * @brief Write records.
+     */
+    void write(const list_mode::record& rec);
+    void write(const list_mode::records& recs);
+    /**
+     * @brief Decode a list-mode data block and write the records. The
+     *     arguments are passed to `list_mode::decode_data_block`.
+     */
+    void write(uint32_t* data, size_t len, size_t revision, size_t frequency,
+        list_mode::buffer& leftovers);
+
+    /**
+     * @brief Write the buffered events as a chunk.
+     */
+    void flush();
+    void close();
+
+    bool is_open() const;
+    size_t events() const;
+    size_t chunks() const;
+
+private:
+    void write_chunk();
+
+    const std::string name;
+    const size_t chunk_events;
+    std::ofstream out;
+    std::ofstream traces;
+    uint64_t trace_pos;
+    batch pending;
+    chunk_index pending_index;
+    chunk_indexes index;
+    list_mode::records recs;
+    size_t total;
+};
+
+/**
+ * @brief Reads a columnar file.
+ */
+class reader {
+public:
+    reader(const std::string& name);
+
+    reader(const reader&) = delete;
+    reader& operator=(const reader&) = delete;
+
+    /**
+     * @brief The chunk index.
+     */
+    const chunk_indexes& index() const;
+    /**
+     * @brief The total number of events in the file.
+     */
+    size_t events() const;
+
+    /**
+     * @brief Read the next chunk the filter selects into the batch. Only
+     *     the requested columns the chunk has are loaded.
+     * @return False when there are no more chunks.
+     */
+    bool read(batch& out, columns cols = column::all, const filter& select = filter());
+    /**
+     * @brief Read a chunk by its index position.
+     */
+    void read_chunk(size_t chunk, batch& out, columns cols = column::all);
+    /**
+     * @brief Restart reading at the first chunk.
+     */
+    void rewind();
+
+private:
+    void load_index();
+    void scan_index();
+
+    const std::string name;
+    std::ifstream in;
+    std::ifstream traces;
+    chunk_indexes chunks;
+    size_t next;
+};
+
+}  // namespace columnar
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  //PIXIESDK_COLUMNAR_HPP
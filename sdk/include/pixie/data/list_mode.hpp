@@ -24,11 +24,13 @@
 #define PIXIESDK_LIST_MODE_HPP
 
 #include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <pixie/error.hpp>
 #include <pixie/os_compat.hpp>
+#include <pixie/util.hpp>
 
 namespace xia {
 namespace pixie {
@@ -314,6 +316,90 @@ struct record {
  */
 using records = std::vector<record>;
 
+/**
+ * @brief Decoded records partitioned by crate, slot and channel.
+ *
+ * Each channel has its own records arena so the channels can be processed
+ * by different threads without a partitioning pass. A channel is added
+ * when it has its first event or it can be added before decoding. The
+ * arenas are reserved when a channel is added, grow as needed and keep
+ * their memory when cleared so a run reuses it.
+ *
+ * The partitions are separate allocations padded so the arenas of
+ * different channels do not share a cache line.
+ */
+class partitioned_records {
+public:
+    /**
+     * @brief A cache line in bytes.
+     */
+    static constexpr size_t cache_line = 64;
+
+    /**
+     * @brief A channel's records.
+     */
+    struct partition {
+        size_t crate_id;
+        size_t slot_id;
+        size_t channel_number;
+        records recs;
+
+        partition(size_t crate_id, size_t slot_id, size_t channel_number);
+
+    private:
+        char padding[cache_line];
+    };
+
+    /**
+     * @brief Create the partitions.
+     * @param reserve The records reserved for each channel when added.
+     */
+    partitioned_records(size_t reserve = 0);
+
+    partitioned_records(const partitioned_records&) = delete;
+    partitioned_records& operator=(const partitioned_records&) = delete;
+
+    /**
+     * @brief Add a channel or a module's channels.
+     */
+    void add_channel(size_t crate, size_t slot, size_t channel);
+    void add_module(size_t crate, size_t slot, size_t num_channels);
+
+    /**
+     * @brief The channel's records, the channel is added if not present.
+     */
+    records& add(size_t crate, size_t slot, size_t channel);
+
+    bool has(size_t crate, size_t slot, size_t channel) const;
+    records& get(size_t crate, size_t slot, size_t channel);
+    const records& get(size_t crate, size_t slot, size_t channel) const;
+
+    /**
+     * @brief The partitions in the order the channels were added.
+     */
+    size_t size() const;
+    partition& operator[](size_t index);
+    const partition& operator[](size_t index) const;
+
+    /**
+     * @brief The records in all partitions.
+     */
+    size_t events() const;
+
+    /**
+     * @brief Clear the records. The channels and memory are kept.
+     */
+    void clear();
+
+    const size_t reserve;
+
+private:
+    size_t row(size_t crate, size_t slot, size_t channel) const;
+
+    std::vector<std::unique_ptr<partition>> parts;
+    std::vector<uint32_t> rows;
+};
+
 /**
  * @brief Converts a record object into a JSON string.
  * @param[in] rec The record that we want to convert into a string.
@@ -333,6 +419,40 @@ void json_to_record(const std::string& json_string, record& rec);
  */
 using buffer = std::vector<uint32_t>;
 
+/**
+ * @brief The fields of the first word of a list-mode event header that
+ *     identify the event and its length.
+ */
+struct event_header {
+    size_t crate_id;
+    size_t slot_id;
+    size_t channel_number;
+    size_t header_length;
+    size_t event_length;
+
+    event_header();
+
+    /**
+     * @brief The header and event lengths can hold an event.
+     */
+    bool valid() const;
+};
+
+/**
+ * @brief Decodes the first word of a list-mode event header.
+ *
+ * Only the first header word is used. The function lets a caller walk a
+ * data block event by event, for example to split it between threads or
+ * modules, without decoding the events. The values are not checked.
+ *
+ * @param word The first word of an event.
+ * @param revision The firmware revision used to collect the data.
+ * @param frequency The module's ADC sampling frequency that collected the data.
+ * @param header The decoded fields.
+ */
+PIXIE_EXPORT void PIXIE_API decode_event_header(uint32_t word, size_t revision, size_t frequency,
+                                                event_header& header);
+
 /**
  * @brief Decodes a Pixie-16 list-mode data block.
  *
@@ -396,8 +516,45 @@ PIXIE_EXPORT void PIXIE_API decode_data_block(uint32_t* data, size_t len, size_t
  *  typically happens when you've passed in a partial record, or a data block
  *  that contains a partial record at the end.
  */
-PIXIE_EXPORT void PIXIE_API decode_data_block(buffer data, size_t revision, size_t frequency,
-                                              records& recs, buffer& leftovers);
+PIXIE_EXPORT void PIXIE_API decode_data_block(const buffer& data, size_t revision,
+                                              size_t frequency, records& recs, buffer& leftovers);
+
+/**
+ * @brief Decodes a Pixie-16 list-mode data block in place.
+ *
+ * The block is decoded as `decode_data_block` does without copying the
+ * data. The span can be a view of a caller's buffer or of a FIFO read.
+ *
+ * @param data A view of the data read out of the module.
+ * @param revision The firmware revision used to collect the data.
+ * @param frequency The module's ADC sampling frequency that collected the data.
+ * @param recs A vector to hold the decoded records.
+ * @param leftovers A vector to hold any remaining words that could not be decoded.
+ */
+PIXIE_EXPORT void PIXIE_API decode_data_block(util::span<const uint32_t> data, size_t revision,
+                                              size_t frequency, records& recs, buffer& leftovers);
+
+/**
+ * @brief Decodes a Pixie-16 list-mode data block into records partitioned by
+ *     channel.
+ *
+ * The block is decoded as `decode_data_block` does and each record is
+ * moved to its channel's partition. The records are appended to the
+ * partitions, clear the partitions to start a new set.
+ *
+ * @param data A pointer to the array containing the data read out of the module.
+ * @param len The length of the data array.
+ * @param revision The firmware revision used to collect the data.
+ * @param frequency The module's ADC sampling frequency that collected the data.
+ * @param parts The partitions the records are appended to.
+ * @param leftovers A vector to hold any remaining words that could not be decoded.
+ */
+PIXIE_EXPORT void PIXIE_API decode_data_block(uint32_t* data, size_t len, size_t revision,
+                                              size_t frequency, partitioned_records& parts,
+                                              buffer& leftovers);
+PIXIE_EXPORT void PIXIE_API decode_data_block(util::span<const uint32_t> data, size_t revision,
+                                              size_t frequency, partitioned_records& parts,
+                                              buffer& leftovers);
 }  // namespace list_mode
 }  // namespace data
 }  // namespace pixie
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file pileup.hpp
+ * @brief Defines a streaming pile-up and dead time estimator.
+ */
+
+#ifndef PIXIESDK_PILEUP_HPP
+#define PIXIESDK_PILEUP_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <pixie/data/columnar.hpp>
+#include <pixie/data/list_mode.hpp>
+#include <pixie/error.hpp>
+#include <pixie/stats.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+/**
+ * @brief Streaming pile-up and dead time estimation from event times.
+ *
+ * Each channel keeps a histogram of the time between its events and
+ * counts the events that follow the previous event within each pile-up
+ * window. The true rate is estimated from the intervals longer than the
+ * resolving time. Poisson intervals are memoryless so the mean of the
+ * interval less the resolving time is the true mean interval however
+ * much of the short intervals the dead time removed. The observed and
+ * true rates give the dead time per event and the live time.
+ *
+ * The channels are added before the events. Adding an event is a fixed
+ * amount of work and does not allocate memory. The events of a channel
+ * must be added in time order.
+ */
+namespace pileup {
+
+/*
+ * Local error
+ */
+using error = pixie::error::error;
+
+/**
+ * @brief The estimator settings. Times are in seconds.
+ */
+struct config {
+    /**
+     * @brief The pile-up windows.
+     */
+    std::vector<double> windows;
+    /**
+     * @brief Intervals shorter than this are affected by dead time and are
+     *     not used to estimate the true rate. It should be longer than the
+     *     channel's dead time.
+     */
+    double resolving_time;
+    /**
+     * @brief The inter-arrival histogram bin width and number of bins. The
+     *     last bin counts the intervals past the end of the histogram.
+     */
+    double bin_width;
+    size_t bins;
+
+    config();
+};
+
+/**
+ * @brief A channel's estimate.
+ */
+struct channel {
+    uint8_t crate;
+    uint8_t slot;
+    uint8_t channel_number;
+
+    size_t events;
+    double first_time;
+    double last_time;
+    /**
+     * @brief Events within each window of the previous event.
+     */
+    std::vector<size_t> pileups;
+    /**
+     * @brief Inter-arrival histogram.
+     */
+    std::vector<size_t> intervals;
+    /**
+     * @brief Intervals longer than the resolving time and the sum of the
+     *     time past the resolving time.
+     */
+    size_t long_intervals;
+    double long_interval_sum;
+    /**
+     * @brief Events out of time order, they are not used.
+     */
+    size_t out_of_order;
+
+    channel(const config& cfg);
+
+    void clear();
+
+    /**
+     * @brief The time from the first to the last event.
+     */
+    double span() const;
+    /**
+     * @brief Observed event rate.
+     */
+    double observed_rate() const;
+    /**
+     * @brief Dead time corrected event rate.
+     */
+    double true_rate() const;
+    /**
+     * @brief Dead time per observed event, non-extending.
+     */
+    double dead_time() const;
+    /**
+     * @brief The fraction of the span the channel was dead.
+     */
+    double dead_fraction() const;
+    /**
+     * @brief The time the channel was live.
+     */
+    double live_time() const;
+    /**
+     * @brief The fraction of the events piled up in a window.
+     */
+    double pileup_fraction(size_t window) const;
+
+    void output(std::ostream& out) const;
+};
+
+/**
+ * @brief The estimate cross-checked with the channel statistics of the
+ *     run read from the module.
+ */
+struct cross_check {
+    double true_rate;
+    double stats_rate;
+    double live_time;
+    double stats_live_time;
+
+    cross_check();
+
+    /**
+     * @brief Ratios of the estimates to the statistics, 0 if there are no
+     *     statistics.
+     */
+    double rate_ratio() const;
+    double live_time_ratio() const;
+    /**
+     * @brief Do the rates and live times agree within the tolerance? The
+     *     tolerance is a fraction.
+     */
+    bool agrees(double tolerance) const;
+
+    void output(std::ostream& out) const;
+};
+
+/**
+ * @brief Estimates the pile-up and dead time of a set of channels.
+ */
+class estimator {
+public:
+    estimator(const config& cfg = config());
+
+    /**
+     * @brief Add a channel or a module's channels. Adding a channel
+     *     allocates its histogram, adding events does not.
+     */
+    void add_channel(uint8_t crate, uint8_t slot, uint8_t channel);
+    void add_module(uint8_t crate, uint8_t slot, size_t num_channels);
+
+    /**
+     * @brief Add an event. Events of channels not added or out of the
+     *     channel key's range are counted as unknown.
+     */
+    void add(uint8_t crate, uint8_t slot, uint8_t channel, double time);
+    void add(const list_mode::record& rec);
+    void add(const list_mode::records& recs);
+    /**
+     * @brief Add the events of a batch. The batch needs the time, crate,
+     *     slot and channel columns.
+     */
+    void add(const columnar::batch& events);
+
+    /**
+     * @brief Clear the estimates for a new run. The channels are kept.
+     */
+    void clear();
+
+    bool has(uint8_t crate, uint8_t slot, uint8_t channel) const;
+    const channel& get(uint8_t crate, uint8_t slot, uint8_t channel) const;
+    const std::vector<channel>& channels() const;
+    size_t unknown() const;
+
+    /**
+     * @brief Cross-check a channel's estimate with its run statistics.
+     */
+    cross_check check(uint8_t crate, uint8_t slot, uint8_t channel,
+        const stats::channel& stats) const;
+
+    const config cfg;
+
+private:
+    std::vector<channel> chans;
+    std::vector<uint32_t> rows;
+    double inverse_bin_width;
+    size_t unknown_;
+};
+
+}  // namespace pileup
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  //PIXIESDK_PILEUP_HPP
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file psd.hpp
+ * @brief Defines pulse shape discrimination of decoded events.
+ */
+
+#ifndef PIXIESDK_PSD_HPP
+#define PIXIESDK_PSD_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <pixie/data/columnar.hpp>
+#include <pixie/error.hpp>
+#include <pixie/thread_pool.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+/**
+ * @brief Pulse shape discrimination of columnar event batches.
+ *
+ * The PSD value of an event is the ratio of the tail to the total of its
+ * pulse. The tail and total are weighted sums of the event's QDC sums or
+ * gated sums of its trace less the baseline. The QDC weights let a sum be
+ * left out or a baseline sum be subtracted scaled by its length.
+ *
+ * The ratios of a batch are computed in one pass over the contiguous QDC
+ * column. The ratios and energies then fill a 2D energy and PSD histogram
+ * for each channel. The channels are shared between threads so each
+ * histogram is filled by one thread without locks.
+ */
+namespace psd {
+
+/*
+ * Local error
+ */
+using error = pixie::error::error;
+
+/**
+ * @brief Weights of the QDC sums in the tail and total.
+ */
+struct qdc_gates {
+    std::array<double, columnar::qdc_sums> tail;
+    std::array<double, columnar::qdc_sums> total;
+
+    /**
+     * @brief The default tail is sums 3 to 7 and the total sums 1 to 7.
+     */
+    qdc_gates();
+};
+
+/**
+ * @brief Trace gates in samples. The baseline is the mean of its gate.
+ */
+struct trace_gates {
+    size_t baseline_start;
+    size_t baseline_length;
+    size_t total_start;
+    size_t total_length;
+    size_t tail_start;
+    size_t tail_length;
+
+    trace_gates();
+
+    /**
+     * @brief The length of trace the gates need.
+     */
+    size_t length() const;
+};
+
+/**
+ * @brief The source of the tail and total sums.
+ */
+enum struct source {
+    qdc,
+    trace
+};
+
+/**
+ * @brief A 2D histogram of energy and PSD.
+ */
+struct histogram {
+    size_t energy_bins;
+    double energy_min;
+    double energy_max;
+    size_t psd_bins;
+    double psd_min;
+    double psd_max;
+    /**
+     * @brief The counts, the PSD bins of energy bin 0 are first.
+     */
+    std::vector<uint64_t> counts;
+    /**
+     * @brief Events outside the ranges.
+     */
+    uint64_t outside;
+
+    histogram();
+
+    /**
+     * @brief Set the bins and clear the counts.
+     */
+    void setup(size_t energy_bins_, double energy_min_, double energy_max_, size_t psd_bins_,
+        double psd_min_, double psd_max_);
+    void clear();
+    void fill(double energy, double psd);
+    uint64_t at(size_t energy_bin, size_t psd_bin) const;
+    uint64_t total() const;
+};
+
+/**
+ * @brief A channel's histogram.
+ */
+struct channel {
+    uint8_t crate;
+    uint8_t slot;
+    uint8_t channel_number;
+    /**
+     * @brief Events without a PSD value, for example a zero total or a
+     *     trace shorter than the gates.
+     */
+    uint64_t invalid;
+    histogram hist;
+
+    channel();
+};
+
+/**
+ * @brief The PSD settings.
+ */
+struct config {
+    psd::source source;
+    qdc_gates qdc;
+    trace_gates trace;
+    /**
+     * @brief The histogram of each channel.
+     */
+    size_t energy_bins;
+    double energy_min;
+    double energy_max;
+    size_t psd_bins;
+    double psd_min;
+    double psd_max;
+    /**
+     * @brief Threads of the analyzer's pool that fills the histograms, 0
+     *     uses the hardware concurrency. Not used if the analyzer is
+     *     given a pool.
+     */
+    size_t threads;
+
+    config();
+};
+
+/**
+ * @brief Computes PSD values and fills the channel histograms.
+ */
+class analyzer {
+public:
+    /**
+     * @brief Create an analyzer. The histograms are filled on the pool if
+     *     one is given, otherwise on a pool the analyzer owns. A given pool
+     *     must outlive the analyzer.
+     */
+    analyzer(const config& cfg = config(), thread_pool::pool* pool = nullptr);
+
+    /**
+     * @brief Compute the PSD value of each event in a batch. Events
+     *     without a value are NaN. The batch needs the QDC or trace
+     *     column for the source.
+     */
+    void ratios(const columnar::batch& events, std::vector<double>& psd) const;
+
+    /**
+     * @brief Compute the PSD values of a batch and fill the channel
+     *     histograms. The batch needs the energy, crate, slot and channel
+     *     columns as well.
+     */
+    void analyze(const columnar::batch& events);
+    void analyze(const columnar::batch& events, std::vector<double>& psd);
+
+    void clear();
+
+    bool has(uint8_t crate, uint8_t slot, uint8_t channel) const;
+    const channel& get(uint8_t crate, uint8_t slot, uint8_t channel) const;
+    const std::vector<channel>& channels() const;
+
+    const config cfg;
+
+private:
+    size_t find_or_add(uint8_t crate, uint8_t slot, uint8_t channel);
+
+    std::vector<channel> chans;
+    std::vector<uint32_t> rows;
+
+    std::unique_ptr<thread_pool::pool> owned_workers;
+    thread_pool::pool* workers;
+};
+
+}  // namespace psd
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
+
+#endif  //PIXIESDK_PSD_HPP
@@ -72,6 +72,10 @@ enum struct code {
      * @brief 102
      */
     crate_invalid_param,
+    /**
+     * @brief 103
+     */
+    crate_busy,
     /*
      * Module
      */
@@ -341,6 +345,10 @@ enum struct code {
      * @brief 807
      */
     buffer_pool_not_enough,
+    /**
+     * @brief 808
+     */
+    thread_pool_busy,
     /*
      * Catch all
      */
@@ -198,6 +198,11 @@ struct firmware {
      */
     size_t words();
 
+    /**
+     * @brief The number of bytes of the image loaded in memory.
+     */
+    size_t bytes();
+
     /**
      * @brief We only compare the version, module revision and device.
      *
@@ -245,6 +250,11 @@ typedef std::map<std::string, module> crate;
  */
 std::string tag(const int revision, const int adc_msps, const int adc_bits);
 
+/**
+ * @brief The bytes of all the firmware images loaded in memory.
+ */
+size_t loaded_bytes();
+
 /**
  * @brief Add the firmware to a crate.
  * @param firmwares The vector of firmwares already associated with the crate.
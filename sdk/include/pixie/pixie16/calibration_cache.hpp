@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file calibration_cache.hpp
+ * @brief Defines a persistent cache of the module channel calibrations.
+ */
+
+#ifndef PIXIE_CALIBRATION_CACHE_H
+#define PIXIE_CALIBRATION_CACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <pixie/error.hpp>
+#include <pixie/param.hpp>
+
+#include <pixie/pixie16/hw.hpp>
+
+namespace xia {
+namespace pixie {
+namespace module {
+class module;
+}
+/**
+ * @brief A persistent cache of the channel calibrations.
+ *
+ * The offset DAC, baseline cut and preamp tau of each channel are saved
+ * to a JSON file. A module's entry is keyed by its serial number,
+ * revision, daughter boards and firmware. A channel's entry holds the
+ * settings the calibration depends on. Only the gain and polarity bits
+ * of CSRA are held.
+ *
+ * Restoring a module applies the cached values of the channels with
+ * unchanged settings and verifies them with one ADC trace per channel.
+ * Only the channels that are not cached or fail the check are
+ * recalibrated.
+ */
+namespace calibration_cache {
+/*
+ * Local error
+ */
+typedef pixie::error::error error;
+
+/**
+ * @brief The settings a channel's calibration depends on by variable name.
+ *     The values are masked to the bits the calibration depends on.
+ */
+typedef std::map<std::string, param::value_type> settings;
+
+/**
+ * @brief A channel's cached calibration.
+ */
+struct channel {
+    size_t number;
+    param::value_type offset_dac;
+    param::value_type bl_cut;
+    param::value_type preamp_tau;
+    calibration_cache::settings settings;
+
+    channel();
+};
+
+typedef std::vector<channel> channels;
+
+/**
+ * @brief A module's cached calibration.
+ */
+struct module {
+    std::string key;
+    int serial_num;
+    std::string dbs;
+    std::string firmware;
+    calibration_cache::channels channels;
+
+    module();
+
+    const channel* find(size_t number) const;
+};
+
+/**
+ * @brief The result of restoring a module.
+ */
+struct counts {
+    size_t channels;
+    /**
+     * Channels restored from the cache that passed the check.
+     */
+    size_t restored;
+    /**
+     * Channels not in the cache or with changed settings.
+     */
+    size_t missing;
+    /**
+     * Channels restored from the cache that failed the check.
+     */
+    size_t failed;
+    /**
+     * Channels recalibrated.
+     */
+    size_t recalibrated;
+    /**
+     * Recalibrated channels that still fail the check.
+     */
+    size_t unverified;
+    size_t usecs;
+
+    counts();
+
+    void clear();
+};
+
+/**
+ * @brief The module calibration cache.
+ *
+ * A cache is not thread safe. Restore modules from their own cache and
+ * merge the records into the file or restore in series.
+ */
+class cache {
+public:
+    static const int format;
+
+    /**
+     * @brief The verified baseline can be this percentage of the ADC range
+     *     from the baseline percent target.
+     */
+    double tolerance_percent;
+
+    /**
+     * @brief Run the tau finder for the recalibrated channels.
+     */
+    bool find_tau;
+
+    cache();
+
+    /**
+     * @brief Load a cache file. A missing file is an empty cache.
+     * @return True if the file was loaded.
+     */
+    bool load(const std::string& file);
+
+    /**
+     * @brief Save the cache. The file is replaced once written.
+     */
+    void save(const std::string& file) const;
+
+    /**
+     * @brief Record the module's calibration replacing any entry.
+     */
+    void record(pixie::module::module& module);
+
+    /**
+     * @brief Restore the module's calibration, verify it and recalibrate
+     *     the channels that fail. The recalibrated channels that verify
+     *     are recorded.
+     * @param module The module.
+     * @param result The channel counts.
+     * @param recalibrate Recalibrate the missing and failed channels.
+     */
+    void restore(pixie::module::module& module, counts& result, bool recalibrate = true);
+
+    bool has(pixie::module::module& module) const;
+    const calibration_cache::module& get(pixie::module::module& module) const;
+
+    size_t size() const;
+    void clear();
+
+private:
+    void verify(pixie::module::module& module, const std::vector<size_t>& chans,
+                std::vector<size_t>& failed);
+    void recalibrate(pixie::module::module& module, const std::vector<size_t>& chans,
+                     const std::vector<size_t>& good);
+
+    std::map<std::string, calibration_cache::module> modules;
+};
+
+/**
+ * @brief The module's cache key.
+ */
+std::string key(pixie::module::module& module);
+
+/**
+ * @brief Read a channel's calibration settings.
+ */
+void read_settings(pixie::module::module& module, size_t channel, settings& values);
+
+/**
+ * @brief Check a trace's baseline is off the ADC rails and within the
+ *     tolerance of the baseline percent target.
+ * @param trace The ADC trace.
+ * @param adc_bits The ADC resolution.
+ * @param baseline_percent The baseline target as a percentage of the ADC range.
+ * @param tolerance_percent The tolerance as a percentage of the ADC range.
+ * @param baseline The trace's baseline, the median of the samples.
+ * @return True if the baseline is valid.
+ */
+bool baseline_valid(const hw::adc_trace& trace, int adc_bits, double baseline_percent,
+                    double tolerance_percent, int& baseline);
+}  // namespace calibration_cache
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_CALIBRATION_CACHE_H
@@ -24,10 +24,13 @@
 #define PIXIE_CRATE_H
 
 #include <atomic>
+#include <functional>
+#include <vector>
 
 #include <pixie/error.hpp>
 #include <pixie/fw.hpp>
 #include <pixie/os_compat.hpp>
+#include <pixie/thread_pool.hpp>
 
 #include <pixie/pixie16/backplane.hpp>
 #include <pixie/pixie16/fpga.hpp>
@@ -80,6 +83,26 @@ public:
         ~user();
     };
 
+    /**
+     * Crate identifier. This is the crate id the modules report in the
+     * list-mode data. It is written to the online modules' CrateID after a
+     * boot and a configuration import. A negative id leaves the modules'
+     * configured CrateID.
+     */
+    int id;
+
+    /**
+     * Largest crate id the list-mode event header holds.
+     */
+    static const int max_id = 15;
+
+    /**
+     * The PCI buses this crate owns. Modules found on other buses are
+     * closed and left for other crate instances in the process. An empty
+     * list owns all modules found.
+     */
+    std::vector<int> pci_buses;
+
     /**
      * Number of modules present in the crate.
      */
@@ -114,6 +137,19 @@ public:
      */
     firmware::crate firmware;
 
+    /**
+     * The threads that run the crate's parallel module operations. Resize
+     * the pool to tune the concurrency. The default is the hardware
+     * concurrency.
+     */
+    thread_pool::pool workers;
+
+    /**
+     * Run state changes of all the crate's modules. The notices have the
+     * crate's sequence numbers.
+     */
+    module::run_notifier run_notices;
+
     crate();
     virtual ~crate();
 
@@ -242,6 +278,12 @@ public:
      */
     void import_config(const std::string json_file, module::number_slots& loaded);
 
+    /**
+     * @brief Write the crate id to the online modules' CrateID. Nothing is
+     *        written if the id is negative.
+     */
+    void write_id();
+
     /**
      * @brief Initializes the module's analog front end after importing a configuration.
      * @see xia::pixie::module::sync_hw
@@ -250,6 +292,48 @@ public:
      */
     void initialize_afe();
 
+    /**
+     * @brief Characterizes the PCI bus and DMA throughput of the online modules.
+     * @see xia::pixie::module::module::characterize_fifo
+     * @param config The DMA block sizes, trigger levels and limits of each point.
+     * @param reports A report for each online module in module number order.
+     * @param concurrent Test the modules at the same time if true else one after
+     *                   the other.
+     */
+    void characterize_fifo(const module::module::throughput_config& config,
+                           module::module::throughput_reports& reports, bool concurrent = true);
+
+    /**
+     * @brief The channels selected in each module indexed by module number,
+     * bit 0 is channel 0. An empty list selects all channels.
+     */
+    typedef std::vector<uint32_t> channel_masks;
+
+    /**
+     * @brief Copy a source channel's settings to the selected channels in the crate.
+     *
+     * The modules are updated in parallel. Each module is written with one
+     * coalesced DSP write and the FiPPI is programmed once.
+     *
+     * @param source_module The source module number.
+     * @param source_channel The source channel.
+     * @param filter_mask The variable groups to copy, see param::copy_parameters.
+     * @param channels The channels to copy to.
+     */
+    void broadcast(const size_t source_module, const size_t source_channel,
+                   const unsigned int filter_mask, const channel_masks& channels = {});
+
+    /**
+     * @brief Write channel parameters to the selected channels in the crate.
+     *
+     * The modules are updated in parallel. Each module is written with one
+     * coalesced DSP write and the FiPPI is programmed once.
+     *
+     * @param params The parameter names and values.
+     * @param channels The channels to write.
+     */
+    void broadcast(const module::module::param_values& params, const channel_masks& channels = {});
+
     /**
      * @brief Export the active module configurations to a file.
      * @param json_file Path to the file that will hold the configurations.
@@ -274,7 +358,18 @@ public:
 protected:
     virtual void add_module();
 
+    /*
+     * Does the crate own the modules on the PCI bus?
+     */
+    bool owns(int pci_bus) const;
+
 private:
+    /*
+     * Run a broadcast on the selected modules in parallel.
+     */
+    typedef std::function<void(module::module&, const uint32_t)> broadcaster;
+    void broadcast(const channel_masks& channels, broadcaster update);
+
     /*
      * Check the module slots.
      */
@@ -247,6 +247,12 @@ struct module {
      * Tau Finder
      */
     virtual void tau_finder();
+
+    /**
+     * The time in milli-seconds the input signals take to settle after
+     * the DACs are set.
+     */
+    virtual int dac_settle_period();
 };
 
 using module_ptr = std::shared_ptr<module>;
@@ -24,6 +24,8 @@
 #define PIXIE_HW_MEMORY_H
 
 #include <cstdint>
+#include <utility>
+#include <vector>
 
 #include <pixie/error.hpp>
 #include <pixie/fw.hpp>
@@ -56,6 +58,12 @@ static const address MCA_MEM_DATA = 0x00400000; /* R W */
  */
 static const address HISTOGRAM_MEMORY = 0x00000000;
 
+/*
+ * Address and value pairs for a scatter write.
+ */
+typedef std::pair<address, word> address_value;
+typedef std::vector<address_value> address_values;
+
 /**
  * @brief Defines a memory bus for low level communication with the hardware.
  */
@@ -117,6 +125,18 @@ struct host_bus : public bus {
     void write(const address addr, const words& values);
     void write(const size_t channel, const address addr, const words& values);
 
+    /*
+     * Memory scatter write. The values are sorted by address and written
+     * holding the bus once. A run of consecutive addresses is written as
+     * a block.
+     */
+    void write(address_values& values);
+
+    /*
+     * The address of a channel's variable.
+     */
+    address channel_address(const size_t channel, const size_t offset, const address addr);
+
 private:
     /*
      * DMA set up
@@ -24,8 +24,13 @@
 #define PIXIE_MODULE_H
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -39,6 +44,7 @@
 #include <pixie/param.hpp>
 #include <pixie/stats.hpp>
 #include <pixie/sync.hpp>
+#include <pixie/util.hpp>
 
 #include <pixie/pixie16/backplane.hpp>
 #include <pixie/pixie16/channel.hpp>
@@ -75,6 +81,105 @@ struct pci_bus_handle;
  */
 typedef std::unique_ptr<pci_bus_handle> bus_handle;
 
+/**
+ * @brief Run state change events.
+ */
+enum struct run_event {
+    started, /* A histogram or list-mode run started */
+    ended, /* The run ended by a call or in the module */
+    fifo_overflow, /* The FIFO or the buffer pool is full */
+    worker_error /* A FIFO worker stopped with an error */
+};
+
+const char* run_event_label(const run_event event);
+
+/**
+ * @brief A run state change.
+ */
+struct run_notice {
+    typedef std::chrono::steady_clock clock;
+
+    run_event event;
+    size_t sequence; /* The notifier's count of notices */
+    int number; /* Module number */
+    int slot; /* Module slot */
+    hw::run::run_task task; /* The run's task */
+    std::string what; /* The cause */
+    clock::time_point when;
+
+    run_notice();
+
+    std::string output() const;
+};
+
+/**
+ * @brief A listener is called with each run state change.
+ */
+typedef std::function<void(const run_notice& notice)> run_listener;
+
+/**
+ * @brief Delivers run state changes to listeners and waiters.
+ *
+ * A listener is called in the thread making the change and this can be
+ * the FIFO worker. Keep listeners short and do not start or end a run in
+ * a listener, wait for the notice in another thread.
+ *
+ * A waiter passes the sequence number of the last notice it has seen and
+ * is returned the next notice. The most recent notices are held, a waiter
+ * that falls behind sees a gap in the sequence numbers.
+ */
+class run_notifier {
+public:
+    /*
+     * The number of notices held.
+     */
+    static const size_t max_notices;
+
+    run_notifier();
+
+    run_notifier(const run_notifier&) = delete;
+    run_notifier& operator=(const run_notifier&) = delete;
+
+    /**
+     * Add a listener, the handle removes it.
+     */
+    size_t add(run_listener listener);
+    void remove(const size_t handle);
+
+    /**
+     * Pass the notices on to another notifier. A crate collects its
+     * modules' notices. A nullptr stops the forwarding.
+     */
+    void forward(run_notifier* to);
+
+    /**
+     * Raise a notice. The sequence number is set.
+     */
+    void notify(run_notice notice);
+
+    /**
+     * Wait for the next notice after the sequence number. A timeout of 0
+     * waits for ever.
+     * @retval true A notice has been returned
+     * @retval false The wait timed out
+     */
+    bool wait(run_notice& notice, const size_t after, const size_t timeout_usecs = 0);
+
+    /**
+     * The sequence number of the last notice.
+     */
+    size_t sequence();
+
+private:
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<run_notice> notices;
+    size_t last;
+    size_t next_handle;
+    std::map<size_t, run_listener> listeners;
+    run_notifier* forward_to;
+};
+
 /**
  * @brief Defines a Pixie-16 Module
  *
@@ -164,6 +269,11 @@ public:
         std::atomic_size_t bandwidth; /* Current bandwidth */
         std::atomic_size_t max_bandwidth; /* Maximum bandwidth */
         std::atomic_size_t min_bandwidth; /* Minimum bandwidth */
+        std::atomic_size_t errors; /* DMA and FIFO read errors */
+        std::atomic_size_t recoveries; /* Reads resumed after errors */
+        std::atomic_size_t lost; /* Estimated data lost to errors */
+        std::atomic_size_t recovery_usecs; /* Time spent recovering */
+        std::atomic_size_t failures; /* Recoveries that exhausted the retries */
 
         fifo_stats();
         fifo_stats(const fifo_stats& s);
@@ -176,19 +286,384 @@ public:
         std::string output() const;
     };
 
+    /*
+     * Bus access costs. The bus wait is the time spent waiting for the
+     * module's bus lock.
+     */
+    struct bus_cost {
+        size_t calls; /* Operation calls */
+        size_t pio_reads; /* Register reads */
+        size_t pio_writes; /* Register writes */
+        size_t dma_transfers; /* DMA transfers */
+        size_t dma_bytes; /* DMA bytes transferred */
+        size_t hbr_requests; /* Host bus requests */
+        size_t bus_wait_usecs; /* Bus lock wait */
+
+        bus_cost();
+
+        bus_cost& operator+=(const bus_cost& c);
+
+        void clear();
+
+        std::string output() const;
+    };
+
+    /*
+     * Bus access costs by operation.
+     */
+    typedef std::map<std::string, bus_cost> bus_costs;
+
+    /*
+     * Bus access counters for the module.
+     */
+    struct bus_stats {
+        std::atomic_size_t pio_reads;
+        std::atomic_size_t pio_writes;
+        std::atomic_size_t dma_transfers;
+        std::atomic_size_t dma_bytes;
+        std::atomic_size_t hbr_requests;
+        std::atomic_size_t bus_wait_usecs;
+
+        bus_stats();
+        bus_stats(const bus_stats& s);
+
+        bus_stats& operator=(const bus_stats& s);
+
+        void clear();
+        bus_cost get() const;
+    };
+
+    /*
+     * Memory held by the module in bytes. The FIFO pool buffers are
+     * allocated when the FIFO services start and the pool in use includes
+     * the queued data and the recorder's buffers. Firmware images are
+     * shared by the modules using the same firmware.
+     */
+    struct memory_usage {
+        size_t pool_capacity; /* FIFO pool buffers */
+        size_t pool_in_use; /* FIFO pool buffers not free */
+        size_t queued; /* FIFO data waiting to be read */
+        size_t recorder; /* FIFO data held by the recorder */
+        size_t firmware; /* Firmware images */
+        size_t variables; /* Variable descriptors and values */
+        size_t fixtures; /* Fixture trace buffers */
+
+        memory_usage();
+
+        /*
+         * Hold the larger of each value.
+         */
+        void peak(const memory_usage& m);
+
+        void clear();
+
+        /*
+         * The pool capacity, firmware, variables and fixtures. The pool
+         * in use, queued and recorder data are held in the pool.
+         */
+        size_t total() const;
+
+        std::string output() const;
+    };
+
+    /**
+     * @brief Tags the module's bus accesses made by this thread with an
+     * operation while it is in scope.
+     *
+     * The costs are added to the module's operation table when the tag
+     * goes out of scope. Tags nest and an operation's costs include the
+     * costs of the operations it calls. The name must be a string that
+     * lives for the life of the tag.
+     */
+    class bus_op {
+    public:
+        bus_op(module& mod, const char* name);
+        ~bus_op();
+
+        bus_op(const bus_op&) = delete;
+        bus_op& operator=(const bus_op&) = delete;
+
+    private:
+        friend class module;
+
+        /*
+         * Find the innermost tag for the module starting at op.
+         */
+        static bus_op* find(bus_op* op, module& mod);
+
+        module& mod_;
+        const char* name_;
+        bus_op* parent_;
+        bus_cost cost_;
+    };
+
+    /**
+     * @brief Defers the module's DSP variable writes, FiPPI programming and
+     * DAC setting while in scope.
+     *
+     * Variable writes update the module's copy and mark the value dirty.
+     * Reads return the copy of a dirty value. Commit writes the dirty
+     * variables to the DSP with one coalesced write, then programs the
+     * FiPPI and sets the DACs once if any write requested it. Deferrals
+     * nest and only the outermost commit writes to the module. The
+     * module is locked while a deferral is in scope.
+     */
+    class deferred_io {
+    public:
+        deferred_io(module& mod);
+        ~deferred_io();
+
+        deferred_io(const deferred_io&) = delete;
+        deferred_io& operator=(const deferred_io&) = delete;
+
+        void commit();
+
+    private:
+        module& mod_;
+        lock_guard guard_;
+        bool committed_;
+    };
+
+    /*
+     * Channel parameter name and value pairs.
+     */
+    typedef std::pair<std::string, double> param_value;
+    typedef std::vector<param_value> param_values;
+
+    /*
+     * Adaptive FIFO worker settings. The settings are computed from the
+     * measured data rate, if the FIFO level is rising and if the buffer
+     * pool is running low.
+     *
+     * At low rates the settings keep the latency of data in the FIFO
+     * low. As the rate increases the run wait is limited so the FIFO
+     * cannot fill between polls and the trigger level is raised so DMA
+     * transfers are large. Every transfer uses a buffer so a pool that is
+     * running low raises the trigger level to fill each buffer further.
+     */
+    struct fifo_tuning {
+        /*
+         * The latency target for data when the rate is low.
+         */
+        static const size_t latency_usecs;
+        /*
+         * The measurement period.
+         */
+        static const size_t period_usecs;
+
+        size_t run_wait_usecs;
+        size_t hold_usecs;
+        size_t dma_trigger_level;
+
+        fifo_tuning();
+
+        /*
+         * Compute the settings for a rate in words per second.
+         */
+        void tune(const double rate, const bool level_rising, const bool pool_low);
+    };
+
+    /*
+     * A latency histogram. Bin 0 holds latencies under 1 usec and bin `n`
+     * holds latencies from 2^(n-1) up to 2^n usecs. The last bin holds all
+     * longer latencies.
+     */
+    struct latency_histogram {
+        static const size_t bins = 24;
+
+        std::atomic_size_t counts[bins];
+        std::atomic_size_t count;
+        std::atomic_size_t min_nsecs;
+        std::atomic_size_t max_nsecs;
+        std::atomic_size_t total_nsecs;
+
+        latency_histogram();
+        latency_histogram(const latency_histogram& h);
+
+        latency_histogram& operator=(const latency_histogram& h);
+
+        void clear();
+        void add(const size_t nsecs);
+
+        /*
+         * The upper edge in usecs of the bin holding the percentile.
+         */
+        size_t percentile(const double pc) const;
+        double mean_usecs() const;
+
+        std::string output() const;
+    };
+
+    /*
+     * Event accounting of the list-mode data read from the FIFO. Only the
+     * first header words of each event are read and the event length
+     * moves to the next event. An event can be split between reads so the
+     * position in the event is carried to the next read. A bad event
+     * length stops the accounting until it is cleared as the next event
+     * cannot be found. The counts are atomic and can be read at any time.
+     *
+     * The headers are decoded with the list-mode format of the firmware
+     * revision and ADC frequency. There is no accounting until a
+     * supported format is set.
+     */
+    struct event_counts {
+        struct channel_counts {
+            std::atomic_size_t events;
+            std::atomic_size_t bytes;
+            std::atomic<uint64_t> last_time; /* Clock ticks */
+        };
+
+        channel_counts channels[hw::max_channels];
+        std::atomic_size_t events;
+        std::atomic_size_t other_slots; /* Events of another slot */
+        std::atomic_size_t bad_headers; /* Bad event lengths or channels */
+
+        event_counts();
+        event_counts(const event_counts& c);
+
+        event_counts& operator=(const event_counts& c);
+
+        /*
+         * Clear the counts. The next data added is the start of an event.
+         */
+        void clear();
+
+        /*
+         * Set the list-mode format. An unsupported format stops the
+         * accounting.
+         */
+        void format(const size_t revision, const size_t frequency);
+
+        /*
+         * Add data read from the FIFO.
+         */
+        void add(const hw::word* data, const size_t length, const int slot);
+
+        std::string output() const;
+
+    private:
+        static const size_t header_words = 3;
+
+        /*
+         * Only the thread reading the FIFO uses the position.
+         */
+        std::atomic_bool restart;
+        std::atomic_size_t revision;
+        std::atomic_size_t frequency;
+        bool stopped;
+        size_t skip;
+        size_t held;
+        hw::word header[header_words];
+    };
+
+    /*
+     * Low latency list-mode consumer. The data is one or more complete
+     * events and is only valid for the call.
+     */
+    typedef std::function<void(const hw::word* data, const size_t length)> fifo_consumer;
+
+    /*
+     * The word counts of a drained run.
+     */
+    struct drain_counts {
+        size_t dma_in; /* Words read from the FIFO in the run */
+        size_t in; /* Words queued in the run */
+        size_t dropped; /* Words dropped in the run */
+        size_t lost; /* Estimate of the words lost to read errors in the run */
+        size_t drained; /* Words read from the FIFO after the run ended */
+        size_t consumed; /* Words handed to the consumer */
+        size_t queued; /* Words left in the queue for the reader */
+        size_t usecs; /* Time to end the run and drain the FIFO */
+
+        drain_counts();
+
+        void clear();
+
+        std::string output() const;
+    };
+
     /**
      * @brief Test mode
      */
     enum struct test { off = 0, lm_fifo };
 
+    /*
+     * FIFO throughput characterization settings. Every DMA block size is
+     * run with every trigger level. A block size of 0 reads the FIFO
+     * level in one transfer as the FIFO worker normally does. A point
+     * ends when the words have been transferred or the time limit is
+     * reached.
+     */
+    struct throughput_config {
+        std::vector<size_t> dma_block_sizes; /* Words per DMA transfer */
+        std::vector<size_t> trigger_levels; /* FIFO DMA trigger levels */
+        size_t words; /* Words to transfer per point */
+        size_t max_msecs; /* Time limit per point */
+
+        throughput_config();
+    };
+
+    /*
+     * A measured characterization point. The CPU time is the process's
+     * CPU time and includes any other modules tested concurrently.
+     */
+    struct throughput_point {
+        size_t dma_block_size; /* Words per DMA transfer, 0 is the level */
+        size_t trigger_level; /* FIFO DMA trigger level */
+        size_t words; /* Words transferred */
+        size_t transfers; /* DMA transfers */
+        size_t hw_overflows; /* FIFO HW overflows */
+        double secs; /* Period of the point */
+        double mb_per_sec; /* Sustained rate */
+        double bus_usage; /* Rate as a percentage of hw::pci_bus_datarate */
+        double latency_p50_usecs; /* DMA transfer latency percentiles */
+        double latency_p90_usecs;
+        double latency_p99_usecs;
+        double latency_max_usecs;
+        double cpu_secs; /* FIFO worker CPU time */
+        double cpu_usecs_per_mb; /* CPU time per Mbyte transferred */
+
+        throughput_point();
+
+        std::string output() const;
+    };
+
+    /*
+     * The characterization report of a module.
+     */
+    struct throughput_report {
+        int number;
+        int slot;
+        int serial_num;
+        size_t bus_datarate; /* hw::pci_bus_datarate */
+        std::vector<throughput_point> points;
+
+        throughput_report();
+
+        /*
+         * The point with the highest sustained rate.
+         */
+        const throughput_point& best() const;
+
+        std::string output() const;
+    };
+
+    typedef std::vector<throughput_report> throughput_reports;
+
     /*
      * Defaults
      */
+    static const size_t fifo_buffer_words;
     static const size_t default_fifo_buffers;
+    static const size_t default_list_mode_revision;
     static const size_t default_fifo_run_wait_usec;
     static const size_t default_fifo_idle_wait_usec;
     static const size_t default_fifo_hold_usec;
     static const size_t default_fifo_dma_trigger_level;
+    static const size_t fifo_read_retries;
+    static const size_t default_drain_timeout_usec;
+    static const size_t fifo_recovery_backoff_usec;
+    static const size_t max_fifo_recovery_backoff_usec;
 
     /*
      * Ranges
@@ -344,6 +819,26 @@ public:
      */
     std::atomic_size_t fifo_bandwidth;
 
+    /**
+     * Adaptive FIFO worker settings. If enabled the worker chooses the run
+     * wait, hold and DMA trigger level while a run or test is active. The
+     * user settings are not changed, see @ref get_fifo_settings.
+     *
+     * Do not set this value directly, use @ref set_fifo_adaptive.
+     */
+    std::atomic_bool fifo_adaptive;
+
+    /**
+     * FIFO flight recorder bounds. The recorder holds the most recent
+     * buffers read from the FIFO, up to this many bytes and this many
+     * seconds of data. The buffers are reserved in the FIFO pool when the
+     * FIFO services start. A size of 0 disables the recorder.
+     *
+     * Do not set these values directly, use @ref set_fifo_recorder.
+     */
+    size_t fifo_recorder_bytes;
+    double fifo_recorder_secs;
+
     /*
      * Dataflow stats
      */
@@ -355,6 +850,27 @@ public:
     util::timepoint run_interval; /* Period of the run */
     fifo_stats run_stats;
 
+    /*
+     * Bus access stats
+     */
+    bus_stats bus_totals;
+
+    /**
+     * Run state changes of the module. The crate forwards them to its
+     * notifier.
+     */
+    run_notifier run_notices;
+
+    /*
+     * Low latency FIFO arrival to consumer latency.
+     */
+    latency_histogram low_latency_stats;
+
+    /*
+     * Events read from the FIFO in the run by channel.
+     */
+    event_counts event_stats;
+
     /**
      * Crate revision
      */
@@ -399,6 +915,13 @@ public:
     virtual void open(size_t device_number);
     virtual void close();
 
+    /**
+     * Find the device on the bus without opening it and return its PCI
+     * bus. Returns -1 if the device is not found or the bus is not known
+     * until the module is opened.
+     */
+    virtual int find_pci_bus(size_t device_number);
+
     /**
      * Force offline.
      */
@@ -500,12 +1023,55 @@ public:
      */
     void sync_hw(const bool program_fippi = true, const bool program_dacs = true);
 
+    /**
+     * @brief Copy a source channel's variables to the channels in the mask.
+     *
+     * The filter mask selects the groups of variables copied. The variables
+     * are written with one coalesced DSP write and the FiPPI is programmed
+     * once.
+     *
+     * @param source The source channel's variables.
+     * @param filter_mask The variable groups to copy, see param::copy_parameters.
+     * @param channel_mask The channels to copy to, bit 0 is channel 0.
+     */
+    void broadcast(const param::channel_variables& source, const unsigned int filter_mask,
+                   const uint32_t channel_mask);
+
+    /**
+     * @brief Write the channel parameters to the channels in the mask.
+     *
+     * The parameters are written in order to each channel. The variables
+     * are written with one coalesced DSP write and the FiPPI is programmed
+     * once.
+     *
+     * @param params The parameter names and values.
+     * @param channel_mask The channels to write, bit 0 is channel 0.
+     */
+    void broadcast(const param_values& params, const uint32_t channel_mask);
+
+    /*
+     * Defer a control task if I/O is deferred. Only the FiPPI programming
+     * and DAC setting tasks are deferred.
+     *
+     * @return True if the task is deferred.
+     */
+    bool defer_control(const hw::run::control_task control_tsk);
+
     /*
      * Run control and status
      */
     void run_end();
     bool run_active();
 
+    /*
+     * End the run and drain the FIFO. The worker is run until the FIFO
+     * is empty whatever the hold time and DMA trigger level. The queued
+     * data is handed to the consumer if there is one else it is left
+     * for the reader. Throws if the FIFO does not empty in the timeout.
+     */
+    void run_end_drain(drain_counts& counts, fifo_consumer consumer = nullptr,
+                       size_t timeout_usecs = default_drain_timeout_usec);
+
     /*
      * Control tasks
      */
@@ -540,6 +1106,15 @@ public:
      *                  already been run.
      */
     void read_adc(size_t channel, hw::adc_trace& buffer, bool run = true);
+    /**
+     * @brief Reads an ADC trace from the specified channel into the caller's
+     *     memory.
+     * @param[in] channel The channel that we'd like to read the ADC trace from.
+     * @param[out] buffer A view of the memory to hold the trace.
+     * @param[in] run If true, then we execute the control task to collect the
+     *                  ADC traces.
+     */
+    void read_adc(size_t channel, util::span<hw::adc_word> buffer, bool run = true);
 
     /*
      * Find the baseline cut for the range of channels. Return the
@@ -554,13 +1129,16 @@ public:
      */
     void read_histogram(size_t channel, hw::words& values);
     void read_histogram(size_t channel, hw::word_ptr values, const size_t size);
+    void read_histogram(size_t channel, util::span<hw::word> values);
 
     /*
-     * Read the module's list mode
+     * Read the module's list mode. A vector with no size is resized to
+     * hold the available data, a pointer or span is filled in place.
      */
     size_t read_list_mode_level();
     size_t read_list_mode(hw::words& words);
     size_t read_list_mode(hw::word_ptr values, const size_t size);
+    size_t read_list_mode(util::span<hw::word> values);
 
     /**
      * Read the stats
@@ -581,6 +1159,34 @@ public:
     void set_fifo_hold(const size_t hold);
     void set_fifo_dma_trigger_level(const size_t dma_trigger_level);
     void set_fifo_bandwidth(const size_t bandwidth);
+    void set_fifo_adaptive(const bool adaptive);
+
+    /*
+     * The run wait, hold and DMA trigger level the FIFO worker is using.
+     * These are the adapted values while the adaptive worker is tuning a
+     * run or test, otherwise the user settings.
+     */
+    fifo_tuning get_fifo_settings() const;
+
+    /*
+     * The firmware revision and ADC frequency of the module's list-mode
+     * data. The revision is the fippi firmware's version, or @ref
+     * default_list_mode_revision if it is not known.
+     */
+    void list_mode_format(size_t& revision, size_t& frequency);
+
+    void set_fifo_recorder(const double seconds, const size_t bytes);
+
+    /**
+     * Dump the FIFO data recorded from `before` seconds before to `after`
+     * seconds after the trigger time to a file. The dump runs in the
+     * background and does not stop the FIFO worker. The result is the
+     * number of words written.
+     */
+    buffer::recorder::dump_result dump_fifo_recorder(const std::string& path,
+        const double before, const double after);
+    buffer::recorder::dump_result dump_fifo_recorder(const std::string& path,
+        buffer::recorder::time_point trigger, const double before, const double after);
 
     /**
      * Select the module's port
@@ -599,6 +1205,26 @@ public:
      */
     void report(std::ostream& out) const;
 
+    /**
+     * Bus access costs by operation.
+     */
+    void get_bus_costs(bus_costs& costs);
+    void clear_bus_costs();
+
+    /**
+     * Memory held by the module and the peak values since the module was
+     * created or the peaks were cleared. The pool in use and queued peaks
+     * are tracked by the FIFO pool and queue, the other peaks are the
+     * largest values read.
+     */
+    void get_memory_usage(memory_usage& current, memory_usage& peak);
+    void clear_memory_peaks();
+
+    /*
+     * Count a host bus request.
+     */
+    void count_hbr_request();
+
     /**
      * Read a word.
      */
@@ -615,6 +1241,12 @@ public:
     virtual void dma_read(const hw::address source, hw::words& values);
     virtual void dma_read(const hw::address source, hw::word_ptr values, const size_t size);
 
+    /*
+     * Reset the DMA path after a failed transfer. The DMA channel is
+     * closed and opened again.
+     */
+    virtual void dma_reset();
+
     /*
      * Revision tag operators to make comparisons of a version simpler to
      * code.
@@ -651,7 +1283,55 @@ public:
     void start_test(const test mode);
     void end_test();
 
+    /*
+     * Low latency list-mode
+     *
+     * A thread busy-polls the FIFO level and reads any data as soon as it
+     * is available. The complete events read are passed to the consumer
+     * without being queued and the FIFO worker does not read the FIFO.
+     * The thread uses all of a CPU core. If `cpu` is not negative the
+     * thread is pinned to the core. The consumer runs on the thread and
+     * must not call the module's calls. Stopping holds the module's lock
+     * while the thread finishes.
+     *
+     * The latency is the time from the data's arrival in the FIFO to its
+     * hand-off to the consumer. The consumer's time is not included.
+     */
+    void start_low_latency(fifo_consumer consumer, const int cpu = -1);
+    void stop_low_latency();
+    bool low_latency() const;
+
+    /*
+     * Characterize the PCI bus and DMA throughput of the module using the
+     * list-mode FIFO test. The FIFO worker settings are restored when
+     * the characterization finishes.
+     */
+    void characterize_fifo(const throughput_config& config, throughput_report& report);
+
 protected:
+    /*
+     * Bus word access when the module has no hardware. Reads return 0 and
+     * writes are discarded. A simulation can override these to model
+     * registers.
+     */
+    virtual hw::word emulate_read_word(int reg);
+    virtual void emulate_write_word(int reg, const hw::word value);
+
+    /*
+     * Variable I/O uses the bus.
+     */
+    bool bus_io() const {
+        return have_hardware || bus_emulated;
+    }
+
+    /*
+     * Bus access accounting.
+     */
+    enum struct bus_access { pio_read, pio_write };
+    void count_bus_access(bus_access access);
+    void count_dma(const size_t size);
+    bus_lock_type& bus_acquire();
+
     /*
      * Locks
      */
@@ -711,6 +1391,11 @@ protected:
     void stop_fifo_worker();
     void fifo_worker();
 
+    /*
+     * Low latency worker
+     */
+    void low_latency_worker(const size_t revision, const size_t frequency);
+
     /*
      * Calculate the bus speed
      */
@@ -721,12 +1406,37 @@ protected:
      */
     void log_stats(const char* label, const fifo_stats& stats);
 
+    /*
+     * Recover the FIFO worker from a read error. The error is counted,
+     * the worker backs off and the DMA path is reset. Exhausting the
+     * retries raises a worker error and the recovery continues at the
+     * capped backoff. Returns false if the error cannot be recovered.
+     */
+    bool fifo_recover(const pixie::error::error& e, const size_t read_words, size_t& retries);
+
     /*
      * Request the worker to run and wait for to respond it has
      * completed the run.
      */
     bool fifo_worker_run(size_t timeout_usecs);
 
+    /*
+     * The number of FIFO buffers the recorder settings need.
+     */
+    size_t fifo_recorder_buffers() const;
+
+    /*
+     * Raise a run state change. The end of a run is raised once for the
+     * run that was started.
+     */
+    void notify_run(const run_event event, const std::string& what);
+    void notify_run_ended(const char* cause);
+
+    /*
+     * Check an active run has ended in the module.
+     */
+    void check_run_ended();
+
     /*
      * Synchronous worker run
      */
@@ -742,6 +1452,26 @@ protected:
 
     buffer::pool fifo_pool;
     buffer::queue fifo_data;
+    buffer::recorder fifo_recorder;
+    size_t fifo_recorder_reserved;
+
+    /*
+     * The adaptive worker's settings. Only the FIFO worker writes these
+     * and the user settings are not changed. A run wait of 0 means the
+     * worker is not adapting.
+     */
+    std::atomic_size_t tuned_run_wait_usecs;
+    std::atomic_size_t tuned_hold_usecs;
+    std::atomic_size_t tuned_dma_trigger_level;
+
+    /*
+     * The task of the run raised as started.
+     */
+    std::atomic<hw::run::run_task> notified_run;
+
+    std::thread low_latency_thread;
+    std::atomic_bool low_latency_running;
+    fifo_consumer low_latency_consumer;
 
     /*
      * Module lock
@@ -753,6 +1483,17 @@ protected:
      */
     bus_lock_type bus_lock_;
 
+    /*
+     * Bus access costs by operation.
+     */
+    std::mutex bus_costs_lock;
+    bus_costs bus_op_costs;
+
+    /*
+     * Memory usage peaks.
+     */
+    memory_usage memory_peak;
+
     /*
      * In use counter.
      */
@@ -790,11 +1531,25 @@ protected:
      */
     bool have_hardware;
 
+    /*
+     * A simulation models the DSP memory on the bus. The variable reads
+     * and writes use the bus as they do with hardware.
+     */
+    bool bus_emulated;
+
     /*
      * Vars loaded?
      */
     bool vars_loaded;
 
+    /*
+     * Deferred I/O nesting depth and the control tasks requested while
+     * deferred.
+     */
+    int deferred_depth;
+    bool deferred_fippi;
+    bool deferred_dacs;
+
     /*
      * Control CS shadow, it is a write-only register
      */
@@ -809,6 +1564,20 @@ protected:
      * Current test mode.
      */
     std::atomic<test> test_mode;
+
+    /*
+     * Test mode DMA block size in words. If 0 the FIFO worker reads the
+     * level.
+     */
+    std::atomic_size_t test_dma_block_size;
+
+    /*
+     * Test mode DMA transfer latencies. Recording stops when the reserved
+     * capacity is used.
+     */
+    std::atomic_bool test_latency_record;
+    std::mutex test_latency_lock;
+    std::vector<double> test_latencies;
 };
 
 inline hw::word module::read_word(int reg) {
@@ -816,8 +1585,9 @@ inline hw::word module::read_word(int reg) {
     if (have_hardware) {
         value = hw::read_word(vmaddr, reg);
     } else {
-        value = 0;
+        value = emulate_read_word(reg);
     }
+    count_bus_access(bus_access::pio_read);
     if (reg_trace) {
         xia_log(log::debug) << "M r " << std::setfill('0') << std::hex << vmaddr << ':' << std::setw(2)
                             << reg << " => " << std::setw(8) << value;
@@ -832,7 +1602,10 @@ inline void module::write_word(int reg, const hw::word value) {
     }
     if (have_hardware) {
         hw::write_word(vmaddr, reg, value);
+    } else {
+        emulate_write_word(reg, value);
     }
+    count_bus_access(bus_access::pio_write);
 }
 
 /**
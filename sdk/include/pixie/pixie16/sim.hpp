@@ -23,7 +23,10 @@
 #ifndef PIXIE_SDK_SYSTEM_SIMULATION_HPP
 #define PIXIE_SDK_SYSTEM_SIMULATION_HPP
 
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
 
 #include <pixie/error.hpp>
 
@@ -38,8 +41,79 @@ namespace pixie {
 namespace sim {
 typedef xia::pixie::error::error error;
 
+/**
+ * @brief The pacing of a list-mode replay.
+ */
+enum struct replay_pacing {
+    /**
+     * Events arrive in the FIFO at their recorded times.
+     */
+    original,
+    /**
+     * Events arrive at a fixed multiple of their recorded rate.
+     */
+    scaled,
+    /**
+     * Events arrive as fast as the FIFO can hold them.
+     */
+    fast
+};
+
+/**
+ * @brief A fault injected into the FIFO path.
+ */
+enum struct fault {
+    /**
+     * The FIFO fails to reach its watermark. No data is read.
+     */
+    fifo_watermark,
+    /**
+     * The DMA transfer fails. The data read from the FIFO is lost.
+     */
+    dma
+};
+
+/**
+ * @brief The modeled cost of the bus accesses. The defaults are typical of
+ *     a 33MHz PCI crate.
+ */
+struct bus_timing {
+    /**
+     * Register read, the host waits for the data.
+     */
+    double pio_read_usecs;
+    /**
+     * Register write, the write is posted.
+     */
+    double pio_write_usecs;
+    /**
+     * Setting up and completing a DMA transfer.
+     */
+    double dma_setup_usecs;
+    /**
+     * DMA transfer rate in MB/s.
+     */
+    double dma_mb_per_sec;
+
+    bus_timing();
+};
+
+/**
+ * @brief A list-mode replay source. Defined in the implementation.
+ */
+struct replay_source;
+
 /**
  * @brief A Simulated a module derived from the module class.
+ *
+ * A module can replay a recorded list-mode data file. The CSR and external
+ * FIFO registers are modeled and the file's events arrive in the FIFO
+ * while a list-mode run is active. The FIFO worker reads the data using
+ * the same path as the hardware.
+ *
+ * The DSP memory can be modeled so the variable reads and writes use the
+ * bus as they do with hardware. The bus accesses are counted and their
+ * time is modeled without delaying the caller.
  */
 class module : public xia::pixie::module::module {
 public:
@@ -52,6 +126,7 @@ public:
 
     void open(size_t device_number) override;
     void close() override;
+    int find_pci_bus(size_t device_number) override;
     void probe() override;
     void boot(bool boot_comms = true, bool boot_fippi = true, bool boot_dsp = true) override;
     void initialize() override;
@@ -60,8 +135,120 @@ public:
     void load_var_defaults(const std::string& file);
     void load_var_defaults(std::istream& input);
 
+    /**
+     * @brief Replay a recorded list-mode data file through the FIFO.
+     *
+     * Replaying starts with the next list-mode run. Each run continues
+     * from where the last run stopped.
+     *
+     * @param file The list-mode data file recorded for this slot.
+     * @param pacing How the events arrive in the FIFO.
+     * @param rate The multiple of the recorded rate for scaled pacing.
+     */
+    void replay(const std::string& file, replay_pacing pacing = replay_pacing::original,
+                double rate = 1.0);
+
+    /**
+     * @brief Stop replaying a file.
+     */
+    void replay_stop();
+
+    /**
+     * @brief The number of words of the replay file read from the FIFO.
+     */
+    size_t replay_words();
+
+    /**
+     * @brief End the run in the module as another module or the preset
+     *     run time would. The SDK is not told.
+     */
+    void replay_end_run();
+
+    /**
+     * @brief Fail the next FIFO reads.
+     *
+     * @param type The fault to inject.
+     * @param count The number of reads that fail.
+     */
+    void inject_fault(fault type, size_t count = 1);
+
+    /**
+     * @brief Shift a channel's input DC level.
+     *
+     * The ADC traces are flat at the level set by the channel's offset DAC
+     * and its input level. The adjust offsets control task sets the offset
+     * DACs so the traces sit at each channel's baseline percent.
+     *
+     * @param channel The channel.
+     * @param offset The input level in ADC counts.
+     */
+    void adc_input_offset(size_t channel, int offset);
+
+    /**
+     * @brief The level of a channel's ADC trace.
+     */
+    hw::adc_word adc_level(size_t channel);
+
+    /**
+     * @brief Model the DSP memory.
+     *
+     * The variables are held in the DSP memory and accessed over the bus.
+     * Variables without an address from a variable file are placed one
+     * after the other from the start of the DSP's data memory. Disabling
+     * the model erases the memory.
+     *
+     * @param enable Enable the model.
+     */
+    void emulate_dsp_memory(bool enable = true);
+    bool dsp_memory_emulated() const;
+
+    /**
+     * @brief Set the bus timing model.
+     */
+    void set_bus_timing(const bus_timing& timing);
+
+    /**
+     * @brief The modeled time of the bus accesses since the last clear.
+     */
+    double bus_usecs() const;
+    void clear_bus_usecs();
+
+    void dma_read(const hw::address source, hw::word_ptr values, const size_t size) override;
+    using xia::pixie::module::module::dma_read;
+    void dma_reset() override;
+
     std::unique_ptr<uint8_t[]> pci_memory;
     std::string var_defaults;
+
+protected:
+    hw::word emulate_read_word(int reg) override;
+    void emulate_write_word(int reg, const hw::word value) override;
+
+private:
+    void start_replay_services();
+    void emulate_adjust_offsets();
+    std::string sim_label() const;
+
+    /*
+     * DSP memory model. The bus is held by the caller.
+     */
+    void assign_var_addresses();
+    void store_vars();
+    hw::word dsp_load(hw::address addr) const;
+    void model_bus_time(double usecs);
+    void model_dma_time(size_t size);
+
+    std::unique_ptr<replay_source> replay_;
+    hw::word csr;
+    std::atomic_size_t fifo_faults;
+    std::atomic_size_t dma_faults;
+    std::vector<int> adc_offsets;
+    hw::address dsp_dma_addr;
+    bool dsp_dma_active;
+    std::unordered_map<hw::address, hw::word> dsp_memory;
+    hw::address dsp_mem_addr;
+    bus_timing timing;
+    std::atomic<uint64_t> bus_nsecs;
 };
 
 /**
@@ -88,6 +275,9 @@ struct module_def {
     int adc_msps;
     int adc_clk_div;
     std::string var_defaults;
+    std::string replay;
+    replay_pacing replay_mode;
+    double replay_rate;
 
     module_def();
 };
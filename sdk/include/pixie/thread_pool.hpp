@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file thread_pool.hpp
+ * @brief Defines a work-stealing thread pool and task groups.
+ */
+
+#ifndef PIXIE_THREAD_POOL_H
+#define PIXIE_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pixie/error.hpp>
+
+namespace xia {
+namespace pixie {
+/**
+ * @brief A work-stealing thread pool for parallel module operations.
+ *
+ * Each pool thread has a queue. A task submitted by a pool thread is
+ * added to its own queue and other tasks are spread over the queues. A
+ * thread runs the tasks in its own queue in order and when that is
+ * empty it steals the newest task from another queue. The queues are
+ * bounded and a task submitted to a full queue is run by the submitting
+ * thread.
+ *
+ * The threads are started when the first task is submitted.
+ *
+ * Tasks are run in a group. Waiting for a group runs queued tasks on the
+ * waiting thread so a task can wait for a group it creates and a pool
+ * with fewer threads than tasks makes progress.
+ */
+namespace thread_pool {
+/*
+ * Local error
+ */
+typedef pixie::error::error error;
+
+/**
+ * @brief A task. The pool calls a task once.
+ */
+typedef std::function<void()> task;
+
+/**
+ * @brief A fixed number of threads that run tasks.
+ */
+class pool {
+public:
+    /**
+     * @brief The maximum number of threads.
+     */
+    static const size_t max_threads;
+
+    /**
+     * @brief The maximum number of tasks queued on a thread. A task
+     *     submitted to a full queue is run by the submitting thread.
+     */
+    static const size_t max_queued;
+
+    /**
+     * @brief Create a pool.
+     * @param threads The number of threads, 0 is the hardware concurrency.
+     */
+    pool(size_t threads = 0);
+    ~pool();
+
+    pool(const pool&) = delete;
+    pool& operator=(const pool&) = delete;
+
+    /**
+     * @brief Change the number of threads. A pool with tasks queued or
+     *     running is busy and cannot be resized, the error is
+     *     thread_pool_busy. Tasks submitted while
+     *     resizing wait for the new threads.
+     * @param threads The number of threads, 0 is the hardware concurrency.
+     */
+    void resize(size_t threads);
+
+    /**
+     * @brief The number of threads.
+     */
+    size_t size() const;
+
+    /**
+     * @brief The tasks queued and not yet running.
+     */
+    size_t queued() const;
+
+    /**
+     * @brief The tasks queued or running.
+     */
+    size_t active() const;
+
+    /**
+     * @brief The tasks a thread took from another thread's queue.
+     */
+    size_t stolen() const;
+
+    /**
+     * @brief The tasks run by the submitting thread because the queue was
+     *     full.
+     */
+    size_t ran_inline() const;
+
+private:
+    friend class group;
+
+    struct queue {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+
+    void submit(task work);
+    bool run_one();
+    bool take(size_t self, task& work);
+
+    static size_t threads_to_run(size_t threads);
+
+    void start();
+    void stop();
+    void worker(size_t self);
+
+    std::vector<std::unique_ptr<queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex lock;
+    std::condition_variable ready;
+    /*
+     * Held to submit a task and to resize.
+     */
+    std::mutex resize_lock;
+
+    size_t configured;
+    std::atomic_bool running;
+    std::atomic_size_t pending;
+    std::atomic_size_t active_;
+    std::atomic_size_t next;
+    std::atomic_size_t steals;
+    std::atomic_size_t inlined;
+    bool stopping;
+};
+
+/**
+ * @brief A task's error.
+ */
+struct task_error {
+    /**
+     * @brief The task's index in the group, the order it was run.
+     */
+    size_t task;
+    error::code code;
+    std::string what;
+    /**
+     * @brief Set if the task threw an exception that is not an SDK error.
+     */
+    std::exception_ptr exception;
+};
+
+typedef std::vector<task_error> task_errors;
+
+/**
+ * @brief How a group handles task errors.
+ */
+enum struct aggregate {
+    /**
+     * The first error cancels the group's tasks that have not started.
+     * Checking the group throws the first task's error.
+     */
+    first,
+    /**
+     * All tasks are run. Checking the group throws the first task's error
+     * code with all the errors in the message.
+     */
+    all
+};
+
+/**
+ * @brief A group of tasks run in a pool.
+ *
+ * The group waits for its tasks when destroyed.
+ */
+class group {
+public:
+    group(pool& pool_, aggregate mode = aggregate::all);
+    ~group();
+
+    group(const group&) = delete;
+    group& operator=(const group&) = delete;
+
+    /**
+     * @brief Run a task in the pool.
+     */
+    void run(task work);
+
+    /**
+     * @brief Wait for the tasks to finish. The waiting thread runs queued
+     *     tasks.
+     */
+    void wait();
+
+    /**
+     * @brief Wait for the tasks to finish without running tasks.
+     * @param usecs The time to wait.
+     * @return True if the tasks have finished.
+     */
+    bool wait_for(size_t usecs);
+
+    /**
+     * @brief Have all tasks finished?
+     */
+    bool done();
+
+    /**
+     * @brief Wait for the tasks and throw if a task failed.
+     * @param label The error message label.
+     */
+    void check(const std::string& label);
+
+    /**
+     * @brief Has a task failed?
+     */
+    bool failed();
+
+    /**
+     * @brief The errors in task order.
+     */
+    task_errors errors();
+
+    /**
+     * @brief The tasks cancelled after an error.
+     */
+    size_t cancelled();
+
+    const aggregate mode;
+
+private:
+    void finished(task_error* err, bool skipped);
+
+    pool& pool_;
+
+    std::mutex lock;
+    std::condition_variable complete;
+    size_t submitted;
+    size_t completed;
+    size_t cancelled_;
+    bool cancel;
+    task_errors errors_;
+};
+
+}  // namespace thread_pool
+}  // namespace pixie
+}  // namespace xia
+
+#endif  // PIXIE_THREAD_POOL_H
@@ -23,12 +23,15 @@
 #ifndef PIXIE16_UTIL_H
 #define PIXIE16_UTIL_H
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 namespace xia {
@@ -137,6 +140,58 @@ struct ostream_guard {
     }
 };
 
+/**
+ * @brief A view of contiguous memory the caller owns, a pointer and a
+ *     length. Reads and decodes use a span to work in place.
+ */
+template<typename T>
+struct span {
+    using value_type = typename std::remove_const<T>::type;
+    using pointer = T*;
+    using iterator = T*;
+
+    span() : data_(nullptr), size_(0) {}
+    span(T* data, size_t size) : data_(data), size_(size) {}
+    span(std::vector<value_type>& values) : data_(values.data()), size_(values.size()) {}
+    template<typename V = T,
+             typename = typename std::enable_if<std::is_const<V>::value>::type>
+    span(const std::vector<value_type>& values) : data_(values.data()), size_(values.size()) {}
+    template<typename U,
+             typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+    span(const span<U>& other) : data_(other.data()), size_(other.size()) {}
+
+    T* data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+    T& operator[](size_t index) const {
+        return data_[index];
+    }
+    iterator begin() const {
+        return data_;
+    }
+    iterator end() const {
+        return data_ + size_;
+    }
+    /**
+     * @brief The view of `count` elements from `offset`. The range is
+     *     clipped to the span.
+     */
+    span subspan(size_t offset, size_t count = size_t(-1)) const {
+        offset = std::min(offset, size_);
+        return span(data_ + offset, std::min(count, size_ - offset));
+    }
+
+private:
+    T* data_;
+    size_t size_;
+};
+
 /**
  * @brief Timepoint measures a period of time between two points.
  */
@@ -181,6 +236,20 @@ private:
     std::atomic_bool locked;
 };
 
+/**
+ * @brief Pin a thread to a CPU core.
+ * @return False if the host does not support pinning threads or the core
+ *     is not valid.
+ */
+bool set_thread_affinity(std::thread& thread, const int cpu);
+
+/**
+ * @brief The CPU time a thread has used.
+ * @return The CPU time in seconds or 0 if the host cannot report the
+ *     thread's CPU time or the thread is not running.
+ */
+double thread_cpu_secs(std::thread& thread);
+
 /**
  * @brief Defines a type for the IEEE 754 floating point standard.
  */
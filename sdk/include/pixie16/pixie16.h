@@ -234,6 +234,144 @@ struct module_fifo_stats {
     double min_bandwidth; /** Minimum bandwidth */
 };
 
+/**
+ * @ingroup PIXIE16_API
+ * @brief Defines a data structure used to provide users the FIFO read error recovery
+ * statistics for a module.
+ */
+struct module_fifo_recovery_stats {
+    size_t errors; /** DMA and FIFO read errors */
+    size_t recoveries; /** Reads resumed after errors */
+    size_t lost; /** Estimate of the data lost to errors */
+    size_t recovery_usecs; /** Time spent recovering in microseconds */
+    size_t failures; /** Recoveries that exhausted the retries */
+};
+
+/**
+ * @ingroup PIXIE16_API
+ * @brief Defines a data structure used to provide users the memory a module holds in
+ * bytes. The FIFO pool in use includes the queued and recorder data.
+ */
+struct module_memory_usage {
+    size_t pool_capacity; /** FIFO pool buffers */
+    size_t pool_in_use; /** FIFO pool buffers not free */
+    size_t queued; /** FIFO data waiting to be read */
+    size_t recorder; /** FIFO data held by the recorder */
+    size_t firmware; /** Firmware images */
+    size_t variables; /** Variable descriptors and values */
+    size_t fixtures; /** Fixture trace buffers */
+    size_t total; /** The pool capacity, firmware, variables and fixtures */
+};
+
+#define PIXIE_API_BUS_OP_MAX_STRING (64)
+
+/**
+ * @ingroup PIXIE16_API
+ * @brief Defines a data structure used to provide users the bus access costs of a module.
+ *
+ * The costs are the module's totals or the costs of an operation. An operation is an API
+ * call, a control or run task, or the FIFO worker. The costs of an operation include the
+ * costs of the operations it calls.
+ */
+struct module_bus_cost {
+    char operation[PIXIE_API_BUS_OP_MAX_STRING]; /** Operation name */
+    size_t calls; /** Operation calls, 0 for the module's totals */
+    size_t pio_reads; /** Register reads */
+    size_t pio_writes; /** Register writes */
+    size_t dma_transfers; /** DMA transfers */
+    size_t dma_bytes; /** DMA bytes transferred */
+    size_t hbr_requests; /** Host bus requests */
+    size_t bus_wait_usecs; /** Time waiting for the module's bus lock in microseconds */
+};
+
+#define PIXIE_API_LATENCY_BINS (24)
+
+/**
+ * @ingroup PIXIE16_API
+ * @brief Defines a data structure used to provide users a module's low latency list-mode
+ * latency histogram.
+ *
+ * The latency is the time from the data's arrival in the FIFO to the consumer's call.
+ * Bin 0 counts latencies under 1 microsecond and bin `n` counts latencies from 2^(n-1) up to
+ * 2^n microseconds. The last bin counts all longer latencies.
+ */
+struct module_latency_stats {
+    size_t count; /** Consumer calls */
+    size_t min_usecs; /** Minimum latency */
+    size_t max_usecs; /** Maximum latency */
+    double mean_usecs; /** Mean latency */
+    size_t bins[PIXIE_API_LATENCY_BINS]; /** Latency histogram */
+};
+
+#define PIXIE_API_EVENT_CHANNELS (32)
+
+/**
+ * @ingroup PIXIE16_API
+ * @brief Defines a data structure used to provide users the events read from a module's FIFO.
+ *
+ * The counts are for the current or last list-mode run. Only the event headers are read so
+ * the counts are cheap to keep. The channel counts can be checked against the DSP's
+ * ChanEventsA/B statistics.
+ */
+struct module_event_counts {
+    size_t events[PIXIE_API_EVENT_CHANNELS]; /** Events by channel */
+    size_t bytes[PIXIE_API_EVENT_CHANNELS]; /** Event bytes by channel */
+    unsigned long long last_time[PIXIE_API_EVENT_CHANNELS]; /** Last event time in clock ticks */
+    size_t total_events; /** Events read */
+    size_t other_slots; /** Events with the slot of another module */
+    size_t bad_headers; /** Bad event headers, the counting stops at a bad header */
+};
+
+/**
+ * @ingroup PIXIE16_API
+ * @brief Defines a data structure used to provide users the word counts of a drained run.
+ */
+struct module_drain_counts {
+    size_t dma_in; /** Words read from the FIFO in the run */
+    size_t in; /** Words queued in the run */
+    size_t dropped; /** Words dropped in the run */
+    size_t lost; /** Estimate of the words lost to read errors in the run */
+    size_t drained; /** Words read from the FIFO after the run ended */
+    size_t written; /** Words written to the file */
+    size_t queued; /** Words left in the queue for Pixie16ReadDataFromExternalFIFO */
+    size_t usecs; /** Time to end the run and drain the FIFO in microseconds */
+};
+
+/**
+ * @ingroup PIXIE16_API
+ * @brief The channel counts of a module's calibration restore.
+ */
+struct module_calibration_counts {
+    size_t channels; /** Channels in the module */
+    size_t restored; /** Channels restored from the cache that passed the check */
+    size_t missing; /** Channels not in the cache or with changed settings */
+    size_t failed; /** Channels restored from the cache that failed the check */
+    size_t recalibrated; /** Channels recalibrated */
+    size_t unverified; /** Recalibrated channels that still fail the check */
+    size_t usecs; /** Time to restore the module in microseconds */
+};
+
+/**
+ * @ingroup PIXIE16_API
+ * @brief A low latency list-mode consumer.
+ *
+ * The data is one or more complete events and is only valid for the call. The
+ * call is made from the module's low latency thread and must return quickly.
+ */
+typedef void (*pixie_fifo_consumer)(unsigned short mod_num, const unsigned int* data,
+                                    unsigned int length, void* user);
+
+/**
+ * @ingroup PIXIE16_API
+ * @brief An opaque handle to a crate instance.
+ *
+ * A process can drive more than one crate. Each crate instance owns its
+ * modules, their FIFO workers and buffers, and its firmware. The API calls
+ * made on a thread operate on the crate selected by that thread, or the
+ * default crate if the thread has not selected one.
+ */
+typedef struct pixie_crate* pixie_crate_handle;
+
 /**
  * @defgroup PIXIE_SDK PixieSDK
  * Documentation group for the PixieSDK functions/classes/macros.
@@ -796,10 +934,10 @@ PIXIE_EXPORT double PIXIE_API Pixie16ComputeRealTime(unsigned int* Statistics,
 /**
  * @ingroup PIXIE16_API
  * @brief Copy DSP parameters from one module to other modules.
- * @note This function is **not** implemented at this time.
  *
  * Use this function to copy DSP parameters from one module to the others that are installed in
- * the system.
+ * the system. The modules are updated in parallel. Each module's DSP parameters are written in
+ * one coalesced write and its FiPPI is programmed once.
  *
  * ### Example
  * \snippet snippets/api_function_examples.c Pixie16CopyDSPParameters
@@ -1528,6 +1666,10 @@ PIXIE_EXPORT int PIXIE_API PixieBootCrate(const char* settings_file,
 /**
  * @ingroup PIXIE_API
  * @brief Gets a worker configuration from the specified module
+ *
+ * If the worker is adaptive the run wait, hold and DMA trigger level are the
+ * values the worker has chosen.
+ *
  * @param mod_num The module number to get the configuration from.
  * @param worker_config A pointer to the configuration object to fill with the information
  * @return The value of the xia::pixie::error::code indicating the result of the operation
@@ -1569,6 +1711,58 @@ PIXIE_EXPORT int PIXIE_API PixieRegisterFirmware(const unsigned int version, con
 PIXIE_EXPORT int PIXIE_API PixieSetWorkerConfiguration(unsigned short mod_num,
                                                        struct fifo_worker_config* worker_config);
 
+/**
+ * @ingroup PIXIE_API
+ * @brief Enable or disable the adaptive worker mode in the specified module
+ *
+ * The adaptive worker measures the incoming data rate, the FIFO level trend
+ * and the free buffers in the pool while a run is active and sets the run wait,
+ * hold and DMA trigger level. Low rates use short hold periods to keep the
+ * latency low and high rates use large DMA transfers. The values set with
+ * PixieSetWorkerConfiguration are the starting values. Use
+ * PixieGetWorkerConfiguration to read the values chosen.
+ *
+ * @param mod_num The module number to set the mode.
+ * @param enable Enable the adaptive mode if not 0.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieSetWorkerAdaptive(unsigned short mod_num, unsigned int enable);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Set the module's FIFO flight recorder bounds.
+ *
+ * The flight recorder holds the most recent list-mode buffers read from
+ * the module's FIFO. Only small reads are copied. The buffers are reserved when
+ * the FIFO services start so the size can only be increased before the
+ * module is booted.
+ *
+ * @param mod_num The module number to set the recorder.
+ * @param seconds The age of the oldest data held, 0 has no limit.
+ * @param bytes The size of the data held, 0 disables the recorder.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieSetFifoRecorder(unsigned short mod_num, double seconds,
+                                                size_t bytes);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Dump the module's FIFO flight recorder to a file.
+ *
+ * The list-mode data recorded from `before` seconds before the call to
+ * `after` seconds after the call is written to the file in the
+ * background. The call does not wait for the data to be written and the
+ * acquisition is not affected. Errors writing the file are logged.
+ *
+ * @param mod_num The module number to dump.
+ * @param file_name The file the raw list-mode words are written to.
+ * @param before The seconds of data before the call to write.
+ * @param after The seconds of data after the call to write.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieDumpFifoRecorder(unsigned short mod_num, const char* file_name,
+                                                 double before, double after);
+
 /**
  * @ingroup PIXIE_API
  * @brief Read the session's statistics for the module.
@@ -1590,6 +1784,275 @@ PIXIE_EXPORT int PIXIE_API PixieReadModuleFifoStats(unsigned short mod_num,
 PIXIE_EXPORT int PIXIE_API PixieReadModuleRunFifoStats(unsigned short mod_num,
                                                        struct module_fifo_stats* fifo_stats);
 
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the session's FIFO read error recovery statistics for the module.
+ * @param mod_num The module number to read the statistics from.
+ * @param recovery_stats A pointer to the statistics the module data is copied too.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadModuleFifoRecoveryStats(
+    unsigned short mod_num, struct module_fifo_recovery_stats* recovery_stats);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the run's FIFO read error recovery statistics for the module. If a run has
+ * finished the statistics are for the last run.
+ * @param mod_num The module number to read the statistics from.
+ * @param recovery_stats A pointer to the statistics the module data is copied too.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadModuleRunFifoRecoveryStats(
+    unsigned short mod_num, struct module_fifo_recovery_stats* recovery_stats);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the memory the module holds and the largest values read since the peaks
+ * were cleared.
+ * @param mod_num The module number to read the memory usage from.
+ * @param current A pointer to the current memory usage the module data is copied too.
+ * @param peak A pointer to the peak memory usage the module data is copied too.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadModuleMemoryUsage(unsigned short mod_num,
+                                                      struct module_memory_usage* current,
+                                                      struct module_memory_usage* peak);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Clear the module's peak memory usage.
+ * @param mod_num The module number to clear the peaks of.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieClearModuleMemoryPeaks(unsigned short mod_num);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Create a crate instance.
+ *
+ * The crate is not initialized. Select the crate on a thread and call
+ * Pixie16InitSystem to open the modules it owns.
+ *
+ * @param[in] crate_id The crate's identifier reported in list-mode data,
+ *     0 to 15. It is written to the modules' CrateID after they are booted
+ *     and after settings are loaded.
+ * @param[in] pci_buses The PCI buses the crate owns. Modules on other buses
+ *     are left for other crate instances. If NULL all modules found are
+ *     owned.
+ * @param[in] num_pci_buses The number of entries in @ref pci_buses.
+ * @param[out] handle The handle of the created crate.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieCreateCrate(int crate_id, const unsigned short* pci_buses,
+                                            unsigned short num_pci_buses,
+                                            pixie_crate_handle* handle);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Destroy a crate instance created with PixieCreateCrate.
+ *
+ * The crate's modules are closed. The crate must not be in use, and no
+ * other thread may have it selected.
+ *
+ * @param[in] handle The handle of the crate to destroy.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieDestroyCrate(pixie_crate_handle handle);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Get the handle of the default crate.
+ *
+ * The default crate is used on threads that have not selected a crate. It
+ * cannot be destroyed.
+ *
+ * @param[out] handle The handle of the default crate.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieGetDefaultCrate(pixie_crate_handle* handle);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Select the crate the calling thread's API calls operate on.
+ * @param[in] handle The crate's handle. NULL selects the default crate.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieSelectCrate(pixie_crate_handle handle);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Get the crate the calling thread's API calls operate on.
+ * @param[out] handle The handle of the selected crate.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieGetSelectedCrate(pixie_crate_handle* handle);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Set the number of threads the selected crate's parallel module operations use.
+ *
+ * The crate boots, initializes and updates its modules in parallel using a pool of
+ * threads. Hosts with fewer cores than modules can limit the threads. The threads cannot
+ * be changed while the pool is running tasks and the call returns crate busy.
+ *
+ * @param[in] threads The number of threads. 0 uses the host's hardware concurrency.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieSetCrateWorkers(unsigned int threads);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the module's bus access totals.
+ * @param[in] mod_num The module number to read the totals from.
+ * @param[out] total The module's totals. The operation name is `total`.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadModuleBusTotals(unsigned short mod_num,
+                                                    struct module_bus_cost* total);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the module's bus access costs by operation.
+ *
+ * Call with `costs` set to NULL to get the number of operations.
+ *
+ * @param[in] mod_num The module number to read the costs from.
+ * @param[out] costs An array the operation costs are copied to. The operations are
+ *     sorted by name.
+ * @param[in,out] num_costs On entry the number of elements in `costs`. On return the
+ *     number of operations the module has. Only the elements that fit are copied.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadModuleBusCosts(unsigned short mod_num,
+                                                   struct module_bus_cost* costs,
+                                                   unsigned int* num_costs);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Clear the module's bus access totals and operation costs.
+ * @param[in] mod_num The module number to clear.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieClearModuleBusCosts(unsigned short mod_num);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Start the module's low latency list-mode.
+ *
+ * A thread busy-polls the module's FIFO and passes complete events to the
+ * consumer as soon as they arrive. The data is not queued and cannot be read
+ * with Pixie16ReadDataFromExternalFIFO while the mode is running. The thread
+ * uses all of a CPU core.
+ *
+ * @param[in] mod_num The module number.
+ * @param[in] consumer The function called with the events.
+ * @param[in] user A pointer passed to the consumer.
+ * @param[in] cpu The CPU core the thread is pinned to. A negative value does not pin
+ *     the thread.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieStartLowLatency(unsigned short mod_num,
+                                                pixie_fifo_consumer consumer, void* user,
+                                                int cpu);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Stop the module's low latency list-mode.
+ * @param[in] mod_num The module number.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieStopLowLatency(unsigned short mod_num);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the module's low latency list-mode latency histogram.
+ * @param[in] mod_num The module number.
+ * @param[out] stats A pointer to the statistics the module's histogram is copied to.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadModuleLatencyStats(unsigned short mod_num,
+                                                       struct module_latency_stats* stats);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Read the module's list-mode event counts for the run.
+ * @param[in] mod_num The module number.
+ * @param[out] counts A pointer to the counts the module's counts are copied to.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieReadModuleEventCounts(unsigned short mod_num,
+                                                      struct module_event_counts* counts);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief End the module's run and drain its FIFO.
+ *
+ * The call returns once the run has ended and the module's FIFO is
+ * empty. There is no need to wait and poll Pixie16CheckExternalFIFOStatus
+ * for the last of the data. If a file is given the queued data is
+ * appended to the file else it is left for Pixie16ReadDataFromExternalFIFO.
+ *
+ * @param[in] mod_num The module number.
+ * @param[in] file_name The file the remaining list-mode words are appended to. Can be NULL.
+ * @param[out] counts A pointer to the run's final word counts. Can be NULL.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieEndRunDrain(unsigned short mod_num, const char* file_name,
+                                            struct module_drain_counts* counts);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Restore the module's calibration from a cache file.
+ *
+ * The cached OffsetDAC, BLcut and PreampTau of the channels with unchanged
+ * settings are applied and checked with one ADC trace per channel. The
+ * channels that are not cached or fail the check are recalibrated and the
+ * cache file is updated. A missing file is an empty cache and all channels
+ * are recalibrated.
+ *
+ * @param[in] mod_num The module number.
+ * @param[in] file_name The calibration cache file.
+ * @param[out] counts A pointer to the channel counts. Can be NULL.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieRestoreCalibration(unsigned short mod_num, const char* file_name,
+                                                   struct module_calibration_counts* counts);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Save the module's calibration to a cache file.
+ *
+ * The module's entry in the file is replaced. The entries of other modules
+ * are kept.
+ *
+ * @param[in] mod_num The module number.
+ * @param[in] file_name The calibration cache file.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieSaveCalibration(unsigned short mod_num, const char* file_name);
+
+/**
+ * @ingroup PIXIE_API
+ * @brief Write channel parameters to the selected channels of all modules.
+ *
+ * The parameters are written in order to each selected channel. The modules
+ * are updated in parallel. Each module's DSP parameters are written in one
+ * coalesced write and its FiPPI is programmed once.
+ *
+ * @param[in] names The channel parameter names, for example "TRIGGER_THRESHOLD".
+ * @param[in] values The parameter values.
+ * @param[in] count The number of names and values.
+ * @param[in] channel_masks The channels to write for each module indexed by the module
+ *     number, bit 0 is channel 0. NULL selects all channels of all modules.
+ * @param[in] num_masks The number of channel masks.
+ * @return The value of the xia::pixie::error::code indicating the result of the operation
+ */
+PIXIE_EXPORT int PIXIE_API PixieBroadcastChannelParameters(const char* const* names,
+                                                           const double* values,
+                                                           unsigned int count,
+                                                           const unsigned int* channel_masks,
+                                                           unsigned short num_masks);
+
 #ifdef __cplusplus
 }
 #endif
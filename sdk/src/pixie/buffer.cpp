@@ -20,9 +20,13 @@
  * @brief Implements functions and data structures for creating threaded data buffers
  */
 
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <thread>
 
 #include <pixie/buffer.hpp>
 #include <pixie/error.hpp>
@@ -32,6 +36,69 @@ namespace xia {
 namespace buffer {
 static constexpr bool queue_trace = false;
 
+/*
+ * A lock guard that counts the lock's use.
+ */
+class counted_guard {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    counted_guard(lock_type& lock_, lock_stats& stats_, const bool& time_holds)
+        : lock(lock_), stats(stats_), timed(false) {
+        if (!lock.try_lock()) {
+            auto start = clock::now();
+            lock.lock();
+            ++stats.contended;
+            stats.wait_nsecs += nsecs(start);
+        }
+        ++stats.acquires;
+        if (time_holds) {
+            timed = true;
+            held = clock::now();
+        }
+    }
+
+    ~counted_guard() {
+        if (timed) {
+            auto hold = nsecs(held);
+            stats.hold_nsecs += hold;
+            stats.max_hold_nsecs = std::max(stats.max_hold_nsecs, hold);
+        }
+        lock.unlock();
+    }
+
+    counted_guard(const counted_guard&) = delete;
+    counted_guard& operator=(const counted_guard&) = delete;
+
+private:
+    static uint64_t nsecs(clock::time_point since) {
+        return uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - since).count());
+    }
+
+    lock_type& lock;
+    lock_stats& stats;
+    bool timed;
+    clock::time_point held;
+};
+
+lock_stats::lock_stats() {
+    clear();
+}
+
+void lock_stats::clear() {
+    acquires = 0;
+    contended = 0;
+    wait_nsecs = 0;
+    hold_nsecs = 0;
+    max_hold_nsecs = 0;
+}
+
+void lock_stats::output(std::ostream& out) const {
+    out << "acquires=" << acquires << " contended=" << contended << " wait=" << wait_nsecs
+        << "ns hold=" << hold_nsecs << "ns max-hold=" << max_hold_nsecs << "ns";
+}
+
 struct pool::releaser {
     pool& pool_;
     releaser(pool& pool_);
@@ -44,7 +111,7 @@ void pool::releaser::operator()(buffer* buf) const {
     pool_.release(buf);
 }
 
-pool::pool() : number(0), size(0), count_(0) {}
+pool::pool() : number(0), size(0), count_(0), low_count_(0), time_holds(false) {}
 
 pool::~pool() {
     try {
@@ -56,7 +123,7 @@ pool::~pool() {
 
 void pool::create(const size_t number_, const size_t size_) {
     xia_log(log::info) << "pool create: num=" << number_ << " size=" << size_;
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     if (valid()) {
         throw error(error::code::buffer_pool_not_empty, "pool is already created");
     }
@@ -68,10 +135,11 @@ void pool::create(const size_t number_, const size_t size_) {
         buffers.push_front(buf);
     }
     count_ = number;
+    low_count_ = number;
 }
 
 void pool::destroy() {
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     if (number > 0) {
         xia_log(log::info) << "pool destroy";
         if (count_.load() != number) {
@@ -85,15 +153,19 @@ void pool::destroy() {
         number = 0;
         size = 0;
         count_ = 0;
+        low_count_ = 0;
     }
 }
 
 handle pool::request() {
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     if (empty()) {
         throw error(error::code::buffer_pool_empty, "no buffers available");
     }
     count_--;
+    if (count_.load() < low_count_) {
+        low_count_ = count_.load();
+    }
     buffer_ptr buf = buffers.front();
     buffers.pop_front();
     return handle(buf, releaser(*this));
@@ -101,22 +173,50 @@ handle pool::request() {
 
 void pool::release(buffer_ptr buf) {
     buf->clear();
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     buffers.push_front(buf);
     count_++;
 }
 
+size_t pool::low_count() {
+    lock_guard guard(lock);
+    return low_count_;
+}
+
+void pool::reset_low_count() {
+    lock_guard guard(lock);
+    low_count_ = count_.load();
+}
+
+void pool::time_locks(bool enable) {
+    counted_guard guard(lock, locking, time_holds);
+    time_holds = enable;
+}
+
+lock_stats pool::lock_counts() {
+    lock_guard guard(lock);
+    return locking;
+}
+
+void pool::clear_lock_counts() {
+    lock_guard guard(lock);
+    locking.clear();
+}
+
 void pool::output(std::ostream& out) {
     out << "count=" << count_.load() << " num=" << number << " size=" << size;
 }
 
-queue::queue() : size_(0) {}
+queue::queue() : time_holds(false), head(0), size_(0), max_size_(0) {}
 
 void queue::push(handle buf) {
     if (buf->size() > 0) {
-        lock_guard guard(lock);
+        counted_guard guard(lock, locking, time_holds);
         buffers.push_back(buf);
         size_ += buf->size();
+        if (size_ > max_size_) {
+            max_size_ = size_;
+        }
         if (queue_trace) {
             xia_log(log::debug) << "queue::push: buffers=" << buffers.size()
                                 << " buf=" << buf->size()
@@ -127,9 +227,21 @@ void queue::push(handle buf) {
 }
 
 handle queue::pop() {
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     handle buf = buffers.front();
     buffers.pop_front();
+    if (head != 0) {
+        /*
+         * A buffer held elsewhere, for example by a recorder, is not
+         * changed so copy the data not read.
+         */
+        if (buf.use_count() > 1) {
+            buf = std::make_shared<buffer>(buf->begin() + head, buf->end());
+        } else {
+            buf->erase(buf->begin(), buf->begin() + head);
+        }
+        head = 0;
+    }
     size_ -= buf->size();
     if (queue_trace) {
         xia_log(log::debug) << "queue::pop: buffers=" << buffers.size()
@@ -141,7 +253,7 @@ handle queue::pop() {
 }
 
 size_t queue::copy(buffer& to) {
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     /*
      * If the `to` size is 0 copy all the available data
      */
@@ -154,7 +266,7 @@ size_t queue::copy(buffer& to) {
 }
 
 size_t queue::copy(buffer_value_ptr to, const size_t to_move) {
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     return copy_unprotected(to, to_move);
 }
 
@@ -169,33 +281,36 @@ size_t queue::copy_unprotected(buffer_value_ptr to, size_t to_move) {
         check("copy start");
     }
     auto copied = to_move;
-    auto to_in = to;
     auto from_bi = buffers.begin();
     while (to_move > 0 && from_bi != buffers.end()) {
         auto from = *from_bi;
         ++from_bi;
-        if (to_move >= from->size()) {
+        /*
+         * A partly read buffer is not moved down, the head is the offset
+         * of the data not read. Buffers can be shared and must not be
+         * changed.
+         */
+        const size_t available = from->size() - head;
+        if (to_move >= available) {
             if (queue_trace) {
                 xia_log(log::debug) << "queue::copy: from-all: to_move=" << to_move
-                                    << " from=" << from->size()
+                                    << " from=" << available
                                     << " size_=" << size_;
             }
-            std::memcpy(to, from->data(), from->size() * sizeof(*to));
-            to += from->size();
-            to_move -= from->size();
-            size_ -= from->size();
+            std::memcpy(to, from->data() + head, available * sizeof(*to));
+            to += available;
+            to_move -= available;
+            size_ -= available;
+            head = 0;
         } else {
-            auto remaining = from->size() - to_move;
             if (queue_trace) {
                 xia_log(log::debug) << "queue::copy: from-some: to_move=" << to_move
-                                    << " from=" << from->size()
-                                    << " remaining=" << remaining
+                                    << " from=" << available
+                                    << " remaining=" << available - to_move
                                     << " size_=" << size_;
             }
-            std::memcpy(to, from->data(), to_move * sizeof(*to));
-            std::memmove(
-                from->data(), from->data() + to_move, remaining * sizeof(*to));
-            from->resize(remaining);
+            std::memcpy(to, from->data() + head, to_move * sizeof(*to));
+            head += to_move;
             to += to_move;
             size_ -= to_move;
             to_move = 0;
@@ -216,7 +331,7 @@ size_t queue::copy_unprotected(buffer_value_ptr to, size_t to_move) {
 }
 
 void queue::compact() {
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     if (queue_trace) {
         check("compact start");
     }
@@ -236,10 +351,14 @@ void queue::compact() {
             auto& to = *to_bi;
             auto to_move = to->capacity() - to->size();
             auto from_bi = to_bi + 1;
-            if (to_move > 0 && from_bi != buffers.end()) {
+            /*
+             * Buffers held elsewhere, for example by a recorder, are not
+             * changed.
+             */
+            if (to_move > 0 && from_bi != buffers.end() && to.use_count() == 1) {
                 auto erase_from = buffers.end();
                 auto erase_to = buffers.end();
-                while (to_move > 0 && from_bi != buffers.end()) {
+                while (to_move > 0 && from_bi != buffers.end() && (*from_bi).use_count() == 1) {
                     auto from = *from_bi;
                     if (queue_trace) {
                         xia_log(log::debug) << "compact: move=" << to_move
@@ -281,26 +400,52 @@ void queue::compact() {
 }
 
 bool queue::empty() {
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     return buffers.empty();
 }
 
 size_t queue::size() {
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     return size_;
     }
 
 size_t queue::count() {
-    lock_guard guard(lock);
+    counted_guard guard(lock, locking, time_holds);
     return buffers.size();
 }
 
-void queue::flush() {
+size_t queue::max_size() {
+    lock_guard guard(lock);
+    return max_size_;
+}
+
+void queue::reset_max_size() {
     lock_guard guard(lock);
+    max_size_ = size_;
+}
+
+void queue::flush() {
+    counted_guard guard(lock, locking, time_holds);
     buffers.clear();
+    head = 0;
     size_ = 0;
 }
 
+void queue::time_locks(bool enable) {
+    counted_guard guard(lock, locking, time_holds);
+    time_holds = enable;
+}
+
+lock_stats queue::lock_counts() {
+    lock_guard guard(lock);
+    return locking;
+}
+
+void queue::clear_lock_counts() {
+    lock_guard guard(lock);
+    locking.clear();
+}
+
 void queue::output(std::ostream& out) {
     out << "count=" << count() << " size=" << size();
 }
@@ -311,6 +456,9 @@ void queue::check(const char* label) {
     buffer_value prev = 1;
     for (auto& buf : buffers) {
         csize += buf->size();
+        if (&buf == &buffers.front()) {
+            csize -= head;
+        }
         auto* ptr = buf->data();
         for (size_t i = 0; i < buf->size(); ++i) {
             if (ptr[i] == 0 && prev == 0) {
@@ -322,9 +470,183 @@ void queue::check(const char* label) {
     xia_log(log::debug) << "queue::check: " << label << ": found=" << csize << " has=" << size_
                         << " buffers=" << buffers.size() << " zero-pairs=" << zero_pairs;
 }
+
+recorder::recorder()
+    : max_words(0), seconds(0), size_(0), enabled_(false), stopping(false) {}
+
+recorder::~recorder() {
+    try {
+        clear();
+    } catch (...) {
+        /* any error will be logged */
+    }
+}
+
+size_t recorder::pinned_buffers(const size_t max_words, const size_t buffer_words) {
+    if (buffer_words < 2) {
+        return max_words;
+    }
+    const size_t min_words = buffer_words / 2;
+    return (max_words + min_words - 1) / min_words;
+}
+
+void recorder::configure(const size_t max_words_, const double seconds_) {
+    if (seconds_ < 0) {
+        throw error(error::code::invalid_value, "recorder: invalid seconds");
+    }
+    xia_log(log::info) << "recorder configure: words=" << max_words_
+                       << " secs=" << seconds_;
+    lock_guard guard(lock);
+    max_words = max_words_;
+    seconds = seconds_;
+    enabled_ = max_words != 0;
+    evict(clock::now());
+}
+
+void recorder::record(handle buf) {
+    record(buf, clock::now());
+}
+
+void recorder::record(handle buf, time_point when) {
+    if (enabled_.load() && buf->size() > 0) {
+        /*
+         * Copy a buffer less than half full so it returns to its pool and
+         * can be compacted in a queue.
+         */
+        if (buf->size() < buf->capacity() / 2) {
+            buf = std::make_shared<buffer>(buf->begin(), buf->end());
+        }
+        lock_guard guard(lock);
+        ring.push_back({when, buf});
+        size_ += buf->size();
+        evict(when);
+    }
+}
+
+recorder::dump_result recorder::dump(const std::string& path, time_point trigger,
+    const double before, const double after) {
+    if (before < 0 || after < 0) {
+        throw error(error::code::invalid_value, "recorder: invalid dump period");
+    }
+    xia_log(log::info) << "recorder dump: " << path << " before=" << before
+                       << " after=" << after;
+    lock_guard guard(dumps_lock);
+    dumps.erase(std::remove_if(dumps.begin(), dumps.end(),
+                    [](dump_result& result) {
+                        return result.wait_for(std::chrono::seconds(0)) ==
+                               std::future_status::ready;
+                    }),
+        dumps.end());
+    dump_result result = std::async(std::launch::async, [this, path, trigger, before, after]() {
+        try {
+            return write(path, trigger, before, after);
+        } catch (pixie::error::error& e) {
+            xia_log(log::error) << "recorder dump: " << e;
+            throw;
+        }
+    }).share();
+    dumps.push_back(result);
+    return result;
+}
+
+void recorder::wait() {
+    stopping = true;
+    std::vector<dump_result> waiting;
+    {
+        lock_guard guard(dumps_lock);
+        waiting.swap(dumps);
+    }
+    for (auto& result : waiting) {
+        result.wait();
+    }
+    stopping = false;
+}
+
+void recorder::clear() {
+    wait();
+    lock_guard guard(lock);
+    ring.clear();
+    size_ = 0;
+}
+
+size_t recorder::count() {
+    lock_guard guard(lock);
+    return ring.size();
+}
+
+size_t recorder::size() {
+    lock_guard guard(lock);
+    return size_;
+}
+
+void recorder::output(std::ostream& out) {
+    lock_guard guard(lock);
+    out << "count=" << ring.size() << " size=" << size_ << " max=" << max_words
+        << " secs=" << seconds;
+}
+
+size_t recorder::write(const std::string& path, time_point trigger, const double before,
+    const double after) {
+    auto start = trigger - std::chrono::duration_cast<clock::duration>(
+                               std::chrono::duration<double>(before));
+    auto end = trigger + std::chrono::duration_cast<clock::duration>(
+                             std::chrono::duration<double>(after));
+    /*
+     * Wait for the period after the trigger to be recorded.
+     */
+    while (!stopping.load() && clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    /*
+     * Hold the buffers in the window so the ring can move on while they
+     * are written.
+     */
+    std::vector<handle> window;
+    {
+        lock_guard guard(lock);
+        for (auto& ent : ring) {
+            if (ent.time >= start && ent.time <= end) {
+                window.push_back(ent.buf);
+            }
+        }
+    }
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        throw error(error::code::file_create_failure,
+            "recorder: creating: " + path + ": " + std::strerror(errno));
+    }
+    size_t words = 0;
+    for (auto& buf : window) {
+        output.write(reinterpret_cast<const char*>(buf->data()),
+            buf->size() * sizeof(buffer_value));
+        words += buf->size();
+    }
+    output.close();
+    if (!output) {
+        throw error(error::code::file_create_failure, "recorder: writing: " + path);
+    }
+    xia_log(log::info) << "recorder dump: " << path << " buffers=" << window.size()
+                       << " words=" << words;
+    return words;
+}
+
+void recorder::evict(time_point now) {
+    auto oldest = now - std::chrono::duration_cast<clock::duration>(
+                            std::chrono::duration<double>(seconds));
+    while (!ring.empty() &&
+           (size_ > max_words || (seconds > 0 && ring.front().time < oldest))) {
+        size_ -= ring.front().buf->size();
+        ring.pop_front();
+    }
+}
 }  // namespace buffer
 }  // namespace xia
 
+std::ostream& operator<<(std::ostream& out, const xia::buffer::lock_stats& stats) {
+    stats.output(out);
+    return out;
+}
+
 std::ostream& operator<<(std::ostream& out, xia::buffer::pool& pool) {
     pool.output(out);
     return out;
@@ -334,3 +656,8 @@ std::ostream& operator<<(std::ostream& out, xia::buffer::queue& queue) {
     queue.output(out);
     return out;
 }
+
+std::ostream& operator<<(std::ostream& out, xia::buffer::recorder& recorder) {
+    recorder.output(out);
+    return out;
+}
@@ -375,6 +375,7 @@ void export_json(const std::string& filename, crate::crate& crate) {
         metadata["fifo"]["run-wait"] = mod.fifo_run_wait_usecs.load();
         metadata["fifo"]["idle-wait"] = mod.fifo_idle_wait_usecs.load();
         metadata["fifo"]["hold"] = mod.fifo_hold_usecs.load();
+        metadata["fifo"]["adaptive"] = mod.fifo_adaptive.load();
         metadata["config"] = json::array();
         for (auto& chan : mod.channels) {
             json cfg;
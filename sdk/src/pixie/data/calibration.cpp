@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file calibration.cpp
+ * @brief Implements the energy calibration and gain matching of decoded events.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+#include <pixie/data/calibration.hpp>
+#include <pixie/data/channel_key.hpp>
+
+#include <nolhmann/json.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace calibration {
+
+using json = nlohmann::json;
+
+static const std::array<double, terms> identity = {0, 1, 0, 0};
+
+/*
+ * Evaluate the polynomial over a run of values. The coefficients are
+ * loaded once and the loop has no branches or indexed loads so the
+ * compiler vectorizes it.
+ */
+static void energy_kernel(const std::array<double, terms>& poly, double* values, size_t count) {
+    const double c0 = poly[0];
+    const double c1 = poly[1];
+    const double c2 = poly[2];
+    const double c3 = poly[3];
+    for (size_t v = 0; v < count; ++v) {
+        const double x = values[v];
+        values[v] = ((c3 * x + c2) * x + c1) * x + c0;
+    }
+}
+
+static void qdc_kernel(double gain, const uint32_t* sums, double* values, size_t count) {
+    for (size_t v = 0; v < count; ++v) {
+        values[v] = gain * double(sums[v]);
+    }
+}
+
+channel_calibration::channel_calibration()
+    : crate(0), slot(0), channel(0), energy(identity), gain(1), offset(0), qdc_gain(1) {}
+
+table::table() {
+    clear();
+}
+
+void table::set_energy(uint8_t crate, uint8_t slot, uint8_t channel,
+    const std::vector<double>& coefficients) {
+    if (coefficients.empty() || coefficients.size() > terms) {
+        throw error(error::code::invalid_value,
+            "calibration: invalid number of energy coefficients: " +
+                std::to_string(coefficients.size()));
+    }
+    auto& cal = find_or_add(crate, slot, channel);
+    cal.energy.fill(0);
+    std::copy(coefficients.begin(), coefficients.end(), cal.energy.begin());
+    fold(rows[channel_key::make(crate, slot, channel)]);
+}
+
+void table::set_gain(uint8_t crate, uint8_t slot, uint8_t channel, double gain, double offset) {
+    auto& cal = find_or_add(crate, slot, channel);
+    cal.gain = gain;
+    cal.offset = offset;
+    fold(rows[channel_key::make(crate, slot, channel)]);
+}
+
+void table::set_qdc_gain(uint8_t crate, uint8_t slot, uint8_t channel, double gain) {
+    auto& cal = find_or_add(crate, slot, channel);
+    cal.qdc_gain = gain;
+    fold(rows[channel_key::make(crate, slot, channel)]);
+}
+
+void table::set(const channel_calibration& cal) {
+    find_or_add(cal.crate, cal.slot, cal.channel) = cal;
+    fold(rows[channel_key::make(cal.crate, cal.slot, cal.channel)]);
+}
+
+bool table::has(uint8_t crate, uint8_t slot, uint8_t channel) const {
+    if (!channel_key::valid(crate, slot, channel)) {
+        return false;
+    }
+    auto k = channel_key::make(crate, slot, channel);
+    return k < rows.size() && rows[k] != 0;
+}
+
+const channel_calibration& table::get(uint8_t crate, uint8_t slot, uint8_t channel) const {
+    if (!has(crate, slot, channel)) {
+        throw error(error::code::invalid_value,
+            "calibration: channel not found: crate=" + std::to_string(crate) +
+                " slot=" + std::to_string(slot) + " channel=" + std::to_string(channel));
+    }
+    return cals[rows[channel_key::make(crate, slot, channel)] - 1];
+}
+
+const channel_calibrations& table::channels() const {
+    return cals;
+}
+
+size_t table::size() const {
+    return cals.size();
+}
+
+void table::clear() {
+    cals.clear();
+    polys.assign(1, identity);
+    qdc_gains.assign(1, 1.0);
+    rows.clear();
+}
+
+double table::energy(uint8_t crate, uint8_t slot, uint8_t channel, double value) const {
+    if (!has(crate, slot, channel)) {
+        return value;
+    }
+    energy_kernel(polys[rows[channel_key::make(crate, slot, channel)]], &value, 1);
+    return value;
+}
+
+void table::apply(columnar::batch& events) const {
+    if (!events.has(columnar::column::energy)) {
+        throw error(error::code::invalid_value, "calibration: batch has no energy column");
+    }
+    runs(events, [this, &events](size_t row, size_t first, size_t count) {
+        if (row != 0) {
+            energy_kernel(polys[row], events.energy.data() + first, count);
+        }
+    });
+}
+
+void table::apply_qdc(const columnar::batch& events, std::vector<double>& qdc) const {
+    if (!events.has(columnar::column::qdc)) {
+        throw error(error::code::invalid_value, "calibration: batch has no QDC column");
+    }
+    qdc.resize(events.size * columnar::qdc_sums);
+    runs(events, [this, &events, &qdc](size_t row, size_t first, size_t count) {
+        const size_t offset = first * columnar::qdc_sums;
+        qdc_kernel(qdc_gains[row], events.qdc.data() + offset, qdc.data() + offset,
+            count * columnar::qdc_sums);
+    });
+}
+
+void table::load(const std::string& file) {
+    std::ifstream input(file);
+    if (!input) {
+        throw error(error::code::file_open_failure,
+            "calibration: opening: " + file + ": " + std::strerror(errno));
+    }
+    table loaded;
+    try {
+        auto doc = json::parse(input);
+        for (auto& entry : doc.at("calibration")) {
+            auto crate = entry.at("crate").get<unsigned int>();
+            auto slot = entry.at("slot").get<unsigned int>();
+            auto channel = entry.at("channel").get<unsigned int>();
+            channel_key::check("calibration", crate, slot, channel);
+            channel_calibration cal;
+            cal.crate = uint8_t(crate);
+            cal.slot = uint8_t(slot);
+            cal.channel = uint8_t(channel);
+            auto energy = entry.at("energy").get<std::vector<double>>();
+            if (energy.empty() || energy.size() > terms) {
+                throw error(error::code::invalid_value,
+                    "calibration: invalid number of energy coefficients: " +
+                        std::to_string(energy.size()));
+            }
+            cal.energy.fill(0);
+            std::copy(energy.begin(), energy.end(), cal.energy.begin());
+            cal.gain = entry.value("gain", 1.0);
+            cal.offset = entry.value("offset", 0.0);
+            cal.qdc_gain = entry.value("qdc_gain", 1.0);
+            loaded.set(cal);
+        }
+    } catch (json::exception& e) {
+        throw error(error::code::invalid_value,
+            std::string("calibration: parse: ") + file + ": " + e.what());
+    }
+    *this = loaded;
+}
+
+void table::save(const std::string& file) const {
+    json entries = json::array();
+    for (auto& cal : cals) {
+        entries.push_back({{"crate", cal.crate}, {"slot", cal.slot}, {"channel", cal.channel},
+            {"energy", cal.energy}, {"gain", cal.gain}, {"offset", cal.offset},
+            {"qdc_gain", cal.qdc_gain}});
+    }
+    std::ofstream output(file);
+    if (!output) {
+        throw error(error::code::file_open_failure,
+            "calibration: opening: " + file + ": " + std::strerror(errno));
+    }
+    output << std::setw(4) << json({{"calibration", entries}}) << std::endl;
+}
+
+channel_calibration& table::find_or_add(uint8_t crate, uint8_t slot, uint8_t channel) {
+    channel_key::check("calibration", crate, slot, channel);
+    auto k = channel_key::make(crate, slot, channel);
+    if (k >= rows.size()) {
+        rows.resize(k + 1, 0);
+    }
+    if (rows[k] == 0) {
+        channel_calibration cal;
+        cal.crate = crate;
+        cal.slot = slot;
+        cal.channel = channel;
+        cals.push_back(cal);
+        polys.push_back(identity);
+        qdc_gains.push_back(1.0);
+        rows[k] = uint32_t(cals.size());
+    }
+    return cals[rows[k] - 1];
+}
+
+void table::fold(size_t row) {
+    const auto& cal = cals[row - 1];
+    auto& poly = polys[row];
+    for (size_t t = 0; t < terms; ++t) {
+        poly[t] = cal.gain * cal.energy[t];
+    }
+    poly[0] += cal.offset;
+    qdc_gains[row] = cal.qdc_gain;
+}
+
+template<typename Apply>
+void table::runs(const columnar::batch& events, Apply apply) const {
+    const columnar::columns needed =
+        columnar::column::crate | columnar::column::slot | columnar::column::channel;
+    if ((events.present & needed) != needed) {
+        throw error(error::code::invalid_value, "calibration: batch needs crate, slot and channel");
+    }
+    size_t first = 0;
+    while (first < events.size) {
+        const uint8_t crate = events.crate[first];
+        const uint8_t slot = events.slot[first];
+        const uint8_t channel = events.channel[first];
+        size_t last = first + 1;
+        while (last < events.size && events.channel[last] == channel &&
+               events.slot[last] == slot && events.crate[last] == crate) {
+            ++last;
+        }
+        uint32_t row = 0;
+        if (channel_key::valid(crate, slot, channel)) {
+            auto k = channel_key::make(crate, slot, channel);
+            row = k < rows.size() ? rows[k] : 0;
+        }
+        apply(row, first, last - first);
+        first = last;
+    }
+}
+
+}  // namespace calibration
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
@@ -0,0 +1,384 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file coincidence.cpp
+ * @brief Implements a host software coincidence trigger for list-mode data.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include <pixie/util.hpp>
+
+#include <pixie/data/channel_key.hpp>
+#include <pixie/data/coincidence.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace coincidence {
+
+/*
+ * The smallest event is the 4 word header.
+ */
+static constexpr size_t min_event_words = 4;
+
+const size_t trigger::max_groups = 64;
+
+channel::channel(uint8_t crate_, uint8_t slot_, uint8_t channel_number_)
+    : crate(crate_), slot(slot_), channel_number(channel_number_) {}
+
+channel_group::channel_group() : multiplicity(1) {}
+
+config::config() : window(100e-9), multiplicity(2), max_pending(1 << 20) {}
+
+counts::counts() {
+    clear();
+}
+
+void counts::clear() {
+    events = 0;
+    accepted_events = 0;
+    rejected_events = 0;
+    accepted_groups = 0;
+    rejected_groups = 0;
+    words_in = 0;
+    words_out = 0;
+    out_of_order = 0;
+    forced = 0;
+}
+
+double counts::accept_fraction() const {
+    if (events == 0) {
+        return 0;
+    }
+    return double(accepted_events) / double(events);
+}
+
+void counts::output(std::ostream& out) const {
+    util::ostream_guard flags(out);
+    out << "events=" << events << " accepted=" << accepted_events
+        << " rejected=" << rejected_events << " groups-accepted=" << accepted_groups
+        << " groups-rejected=" << rejected_groups << " words-in=" << words_in
+        << " words-out=" << words_out << " out-of-order=" << out_of_order
+        << " forced=" << forced << std::setprecision(4)
+        << " accept=" << accept_fraction() * 100 << '%';
+}
+
+trigger::stream::stream(size_t revision_, size_t frequency_)
+    : revision(revision_), frequency(frequency_), tick(frequency_ == 250 ? 8 : 10),
+      words_in(0), finished(false), next(0), pending(0), done(false) {}
+
+bool trigger::stream::empty() const {
+    return blocks.empty();
+}
+
+const trigger::event& trigger::stream::head() const {
+    return blocks.front().events[next];
+}
+
+trigger::trigger(const config& cfg_) : cfg(cfg_), window(0), open(false), start(0) {
+    if (cfg.window < 0 || !std::isfinite(cfg.window)) {
+        throw error(error::code::invalid_value, "coincidence: invalid window");
+    }
+    if (cfg.multiplicity == 0) {
+        throw error(error::code::invalid_value, "coincidence: invalid multiplicity");
+    }
+    if (cfg.max_pending == 0) {
+        throw error(error::code::invalid_value, "coincidence: invalid max pending");
+    }
+    if (cfg.groups.size() > max_groups) {
+        throw error(error::code::invalid_value,
+            "coincidence: too many channel groups: " + std::to_string(cfg.groups.size()));
+    }
+    window = uint64_t(std::llround(cfg.window * 1e9));
+    for (size_t g = 0; g < cfg.groups.size(); ++g) {
+        auto& group = cfg.groups[g];
+        if (group.multiplicity == 0 || group.multiplicity > group.channels.size()) {
+            throw error(error::code::invalid_value,
+                "coincidence: invalid channel group multiplicity: group=" + std::to_string(g));
+        }
+        for (auto& chan : group.channels) {
+            channel_key::check("coincidence", chan.crate, chan.slot, chan.channel_number);
+            auto k = channel_key::make(chan.crate, chan.slot, chan.channel_number);
+            if (k >= membership.size()) {
+                membership.resize(k + 1, 0);
+            }
+            membership[k] |= uint64_t(1) << g;
+        }
+    }
+    group_hits.resize(cfg.groups.size(), 0);
+}
+
+size_t trigger::add_stream(size_t revision, size_t frequency) {
+    if (frequency != 100 && frequency != 250 && frequency != 500) {
+        throw error(error::code::invalid_frequency,
+            "coincidence: invalid frequency: " + std::to_string(frequency));
+    }
+    /*
+     * Check the revision is supported at the frequency.
+     */
+    list_mode::event_header header;
+    list_mode::decode_event_header(0, revision, frequency, header);
+    streams_.push_back(std::unique_ptr<stream>(new stream(revision, frequency)));
+    return streams_.size() - 1;
+}
+
+void trigger::push(size_t stream_, const uint32_t* data, size_t len) {
+    if (stream_ >= streams_.size()) {
+        throw error(error::code::invalid_value,
+            "coincidence: invalid stream: " + std::to_string(stream_));
+    }
+    if (data == nullptr && len != 0) {
+        throw error(error::code::invalid_buffer, "coincidence: invalid buffer");
+    }
+    auto& source = *streams_[stream_];
+    std::lock_guard<std::mutex> guard(source.lock);
+    source.words_in += len;
+    block blk;
+    blk.words.reserve(source.partial.size() + len);
+    blk.words.insert(blk.words.end(), source.partial.begin(), source.partial.end());
+    blk.words.insert(blk.words.end(), data, data + len);
+    source.partial.clear();
+    const size_t size = blk.words.size();
+    size_t pos = 0;
+    list_mode::event_header header;
+    while (pos < size) {
+        list_mode::decode_event_header(blk.words[pos], source.revision, source.frequency, header);
+        if (header.header_length < min_event_words ||
+            header.event_length < header.header_length) {
+            throw error(error::code::invalid_event_length,
+                "coincidence: bad event: header-length=" + std::to_string(header.header_length) +
+                    " event-length=" + std::to_string(header.event_length));
+        }
+        if (pos + header.event_length > size) {
+            break;
+        }
+        const auto* words = &blk.words[pos];
+        event evt;
+        evt.time = ((uint64_t(words[2] & 0xFFFF) << 32) | uint64_t(words[1])) * source.tick;
+        evt.offset = uint32_t(pos);
+        evt.length = uint32_t(header.event_length);
+        evt.key = uint32_t(
+            channel_key::make(header.crate_id, header.slot_id, header.channel_number));
+        blk.events.push_back(evt);
+        pos += header.event_length;
+    }
+    source.partial.assign(blk.words.begin() + pos, blk.words.end());
+    if (!blk.events.empty()) {
+        blk.words.resize(pos);
+        source.incoming.push_back(std::move(blk));
+    }
+}
+
+void trigger::push(size_t stream_, const list_mode::buffer& data) {
+    push(stream_, data.data(), data.size());
+}
+
+void trigger::finish(size_t stream_) {
+    if (stream_ >= streams_.size()) {
+        throw error(error::code::invalid_value,
+            "coincidence: invalid stream: " + std::to_string(stream_));
+    }
+    auto& source = *streams_[stream_];
+    std::lock_guard<std::mutex> guard(source.lock);
+    source.finished = true;
+}
+
+size_t trigger::process(list_mode::buffer& out) {
+    const size_t before = out.size();
+    take();
+    stream* next = nullptr;
+    while (merge(next)) {
+        add(*next, out);
+    }
+    /*
+     * The last group is closed once all the streams are done.
+     */
+    if (open) {
+        bool drained = true;
+        for (auto& source : streams_) {
+            if (!source->done || !source->empty()) {
+                drained = false;
+                break;
+            }
+        }
+        if (drained) {
+            close(out);
+        }
+    }
+    std::lock_guard<std::mutex> guard(counts_lock);
+    published = merged;
+    return out.size() - before;
+}
+
+size_t trigger::flush(list_mode::buffer& out) {
+    for (size_t s = 0; s < streams_.size(); ++s) {
+        finish(s);
+    }
+    return process(out);
+}
+
+void trigger::clear() {
+    for (auto& source : streams_) {
+        std::lock_guard<std::mutex> guard(source->lock);
+        source->incoming.clear();
+        source->partial.clear();
+        source->words_in = 0;
+        source->finished = false;
+        source->blocks.clear();
+        source->next = 0;
+        source->pending = 0;
+        source->done = false;
+    }
+    open = false;
+    start = 0;
+    members.clear();
+    keys.clear();
+    retired.clear();
+    std::fill(group_hits.begin(), group_hits.end(), 0);
+    merged.clear();
+    std::lock_guard<std::mutex> guard(counts_lock);
+    published.clear();
+}
+
+size_t trigger::streams() const {
+    return streams_.size();
+}
+
+counts trigger::stats() const {
+    counts result;
+    {
+        std::lock_guard<std::mutex> guard(counts_lock);
+        result = published;
+    }
+    for (auto& source : streams_) {
+        std::lock_guard<std::mutex> guard(source->lock);
+        result.words_in += source->words_in;
+    }
+    return result;
+}
+
+void trigger::take() {
+    for (auto& source : streams_) {
+        std::lock_guard<std::mutex> guard(source->lock);
+        for (auto& blk : source->incoming) {
+            source->pending += blk.events.size();
+            source->blocks.push_back(std::move(blk));
+        }
+        source->incoming.clear();
+        source->done = source->finished;
+    }
+}
+
+bool trigger::merge(stream*& next) {
+    next = nullptr;
+    bool waiting = false;
+    bool full = false;
+    for (auto& source : streams_) {
+        if (source->empty()) {
+            if (!source->done) {
+                waiting = true;
+            }
+            continue;
+        }
+        if (source->pending >= cfg.max_pending) {
+            full = true;
+        }
+        if (next == nullptr || source->head().time < next->head().time) {
+            next = source.get();
+        }
+    }
+    if (next == nullptr) {
+        return false;
+    }
+    if (waiting) {
+        if (!full) {
+            return false;
+        }
+        ++merged.forced;
+    }
+    return true;
+}
+
+void trigger::add(stream& source, list_mode::buffer& out) {
+    const auto& evt = source.head();
+    if (open) {
+        if (evt.time < start) {
+            ++merged.out_of_order;
+        } else if (evt.time - start > window) {
+            close(out);
+        }
+    }
+    if (!open) {
+        open = true;
+        start = evt.time;
+    }
+    auto& blk = source.blocks.front();
+    members.push_back({blk.words.data() + evt.offset, evt.length});
+    if (std::find(keys.begin(), keys.end(), evt.key) == keys.end()) {
+        keys.push_back(evt.key);
+        uint64_t groups = evt.key < membership.size() ? membership[evt.key] : 0;
+        for (size_t g = 0; groups != 0; ++g, groups >>= 1) {
+            if ((groups & 1) != 0) {
+                ++group_hits[g];
+            }
+        }
+    }
+    ++merged.events;
+    --source.pending;
+    if (++source.next == blk.events.size()) {
+        /*
+         * The block's words are held until the group is closed.
+         */
+        retired.push_back(std::move(blk));
+        source.blocks.pop_front();
+        source.next = 0;
+    }
+}
+
+void trigger::close(list_mode::buffer& out) {
+    bool accept = keys.size() >= cfg.multiplicity;
+    for (size_t g = 0; accept && g < group_hits.size(); ++g) {
+        accept = group_hits[g] >= cfg.groups[g].multiplicity;
+    }
+    if (accept) {
+        size_t words = 0;
+        for (auto& m : members) {
+            out.insert(out.end(), m.words, m.words + m.length);
+            words += m.length;
+        }
+        merged.accepted_events += members.size();
+        ++merged.accepted_groups;
+        merged.words_out += words;
+    } else {
+        merged.rejected_events += members.size();
+        ++merged.rejected_groups;
+    }
+    open = false;
+    members.clear();
+    keys.clear();
+    retired.clear();
+    std::fill(group_hits.begin(), group_hits.end(), 0);
+}
+
+}  // namespace coincidence
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
@@ -0,0 +1,805 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file columnar.cpp
+ * @brief Implements the chunked, columnar file format for decoded list-mode events.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+
+#include <pixie/data/columnar.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace columnar {
+
+/*
+ * File layout
+ *
+ * Event file:
+ *   file header
+ *   chunk header, column blocks (in column bit order)
+ *   ...
+ *   index entries (chunk header + offset)
+ *   trailer: index offset, chunk count, index magic
+ *
+ * Trace stream:
+ *   file header
+ *   samples of each chunk
+ */
+static const char file_magic[8] = {'P', 'I', 'X', 'I', 'E', 'C', 'O', 'L'};
+static const char trace_magic[8] = {'P', 'I', 'X', 'I', 'E', 'T', 'R', 'C'};
+static constexpr uint32_t file_version = 1;
+static constexpr uint32_t byte_order = 0x01020304;
+static constexpr uint32_t chunk_magic = 0x4b4e4843;
+static constexpr uint32_t index_magic = 0x58495850;
+static constexpr size_t file_header_size = 32;
+static constexpr size_t chunk_header_size = 64;
+static constexpr size_t trailer_size = 16;
+
+/*
+ * Bytes per event of each column in column bit order. The energy sums
+ * column is the sums followed by the baseline.
+ */
+static const size_t column_widths[] = {
+    sizeof(double),                                    /* time */
+    sizeof(double),                                    /* energy */
+    sizeof(uint8_t),                                   /* crate */
+    sizeof(uint8_t),                                   /* slot */
+    sizeof(uint8_t),                                   /* channel */
+    sizeof(double),                                    /* cfd */
+    sizeof(uint8_t),                                   /* flags */
+    sizeof(double),                                    /* external_time */
+    qdc_sums * sizeof(uint32_t),                       /* qdc */
+    energy_sums * sizeof(uint32_t) + sizeof(double),   /* esums */
+    sizeof(uint32_t)                                   /* trace */
+};
+static constexpr size_t num_columns = sizeof(column_widths) / sizeof(column_widths[0]);
+
+static const columns base_columns = column::time | column::energy | column::crate |
+    column::slot | column::channel | column::cfd | column::flags;
+
+template<typename T>
+static void put(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static void put(std::ostream& out, const std::vector<T>& values) {
+    if (!values.empty()) {
+        out.write(reinterpret_cast<const char*>(values.data()),
+            std::streamsize(values.size() * sizeof(T)));
+    }
+}
+
+template<typename T>
+static void get(std::istream& in, T& value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static void get(std::istream& in, std::vector<T>& values, size_t count) {
+    values.resize(count);
+    if (count > 0) {
+        in.read(reinterpret_cast<char*>(values.data()), std::streamsize(count * sizeof(T)));
+    }
+}
+
+static void write_file_header(std::ostream& out, const char* magic, size_t chunk_events) {
+    out.write(magic, sizeof(file_magic));
+    put(out, file_version);
+    put(out, byte_order);
+    put(out, uint32_t(chunk_events));
+    const uint32_t reserved[3] = {0, 0, 0};
+    put(out, reserved);
+}
+
+static void check_file_header(std::istream& in, const char* magic, const std::string& name) {
+    char file_id[sizeof(file_magic)];
+    uint32_t version = 0;
+    uint32_t order = 0;
+    in.read(file_id, sizeof(file_id));
+    get(in, version);
+    get(in, order);
+    if (!in) {
+        throw error(error::code::file_read_failure, "columnar: header read failed: " + name);
+    }
+    if (std::memcmp(file_id, magic, sizeof(file_id)) != 0) {
+        throw error(error::code::invalid_value, "columnar: not a columnar file: " + name);
+    }
+    if (version != file_version) {
+        throw error(error::code::invalid_value,
+            "columnar: unsupported version: " + std::to_string(version) + ": " + name);
+    }
+    if (order != byte_order) {
+        throw error(error::code::invalid_value, "columnar: byte order mismatch: " + name);
+    }
+    in.seekg(file_header_size, std::ios::beg);
+}
+
+static void write_chunk_header(std::ostream& out, const chunk_index& index) {
+    put(out, chunk_magic);
+    put(out, uint32_t(index.events));
+    put(out, uint32_t(index.present));
+    put(out, uint32_t(0));
+    put(out, index.time_min);
+    put(out, index.time_max);
+    put(out, index.slot_min);
+    put(out, index.slot_max);
+    put(out, index.channel_min);
+    put(out, index.channel_max);
+    put(out, index.length);
+    put(out, index.trace_offset);
+    put(out, index.trace_length);
+}
+
+static bool read_chunk_header(std::istream& in, chunk_index& index) {
+    uint32_t magic = 0;
+    uint32_t events = 0;
+    uint32_t present = 0;
+    uint32_t reserved = 0;
+    get(in, magic);
+    get(in, events);
+    get(in, present);
+    get(in, reserved);
+    get(in, index.time_min);
+    get(in, index.time_max);
+    get(in, index.slot_min);
+    get(in, index.slot_max);
+    get(in, index.channel_min);
+    get(in, index.channel_max);
+    get(in, index.length);
+    get(in, index.trace_offset);
+    get(in, index.trace_length);
+    if (!in || magic != chunk_magic) {
+        return false;
+    }
+    index.events = events;
+    index.present = present;
+    return true;
+}
+
+static uint64_t chunk_length(const chunk_index& index) {
+    uint64_t length = 0;
+    for (size_t c = 0; c < num_columns; ++c) {
+        if ((index.present & (1 << c)) != 0) {
+            length += column_widths[c] * index.events;
+        }
+    }
+    return length;
+}
+
+std::string trace_stream_name(const std::string& name) {
+    return name + ".traces";
+}
+
+batch::batch() : size(0), present(column::all) {}
+
+void batch::clear(columns cols) {
+    size = 0;
+    present = cols & column::all;
+    time.clear();
+    energy.clear();
+    crate.clear();
+    slot.clear();
+    channel.clear();
+    cfd.clear();
+    flags.clear();
+    external_time.clear();
+    qdc.clear();
+    esums.clear();
+    baseline.clear();
+    trace_offset.clear();
+    trace.clear();
+    if (has(column::trace)) {
+        trace_offset.push_back(0);
+    }
+}
+
+void batch::append(const list_mode::record& rec) {
+    if (has(column::time)) {
+        time.push_back(rec.time.count());
+    }
+    if (has(column::energy)) {
+        energy.push_back(rec.energy);
+    }
+    if (has(column::crate)) {
+        crate.push_back(uint8_t(rec.crate_id));
+    }
+    if (has(column::slot)) {
+        slot.push_back(uint8_t(rec.slot_id));
+    }
+    if (has(column::channel)) {
+        channel.push_back(uint8_t(rec.channel_number));
+    }
+    if (has(column::cfd)) {
+        cfd.push_back(rec.cfd_fractional_time.count());
+    }
+    if (has(column::flags)) {
+        uint8_t value = uint8_t(rec.cfd_trigger_source << flag::cfd_source_shift);
+        if (rec.finish_code) {
+            value |= flag::finish_code;
+        }
+        if (rec.trace_out_of_range) {
+            value |= flag::trace_out_of_range;
+        }
+        if (rec.cfd_forced_trigger) {
+            value |= flag::cfd_forced_trigger;
+        }
+        flags.push_back(value);
+    }
+    if (has(column::external_time)) {
+        external_time.push_back(rec.external_time.count());
+    }
+    if (has(column::qdc)) {
+        for (size_t q = 0; q < qdc_sums; ++q) {
+            qdc.push_back(q < rec.qdc.size() ? uint32_t(rec.qdc[q]) : 0);
+        }
+    }
+    if (has(column::esums)) {
+        for (size_t s = 0; s < energy_sums; ++s) {
+            esums.push_back(s < rec.energy_sums.size() ? uint32_t(rec.energy_sums[s]) : 0);
+        }
+        baseline.push_back(rec.filter_baseline);
+    }
+    if (has(column::trace)) {
+        for (auto sample : rec.trace) {
+            trace.push_back(uint16_t(sample));
+        }
+        trace_offset.push_back(trace.size());
+    }
+    ++size;
+}
+
+void batch::get(size_t event, list_mode::record& rec) const {
+    if (event >= size) {
+        throw error(error::code::invalid_value,
+            "columnar: event out of range: " + std::to_string(event));
+    }
+    rec = list_mode::record();
+    if (has(column::time)) {
+        rec.time = list_mode::record::time_type(time[event]);
+    }
+    if (has(column::energy)) {
+        rec.energy = energy[event];
+    }
+    if (has(column::crate)) {
+        rec.crate_id = crate[event];
+    }
+    if (has(column::slot)) {
+        rec.slot_id = slot[event];
+    }
+    if (has(column::channel)) {
+        rec.channel_number = channel[event];
+    }
+    if (has(column::cfd)) {
+        rec.cfd_fractional_time = list_mode::record::time_type(cfd[event]);
+    }
+    rec.filter_time = rec.time - rec.cfd_fractional_time;
+    if (has(column::flags)) {
+        auto value = flags[event];
+        rec.finish_code = (value & flag::finish_code) != 0;
+        rec.trace_out_of_range = (value & flag::trace_out_of_range) != 0;
+        rec.cfd_forced_trigger = (value & flag::cfd_forced_trigger) != 0;
+        rec.cfd_trigger_source = value >> flag::cfd_source_shift;
+    }
+    if (has(column::external_time)) {
+        rec.external_time = list_mode::record::time_type(external_time[event]);
+    }
+    if (has(column::qdc)) {
+        auto first = qdc.begin() + event * qdc_sums;
+        rec.qdc.assign(first, first + qdc_sums);
+    }
+    if (has(column::esums)) {
+        auto first = esums.begin() + event * energy_sums;
+        rec.energy_sums.assign(first, first + energy_sums);
+        rec.filter_baseline = baseline[event];
+    }
+    if (has(column::trace)) {
+        rec.trace.assign(
+            trace.begin() + trace_offset[event], trace.begin() + trace_offset[event + 1]);
+        rec.trace_length = rec.trace.size();
+    }
+}
+
+bool batch::has(column col) const {
+    return (present & col) != 0;
+}
+
+template<typename T>
+static void permute(std::vector<T>& values, const std::vector<size_t>& order, size_t width) {
+    std::vector<T> out;
+    out.reserve(values.size());
+    for (auto event : order) {
+        auto first = values.begin() + event * width;
+        out.insert(out.end(), first, first + width);
+    }
+    values.swap(out);
+}
+
+void batch::group_by_channel() {
+    const columns needed = column::crate | column::slot | column::channel;
+    if ((present & needed) != needed) {
+        throw error(error::code::invalid_value, "columnar: group needs crate, slot and channel");
+    }
+    auto key = [this](size_t event) {
+        return (uint32_t(crate[event]) << 16) | (uint32_t(slot[event]) << 8) | channel[event];
+    };
+    std::vector<size_t> order(size);
+    for (size_t event = 0; event < size; ++event) {
+        order[event] = event;
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [&key](size_t a, size_t b) { return key(a) < key(b); });
+    bool grouped = true;
+    for (size_t event = 0; grouped && event < size; ++event) {
+        grouped = order[event] == event;
+    }
+    if (grouped) {
+        return;
+    }
+    if (has(column::time)) {
+        permute(time, order, 1);
+    }
+    if (has(column::energy)) {
+        permute(energy, order, 1);
+    }
+    permute(crate, order, 1);
+    permute(slot, order, 1);
+    permute(channel, order, 1);
+    if (has(column::cfd)) {
+        permute(cfd, order, 1);
+    }
+    if (has(column::flags)) {
+        permute(flags, order, 1);
+    }
+    if (has(column::external_time)) {
+        permute(external_time, order, 1);
+    }
+    if (has(column::qdc)) {
+        permute(qdc, order, qdc_sums);
+    }
+    if (has(column::esums)) {
+        permute(esums, order, energy_sums);
+        permute(baseline, order, 1);
+    }
+    if (has(column::trace)) {
+        samples out;
+        std::vector<size_t> offsets;
+        out.reserve(trace.size());
+        offsets.reserve(trace_offset.size());
+        offsets.push_back(0);
+        for (auto event : order) {
+            out.insert(out.end(), trace.begin() + trace_offset[event],
+                trace.begin() + trace_offset[event + 1]);
+            offsets.push_back(out.size());
+        }
+        trace.swap(out);
+        trace_offset.swap(offsets);
+    }
+}
+
+chunk_index::chunk_index()
+    : events(0), present(0), time_min(std::numeric_limits<double>::max()),
+      time_max(std::numeric_limits<double>::lowest()),
+      slot_min(std::numeric_limits<uint16_t>::max()), slot_max(0),
+      channel_min(std::numeric_limits<uint16_t>::max()), channel_max(0), offset(0), length(0),
+      trace_offset(0), trace_length(0) {}
+
+filter::filter()
+    : time_min(std::numeric_limits<double>::lowest()),
+      time_max(std::numeric_limits<double>::max()), slot_min(0),
+      slot_max(std::numeric_limits<uint16_t>::max()), channel_min(0),
+      channel_max(std::numeric_limits<uint16_t>::max()) {}
+
+void filter::time_range(double min, double max) {
+    time_min = min;
+    time_max = max;
+}
+
+void filter::slots(uint16_t min, uint16_t max) {
+    slot_min = min;
+    slot_max = max;
+}
+
+void filter::channels(uint16_t min, uint16_t max) {
+    channel_min = min;
+    channel_max = max;
+}
+
+bool filter::selects(const chunk_index& index) const {
+    return index.events > 0 && index.time_max >= time_min && index.time_min <= time_max &&
+        index.slot_max >= slot_min && index.slot_min <= slot_max &&
+        index.channel_max >= channel_min && index.channel_min <= channel_max;
+}
+
+writer::writer(const std::string& name_, size_t chunk_events_)
+    : name(name_), chunk_events(chunk_events_), trace_pos(0), total(0) {
+    if (chunk_events == 0) {
+        throw error(error::code::invalid_value, "columnar: chunk size cannot be 0");
+    }
+    out.open(name, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw error(error::code::file_create_failure, "columnar: create failed: " + name);
+    }
+    auto trace_name = trace_stream_name(name);
+    traces.open(trace_name, std::ios::binary | std::ios::trunc);
+    if (!traces) {
+        throw error(error::code::file_create_failure, "columnar: create failed: " + trace_name);
+    }
+    write_file_header(out, file_magic, chunk_events);
+    write_file_header(traces, trace_magic, chunk_events);
+    trace_pos = file_header_size;
+    pending.clear();
+}
+
+writer::~writer() {
+    try {
+        close();
+    } catch (error& e) {
+        xia_log(log::error) << "columnar: writer close: " << e;
+    } catch (...) {
+        xia_log(log::error) << "columnar: writer close: unknown error";
+    }
+}
+
+void writer::write(const list_mode::record& rec) {
+    if (!is_open()) {
+        throw error(error::code::file_open_failure, "columnar: writer not open: " + name);
+    }
+    pending.append(rec);
+    pending_index.time_min = std::min(pending_index.time_min, rec.time.count());
+    pending_index.time_max = std::max(pending_index.time_max, rec.time.count());
+    pending_index.slot_min = std::min(pending_index.slot_min, uint16_t(rec.slot_id));
+    pending_index.slot_max = std::max(pending_index.slot_max, uint16_t(rec.slot_id));
+    pending_index.channel_min =
+        std::min(pending_index.channel_min, uint16_t(rec.channel_number));
+    pending_index.channel_max =
+        std::max(pending_index.channel_max, uint16_t(rec.channel_number));
+    pending_index.present |= base_columns;
+    if (rec.external_time.count() != 0) {
+        pending_index.present |= column::external_time;
+    }
+    if (!rec.qdc.empty()) {
+        pending_index.present |= column::qdc;
+    }
+    if (!rec.energy_sums.empty()) {
+        pending_index.present |= column::esums;
+    }
+    if (!rec.trace.empty()) {
+        pending_index.present |= column::trace;
+    }
+    if (pending.size >= chunk_events) {
+        write_chunk();
+    }
+}
+
+void writer::write(const list_mode::records& recs_) {
+    for (auto& rec : recs_) {
+        write(rec);
+    }
+}
+
+void writer::write(uint32_t* data, size_t len, size_t revision, size_t frequency,
+    list_mode::buffer& leftovers) {
+    list_mode::decode_data_block(data, len, revision, frequency, recs, leftovers);
+    write(recs);
+}
+
+void writer::flush() {
+    if (is_open()) {
+        write_chunk();
+        out.flush();
+        traces.flush();
+    }
+}
+
+void writer::close() {
+    if (!is_open()) {
+        return;
+    }
+    write_chunk();
+    uint64_t index_offset = uint64_t(out.tellp());
+    for (auto& chunk : index) {
+        write_chunk_header(out, chunk);
+        put(out, chunk.offset);
+    }
+    put(out, index_offset);
+    put(out, uint32_t(index.size()));
+    put(out, index_magic);
+    bool ok = bool(out) && bool(traces);
+    out.close();
+    traces.close();
+    if (!ok) {
+        throw error(error::code::file_create_failure, "columnar: write failed: " + name);
+    }
+}
+
+bool writer::is_open() const {
+    return out.is_open();
+}
+
+size_t writer::events() const {
+    return total + pending.size;
+}
+
+size_t writer::chunks() const {
+    return index.size();
+}
+
+void writer::write_chunk() {
+    if (pending.size == 0) {
+        return;
+    }
+    auto& chunk = pending_index;
+    chunk.events = pending.size;
+    chunk.offset = uint64_t(out.tellp());
+    chunk.length = chunk_length(chunk);
+    chunk.trace_offset = trace_pos;
+    chunk.trace_length = 0;
+    if ((chunk.present & column::trace) != 0) {
+        chunk.trace_length = pending.trace.size() * sizeof(uint16_t);
+    }
+    write_chunk_header(out, chunk);
+    if ((chunk.present & column::time) != 0) {
+        put(out, pending.time);
+    }
+    if ((chunk.present & column::energy) != 0) {
+        put(out, pending.energy);
+    }
+    if ((chunk.present & column::crate) != 0) {
+        put(out, pending.crate);
+    }
+    if ((chunk.present & column::slot) != 0) {
+        put(out, pending.slot);
+    }
+    if ((chunk.present & column::channel) != 0) {
+        put(out, pending.channel);
+    }
+    if ((chunk.present & column::cfd) != 0) {
+        put(out, pending.cfd);
+    }
+    if ((chunk.present & column::flags) != 0) {
+        put(out, pending.flags);
+    }
+    if ((chunk.present & column::external_time) != 0) {
+        put(out, pending.external_time);
+    }
+    if ((chunk.present & column::qdc) != 0) {
+        put(out, pending.qdc);
+    }
+    if ((chunk.present & column::esums) != 0) {
+        put(out, pending.esums);
+        put(out, pending.baseline);
+    }
+    if ((chunk.present & column::trace) != 0) {
+        for (size_t e = 0; e < pending.size; ++e) {
+            put(out, uint32_t(pending.trace_offset[e + 1] - pending.trace_offset[e]));
+        }
+        put(traces, pending.trace);
+        trace_pos += chunk.trace_length;
+    }
+    if (!out || !traces) {
+        throw error(error::code::file_create_failure, "columnar: write failed: " + name);
+    }
+    total += pending.size;
+    index.push_back(chunk);
+    pending.clear();
+    pending_index = chunk_index();
+}
+
+reader::reader(const std::string& name_) : name(name_), next(0) {
+    in.open(name, std::ios::binary);
+    if (!in) {
+        throw error(error::code::file_open_failure, "columnar: open failed: " + name);
+    }
+    check_file_header(in, file_magic, name);
+    load_index();
+}
+
+const chunk_indexes& reader::index() const {
+    return chunks;
+}
+
+size_t reader::events() const {
+    size_t count = 0;
+    for (auto& chunk : chunks) {
+        count += chunk.events;
+    }
+    return count;
+}
+
+bool reader::read(batch& out, columns cols, const filter& select) {
+    while (next < chunks.size()) {
+        auto chunk = next++;
+        if (select.selects(chunks[chunk])) {
+            read_chunk(chunk, out, cols);
+            return true;
+        }
+    }
+    return false;
+}
+
+void reader::read_chunk(size_t chunk, batch& out, columns cols) {
+    if (chunk >= chunks.size()) {
+        throw error(error::code::invalid_value,
+            "columnar: chunk out of range: " + std::to_string(chunk));
+    }
+    auto& index = chunks[chunk];
+    auto events = index.events;
+    out.clear(cols & index.present);
+    out.size = events;
+    /*
+     * The columns are contiguous blocks in column bit order. Seek over the
+     * blocks that are not requested.
+     */
+    uint64_t pos = index.offset + chunk_header_size;
+    std::vector<uint32_t> trace_lengths;
+    for (size_t c = 0; c < num_columns; ++c) {
+        auto col = column(1 << c);
+        if ((index.present & col) == 0) {
+            continue;
+        }
+        if (out.has(col)) {
+            in.seekg(std::streamoff(pos), std::ios::beg);
+            switch (col) {
+                case column::time:
+                    get(in, out.time, events);
+                    break;
+                case column::energy:
+                    get(in, out.energy, events);
+                    break;
+                case column::crate:
+                    get(in, out.crate, events);
+                    break;
+                case column::slot:
+                    get(in, out.slot, events);
+                    break;
+                case column::channel:
+                    get(in, out.channel, events);
+                    break;
+                case column::cfd:
+                    get(in, out.cfd, events);
+                    break;
+                case column::flags:
+                    get(in, out.flags, events);
+                    break;
+                case column::external_time:
+                    get(in, out.external_time, events);
+                    break;
+                case column::qdc:
+                    get(in, out.qdc, events * qdc_sums);
+                    break;
+                case column::esums:
+                    get(in, out.esums, events * energy_sums);
+                    get(in, out.baseline, events);
+                    break;
+                case column::trace:
+                    get(in, trace_lengths, events);
+                    break;
+                default:
+                    break;
+            }
+        }
+        pos += column_widths[c] * events;
+    }
+    if (!in) {
+        throw error(error::code::file_read_failure,
+            "columnar: chunk read failed: " + name + ": chunk " + std::to_string(chunk));
+    }
+    if (out.has(column::trace)) {
+        if (!traces.is_open()) {
+            auto trace_name = trace_stream_name(name);
+            traces.open(trace_name, std::ios::binary);
+            if (!traces) {
+                throw error(error::code::file_open_failure,
+                    "columnar: open failed: " + trace_name);
+            }
+            check_file_header(traces, trace_magic, trace_name);
+        }
+        out.trace_offset.resize(events + 1);
+        out.trace_offset[0] = 0;
+        for (size_t e = 0; e < events; ++e) {
+            out.trace_offset[e + 1] = out.trace_offset[e] + trace_lengths[e];
+        }
+        if (out.trace_offset[events] * sizeof(uint16_t) != index.trace_length) {
+            throw error(error::code::file_size_invalid,
+                "columnar: trace length mismatch: " + name + ": chunk " + std::to_string(chunk));
+        }
+        traces.seekg(std::streamoff(index.trace_offset), std::ios::beg);
+        get(traces, out.trace, out.trace_offset[events]);
+        if (!traces) {
+            throw error(error::code::file_read_failure,
+                "columnar: trace read failed: " + name + ": chunk " + std::to_string(chunk));
+        }
+    }
+}
+
+void reader::rewind() {
+    next = 0;
+}
+
+void reader::load_index() {
+    in.seekg(0, std::ios::end);
+    auto size = uint64_t(in.tellg());
+    if (size >= file_header_size + trailer_size) {
+        uint64_t index_offset = 0;
+        uint32_t count = 0;
+        uint32_t magic = 0;
+        in.seekg(std::streamoff(size - trailer_size), std::ios::beg);
+        get(in, index_offset);
+        get(in, count);
+        get(in, magic);
+        if (in && magic == index_magic && index_offset < size) {
+            in.seekg(std::streamoff(index_offset), std::ios::beg);
+            chunks.resize(count);
+            bool ok = true;
+            for (auto& chunk : chunks) {
+                ok = read_chunk_header(in, chunk);
+                get(in, chunk.offset);
+                if (!ok || !in) {
+                    ok = false;
+                    break;
+                }
+            }
+            if (ok) {
+                return;
+            }
+        }
+    }
+    in.clear();
+    chunks.clear();
+    scan_index();
+}
+
+void reader::scan_index() {
+    xia_log(log::warning) << "columnar: no index, scanning chunks: " << name;
+    uint64_t pos = file_header_size;
+    while (true) {
+        chunk_index chunk;
+        in.seekg(std::streamoff(pos), std::ios::beg);
+        if (!read_chunk_header(in, chunk)) {
+            break;
+        }
+        chunk.offset = pos;
+        if (chunk.length != chunk_length(chunk)) {
+            break;
+        }
+        pos += chunk_header_size + chunk.length;
+        /*
+         * A chunk that was not completely written ends the file.
+         */
+        in.seekg(0, std::ios::end);
+        if (uint64_t(in.tellg()) < pos) {
+            break;
+        }
+        chunks.push_back(chunk);
+    }
+    in.clear();
+}
+
+}  // namespace columnar
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
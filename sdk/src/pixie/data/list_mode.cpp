@@ -23,6 +23,7 @@
 #include <pixie/error.hpp>
 #include <pixie/util.hpp>
 
+#include <pixie/data/channel_key.hpp>
 #include <pixie/data/list_mode.hpp>
 
 #include <nolhmann/json.hpp>
@@ -39,7 +40,6 @@ static constexpr size_t num_esum_words = 4;
 static constexpr size_t num_ext_ts_words = 2;
 static constexpr size_t min_slot_id = 2;
 static constexpr size_t max_slot_id = 14;
-
 using json = nlohmann::json;
 
 /**
@@ -554,15 +554,17 @@ struct header_config {
     bool valid;
 };
 
-void fill_remainder(uint32_t* data, uint32_t* data_end, buffer& leftovers) {
-    while (data < data_end) {
-        leftovers.push_back(*data);
-        data += 1;
-    }
+static void fill_remainder(const uint32_t* data, const uint32_t* data_end, buffer& leftovers) {
+    leftovers.insert(leftovers.end(), data, data_end);
 }
 
-void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequency, records& recs,
-                       buffer& leftovers) {
+/*
+ * Decode a data block and pass each record to the sink. The sink can move
+ * the record.
+ */
+template<typename Sink>
+static void decode_block(const uint32_t* data, size_t len, size_t revision, size_t frequency,
+                         buffer& leftovers, Sink& sink) {
     if (data == nullptr) {
         throw error(error::code::invalid_buffer, "buffer pointed to an invalid location");
     }
@@ -574,7 +576,6 @@ void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequ
                     "minimum supported firmware rev is " + std::to_string(min_rev));
     }
 
-    recs.clear();
     leftovers.clear();
     auto* data_start = data;
     auto* data_end = data_start + len;
@@ -741,13 +742,170 @@ void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequ
 
         data += evt.event_length;
         remaining_len -= evt.event_length;
-        recs.push_back(evt);
+        sink(evt);
+    }
+}
+
+void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequency, records& recs,
+                       buffer& leftovers) {
+    decode_data_block(util::span<const uint32_t>(data, len), revision, frequency, recs,
+                      leftovers);
+}
+
+void decode_data_block(util::span<const uint32_t> data, size_t revision, size_t frequency,
+                       records& recs, buffer& leftovers) {
+    recs.clear();
+    auto sink = [&recs](record& evt) { recs.push_back(std::move(evt)); };
+    decode_block(data.data(), data.size(), revision, frequency, leftovers, sink);
+}
+
+void decode_data_block(uint32_t* data, size_t len, size_t revision, size_t frequency,
+                       partitioned_records& parts, buffer& leftovers) {
+    decode_data_block(util::span<const uint32_t>(data, len), revision, frequency, parts,
+                      leftovers);
+}
+
+void decode_data_block(util::span<const uint32_t> data, size_t revision, size_t frequency,
+                       partitioned_records& parts, buffer& leftovers) {
+    auto sink = [&parts](record& evt) {
+        parts.add(evt.crate_id, evt.slot_id, evt.channel_number).push_back(std::move(evt));
+    };
+    decode_block(data.data(), data.size(), revision, frequency, leftovers, sink);
+}
+
+constexpr size_t partitioned_records::cache_line;
+
+partitioned_records::partition::partition(size_t crate_id_, size_t slot_id_,
+                                          size_t channel_number_)
+    : crate_id(crate_id_), slot_id(slot_id_), channel_number(channel_number_) {}
+
+partitioned_records::partitioned_records(size_t reserve_) : reserve(reserve_) {}
+
+void partitioned_records::add_channel(size_t crate, size_t slot, size_t channel) {
+    add(crate, slot, channel);
+}
+
+void partitioned_records::add_module(size_t crate, size_t slot, size_t num_channels) {
+    for (size_t c = 0; c < num_channels; ++c) {
+        add(crate, slot, c);
+    }
+}
+
+records& partitioned_records::add(size_t crate, size_t slot, size_t channel) {
+    channel_key::check("partitioned records", crate, slot, channel);
+    auto k = channel_key::make(crate, slot, channel);
+    if (k < rows.size() && rows[k] != 0) {
+        return parts[rows[k] - 1]->recs;
+    }
+    if (k >= rows.size()) {
+        rows.resize(k + 1, 0);
+    }
+    std::unique_ptr<partition> part(new partition(crate, slot, channel));
+    part->recs.reserve(reserve);
+    parts.push_back(std::move(part));
+    rows[k] = uint32_t(parts.size());
+    return parts.back()->recs;
+}
+
+bool partitioned_records::has(size_t crate, size_t slot, size_t channel) const {
+    return row(crate, slot, channel) != 0;
+}
+
+records& partitioned_records::get(size_t crate, size_t slot, size_t channel) {
+    auto r = row(crate, slot, channel);
+    if (r == 0) {
+        throw error(error::code::invalid_value,
+                    "partitioned records: channel not found: crate=" + std::to_string(crate) +
+                        " slot=" + std::to_string(slot) + " channel=" + std::to_string(channel));
+    }
+    return parts[r - 1]->recs;
+}
+
+const records& partitioned_records::get(size_t crate, size_t slot, size_t channel) const {
+    return const_cast<partitioned_records*>(this)->get(crate, slot, channel);
+}
+
+size_t partitioned_records::size() const {
+    return parts.size();
+}
+
+partitioned_records::partition& partitioned_records::operator[](size_t index) {
+    if (index >= parts.size()) {
+        throw error(error::code::invalid_value,
+                    "partitioned records: invalid partition: " + std::to_string(index));
+    }
+    return *parts[index];
+}
+
+const partitioned_records::partition& partitioned_records::operator[](size_t index) const {
+    return const_cast<partitioned_records*>(this)->operator[](index);
+}
+
+size_t partitioned_records::events() const {
+    size_t count = 0;
+    for (auto& part : parts) {
+        count += part->recs.size();
+    }
+    return count;
+}
+
+void partitioned_records::clear() {
+    for (auto& part : parts) {
+        part->recs.clear();
+    }
+}
+
+size_t partitioned_records::row(size_t crate, size_t slot, size_t channel) const {
+    if (!channel_key::valid(crate, slot, channel)) {
+        return 0;
+    }
+    auto k = channel_key::make(crate, slot, channel);
+    return k < rows.size() ? rows[k] : 0;
+}
+
+event_header::event_header()
+    : crate_id(0), slot_id(0), channel_number(0), header_length(0), event_length(0) {}
+
+bool event_header::valid() const {
+    return header_length >= min_words && event_length >= header_length;
+}
+
+void decode_event_header(uint32_t word, size_t revision, size_t frequency, event_header& header) {
+    if (revision < min_rev) {
+        throw error(error::code::invalid_revision,
+                    "minimum supported firmware rev is " + std::to_string(min_rev));
+    }
+    header = event_header();
+    for (const auto& ele : find_element_set(revision, frequency)) {
+        if (ele.header_index != 0) {
+            continue;
+        }
+        auto val = (word & ele.value) >> ele.start_bit;
+        switch (ele.type) {
+            case element::header_length:
+                header.header_length = val;
+                break;
+            case element::event_length:
+                header.event_length = val;
+                break;
+            case element::channel_number:
+                header.channel_number = val;
+                break;
+            case element::crate_id:
+                header.crate_id = val;
+                break;
+            case element::slot_id:
+                header.slot_id = val;
+                break;
+            default:
+                break;
+        }
     }
 }
 
-void decode_data_block(buffer data, size_t revision, size_t frequency, records& recs,
+void decode_data_block(const buffer& data, size_t revision, size_t frequency, records& recs,
                        buffer& leftovers) {
-    decode_data_block(data.data(), data.size(), revision, frequency, recs, leftovers);
+    decode_data_block(util::span<const uint32_t>(data), revision, frequency, recs, leftovers);
 }
 
 }  // namespace list_mode
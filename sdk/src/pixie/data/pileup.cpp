@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file pileup.cpp
+ * @brief Implements a streaming pile-up and dead time estimator.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include <pixie/util.hpp>
+
+#include <pixie/data/channel_key.hpp>
+#include <pixie/data/pileup.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace pileup {
+
+config::config()
+    : windows({100e-9, 500e-9, 1e-6}), resolving_time(2e-6), bin_width(100e-9), bins(1000) {}
+
+channel::channel(const config& cfg)
+    : crate(0), slot(0), channel_number(0), pileups(cfg.windows.size()),
+      intervals(cfg.bins + 1) {
+    clear();
+}
+
+void channel::clear() {
+    events = 0;
+    first_time = 0;
+    last_time = 0;
+    std::fill(pileups.begin(), pileups.end(), 0);
+    std::fill(intervals.begin(), intervals.end(), 0);
+    long_intervals = 0;
+    long_interval_sum = 0;
+    out_of_order = 0;
+}
+
+double channel::span() const {
+    return last_time - first_time;
+}
+
+double channel::observed_rate() const {
+    if (events < 2 || span() <= 0) {
+        return 0;
+    }
+    return double(events - 1) / span();
+}
+
+double channel::true_rate() const {
+    if (long_intervals == 0 || long_interval_sum <= 0) {
+        return observed_rate();
+    }
+    return double(long_intervals) / long_interval_sum;
+}
+
+double channel::dead_time() const {
+    const double observed = observed_rate();
+    const double actual = true_rate();
+    if (observed == 0 || actual == 0) {
+        return 0;
+    }
+    return std::max(1.0 / observed - 1.0 / actual, 0.0);
+}
+
+double channel::dead_fraction() const {
+    const double actual = true_rate();
+    if (actual == 0) {
+        return 0;
+    }
+    return std::min(std::max(1.0 - observed_rate() / actual, 0.0), 1.0);
+}
+
+double channel::live_time() const {
+    return span() * (1.0 - dead_fraction());
+}
+
+double channel::pileup_fraction(size_t window) const {
+    if (window >= pileups.size()) {
+        throw error(error::code::invalid_value,
+            "pileup: invalid window: " + std::to_string(window));
+    }
+    if (events == 0) {
+        return 0;
+    }
+    return double(pileups[window]) / double(events);
+}
+
+void channel::output(std::ostream& out) const {
+    util::ostream_guard flags(out);
+    out << "crate=" << int(crate) << " slot=" << int(slot) << " channel=" << int(channel_number)
+        << " events=" << events << std::setprecision(6) << " observed=" << observed_rate()
+        << " true=" << true_rate() << " dead-time=" << dead_time() * 1e6
+        << "us dead=" << dead_fraction() * 100 << "% live=" << live_time() << 's';
+    for (size_t w = 0; w < pileups.size(); ++w) {
+        out << " pileup[" << w << "]=" << pileup_fraction(w) * 100 << '%';
+    }
+}
+
+cross_check::cross_check() : true_rate(0), stats_rate(0), live_time(0), stats_live_time(0) {}
+
+double cross_check::rate_ratio() const {
+    if (stats_rate == 0) {
+        return 0;
+    }
+    return true_rate / stats_rate;
+}
+
+double cross_check::live_time_ratio() const {
+    if (stats_live_time == 0) {
+        return 0;
+    }
+    return live_time / stats_live_time;
+}
+
+bool cross_check::agrees(double tolerance) const {
+    return std::abs(rate_ratio() - 1.0) <= tolerance &&
+           std::abs(live_time_ratio() - 1.0) <= tolerance;
+}
+
+void cross_check::output(std::ostream& out) const {
+    util::ostream_guard flags(out);
+    out << std::setprecision(6) << "rate=" << true_rate << " stats-rate=" << stats_rate
+        << " live-time=" << live_time << "s stats-live-time=" << stats_live_time << 's';
+}
+
+estimator::estimator(const config& cfg_)
+    : cfg(cfg_), inverse_bin_width(0), unknown_(0) {
+    if (cfg.bin_width <= 0 || cfg.bins == 0) {
+        throw error(error::code::invalid_value, "pileup: invalid histogram");
+    }
+    if (cfg.resolving_time < 0) {
+        throw error(error::code::invalid_value, "pileup: invalid resolving time");
+    }
+    for (auto window : cfg.windows) {
+        if (window <= 0) {
+            throw error(error::code::invalid_value, "pileup: invalid window");
+        }
+    }
+    inverse_bin_width = 1.0 / cfg.bin_width;
+}
+
+void estimator::add_channel(uint8_t crate, uint8_t slot, uint8_t channel_number) {
+    channel_key::check("pileup", crate, slot, channel_number);
+    auto k = channel_key::make(crate, slot, channel_number);
+    if (k >= rows.size()) {
+        rows.resize(k + 1, 0);
+    }
+    if (rows[k] == 0) {
+        channel chan(cfg);
+        chan.crate = crate;
+        chan.slot = slot;
+        chan.channel_number = channel_number;
+        chans.push_back(chan);
+        rows[k] = uint32_t(chans.size());
+    }
+}
+
+void estimator::add_module(uint8_t crate, uint8_t slot, size_t num_channels) {
+    for (size_t c = 0; c < num_channels; ++c) {
+        add_channel(crate, slot, uint8_t(c));
+    }
+}
+
+void estimator::add(uint8_t crate, uint8_t slot, uint8_t channel_number, double time) {
+    uint32_t row = 0;
+    if (channel_key::valid(crate, slot, channel_number)) {
+        auto k = channel_key::make(crate, slot, channel_number);
+        row = k < rows.size() ? rows[k] : 0;
+    }
+    if (row == 0) {
+        ++unknown_;
+        return;
+    }
+    auto& chan = chans[row - 1];
+    if (chan.events == 0) {
+        chan.first_time = time;
+        chan.last_time = time;
+        chan.events = 1;
+        return;
+    }
+    const double interval = time - chan.last_time;
+    if (interval < 0) {
+        ++chan.out_of_order;
+        return;
+    }
+    ++chan.events;
+    chan.last_time = time;
+    const double bin = interval * inverse_bin_width;
+    ++chan.intervals[bin < double(cfg.bins) ? size_t(bin) : cfg.bins];
+    for (size_t w = 0; w < cfg.windows.size(); ++w) {
+        if (interval < cfg.windows[w]) {
+            ++chan.pileups[w];
+        }
+    }
+    if (interval >= cfg.resolving_time) {
+        ++chan.long_intervals;
+        chan.long_interval_sum += interval - cfg.resolving_time;
+    }
+}
+
+void estimator::add(const list_mode::record& rec) {
+    if (!channel_key::valid(rec.crate_id, rec.slot_id, rec.channel_number)) {
+        ++unknown_;
+        return;
+    }
+    add(uint8_t(rec.crate_id), uint8_t(rec.slot_id), uint8_t(rec.channel_number),
+        rec.time.count());
+}
+
+void estimator::add(const list_mode::records& recs) {
+    for (auto& rec : recs) {
+        add(rec);
+    }
+}
+
+void estimator::add(const columnar::batch& events) {
+    const columnar::columns needed = columnar::column::time | columnar::column::crate |
+                                     columnar::column::slot | columnar::column::channel;
+    if ((events.present & needed) != needed) {
+        throw error(error::code::invalid_value,
+            "pileup: batch needs time, crate, slot and channel");
+    }
+    for (size_t e = 0; e < events.size; ++e) {
+        add(events.crate[e], events.slot[e], events.channel[e], events.time[e]);
+    }
+}
+
+void estimator::clear() {
+    for (auto& chan : chans) {
+        chan.clear();
+    }
+    unknown_ = 0;
+}
+
+bool estimator::has(uint8_t crate, uint8_t slot, uint8_t channel_number) const {
+    if (!channel_key::valid(crate, slot, channel_number)) {
+        return false;
+    }
+    auto k = channel_key::make(crate, slot, channel_number);
+    return k < rows.size() && rows[k] != 0;
+}
+
+const channel& estimator::get(uint8_t crate, uint8_t slot, uint8_t channel_number) const {
+    if (!has(crate, slot, channel_number)) {
+        throw error(error::code::invalid_value,
+            "pileup: channel not found: crate=" + std::to_string(crate) +
+                " slot=" + std::to_string(slot) + " channel=" + std::to_string(channel_number));
+    }
+    return chans[rows[channel_key::make(crate, slot, channel_number)] - 1];
+}
+
+const std::vector<channel>& estimator::channels() const {
+    return chans;
+}
+
+size_t estimator::unknown() const {
+    return unknown_;
+}
+
+cross_check estimator::check(uint8_t crate, uint8_t slot, uint8_t channel_number,
+    const stats::channel& stats) const {
+    auto& chan = get(crate, slot, channel_number);
+    cross_check result;
+    result.true_rate = chan.true_rate();
+    result.live_time = chan.live_time();
+    result.stats_rate = stats.input_count_rate();
+    result.stats_live_time = stats.live_time();
+    return result;
+}
+
+}  // namespace pileup
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
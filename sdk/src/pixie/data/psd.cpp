@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file psd.cpp
+ * @brief Implements pulse shape discrimination of decoded events.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <pixie/data/channel_key.hpp>
+#include <pixie/data/psd.hpp>
+
+namespace xia {
+namespace pixie {
+namespace data {
+namespace psd {
+
+static const double not_a_value = std::numeric_limits<double>::quiet_NaN();
+
+/*
+ * The weighted sums of a run of events. The weights are held in
+ * registers and the sums of an event are contiguous so the loop
+ * vectorizes.
+ */
+static void qdc_kernel(const qdc_gates& gates, const uint32_t* sums, double* psd, size_t count) {
+    const auto& tail = gates.tail;
+    const auto& total = gates.total;
+    for (size_t e = 0; e < count; ++e) {
+        const uint32_t* qdc = sums + e * columnar::qdc_sums;
+        double t = 0;
+        double a = 0;
+        for (size_t s = 0; s < columnar::qdc_sums; ++s) {
+            t += tail[s] * double(qdc[s]);
+            a += total[s] * double(qdc[s]);
+        }
+        psd[e] = a != 0 ? t / a : not_a_value;
+    }
+}
+
+static double trace_sum(const uint16_t* samples, size_t start, size_t length) {
+    double sum = 0;
+    for (size_t s = start; s < start + length; ++s) {
+        sum += samples[s];
+    }
+    return sum;
+}
+
+qdc_gates::qdc_gates() : tail({0, 0, 0, 1, 1, 1, 1, 1}), total({0, 1, 1, 1, 1, 1, 1, 1}) {}
+
+trace_gates::trace_gates()
+    : baseline_start(0), baseline_length(10), total_start(10), total_length(60),
+      tail_start(25), tail_length(45) {}
+
+size_t trace_gates::length() const {
+    return std::max(baseline_start + baseline_length,
+        std::max(total_start + total_length, tail_start + tail_length));
+}
+
+histogram::histogram()
+    : energy_bins(0), energy_min(0), energy_max(0), psd_bins(0), psd_min(0), psd_max(0),
+      outside(0) {}
+
+void histogram::setup(size_t energy_bins_, double energy_min_, double energy_max_,
+    size_t psd_bins_, double psd_min_, double psd_max_) {
+    if (energy_bins_ == 0 || psd_bins_ == 0 || energy_max_ <= energy_min_ ||
+        psd_max_ <= psd_min_) {
+        throw error(error::code::invalid_value, "psd: invalid histogram");
+    }
+    energy_bins = energy_bins_;
+    energy_min = energy_min_;
+    energy_max = energy_max_;
+    psd_bins = psd_bins_;
+    psd_min = psd_min_;
+    psd_max = psd_max_;
+    counts.assign(energy_bins * psd_bins, 0);
+    outside = 0;
+}
+
+void histogram::clear() {
+    std::fill(counts.begin(), counts.end(), 0);
+    outside = 0;
+}
+
+void histogram::fill(double energy, double psd) {
+    const double e = (energy - energy_min) * double(energy_bins) / (energy_max - energy_min);
+    const double p = (psd - psd_min) * double(psd_bins) / (psd_max - psd_min);
+    if (e >= 0 && e < double(energy_bins) && p >= 0 && p < double(psd_bins)) {
+        ++counts[size_t(e) * psd_bins + size_t(p)];
+    } else {
+        ++outside;
+    }
+}
+
+uint64_t histogram::at(size_t energy_bin, size_t psd_bin) const {
+    if (energy_bin >= energy_bins || psd_bin >= psd_bins) {
+        throw error(error::code::invalid_value, "psd: histogram bin out of range");
+    }
+    return counts[energy_bin * psd_bins + psd_bin];
+}
+
+uint64_t histogram::total() const {
+    uint64_t sum = 0;
+    for (auto count : counts) {
+        sum += count;
+    }
+    return sum;
+}
+
+channel::channel() : crate(0), slot(0), channel_number(0), invalid(0) {}
+
+config::config()
+    : source(psd::source::qdc), energy_bins(1024), energy_min(0), energy_max(65536),
+      psd_bins(256), psd_min(0), psd_max(1), threads(0) {}
+
+analyzer::analyzer(const config& cfg_, thread_pool::pool* pool) : cfg(cfg_), workers(pool) {
+    histogram check;
+    check.setup(cfg.energy_bins, cfg.energy_min, cfg.energy_max, cfg.psd_bins, cfg.psd_min,
+        cfg.psd_max);
+    if (cfg.source == source::trace &&
+        (cfg.trace.baseline_length == 0 || cfg.trace.total_length == 0)) {
+        throw error(error::code::invalid_value, "psd: invalid trace gates");
+    }
+    if (workers == nullptr) {
+        owned_workers.reset(new thread_pool::pool(cfg.threads));
+        workers = owned_workers.get();
+    }
+}
+
+void analyzer::ratios(const columnar::batch& events, std::vector<double>& psd) const {
+    psd.resize(events.size);
+    if (cfg.source == source::qdc) {
+        if (!events.has(columnar::column::qdc)) {
+            throw error(error::code::invalid_value, "psd: batch has no QDC column");
+        }
+        qdc_kernel(cfg.qdc, events.qdc.data(), psd.data(), events.size);
+    } else {
+        if (!events.has(columnar::column::trace)) {
+            throw error(error::code::invalid_value, "psd: batch has no trace column");
+        }
+        const auto& gates = cfg.trace;
+        const size_t length = gates.length();
+        for (size_t e = 0; e < events.size; ++e) {
+            const size_t first = events.trace_offset[e];
+            if (events.trace_offset[e + 1] - first < length) {
+                psd[e] = not_a_value;
+                continue;
+            }
+            const uint16_t* samples = events.trace.data() + first;
+            const double baseline =
+                trace_sum(samples, gates.baseline_start, gates.baseline_length) /
+                double(gates.baseline_length);
+            const double tail = trace_sum(samples, gates.tail_start, gates.tail_length) -
+                                baseline * double(gates.tail_length);
+            const double total = trace_sum(samples, gates.total_start, gates.total_length) -
+                                 baseline * double(gates.total_length);
+            psd[e] = total != 0 ? tail / total : not_a_value;
+        }
+    }
+}
+
+void analyzer::analyze(const columnar::batch& events) {
+    std::vector<double> psd;
+    analyze(events, psd);
+}
+
+void analyzer::analyze(const columnar::batch& events, std::vector<double>& psd) {
+    const columnar::columns needed = columnar::column::energy | columnar::column::crate |
+                                     columnar::column::slot | columnar::column::channel;
+    if ((events.present & needed) != needed) {
+        throw error(error::code::invalid_value,
+            "psd: batch needs energy, crate, slot and channel");
+    }
+    ratios(events, psd);
+
+    /*
+     * Split the batch into runs of a channel. New channels are added here
+     * so the threads do not change the channel list.
+     */
+    struct run {
+        size_t row;
+        size_t first;
+        size_t count;
+    };
+    std::vector<run> runs;
+    size_t first = 0;
+    while (first < events.size) {
+        const uint8_t crate = events.crate[first];
+        const uint8_t slot = events.slot[first];
+        const uint8_t channel_number = events.channel[first];
+        size_t last = first + 1;
+        while (last < events.size && events.channel[last] == channel_number &&
+               events.slot[last] == slot && events.crate[last] == crate) {
+            ++last;
+        }
+        if (channel_key::valid(crate, slot, channel_number)) {
+            runs.push_back({find_or_add(crate, slot, channel_number), first, last - first});
+        }
+        first = last;
+    }
+
+    auto fill = [this, &events, &psd, &runs](size_t task, size_t tasks) {
+        for (auto& r : runs) {
+            if ((r.row % tasks) != task) {
+                continue;
+            }
+            auto& chan = chans[r.row];
+            for (size_t e = r.first; e < r.first + r.count; ++e) {
+                if (std::isnan(psd[e])) {
+                    ++chan.invalid;
+                } else {
+                    chan.hist.fill(events.energy[e], psd[e]);
+                }
+            }
+        }
+    };
+
+    const size_t tasks = std::min(workers->size(), chans.size());
+    if (tasks <= 1) {
+        fill(0, 1);
+        return;
+    }
+    thread_pool::group filling(*workers);
+    for (size_t t = 0; t < tasks; ++t) {
+        filling.run([&fill, t, tasks] { fill(t, tasks); });
+    }
+    filling.check("psd: analyze");
+}
+
+void analyzer::clear() {
+    for (auto& chan : chans) {
+        chan.invalid = 0;
+        chan.hist.clear();
+    }
+}
+
+bool analyzer::has(uint8_t crate, uint8_t slot, uint8_t channel_number) const {
+    if (!channel_key::valid(crate, slot, channel_number)) {
+        return false;
+    }
+    auto k = channel_key::make(crate, slot, channel_number);
+    return k < rows.size() && rows[k] != 0;
+}
+
+const channel& analyzer::get(uint8_t crate, uint8_t slot, uint8_t channel_number) const {
+    if (!has(crate, slot, channel_number)) {
+        throw error(error::code::invalid_value,
+            "psd: channel not found: crate=" + std::to_string(crate) +
+                " slot=" + std::to_string(slot) + " channel=" + std::to_string(channel_number));
+    }
+    return chans[rows[channel_key::make(crate, slot, channel_number)] - 1];
+}
+
+const std::vector<channel>& analyzer::channels() const {
+    return chans;
+}
+
+size_t analyzer::find_or_add(uint8_t crate, uint8_t slot, uint8_t channel_number) {
+    auto k = channel_key::make(crate, slot, channel_number);
+    if (k >= rows.size()) {
+        rows.resize(k + 1, 0);
+    }
+    if (rows[k] == 0) {
+        channel chan;
+        chan.crate = crate;
+        chan.slot = slot;
+        chan.channel_number = channel_number;
+        chan.hist.setup(cfg.energy_bins, cfg.energy_min, cfg.energy_max, cfg.psd_bins,
+            cfg.psd_min, cfg.psd_max);
+        chans.push_back(chan);
+        rows[k] = uint32_t(chans.size());
+    }
+    return rows[k] - 1;
+}
+
+}  // namespace psd
+}  // namespace data
+}  // namespace pixie
+}  // namespace xia
@@ -47,6 +47,7 @@ static const std::map<code, result_code> result_codes = {
     {code::crate_already_open, {100, "crate already open"}},
     {code::crate_not_ready, {101, "crate not ready"}},
     {code::crate_invalid_param, {102, "invalid system parameter"}},
+    {code::crate_busy, {103, "crate busy"}},
     /*
      * Module
      */
@@ -130,6 +131,7 @@ static const std::map<code, result_code> result_codes = {
     {code::buffer_pool_not_empty, {805, "buffer pool not empty"}},
     {code::buffer_pool_busy, {806, "buffer pool bust"}},
     {code::buffer_pool_not_enough, {807, "buffer pool not enough"}},
+    {code::thread_pool_busy, {808, "thread pool busy"}},
     /*
      * Catch all
      */
@@ -193,6 +193,11 @@ size_t firmware::words() {
     return ((size_t(data.size()) - 1) / sizeof(image_value_type)) + 1;
 }
 
+size_t firmware::bytes() {
+    lock_guard guard(lock);
+    return data.size();
+}
+
 bool firmware::operator==(const firmware& fw) const {
     return fw.version == version && fw.mod_revision == mod_revision &&
            fw.mod_adc_msps == mod_adc_msps && fw.mod_adc_bits == mod_adc_bits &&
@@ -222,6 +227,10 @@ std::string tag(const int revision, const int adc_msps, const int adc_bits) {
            std::to_string(adc_bits);
 }
 
+size_t loaded_bytes() {
+    return total_image_size.load();
+}
+
 void add(crate& firmwares, firmware& fw) {
     auto mi = firmwares.find(fw.tag);
     if (mi == std::end(firmwares)) {
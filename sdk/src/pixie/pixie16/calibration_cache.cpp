@@ -0,0 +1,446 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file calibration_cache.cpp
+ * @brief Implements a persistent cache of the module channel calibrations.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <pixie/log.hpp>
+#include <pixie/util.hpp>
+
+#include <pixie/pixie16/calibration_cache.hpp>
+#include <pixie/pixie16/channel.hpp>
+#include <pixie/pixie16/defs.hpp>
+#include <pixie/pixie16/fixture.hpp>
+#include <pixie/pixie16/module.hpp>
+
+#include <nolhmann/json.hpp>
+
+namespace xia {
+namespace pixie {
+namespace calibration_cache {
+using json = nlohmann::json;
+
+const int cache::format = 1;
+
+/*
+ * The channel variables the calibration depends on and the bits of each
+ * that matter. The offset depends on the gain and polarity in CSRA and
+ * the baseline cut on the energy filter.
+ */
+struct setting_var {
+    param::channel_var var;
+    param::value_type mask;
+};
+
+static const setting_var setting_vars[] = {
+    {param::channel_var::BaselinePercent, ~param::value_type(0)},
+    {param::channel_var::ChanCSRa, 1 << hw::bit::CCSRA_POLARITY | 1 << hw::bit::CCSRA_ENARELAY},
+    {param::channel_var::SlowLength, ~param::value_type(0)},
+    {param::channel_var::SlowGap, ~param::value_type(0)}
+};
+
+static void throw_json_error(json::exception& e, const std::string& what) {
+    throw error(error::code::config_json_error, "calibration cache: " + what + ": " + e.what());
+}
+
+static std::string dbs_label(pixie::module::module& module) {
+    std::string label;
+    for (auto& db : module.eeprom.dbs) {
+        if (!label.empty()) {
+            label += ',';
+        }
+        label += db.label + '@' + std::to_string(db.position);
+    }
+    return label;
+}
+
+static std::string firmware_label(pixie::module::module& module) {
+    std::vector<std::string> fws;
+    for (auto& fw : module.firmware) {
+        fws.push_back(fw->tag + '/' + fw->device + '/' + fw->version);
+    }
+    std::sort(fws.begin(), fws.end());
+    std::string label;
+    for (auto& fw : fws) {
+        if (!label.empty()) {
+            label += ',';
+        }
+        label += fw;
+    }
+    return label;
+}
+
+static void wait_dac_settle_period(pixie::module::module& module) {
+    int settle_period = module.fixtures->dac_settle_period();
+    if (settle_period > 0) {
+        hw::wait(settle_period * 1000);
+    }
+}
+
+channel::channel() : number(0), offset_dac(0), bl_cut(0), preamp_tau(0) {}
+
+module::module() : serial_num(0) {}
+
+const channel* module::find(size_t number) const {
+    for (auto& chan : channels) {
+        if (chan.number == number) {
+            return &chan;
+        }
+    }
+    return nullptr;
+}
+
+counts::counts() {
+    clear();
+}
+
+void counts::clear() {
+    channels = 0;
+    restored = 0;
+    missing = 0;
+    failed = 0;
+    recalibrated = 0;
+    unverified = 0;
+    usecs = 0;
+}
+
+cache::cache() : tolerance_percent(2.0), find_tau(true) {}
+
+bool cache::load(const std::string& file) {
+    std::ifstream input(file);
+    if (!input) {
+        if (errno == ENOENT) {
+            xia_log(log::info) << "calibration cache: not found: " << file;
+            return false;
+        }
+        throw error(error::code::file_open_failure,
+                    "calibration cache: open: " + file + ": " + std::strerror(errno));
+    }
+    json cached;
+    try {
+        cached = json::parse(input);
+    } catch (json::exception& e) {
+        throw_json_error(e, "parse: " + file);
+    }
+    std::map<std::string, calibration_cache::module> loaded;
+    try {
+        if (cached.at("format").get<int>() != format) {
+            throw error(error::code::config_json_error,
+                        "calibration cache: invalid format: " + file);
+        }
+        for (auto& jmod : cached.at("modules")) {
+            calibration_cache::module mod;
+            mod.key = jmod.at("key").get<std::string>();
+            mod.serial_num = jmod.at("serial-num").get<int>();
+            mod.dbs = jmod.at("dbs").get<std::string>();
+            mod.firmware = jmod.at("firmware").get<std::string>();
+            for (auto& jchan : jmod.at("channels")) {
+                channel chan;
+                chan.number = jchan.at("channel").get<size_t>();
+                chan.offset_dac = jchan.at("OffsetDAC").get<param::value_type>();
+                chan.bl_cut = jchan.at("BLcut").get<param::value_type>();
+                chan.preamp_tau = jchan.at("PreampTau").get<param::value_type>();
+                for (auto& el : jchan.at("settings").items()) {
+                    chan.settings[el.key()] = el.value().get<param::value_type>();
+                }
+                mod.channels.push_back(chan);
+            }
+            loaded[mod.key] = mod;
+        }
+    } catch (json::exception& e) {
+        throw_json_error(e, "load: " + file);
+    }
+    modules.swap(loaded);
+    xia_log(log::info) << "calibration cache: loaded: " << file << " modules=" << modules.size();
+    return true;
+}
+
+void cache::save(const std::string& file) const {
+    json cached;
+    cached["format"] = format;
+    cached["modules"] = json::array();
+    for (auto& entry : modules) {
+        auto& mod = entry.second;
+        json jmod;
+        jmod["key"] = mod.key;
+        jmod["serial-num"] = mod.serial_num;
+        jmod["dbs"] = mod.dbs;
+        jmod["firmware"] = mod.firmware;
+        jmod["channels"] = json::array();
+        for (auto& chan : mod.channels) {
+            json jchan;
+            jchan["channel"] = chan.number;
+            jchan["OffsetDAC"] = chan.offset_dac;
+            jchan["BLcut"] = chan.bl_cut;
+            jchan["PreampTau"] = chan.preamp_tau;
+            jchan["settings"] = json::object();
+            for (auto& setting : chan.settings) {
+                jchan["settings"][setting.first] = setting.second;
+            }
+            jmod["channels"].push_back(jchan);
+        }
+        cached["modules"].push_back(jmod);
+    }
+    /*
+     * Write a temporary file and replace the cache so a failed write
+     * does not lose the cache.
+     */
+    const std::string temp = file + ".tmp";
+    {
+        std::ofstream output(temp);
+        if (!output) {
+            throw error(error::code::file_create_failure,
+                        "calibration cache: create: " + temp + ": " + std::strerror(errno));
+        }
+        output << cached.dump(2) << std::endl;
+        if (!output) {
+            throw error(error::code::file_create_failure,
+                        "calibration cache: write: " + temp + ": " + std::strerror(errno));
+        }
+    }
+    if (std::rename(temp.c_str(), file.c_str()) != 0) {
+        const std::string what = std::strerror(errno);
+        std::remove(temp.c_str());
+        throw error(error::code::file_create_failure,
+                    "calibration cache: rename: " + file + ": " + what);
+    }
+    xia_log(log::info) << "calibration cache: saved: " << file << " modules=" << modules.size();
+}
+
+void cache::record(pixie::module::module& module) {
+    calibration_cache::module mod;
+    mod.key = key(module);
+    mod.serial_num = module.serial_num;
+    mod.dbs = dbs_label(module);
+    mod.firmware = firmware_label(module);
+    for (size_t chan = 0; chan < module.num_channels; ++chan) {
+        channel cal;
+        cal.number = chan;
+        cal.offset_dac = module.read_var(param::channel_var::OffsetDAC, chan);
+        cal.bl_cut = module.read_var(param::channel_var::BLcut, chan);
+        cal.preamp_tau = module.read_var(param::channel_var::PreampTau, chan);
+        read_settings(module, chan, cal.settings);
+        mod.channels.push_back(cal);
+    }
+    xia_log(log::info) << pixie::module::module_label(module, "calibration cache")
+                       << "record: " << mod.key;
+    modules[mod.key] = mod;
+}
+
+void cache::restore(pixie::module::module& module, counts& result, bool recalibrate) {
+    const std::string label = pixie::module::module_label(module, "calibration cache");
+    util::timepoint tp(true);
+    result.clear();
+    result.channels = module.num_channels;
+
+    std::vector<size_t> applied;
+    std::vector<size_t> recal;
+
+    auto entry = modules.find(key(module));
+    for (size_t chan = 0; chan < module.num_channels; ++chan) {
+        const channel* cal = nullptr;
+        if (entry != modules.end()) {
+            cal = entry->second.find(chan);
+        }
+        if (cal != nullptr) {
+            settings values;
+            read_settings(module, chan, values);
+            if (values != cal->settings) {
+                xia_log(log::info) << label << "channel=" << chan << " settings changed";
+                cal = nullptr;
+            }
+        }
+        if (cal == nullptr) {
+            ++result.missing;
+            recal.push_back(chan);
+            continue;
+        }
+        module.write_var(param::channel_var::OffsetDAC, cal->offset_dac, chan);
+        module.write_var(param::channel_var::BLcut, cal->bl_cut, chan);
+        module.write_var(param::channel_var::PreampTau, cal->preamp_tau, chan);
+        applied.push_back(chan);
+    }
+
+    std::vector<size_t> good;
+    if (!applied.empty()) {
+        module.set_dacs();
+        wait_dac_settle_period(module);
+        std::vector<size_t> failed;
+        verify(module, applied, failed);
+        result.failed = failed.size();
+        result.restored = applied.size() - failed.size();
+        std::set_difference(applied.begin(), applied.end(), failed.begin(), failed.end(),
+                            std::back_inserter(good));
+        recal.insert(recal.end(), failed.begin(), failed.end());
+        std::sort(recal.begin(), recal.end());
+    }
+
+    if (recalibrate && !recal.empty()) {
+        this->recalibrate(module, recal, good);
+        std::vector<size_t> failed;
+        verify(module, recal, failed);
+        result.recalibrated = recal.size();
+        result.unverified = failed.size();
+        record(module);
+        /*
+         * Do not keep a calibration that did not verify, the channel is
+         * recalibrated the next time.
+         */
+        if (!failed.empty()) {
+            auto& channels = modules[key(module)].channels;
+            channels.erase(std::remove_if(channels.begin(), channels.end(),
+                                          [&failed](const channel& chan) {
+                                              return std::find(failed.begin(), failed.end(),
+                                                               chan.number) != failed.end();
+                                          }),
+                           channels.end());
+        }
+    }
+
+    tp.end();
+    result.usecs = tp.usecs();
+    xia_log(log::info) << label << "restore: restored=" << result.restored
+                       << " missing=" << result.missing << " failed=" << result.failed
+                       << " recalibrated=" << result.recalibrated
+                       << " unverified=" << result.unverified << " duration=" << tp;
+}
+
+bool cache::has(pixie::module::module& module) const {
+    return modules.find(key(module)) != modules.end();
+}
+
+const calibration_cache::module& cache::get(pixie::module::module& module) const {
+    auto entry = modules.find(key(module));
+    if (entry == modules.end()) {
+        throw error(error::code::invalid_value, "calibration cache: module not found");
+    }
+    return entry->second;
+}
+
+size_t cache::size() const {
+    return modules.size();
+}
+
+void cache::clear() {
+    modules.clear();
+}
+
+void cache::verify(pixie::module::module& module, const std::vector<size_t>& chans,
+                   std::vector<size_t>& failed) {
+    const std::string label = pixie::module::module_label(module, "calibration cache");
+    failed.clear();
+    module.get_traces();
+    for (auto chan : chans) {
+        hw::adc_trace trace;
+        module.read_adc(chan, trace, false);
+        const double percent = double(module.read_var(param::channel_var::BaselinePercent, chan));
+        int baseline;
+        if (!baseline_valid(trace, module.channels[chan].fixture->config.adc_bits, percent,
+                            tolerance_percent, baseline)) {
+            xia_log(log::info) << label << "verify: channel=" << chan
+                               << " failed: baseline=" << baseline;
+            failed.push_back(chan);
+        }
+    }
+}
+
+void cache::recalibrate(pixie::module::module& module, const std::vector<size_t>& chans,
+                        const std::vector<size_t>& good) {
+    xia_log(log::info) << pixie::module::module_label(module, "calibration cache")
+                       << "recalibrate: channels=" << chans.size();
+    /*
+     * Adjusting the offsets is a module task. Put back the offsets of the
+     * channels that passed.
+     */
+    param::values offset_dacs;
+    for (auto chan : good) {
+        offset_dacs.push_back(module.read_var(param::channel_var::OffsetDAC, chan));
+    }
+    module.adjust_offsets();
+    if (!good.empty()) {
+        for (size_t g = 0; g < good.size(); ++g) {
+            module.write_var(param::channel_var::OffsetDAC, offset_dacs[g], good[g]);
+        }
+        module.set_dacs();
+        wait_dac_settle_period(module);
+    }
+    pixie::channel::range range(chans.begin(), chans.end());
+    param::values cuts;
+    module.bl_find_cut(range, cuts);
+    if (find_tau) {
+        module.tau_finder();
+        for (auto chan : chans) {
+            const double tau = module.channels[chan].autotau();
+            if (tau > 0) {
+                module.write_var(param::channel_var::PreampTau,
+                                 param::value_type(util::ieee_float(tau)), chan);
+            }
+        }
+    }
+}
+
+std::string key(pixie::module::module& module) {
+    std::ostringstream oss;
+    oss << "serial=" << module.serial_num << " rev=" << module.revision_label()
+        << " channels=" << module.num_channels << " dbs=" << dbs_label(module)
+        << " firmware=" << firmware_label(module);
+    return oss.str();
+}
+
+void read_settings(pixie::module::module& module, size_t channel, settings& values) {
+    values.clear();
+    for (auto& setting : setting_vars) {
+        auto& desc = module.channel_var_descriptors[int(setting.var)];
+        values[desc.name] = module.read_var(setting.var, channel, 0, false) & setting.mask;
+    }
+    values["SlowFilterRange"] = module.read_var(param::module_var::SlowFilterRange, 0, false);
+}
+
+bool baseline_valid(const hw::adc_trace& trace, int adc_bits, double baseline_percent,
+                    double tolerance_percent, int& baseline) {
+    baseline = 0;
+    if (trace.empty()) {
+        return false;
+    }
+    /*
+     * The median is not moved by the pulses in the trace.
+     */
+    hw::adc_trace samples(trace);
+    auto middle = samples.begin() + samples.size() / 2;
+    std::nth_element(samples.begin(), middle, samples.end());
+    baseline = *middle;
+    const int adc_range = 1 << adc_bits;
+    if (baseline <= 0 || baseline >= adc_range - 1) {
+        return false;
+    }
+    const double target = adc_range * (baseline_percent / 100);
+    const double tolerance = adc_range * (tolerance_percent / 100);
+    return std::abs(baseline - target) <= tolerance;
+}
+}  // namespace calibration_cache
+}  // namespace pixie
+}  // namespace xia
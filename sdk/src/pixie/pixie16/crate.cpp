@@ -21,7 +21,6 @@
  */
 
 #include <algorithm>
-#include <future>
 #include <iomanip>
 #include <sstream>
 
@@ -44,9 +43,16 @@ crate::user::~user() {
     --crate_.users_;
 }
 
-crate::crate() : num_modules(0), revision(-1), ready_(false), users_(0) {}
+crate::crate() : id(-1), num_modules(0), revision(-1), ready_(false), users_(0) {}
 
-crate::~crate() {}
+crate::~crate() {
+    for (auto& module : modules) {
+        module->run_notices.forward(nullptr);
+    }
+    for (auto& module : offline) {
+        module->run_notices.forward(nullptr);
+    }
+}
 
 void crate::ready() {
     if (!ready_.load()) {
@@ -63,7 +69,7 @@ int crate::users() const {
 }
 
 void crate::initialize(bool reg_trace) {
-    xia_log(log::info) << "crate: initialise";
+    xia_log(log::info) << "crate: initialise: id=" << id;
 
     /*
      * Set ready to true and if there is an issue return it to false.
@@ -83,6 +89,21 @@ void crate::initialize(bool reg_trace) {
             module::module& module = *module_ptr;
             bool last_module_found = false;
 
+            /*
+             * Leave the modules on other crates' buses closed.
+             */
+            if (!pci_buses.empty()) {
+                int bus = module.find_pci_bus(device_number);
+                if (bus >= 0 && !owns(bus)) {
+                    xia_log(log::info) << "module: device " << device_number
+                                       << ": not owned by crate: pci-bus:" << bus;
+                    modules.pop_back();
+                    continue;
+                }
+            }
+
+            module.run_notices.forward(&run_notices);
+
             try {
                 module.module_var_descriptors =
                     param::module_var_descs(param::get_module_var_descriptors());
@@ -95,6 +116,14 @@ void crate::initialize(bool reg_trace) {
                 xia_log(log::error) << "module: device " << device_number << ": error: " << e.what();
             }
 
+            if (module.present() && !owns(module.pci_bus())) {
+                xia_log(log::info) << "module: device " << device_number
+                                   << ": not owned by crate: pci-bus:" << module.pci_bus();
+                module.close();
+                modules.pop_back();
+                continue;
+            }
+
             if (module.present()) {
                 xia_log(log::info) << "module: device " << device_number << ": slot:" << module.slot
                                    << " serial-number:" << module.serial_num
@@ -185,47 +214,18 @@ void crate::boot(const bool force) {
     ready();
     lock_guard guard(lock_);
 
-    typedef std::promise<error::code> promise_error;
-    typedef std::future<error::code> future_error;
-
-    std::vector<promise_error> promises(modules.size());
-    std::vector<future_error> futures;
-    std::vector<std::thread> threads;
+    thread_pool::group booting(workers);
 
-    for (size_t m = 0; m < modules.size(); ++m) {
-        auto module = modules[m];
+    for (auto module : modules) {
         if (module->revision == 0 || (!force && module->online())) {
             continue;
         }
-        futures.push_back(future_error(promises[m].get_future()));
-        threads.push_back(std::thread([m, &promises, module] {
-            try {
-                module->boot();
-                promises[m].set_value(error::code::success);
-            } catch (pixie::error::error& e) {
-                promises[m].set_value(e.type);
-            } catch (...) {
-                try {
-                    promises[m].set_exception(std::current_exception());
-                } catch (...) {
-                }
-            }
-        }));
+        booting.run([module] { module->boot(); });
     }
 
-    error::code first_error = error::code::success;
+    booting.check("crate boot error");
 
-    for (size_t t = 0; t < threads.size(); ++t) {
-        error::code e = futures[t].get();
-        if (first_error == error::code::success) {
-            first_error = e;
-        }
-        threads[t].join();
-    }
-
-    if (first_error != error::code::success) {
-        throw error(first_error, "crate boot error; see log");
-    }
+    write_id();
 
     backplane.reinit(modules);
 }
@@ -262,56 +262,139 @@ void crate::import_config(const std::string json_file, module::number_slots& loa
             module->sync_vars();
         }
     }
+    write_id();
     backplane.reinit(modules);
 }
 
+void crate::write_id() {
+    if (id < 0) {
+        return;
+    }
+    if (id > max_id) {
+        throw error(error::code::crate_invalid_param, "crate id out of range");
+    }
+    lock_guard guard(lock_);
+    for (auto& module : modules) {
+        if (module->online()) {
+            module->write(param::module_param::crateid, param::value_type(id));
+        }
+    }
+}
+
 void crate::initialize_afe() {
     xia_log(log::info) << "crate: initializing analog front-end";
 
     ready();
     lock_guard guard(lock_);
 
-    typedef std::promise<error::code> promise_error;
-    typedef std::future<error::code> future_error;
+    thread_pool::group initializing(workers);
 
-    std::vector<promise_error> promises(modules.size());
-    std::vector<future_error> futures;
-    std::vector<std::thread> threads;
+    for (auto module : modules) {
+        if (!module->online()) {
+            continue;
+        }
+        initializing.run([module] { module->sync_hw(); });
+    }
+
+    initializing.check("crate AFE intialize error");
+}
+
+void crate::broadcast(const size_t source_module, const size_t source_channel,
+                      const unsigned int filter_mask, const channel_masks& channels) {
+    xia_log(log::info) << "crate: broadcast: source module=" << source_module
+                       << " channel=" << source_channel << " filter=0x" << std::hex
+                       << filter_mask;
+    ready();
+    /*
+     * Take a copy of the source so the source module can also be a
+     * destination.
+     */
+    auto& module = (*this)[source_module];
+    module.online_check();
+    const param::channel_variables source(module[source_channel].vars);
+    broadcast(channels, [&source, filter_mask](module::module& module, const uint32_t mask) {
+        module.broadcast(source, filter_mask, mask);
+    });
+}
+
+void crate::broadcast(const module::module::param_values& params, const channel_masks& channels) {
+    xia_log(log::info) << "crate: broadcast: params=" << params.size();
+    ready();
+    for (auto& pv : params) {
+        param::lookup_channel_param(pv.first);
+    }
+    broadcast(channels, [&params](module::module& module, const uint32_t mask) {
+        module.broadcast(params, mask);
+    });
+}
+
+void crate::broadcast(const channel_masks& channels, broadcaster update) {
+    lock_guard guard(lock_);
+
+    if (channels.size() > modules.size()) {
+        throw error(pixie::error::code::module_number_invalid,
+                    "broadcast channel masks greater than modules: " +
+                        std::to_string(channels.size()));
+    }
+
+    thread_pool::group updating(workers);
 
     for (size_t m = 0; m < modules.size(); ++m) {
         auto module = modules[m];
-        if (!module->online()) {
+        uint32_t mask = UINT32_MAX >> (hw::max_channels - module->num_channels);
+        if (!channels.empty()) {
+            mask = m < channels.size() ? channels[m] : 0;
+        }
+        if (!module->online() || mask == 0) {
             continue;
         }
-        futures.push_back(future_error(promises[m].get_future()));
-        threads.push_back(std::thread([m, &promises, module] {
+        updating.run([mask, &update, module] {
             try {
-                module->sync_hw();
-                promises[m].set_value(error::code::success);
+                update(*module, mask);
             } catch (pixie::error::error& e) {
-                promises[m].set_value(e.type);
-            } catch (...) {
-                try {
-                    promises[m].set_exception(std::current_exception());
-                } catch (...) {
-                }
+                xia_log(log::error) << e;
+                throw;
             }
-        }));
+        });
     }
 
-    error::code first_error = error::code::success;
+    updating.check("crate broadcast error");
+}
+
+void crate::characterize_fifo(const module::module::throughput_config& config,
+                              module::module::throughput_reports& reports, bool concurrent) {
+    xia_log(log::info) << "crate: characterize FIFO throughput: concurrent="
+                       << std::boolalpha << concurrent;
+
+    ready();
+    lock_guard guard(lock_);
 
-    for (size_t t = 0; t < threads.size(); ++t) {
-        error::code e = futures[t].get();
-        if (first_error == error::code::success) {
-            first_error = e;
+    module::modules tested;
+    for (auto module : modules) {
+        if (module->online()) {
+            tested.push_back(module);
         }
-        threads[t].join();
     }
 
-    if (first_error != error::code::success) {
-        throw error(first_error, "crate AFE intialize error; see log");
+    reports.clear();
+    reports.resize(tested.size());
+
+    if (!concurrent) {
+        for (size_t m = 0; m < tested.size(); ++m) {
+            tested[m]->characterize_fifo(config, reports[m]);
+        }
+        return;
+    }
+
+    thread_pool::group testing(workers);
+
+    for (size_t m = 0; m < tested.size(); ++m) {
+        auto module = tested[m];
+        auto& report = reports[m];
+        testing.run([&config, &report, module] { module->characterize_fifo(config, report); });
     }
+
+    testing.check("crate FIFO characterization error");
 }
 
 void crate::export_config(const std::string json_file) {
@@ -418,6 +501,13 @@ void crate::add_module() {
     modules.push_back(std::make_unique<module::module>(backplane));
 }
 
+bool crate::owns(int pci_bus) const {
+    if (pci_buses.empty()) {
+        return true;
+    }
+    return std::find(pci_buses.begin(), pci_buses.end(), pci_bus) != pci_buses.end();
+}
+
 void crate::check_slots() {
     using duplicate = std::pair<module::module_ptr, module::module_ptr>;
     using duplicates = std::vector<duplicate>;
@@ -240,6 +240,7 @@ struct afe_dbs : public module {
     virtual void set_dacs() override;
     virtual void get_traces() override;
     virtual void adjust_offsets() override;
+    virtual int dac_settle_period() override;
 };
 
 static void unsupported_op(const std::string what) {
@@ -248,17 +249,10 @@ static void unsupported_op(const std::string what) {
 
 static void wait_dac_settle_period(pixie::module::module& mod) {
     /*
-     * Find the longest DB settling period and wait that period of time.
-     *
      * @note this is only ever called for an `afe-dbs` module fixture and
      *       the default daughter board returns 0.
      */
-    int settle_period = 0;
-    for (auto& channel : mod.channels) {
-        int channel_settle_period;
-        channel.fixture->get("DAC_SETTLE_PERIOD", channel_settle_period);
-        settle_period = std::max(settle_period, channel_settle_period);
-    }
+    int settle_period = mod.fixtures->dac_settle_period();
     xia_log(log::debug) << pixie::module::module_label(mod, "afe-dbs: dac-settle-wait")
                         << "period=" << settle_period << " msecs";
     if (settle_period > 0) {
@@ -710,6 +704,19 @@ void afe_dbs::get_traces() {
     }
 }
 
+int afe_dbs::dac_settle_period() {
+    /*
+     * The longest DB settling period.
+     */
+    int settle_period = 0;
+    for (auto& channel : module_.channels) {
+        int channel_settle_period;
+        channel.fixture->get("DAC_SETTLE_PERIOD", channel_settle_period);
+        settle_period = std::max(settle_period, channel_settle_period);
+    }
+    return settle_period;
+}
+
 void afe_dbs::adjust_offsets() {
     const std::string log_leader =
         pixie::module::module_label(module_, "fixture: afe_dbs");
@@ -1031,6 +1038,10 @@ void module::tau_finder() {
     unsupported_op("tau finder is using the DSP");
 }
 
+int module::dac_settle_period() {
+    return 0;
+}
+
 channel_ptr make(pixie::channel::channel& module_channel, const hw::config& config) {
     channel_ptr chan_fixture;
     switch (config.fixture) {
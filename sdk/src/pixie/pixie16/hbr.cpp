@@ -65,6 +65,7 @@ host_bus_request::~host_bus_request() {
 
 void host_bus_request::request(bool force) {
     if (force || !holding) {
+        module.count_hbr_request();
         module.write_word(hw::device::REQUEST_HBR, access.request);
         holding = true;
     }
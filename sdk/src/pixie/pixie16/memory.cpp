@@ -20,6 +20,7 @@
  * @brief Implements data and functions used to access Pixie-16 memory registers.
  */
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 
@@ -63,13 +64,7 @@ word host_bus::read(const size_t offset, const address addr) {
 }
 
 word host_bus::read(const size_t channel, const size_t offset, const address addr) {
-    channel::channel& chan = module[channel];
-    if ( chan.fixture->config.index < 0) {
-        throw error(error::code::channel_invalid_index,
-                    "dsp: invalid index: module=" + std::to_string(module.number) +
-                        " channel=" + std::to_string(channel));
-    }
-    return read(static_cast<hw::address>(addr + chan.fixture->config.index + offset));
+    return read(channel_address(channel, offset, addr));
 }
 
 void host_bus::read(const address addr, word_ptr buffer, const size_t length) {
@@ -110,13 +105,7 @@ void host_bus::write(const size_t offset, const address addr, const word value)
 }
 
 void host_bus::write(const size_t channel, const size_t offset, const address addr, const word value) {
-    channel::channel& chan = module[channel];
-    if (chan.fixture->config.index < 0) {
-        throw error(error::code::channel_invalid_index,
-                    "dsp: invalid index: module=" + std::to_string(module.number) +
-                        " channel=" + std::to_string(channel));
-    }
-    write(static_cast<hw::address>(addr + chan.fixture->config.index + offset), value);
+    write(channel_address(channel, offset, addr), value);
 }
 
 void host_bus::write(const address addr, const words& values) {
@@ -128,6 +117,38 @@ void host_bus::write(const address addr, const words& values) {
     }
 }
 
+void host_bus::write(address_values& values) {
+    if (values.empty()) {
+        return;
+    }
+    std::sort(values.begin(), values.end(),
+              [](const address_value& a, const address_value& b) { return a.first < b.first; });
+    module::module::bus_guard guard(module);
+    hbr::host_bus_request hbr(module, access);
+    size_t runs = 0;
+    address next = values.front().first;
+    for (auto& value : values) {
+        if (runs == 0 || value.first != next) {
+            bus_write(hw::device::EXT_MEM_TEST, value.first);
+            ++runs;
+        }
+        bus_write(hw::device::WRT_DSP_MMA, value.second);
+        next = value.first + 1;
+    }
+    xia_log(log::debug) << module::module_label(module) << "dsp scatter write: words="
+                        << values.size() << " runs=" << runs;
+}
+
+address host_bus::channel_address(const size_t channel, const size_t offset, const address addr) {
+    channel::channel& chan = module[channel];
+    if (chan.fixture->config.index < 0) {
+        throw error(error::code::channel_invalid_index,
+                    "dsp: invalid index: module=" + std::to_string(module.number) +
+                        " channel=" + std::to_string(channel));
+    }
+    return static_cast<hw::address>(addr + chan.fixture->config.index + offset);
+}
+
 void host_bus::dma_read(const address addr, word_ptr buffer, const size_t length) {
     xia_log(log::debug) << module::module_label(module) << "dsp dma read: addr=0x" << std::hex << addr
                         << " length=" << std::dec << length;
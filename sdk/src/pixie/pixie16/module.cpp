@@ -22,14 +22,18 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 
+#include <pixie/error.hpp>
 #include <pixie/log.hpp>
 #include <pixie/util.hpp>
 
+#include <pixie/data/list_mode.hpp>
+
 #include <pixie/pixie16/channel.hpp>
 #include <pixie/pixie16/csr.hpp>
 #include <pixie/pixie16/defs.hpp>
@@ -77,6 +81,113 @@ std::string error::make_what(const int num, const int slot, const char* what_) {
     return oss.str();
 }
 
+const char* run_event_label(const run_event event) {
+    switch (event) {
+    case run_event::started:
+        return "started";
+    case run_event::ended:
+        return "ended";
+    case run_event::fifo_overflow:
+        return "fifo-overflow";
+    case run_event::worker_error:
+        return "worker-error";
+    }
+    return "invalid";
+}
+
+run_notice::run_notice()
+    : event(run_event::started), sequence(0), number(-1), slot(-1),
+      task(hw::run::run_task::nop) {}
+
+std::string run_notice::output() const {
+    std::ostringstream oss;
+    oss << "run-notice: seq=" << sequence << " num=" << number << " slot=" << slot
+        << " event=" << run_event_label(event) << " task=0x" << std::hex << int(task)
+        << std::dec << " what=" << what;
+    return oss.str();
+}
+
+const size_t run_notifier::max_notices = 64;
+
+run_notifier::run_notifier() : last(0), next_handle(1), forward_to(nullptr) {}
+
+size_t run_notifier::add(run_listener listener) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto handle = next_handle++;
+    listeners[handle] = listener;
+    return handle;
+}
+
+void run_notifier::remove(const size_t handle) {
+    std::lock_guard<std::mutex> guard(lock);
+    listeners.erase(handle);
+}
+
+void run_notifier::forward(run_notifier* to) {
+    std::lock_guard<std::mutex> guard(lock);
+    forward_to = to;
+}
+
+void run_notifier::notify(run_notice notice) {
+    std::vector<run_listener> callees;
+    run_notifier* to;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        notice.sequence = ++last;
+        notices.push_back(notice);
+        if (notices.size() > max_notices) {
+            notices.pop_front();
+        }
+        for (auto& listener : listeners) {
+            callees.push_back(listener.second);
+        }
+        to = forward_to;
+    }
+    cv.notify_all();
+    /*
+     * The listeners are called without the lock held so they can add or
+     * remove listeners.
+     */
+    for (auto& callee : callees) {
+        try {
+            callee(notice);
+        } catch (std::exception& e) {
+            xia_log(log::error) << "run notifier: listener: " << e.what();
+        } catch (...) {
+            xia_log(log::error) << "run notifier: listener: unhandled exception";
+        }
+    }
+    if (to != nullptr) {
+        to->notify(notice);
+    }
+}
+
+bool run_notifier::wait(run_notice& notice, const size_t after, const size_t timeout_usecs) {
+    std::unique_lock<std::mutex> guard(lock);
+    auto ready = [this, after] { return last > after; };
+    if (timeout_usecs == 0) {
+        cv.wait(guard, ready);
+    } else if (!cv.wait_for(guard, std::chrono::microseconds(timeout_usecs), ready)) {
+        return false;
+    }
+    /*
+     * The notices are in sequence order. Return the first after the
+     * sequence number or the oldest held if the waiter has fallen behind.
+     */
+    for (auto& held : notices) {
+        if (held.sequence > after) {
+            notice = held;
+            break;
+        }
+    }
+    return true;
+}
+
+size_t run_notifier::sequence() {
+    std::lock_guard<std::mutex> guard(lock);
+    return last;
+}
+
 /*
  * PLX PCI vendor and device id
  */
@@ -218,7 +329,8 @@ void module::guard::unlock() {
     lock_.unlock();
 }
 
-module::bus_guard::bus_guard(module& mod) : lock_(mod.bus_lock_), guard_(lock_) {}
+module::bus_guard::bus_guard(module& mod)
+    : lock_(mod.bus_lock_), guard_(mod.bus_acquire(), std::adopt_lock) {}
 
 void module::bus_guard::lock() {
     lock_.lock();
@@ -257,6 +369,11 @@ module::fifo_stats& module::fifo_stats::operator=(const module::fifo_stats& s) {
     bandwidth = s.bandwidth.load();
     max_bandwidth = s.max_bandwidth.load();
     min_bandwidth = s.min_bandwidth.load();
+    errors = s.errors.load();
+    recoveries = s.recoveries.load();
+    lost = s.lost.load();
+    recovery_usecs = s.recovery_usecs.load();
+    failures = s.failures.load();
     return *this;
 }
 
@@ -264,7 +381,9 @@ module::fifo_stats::fifo_stats(const module::fifo_stats& s)
     : in(s.in.load()), out(s.out.load()), dma_in(s.dma_in.load()),
       overflows(s.overflows.load()), dropped(s.dropped.load()),
       hw_overflows(s.hw_overflows.load()), bandwidth(s.bandwidth.load()),
-      max_bandwidth(s.max_bandwidth.load()), min_bandwidth(s.min_bandwidth.load()) {
+      max_bandwidth(s.max_bandwidth.load()), min_bandwidth(s.min_bandwidth.load()),
+      errors(s.errors.load()), recoveries(s.recoveries.load()), lost(s.lost.load()),
+      recovery_usecs(s.recovery_usecs.load()), failures(s.failures.load()) {
 }
 
 void module::fifo_stats::clear() {
@@ -277,6 +396,11 @@ void module::fifo_stats::clear() {
     bandwidth = 0;
     max_bandwidth = 0;
     min_bandwidth = 0;
+    errors = 0;
+    recoveries = 0;
+    lost = 0;
+    recovery_usecs = 0;
+    failures = 0;
 }
 
 void module::fifo_stats::set_bandwidth(const size_t bw) {
@@ -299,18 +423,524 @@ std::string module::fifo_stats::output() const {
         << " out=" << out.load() * word_size
         << " dma-in=" << dma_in.load() * word_size
         << " overflows=" << overflows.load() << " dropped=" << dropped.load()
-        << " hw-overflows=" << hw_overflows.load();
+        << " hw-overflows=" << hw_overflows.load()
+        << " errors=" << errors.load() << " recoveries=" << recoveries.load()
+        << " lost=" << lost.load() * word_size
+        << " recovery-time=" << recovery_usecs.load() << "usecs"
+        << " failures=" << failures.load();
+    return oss.str();
+}
+
+module::drain_counts::drain_counts() {
+    clear();
+}
+
+void module::drain_counts::clear() {
+    dma_in = 0;
+    in = 0;
+    dropped = 0;
+    lost = 0;
+    drained = 0;
+    consumed = 0;
+    queued = 0;
+    usecs = 0;
+}
+
+std::string module::drain_counts::output() const {
+    constexpr auto word_size = sizeof(hw::word);
+    std::ostringstream oss;
+    oss << "dma-in=" << dma_in * word_size << " in=" << in * word_size
+        << " dropped=" << dropped * word_size << " lost=" << lost * word_size
+        << " drained=" << drained * word_size << " consumed=" << consumed * word_size
+        << " queued=" << queued * word_size << " time=" << usecs << "usecs";
+    return oss.str();
+}
+
+/*
+ * The innermost bus operation tag of this thread.
+ */
+static thread_local module::bus_op* current_bus_op;
+
+module::bus_cost::bus_cost() {
+    clear();
+}
+
+module::bus_cost& module::bus_cost::operator+=(const module::bus_cost& c) {
+    calls += c.calls;
+    pio_reads += c.pio_reads;
+    pio_writes += c.pio_writes;
+    dma_transfers += c.dma_transfers;
+    dma_bytes += c.dma_bytes;
+    hbr_requests += c.hbr_requests;
+    bus_wait_usecs += c.bus_wait_usecs;
+    return *this;
+}
+
+void module::bus_cost::clear() {
+    calls = 0;
+    pio_reads = 0;
+    pio_writes = 0;
+    dma_transfers = 0;
+    dma_bytes = 0;
+    hbr_requests = 0;
+    bus_wait_usecs = 0;
+}
+
+std::string module::bus_cost::output() const {
+    std::ostringstream oss;
+    oss << "calls=" << calls << " pio-reads=" << pio_reads << " pio-writes=" << pio_writes
+        << " dma-transfers=" << dma_transfers << " dma-bytes=" << dma_bytes
+        << " hbr-requests=" << hbr_requests << " bus-wait=" << bus_wait_usecs << "usecs";
+    return oss.str();
+}
+
+module::bus_stats::bus_stats() {
+    clear();
+}
+
+module::bus_stats::bus_stats(const module::bus_stats& s)
+    : pio_reads(s.pio_reads.load()), pio_writes(s.pio_writes.load()),
+      dma_transfers(s.dma_transfers.load()), dma_bytes(s.dma_bytes.load()),
+      hbr_requests(s.hbr_requests.load()), bus_wait_usecs(s.bus_wait_usecs.load()) {
+}
+
+module::bus_stats& module::bus_stats::operator=(const module::bus_stats& s) {
+    pio_reads = s.pio_reads.load();
+    pio_writes = s.pio_writes.load();
+    dma_transfers = s.dma_transfers.load();
+    dma_bytes = s.dma_bytes.load();
+    hbr_requests = s.hbr_requests.load();
+    bus_wait_usecs = s.bus_wait_usecs.load();
+    return *this;
+}
+
+void module::bus_stats::clear() {
+    pio_reads = 0;
+    pio_writes = 0;
+    dma_transfers = 0;
+    dma_bytes = 0;
+    hbr_requests = 0;
+    bus_wait_usecs = 0;
+}
+
+module::bus_cost module::bus_stats::get() const {
+    bus_cost cost;
+    cost.pio_reads = pio_reads.load();
+    cost.pio_writes = pio_writes.load();
+    cost.dma_transfers = dma_transfers.load();
+    cost.dma_bytes = dma_bytes.load();
+    cost.hbr_requests = hbr_requests.load();
+    cost.bus_wait_usecs = bus_wait_usecs.load();
+    return cost;
+}
+
+module::memory_usage::memory_usage() {
+    clear();
+}
+
+void module::memory_usage::peak(const module::memory_usage& m) {
+    pool_capacity = std::max(pool_capacity, m.pool_capacity);
+    pool_in_use = std::max(pool_in_use, m.pool_in_use);
+    queued = std::max(queued, m.queued);
+    recorder = std::max(recorder, m.recorder);
+    firmware = std::max(firmware, m.firmware);
+    variables = std::max(variables, m.variables);
+    fixtures = std::max(fixtures, m.fixtures);
+}
+
+void module::memory_usage::clear() {
+    pool_capacity = 0;
+    pool_in_use = 0;
+    queued = 0;
+    recorder = 0;
+    firmware = 0;
+    variables = 0;
+    fixtures = 0;
+}
+
+size_t module::memory_usage::total() const {
+    return pool_capacity + firmware + variables + fixtures;
+}
+
+std::string module::memory_usage::output() const {
+    std::ostringstream oss;
+    oss << "pool-capacity=" << pool_capacity << " pool-in-use=" << pool_in_use
+        << " queued=" << queued << " recorder=" << recorder << " firmware=" << firmware
+        << " variables=" << variables << " fixtures=" << fixtures << " total=" << total();
+    return oss.str();
+}
+
+module::bus_op::bus_op(module& mod, const char* name)
+    : mod_(mod), name_(name), parent_(current_bus_op) {
+    current_bus_op = this;
+}
+
+module::bus_op::~bus_op() {
+    current_bus_op = parent_;
+    auto parent = find(parent_, mod_);
+    if (parent != nullptr) {
+        auto calls = parent->cost_.calls;
+        parent->cost_ += cost_;
+        parent->cost_.calls = calls;
+    }
+    cost_.calls = 1;
+    try {
+        std::lock_guard<std::mutex> guard(mod_.bus_costs_lock);
+        mod_.bus_op_costs[name_] += cost_;
+    } catch (...) {
+        /* do not throw from a destructor */
+    }
+}
+
+module::bus_op* module::bus_op::find(bus_op* op, module& mod) {
+    while (op != nullptr && &op->mod_ != &mod) {
+        op = op->parent_;
+    }
+    return op;
+}
+
+module::deferred_io::deferred_io(module& mod)
+    : mod_(mod), guard_(mod.lock_), committed_(false) {
+    ++mod_.deferred_depth;
+}
+
+module::deferred_io::~deferred_io() {
+    if (!committed_) {
+        if (--mod_.deferred_depth == 0 && (mod_.deferred_fippi || mod_.deferred_dacs)) {
+            xia_log(log::warning) << module_label(mod_)
+                                  << "deferred I/O not committed; variables left dirty";
+            mod_.deferred_fippi = false;
+            mod_.deferred_dacs = false;
+        }
+    }
+}
+
+void module::deferred_io::commit() {
+    if (committed_) {
+        return;
+    }
+    committed_ = true;
+    if (--mod_.deferred_depth > 0) {
+        return;
+    }
+    const bool program_fippi = mod_.deferred_fippi;
+    const bool set_dacs = mod_.deferred_dacs;
+    mod_.deferred_fippi = false;
+    mod_.deferred_dacs = false;
+    xia_log(log::debug) << module_label(mod_) << std::boolalpha
+                        << "deferred I/O commit: program_fippi=" << program_fippi
+                        << " set_dacs=" << set_dacs;
+    mod_.sync_vars(sync_to_dsp);
+    if (program_fippi) {
+        hw::run::control(mod_, hw::run::control_task::program_fippi);
+    }
+    if (set_dacs) {
+        mod_.set_dacs();
+    }
+}
+
+module::throughput_config::throughput_config()
+    : dma_block_sizes({0}), trigger_levels({default_fifo_dma_trigger_level}),
+      words(16 * 1024 * 1024), max_msecs(10000) {}
+
+module::throughput_point::throughput_point()
+    : dma_block_size(0), trigger_level(0), words(0), transfers(0), hw_overflows(0), secs(0),
+      mb_per_sec(0), bus_usage(0), latency_p50_usecs(0), latency_p90_usecs(0),
+      latency_p99_usecs(0), latency_max_usecs(0), cpu_secs(0), cpu_usecs_per_mb(0) {}
+
+std::string module::throughput_point::output() const {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(3) << "dma-block=" << dma_block_size
+        << " trigger-level=" << trigger_level << " words=" << words << " transfers=" << transfers
+        << " hw-overflows=" << hw_overflows << " secs=" << secs << " rate=" << mb_per_sec
+        << "MB/s bus=" << bus_usage << "% latency p50=" << latency_p50_usecs
+        << " p90=" << latency_p90_usecs << " p99=" << latency_p99_usecs
+        << " max=" << latency_max_usecs << "usecs cpu=" << cpu_secs
+        << "secs cpu-per-MB=" << cpu_usecs_per_mb << "usecs";
+    return oss.str();
+}
+
+module::throughput_report::throughput_report()
+    : number(-1), slot(0), serial_num(0), bus_datarate(hw::pci_bus_datarate) {}
+
+const module::throughput_point& module::throughput_report::best() const {
+    if (points.empty()) {
+        throw error(number, slot, error::code::invalid_value, "throughput report has no points");
+    }
+    return *std::max_element(points.begin(), points.end(),
+                             [](const throughput_point& a, const throughput_point& b) {
+                                 return a.mb_per_sec < b.mb_per_sec;
+                             });
+}
+
+std::string module::throughput_report::output() const {
+    std::ostringstream oss;
+    oss << "module=" << number << " slot=" << slot << " serial-num=" << serial_num
+        << " bus-datarate=" << bus_datarate << "MB/s" << std::endl;
+    for (auto& point : points) {
+        oss << " " << point.output() << std::endl;
+    }
+    return oss.str();
+}
+
+module::latency_histogram::latency_histogram() {
+    clear();
+}
+
+module::latency_histogram::latency_histogram(const latency_histogram& h)
+    : count(h.count.load()), min_nsecs(h.min_nsecs.load()), max_nsecs(h.max_nsecs.load()),
+      total_nsecs(h.total_nsecs.load()) {
+    for (size_t b = 0; b < bins; ++b) {
+        counts[b] = h.counts[b].load();
+    }
+}
+
+module::latency_histogram& module::latency_histogram::operator=(const latency_histogram& h) {
+    for (size_t b = 0; b < bins; ++b) {
+        counts[b] = h.counts[b].load();
+    }
+    count = h.count.load();
+    min_nsecs = h.min_nsecs.load();
+    max_nsecs = h.max_nsecs.load();
+    total_nsecs = h.total_nsecs.load();
+    return *this;
+}
+
+void module::latency_histogram::clear() {
+    for (auto& c : counts) {
+        c = 0;
+    }
+    count = 0;
+    min_nsecs = 0;
+    max_nsecs = 0;
+    total_nsecs = 0;
+}
+
+void module::latency_histogram::add(const size_t nsecs) {
+    size_t usecs = nsecs / 1000;
+    size_t bin = 0;
+    while (usecs != 0 && bin < bins - 1) {
+        usecs >>= 1;
+        ++bin;
+    }
+    ++counts[bin];
+    if (count++ == 0 || nsecs < min_nsecs.load()) {
+        min_nsecs = nsecs;
+    }
+    if (nsecs > max_nsecs.load()) {
+        max_nsecs = nsecs;
+    }
+    total_nsecs += nsecs;
+}
+
+size_t module::latency_histogram::percentile(const double pc) const {
+    const size_t total = count.load();
+    if (total == 0) {
+        return 0;
+    }
+    size_t rank = size_t(std::ceil((pc / 100) * double(total)));
+    size_t seen = 0;
+    for (size_t b = 0; b < bins; ++b) {
+        seen += counts[b].load();
+        if (seen >= rank) {
+            return size_t(1) << b;
+        }
+    }
+    return size_t(1) << (bins - 1);
+}
+
+double module::latency_histogram::mean_usecs() const {
+    const size_t total = count.load();
+    if (total == 0) {
+        return 0;
+    }
+    return (double(total_nsecs.load()) / double(total)) / 1000;
+}
+
+std::string module::latency_histogram::output() const {
+    std::ostringstream oss;
+    oss << "count=" << count.load() << " min=" << min_nsecs.load() / 1000
+        << " max=" << max_nsecs.load() / 1000 << " mean=" << size_t(mean_usecs())
+        << " p50<" << percentile(50) << " p99<" << percentile(99) << " usecs";
+    return oss.str();
+}
+
+module::event_counts::event_counts() : revision(0), frequency(0) {
+    clear();
+}
+
+module::event_counts::event_counts(const event_counts& c) {
+    *this = c;
+}
+
+module::event_counts& module::event_counts::operator=(const event_counts& c) {
+    for (size_t ch = 0; ch < size_t(hw::max_channels); ++ch) {
+        channels[ch].events = c.channels[ch].events.load();
+        channels[ch].bytes = c.channels[ch].bytes.load();
+        channels[ch].last_time = c.channels[ch].last_time.load();
+    }
+    events = c.events.load();
+    other_slots = c.other_slots.load();
+    bad_headers = c.bad_headers.load();
+    revision = c.revision.load();
+    frequency = c.frequency.load();
+    restart = true;
+    return *this;
+}
+
+void module::event_counts::clear() {
+    for (auto& chan : channels) {
+        chan.events = 0;
+        chan.bytes = 0;
+        chan.last_time = 0;
+    }
+    events = 0;
+    other_slots = 0;
+    bad_headers = 0;
+    restart = true;
+}
+
+void module::event_counts::format(const size_t revision_, const size_t frequency_) {
+    try {
+        data::list_mode::event_header header;
+        data::list_mode::decode_event_header(0, revision_, frequency_, header);
+        revision = revision_;
+        frequency = frequency_;
+    } catch (pixie::error::error&) {
+        revision = 0;
+        frequency = 0;
+    }
+    restart = true;
+}
+
+void module::event_counts::add(const hw::word* data, const size_t length, const int slot) {
+    const size_t format_revision = revision.load();
+    if (format_revision == 0) {
+        return;
+    }
+    if (restart.exchange(false)) {
+        stopped = false;
+        skip = 0;
+        held = 0;
+    }
+    size_t w = 0;
+    while (!stopped && w < length) {
+        if (skip > 0) {
+            const size_t step = std::min(skip, length - w);
+            skip -= step;
+            w += step;
+            continue;
+        }
+        /*
+         * Collect the header words, they can be split between reads.
+         */
+        while (held < header_words && w < length) {
+            header[held++] = data[w++];
+        }
+        if (held < header_words) {
+            break;
+        }
+        held = 0;
+        data::list_mode::event_header event;
+        data::list_mode::decode_event_header(header[0], format_revision, frequency.load(), event);
+        if (!event.valid() || event.channel_number >= size_t(hw::max_channels)) {
+            ++bad_headers;
+            stopped = true;
+            break;
+        }
+        skip = event.event_length - header_words;
+        ++events;
+        if (int(event.slot_id) != slot) {
+            ++other_slots;
+            continue;
+        }
+        auto& counts = channels[event.channel_number];
+        ++counts.events;
+        counts.bytes += event.event_length * sizeof(hw::word);
+        counts.last_time = (uint64_t(header[2] & 0xFFFF) << 32) | header[1];
+    }
+}
+
+std::string module::event_counts::output() const {
+    std::ostringstream oss;
+    oss << "events=" << events.load() << " other-slots=" << other_slots.load()
+        << " bad-headers=" << bad_headers.load();
+    for (size_t ch = 0; ch < size_t(hw::max_channels); ++ch) {
+        auto count = channels[ch].events.load();
+        if (count != 0) {
+            oss << " ch" << ch << '=' << count;
+        }
+    }
     return oss.str();
 }
 
+const size_t module::fifo_tuning::latency_usecs = 5000;
+const size_t module::fifo_tuning::period_usecs = 50000;
+
+module::fifo_tuning::fifo_tuning()
+    : run_wait_usecs(default_fifo_run_wait_usec), hold_usecs(default_fifo_hold_usec),
+      dma_trigger_level(default_fifo_dma_trigger_level) {}
+
+void module::fifo_tuning::tune(const double rate, const bool level_rising, const bool pool_low) {
+    /*
+     * Poll at least 4 times in the period it takes to half fill the FIFO.
+     */
+    double run_wait = double(latency_usecs) / 2;
+    if (pool_low) {
+        run_wait *= 2;
+    }
+    if (rate > 0) {
+        const double fill_usecs = (double(hw::fifo_size_words / 2) * 1e6) / rate;
+        run_wait = std::min(run_wait, fill_usecs / 4);
+    }
+    if (level_rising) {
+        run_wait /= 2;
+    }
+    run_wait_usecs = std::max(min_fifo_run_wait_usec,
+                              std::min(max_fifo_run_wait_usec, size_t(run_wait)));
+    /*
+     * Trigger at the words arriving in a run wait period rounded up to the
+     * minimum trigger level.
+     */
+    size_t level = size_t((rate * double(run_wait_usecs)) / 1e6);
+    level = ((level + min_fifo_dma_trigger_level - 1) / min_fifo_dma_trigger_level) *
+            min_fifo_dma_trigger_level;
+    if (pool_low) {
+        level = max_fifo_dma_trigger_level;
+    }
+    dma_trigger_level = std::max(min_fifo_dma_trigger_level,
+                                 std::min(max_fifo_dma_trigger_level, level));
+    hold_usecs = std::max(min_fifo_hold_usec, std::min(max_fifo_hold_usec, 2 * run_wait_usecs));
+}
+
+/*
+ * The value at the percentile of sorted samples using the nearest rank.
+ */
+static double percentile(const std::vector<double>& sorted, const double pc) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = size_t(std::ceil((pc / 100) * double(sorted.size())));
+    if (rank > 0) {
+        --rank;
+    }
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
 /*
  * FIFO Worker settings
  */
+const size_t module::fifo_buffer_words = 64 * 1024;
 const size_t module::default_fifo_buffers = 100;
+const size_t module::default_list_mode_revision = 46540;
 const size_t module::default_fifo_run_wait_usec = 5000;
 const size_t module::default_fifo_idle_wait_usec = 150000;
 const size_t module::default_fifo_hold_usec = 10000;
 const size_t module::default_fifo_dma_trigger_level = 1024;
+const size_t module::fifo_read_retries = 8;
+const size_t module::default_drain_timeout_usec = 5 * 1000 * 1000;
+const size_t module::fifo_recovery_backoff_usec = 1000;
+const size_t module::max_fifo_recovery_backoff_usec = 100000;
 const size_t module::min_fifo_buffers = 10;
 const size_t module::max_fifo_buffers = 10000000;
 const size_t module::min_fifo_run_wait_usec = 500;
@@ -329,12 +959,18 @@ module::module(backplane::backplane& backplane_)
       fifo_buffers(default_fifo_buffers), fifo_run_wait_usecs(default_fifo_run_wait_usec),
       fifo_idle_wait_usecs(default_fifo_idle_wait_usec), fifo_hold_usecs(default_fifo_hold_usec),
       fifo_dma_trigger_level(default_fifo_dma_trigger_level), fifo_bandwidth(0),
+      fifo_adaptive(false), fifo_recorder_bytes(0), fifo_recorder_secs(0),
       crate_revision(-1), board_revision(-1), reg_trace(false), bus_cycle_period(100),
       fifo_worker_running(false), fifo_worker_finished(false), fifo_worker_req(fifo_worker_working),
-      fifo_worker_resp(fifo_worker_working), in_use(0), present_(false), online_(false),
+      fifo_worker_resp(fifo_worker_working), fifo_recorder_reserved(0),
+      tuned_run_wait_usecs(0), tuned_hold_usecs(0), tuned_dma_trigger_level(0),
+      notified_run(hw::run::run_task::nop),
+      low_latency_running(false), in_use(0), present_(false), online_(false),
       forced_offline_(false), pause_fifo_worker(true), comms_fpga(false), fippi_fpga(false),
-      have_hardware(false), vars_loaded(false), cfg_ctrlcs(0xaaa),
-      device(std::make_unique<pci_bus_handle>()), test_mode(test::off) {}
+      have_hardware(false), bus_emulated(false), vars_loaded(false), deferred_depth(0),
+      deferred_fippi(false), deferred_dacs(false), cfg_ctrlcs(0xaaa),
+      device(std::make_unique<pci_bus_handle>()), test_mode(test::off),
+      test_dma_block_size(0), test_latency_record(false) {}
 
 module::module(module&& m)
     : slot(m.slot), number(m.number), serial_num(m.serial_num), revision(m.revision),
@@ -349,14 +985,25 @@ module::module(module&& m)
       fifo_idle_wait_usecs(m.fifo_idle_wait_usecs.load()),
       fifo_hold_usecs(m.fifo_hold_usecs.load()), fifo_bandwidth(m.fifo_bandwidth.load()),
       fifo_dma_trigger_level(m.fifo_dma_trigger_level.load()),
-      data_stats(m.data_stats), run_stats(m.run_stats), crate_revision(m.crate_revision),
+      fifo_adaptive(m.fifo_adaptive.load()), fifo_recorder_bytes(m.fifo_recorder_bytes),
+      fifo_recorder_secs(m.fifo_recorder_secs),
+      data_stats(m.data_stats), run_stats(m.run_stats), bus_totals(m.bus_totals),
+      low_latency_stats(m.low_latency_stats), event_stats(m.event_stats),
+      crate_revision(m.crate_revision),
       board_revision(m.board_revision), reg_trace(m.reg_trace), bus_cycle_period(100),
       fifo_worker_running(false), fifo_worker_finished(false), fifo_worker_req(fifo_worker_working),
-      fifo_worker_resp(fifo_worker_working), in_use(0), present_(m.present_.load()),
+      fifo_worker_resp(fifo_worker_working), fifo_recorder_reserved(0),
+      tuned_run_wait_usecs(0), tuned_hold_usecs(0), tuned_dma_trigger_level(0),
+      notified_run(hw::run::run_task::nop),
+      low_latency_running(false), in_use(0), present_(m.present_.load()),
       online_(m.online_.load()), forced_offline_(m.forced_offline_.load()),
       pause_fifo_worker(m.pause_fifo_worker.load()), comms_fpga(m.comms_fpga),
-      fippi_fpga(m.fippi_fpga), have_hardware(false), vars_loaded(false),
-      cfg_ctrlcs(0xaaa), device(std::move(m.device)), test_mode(m.test_mode.load()) {
+      fippi_fpga(m.fippi_fpga), have_hardware(false), bus_emulated(false), vars_loaded(false),
+      deferred_depth(0),
+      deferred_fippi(false), deferred_dacs(false), cfg_ctrlcs(0xaaa), device(std::move(m.device)), test_mode(m.test_mode.load()),
+      test_dma_block_size(0), test_latency_record(false) {
+    bus_op_costs = std::move(m.bus_op_costs);
+    memory_peak = m.memory_peak;
     m.slot = 0;
     m.number = -1;
     m.serial_num = 0;
@@ -379,8 +1026,16 @@ module::module(module&& m)
     m.fifo_hold_usecs = default_fifo_hold_usec;
     m.fifo_dma_trigger_level = default_fifo_dma_trigger_level;
     m.fifo_bandwidth = 0;
+    m.fifo_adaptive = false;
+    m.fifo_recorder_bytes = 0;
+    m.fifo_recorder_secs = 0;
     m.data_stats.clear();
     m.run_stats.clear();
+    m.bus_totals.clear();
+    m.low_latency_stats.clear();
+    m.event_stats.clear();
+    m.bus_op_costs.clear();
+    m.memory_peak.clear();
     m.crate_revision = -1;
     m.board_revision = -1;
     m.reg_trace = false;
@@ -392,6 +1047,7 @@ module::module(module&& m)
     m.comms_fpga = false;
     m.fippi_fpga = false;
     m.have_hardware = false;
+    m.bus_emulated = false;
     m.vars_loaded = false;
     m.cfg_ctrlcs = 0xaaa;
     m.test_mode = test::off;
@@ -439,8 +1095,16 @@ module& module::operator=(module&& m) {
     fifo_hold_usecs = m.fifo_hold_usecs.load();
     fifo_dma_trigger_level = m.fifo_dma_trigger_level.load();
     fifo_bandwidth = m.fifo_bandwidth.load();
+    fifo_adaptive = m.fifo_adaptive.load();
+    fifo_recorder_bytes = m.fifo_recorder_bytes;
+    fifo_recorder_secs = m.fifo_recorder_secs;
     data_stats = m.data_stats;
     run_stats = m.run_stats;
+    bus_totals = m.bus_totals;
+    low_latency_stats = m.low_latency_stats;
+    event_stats = m.event_stats;
+    bus_op_costs = std::move(m.bus_op_costs);
+    memory_peak = m.memory_peak;
     crate_revision = m.crate_revision;
     board_revision = m.board_revision;
     reg_trace = m.reg_trace;
@@ -452,6 +1116,7 @@ module& module::operator=(module&& m) {
     comms_fpga = m.comms_fpga;
     fippi_fpga = m.fippi_fpga;
     have_hardware = m.have_hardware;
+    bus_emulated = m.bus_emulated;
     vars_loaded = m.vars_loaded;
     cfg_ctrlcs = m.cfg_ctrlcs;
     test_mode = m.test_mode.load();
@@ -476,8 +1141,16 @@ module& module::operator=(module&& m) {
     m.fifo_hold_usecs = default_fifo_hold_usec;
     m.fifo_dma_trigger_level = default_fifo_dma_trigger_level;
     m.fifo_bandwidth = 0;
+    m.fifo_adaptive = false;
+    m.fifo_recorder_bytes = 0;
+    m.fifo_recorder_secs = 0;
     m.data_stats.clear();
     m.run_stats.clear();
+    m.bus_totals.clear();
+    m.low_latency_stats.clear();
+    m.event_stats.clear();
+    m.bus_op_costs.clear();
+    m.memory_peak.clear();
     m.crate_revision = -1;
     m.board_revision = -1;
     m.reg_trace = false;
@@ -489,6 +1162,7 @@ module& module::operator=(module&& m) {
     m.comms_fpga = false;
     m.fippi_fpga = false;
     m.have_hardware = false;
+    m.bus_emulated = false;
     m.vars_loaded = false;
     m.cfg_ctrlcs = 0xaaa;
     m.test_mode = test::off;
@@ -1299,7 +1973,8 @@ param::value_type module::read_var(param::module_var var, size_t offset, bool io
     param::value_type value;
     {
         lock_guard guard(lock_);
-        if (have_hardware && io) {
+        if (bus_io() && io &&
+            !(deferred_depth > 0 && module_vars[index].value[offset].dirty)) {
             hw::memory::dsp dsp(*this);
             hw::word mem = dsp.read(offset, desc.address);
             hw::convert(mem, value);
@@ -1341,7 +2016,8 @@ param::value_type module::read_var(param::channel_var var, size_t channel, size_
     param::value_type value;
     {
         lock_guard guard(lock_);
-        if (have_hardware && io) {
+        if (bus_io() && io &&
+            !(deferred_depth > 0 && channels[channel].vars[index].value[offset].dirty)) {
             hw::memory::dsp dsp(*this);
             hw::convert(dsp.read(channel, offset, desc.address), value);
             channels[channel].vars[index].value[offset].value = value;
@@ -1395,7 +2071,7 @@ void module::write_var(param::module_var var, param::value_type value, size_t of
     lock_guard guard(lock_);
     module_vars[index].value[offset].value = value;
     module_vars[index].value[offset].dirty = true;
-    if (have_hardware && io) {
+    if (bus_io() && io && deferred_depth == 0) {
         hw::word word;
         hw::convert(value, word);
         hw::memory::dsp dsp(*this);
@@ -1433,7 +2109,7 @@ void module::write_var(param::channel_var var, param::value_type value, size_t c
     lock_guard guard(lock_);
     channels[channel].vars[index].value[offset].value = value;
     channels[channel].vars[index].value[offset].dirty = true;
-    if (have_hardware && io) {
+    if (bus_io() && io && deferred_depth == 0) {
         hw::word word;
         hw::convert(value, word);
         hw::memory::dsp dsp(*this);
@@ -1446,11 +2122,15 @@ void module::sync_vars(const sync_var_mode sync_mode) {
     online_check();
     xia_log(log::info) << module_label(*this) << "sync variables: mode: "
                        << (char*) (sync_mode == sync_to_dsp ? "to dsp" : "from dsp");
-    if (!have_hardware) {
+    if (!bus_io()) {
         return;
     }
     lock_guard guard(lock_);
     hw::memory::dsp dsp(*this);
+    /*
+     * The dirty variables are written to the DSP with one scatter write.
+     */
+    hw::memory::address_values writes;
     for (auto& var : module_vars) {
         const auto& desc = var.var;
         if (desc.state == param::enable && desc.mode != param::ro) {
@@ -1460,7 +2140,8 @@ void module::sync_vars(const sync_var_mode sync_mode) {
                     if (value.dirty) {
                         hw::word word;
                         hw::convert(value.value, word);
-                        dsp.write(v, desc.address, word);
+                        writes.push_back(
+                            std::make_pair(static_cast<hw::address>(desc.address + v), word));
                     }
                 } else {
                     hw::convert(dsp.read(v, desc.address), value.value);
@@ -1479,7 +2160,8 @@ void module::sync_vars(const sync_var_mode sync_mode) {
                         if (value.dirty) {
                             hw::word word;
                             hw::convert(value.value, word);
-                            dsp.write(channel.number, v, desc.address, word);
+                            writes.push_back(std::make_pair(
+                                dsp.channel_address(channel.number, v, desc.address), word));
                         }
                     } else {
                         hw::convert(dsp.read(channel.number, v, desc.address), value.value);
@@ -1489,6 +2171,7 @@ void module::sync_vars(const sync_var_mode sync_mode) {
             }
         }
     }
+    dsp.write(writes);
     fixtures->sync_vars();
 }
 
@@ -1520,6 +2203,82 @@ void module::sync_hw(const bool program_fippi, const bool program_dacs) {
     fixtures->sync_hw();
 }
 
+void module::broadcast(const param::channel_variables& source, const unsigned int filter_mask,
+                       const uint32_t channel_mask) {
+    xia_log(log::info) << module_label(*this) << "broadcast: filter=0x" << std::hex << filter_mask
+                       << " channels=0x" << channel_mask;
+    online_check();
+    lock_guard guard(lock_);
+    for (size_t channel = 0; channel < hw::max_channels; ++channel) {
+        if ((channel_mask & (uint32_t(1) << channel)) != 0) {
+            channel_check(channel);
+        }
+    }
+    {
+        bus_op op(*this, "broadcast");
+        deferred_io deferred(*this);
+        for (size_t channel = 0; channel < num_channels; ++channel) {
+            if ((channel_mask & (uint32_t(1) << channel)) != 0) {
+                param::copy_parameters(filter_mask, source, channels[channel].vars);
+            }
+        }
+        if (channel_mask != 0) {
+            deferred_fippi = true;
+            if ((filter_mask & param::analog_signal_cond_mask) != 0) {
+                deferred_dacs = true;
+            }
+        }
+        deferred.commit();
+    }
+}
+
+void module::broadcast(const param_values& params, const uint32_t channel_mask) {
+    xia_log(log::info) << module_label(*this) << "broadcast: params=" << params.size()
+                       << " channels=0x" << std::hex << channel_mask;
+    online_check();
+    lock_guard guard(lock_);
+    std::vector<param::channel_param> pars;
+    for (auto& pv : params) {
+        pars.push_back(param::lookup_channel_param(pv.first));
+    }
+    for (size_t channel = 0; channel < hw::max_channels; ++channel) {
+        if ((channel_mask & (uint32_t(1) << channel)) != 0) {
+            channel_check(channel);
+        }
+    }
+    {
+        bus_op op(*this, "broadcast");
+        deferred_io deferred(*this);
+        for (size_t channel = 0; channel < num_channels; ++channel) {
+            if ((channel_mask & (uint32_t(1) << channel)) != 0) {
+                for (size_t p = 0; p < pars.size(); ++p) {
+                    write(pars[p], channel, params[p].second);
+                }
+            }
+        }
+        deferred.commit();
+    }
+}
+
+bool module::defer_control(const hw::run::control_task control_tsk) {
+    lock_guard guard(lock_);
+    if (deferred_depth == 0) {
+        return false;
+    }
+    switch (control_tsk) {
+        case hw::run::control_task::program_fippi:
+            deferred_fippi = true;
+            break;
+        case hw::run::control_task::set_dacs:
+            deferred_dacs = true;
+            break;
+        default:
+            return false;
+    }
+    xia_log(log::debug) << module_label(*this) << "control deferred: task=" << int(control_tsk);
+    return true;
+}
+
 void module::run_end() {
     online_check();
     lock_guard guard(lock_);
@@ -1545,17 +2304,83 @@ void module::run_end() {
     run_interval.end();
     sync_worker_run(true);
     pause_fifo_worker = true;
+    notify_run_ended("run-end");
     if (running) {
         log_stats("run", run_stats);
     }
 }
 
-bool module::run_active() {
+void module::run_end_drain(drain_counts& counts, fifo_consumer consumer, size_t timeout_usecs) {
     online_check();
     lock_guard guard(lock_);
-    return hw::run::active(*this);
-}
-
+    xia_log(log::info) << module_label(*this) << "run-end-drain: timeout=" << timeout_usecs
+                       << "usecs";
+    util::timepoint tp(true);
+    counts.clear();
+    if (run_task == hw::run::run_task::nop) {
+        xia_log(log::warning) << module_label(*this) << "run-end-drain: no run active";
+    }
+    hw::run::end(*this);
+    run_interval.end();
+    const size_t run_dma_in = run_stats.dma_in.load();
+    /*
+     * Hand the queued data to the consumer.
+     */
+    hw::words words;
+    auto hand_over = [this, &consumer, &counts, &words]() {
+        if (consumer && !fifo_data.empty()) {
+            words.clear();
+            auto out = fifo_data.copy(words);
+            data_stats.out += out;
+            run_stats.out += out;
+            counts.consumed += out;
+            consumer(words.data(), out);
+        }
+    };
+    /*
+     * A requested worker run reads the FIFO whatever the hold time and
+     * DMA trigger level. Once the FIFO is empty run the worker once more
+     * so a read in progress is queued.
+     */
+    hw::memory::fifo fifo(*this);
+    pause_fifo_worker = false;
+    bool empty = false;
+    while (true) {
+        fifo_worker_run(250 * 1000);
+        hand_over();
+        if (empty) {
+            break;
+        }
+        auto level = fifo.level();
+        if (level == 0) {
+            empty = true;
+        } else if (tp.usecs() > timeout_usecs) {
+            pause_fifo_worker = true;
+            notify_run_ended("run-end-drain");
+            throw error(number, slot, error::code::module_task_timeout,
+                        "run-end-drain: FIFO not empty: level=" + std::to_string(level));
+        }
+    }
+    pause_fifo_worker = true;
+    notify_run_ended("run-end-drain");
+    tp.end();
+    counts.dma_in = run_stats.dma_in.load();
+    counts.in = run_stats.in.load();
+    counts.dropped = run_stats.dropped.load();
+    counts.lost = run_stats.lost.load();
+    counts.drained = counts.dma_in - run_dma_in;
+    counts.queued = fifo_data.size();
+    counts.usecs = size_t(tp.usecs());
+    log_stats("run", run_stats);
+    xia_log(log::info) << module_label(*this) << "run-end-drain: " << counts.output();
+}
+
+bool module::run_active() {
+    online_check();
+    lock_guard guard(lock_);
+    return hw::run::active(*this);
+}
+
 void module::acquire_baselines() {
     xia_log(log::info) << module_label(*this) << "acquire-baselines";
     online_check();
@@ -1611,6 +2436,8 @@ void module::start_histograms(hw::run::run_mode mode) {
     backplane.sync_wait_valid();
     hw::run::run(*this, mode, hw::run::run_task::histogram);
     run_interval.restart();
+    notified_run = hw::run::run_task::histogram;
+    notify_run(run_event::started, "start-histograms");
 }
 
 void module::start_listmode(hw::run::run_mode mode) {
@@ -1627,10 +2454,13 @@ void module::start_listmode(hw::run::run_mode mode) {
     }
     backplane.sync_wait_valid();
     run_stats.clear();
+    event_stats.clear();
     fifo_data.flush();
     pause_fifo_worker = false;
     hw::run::run(*this, mode, hw::run::run_task::list_mode);
     run_interval.restart();
+    notified_run = hw::run::run_task::list_mode;
+    notify_run(run_event::started, "start-list-mode");
 }
 
 void module::read_adc(size_t channel, hw::adc_word* buffer, size_t size, bool run) {
@@ -1657,6 +2487,10 @@ void module::read_adc(size_t channel, hw::adc_trace& buffer, bool run) {
     read_adc(channel, buffer.data(), buffer.size(), run);
 }
 
+void module::read_adc(size_t channel, util::span<hw::adc_word> buffer, bool run) {
+    read_adc(channel, buffer.data(), buffer.size(), run);
+}
+
 void module::bl_find_cut(channel::range& channels_, param::values& cuts) {
     xia_log(log::info) << module_label(*this) << "bl-find-cut: channels=" << channels.size();
     cuts.clear();
@@ -1694,6 +2528,10 @@ void module::read_histogram(size_t channel, hw::word_ptr values, const size_t si
     channels[channel].read_histogram(values, size);
 }
 
+void module::read_histogram(size_t channel, util::span<hw::word> values) {
+    read_histogram(channel, values.data(), values.size());
+}
+
 size_t module::read_list_mode_level() {
     xia_log(log::debug) << module_label(*this) << "read-list-mode-level";
     online_check();
@@ -1733,21 +2571,29 @@ size_t module::read_list_mode(hw::words& values) {
 }
 
 size_t module::read_list_mode(hw::word_ptr values, const size_t size) {
-    xia_log(log::info) << module_label(*this) << "read-list-mode: length=" << size
-                       << " fifo-size=" << fifo_data.size();
+    xia_log(log::debug) << module_label(*this) << "read-list-mode: length=" << size
+                        << " fifo-size=" << fifo_data.size();
     online_check();
-    if (fifo_data.empty()) {
-        return 0;
+    if (!fifo_worker_running.load()) {
+        xia_log(log::warning) << module_label(*this) << "read-list-mode: FIFO worker not running";
     }
     lock_guard guard(lock_);
+    sync_worker_run();
+    if (fifo_data.empty() || size == 0) {
+        return 0;
+    }
     auto out = fifo_data.copy(values, size);
-    data_stats.out += size;
-    run_stats.out += size;
+    data_stats.out += out;
+    run_stats.out += out;
     xia_log(log::debug) << module_label(*this) << "read-list-mode: values=" << size
                         << " out=" << out << " fifo-size=" << fifo_data.size();
     return out;
 }
 
+size_t module::read_list_mode(util::span<hw::word> values) {
+    return read_list_mode(values.data(), values.size());
+}
+
 void module::read_stats(stats::stats& stats) {
     xia_log(log::info) << module_label(*this) << "read-stats: channels=" << channels.size();
     online_check();
@@ -1826,6 +2672,81 @@ void module::set_fifo_bandwidth(const size_t bandwidth) {
     fifo_bandwidth = bandwidth;
 }
 
+void module::set_fifo_adaptive(const bool adaptive) {
+    xia_log(log::debug) << module_label(*this) << "fifo: adaptive=" << std::boolalpha << adaptive;
+    fifo_adaptive = adaptive;
+}
+
+module::fifo_tuning module::get_fifo_settings() const {
+    fifo_tuning settings;
+    const size_t run_wait = tuned_run_wait_usecs.load();
+    if (fifo_adaptive.load() && run_wait != 0) {
+        settings.run_wait_usecs = run_wait;
+        settings.hold_usecs = tuned_hold_usecs.load();
+        settings.dma_trigger_level = tuned_dma_trigger_level.load();
+    } else {
+        settings.run_wait_usecs = fifo_run_wait_usecs.load();
+        settings.hold_usecs = fifo_hold_usecs.load();
+        settings.dma_trigger_level = fifo_dma_trigger_level.load();
+    }
+    return settings;
+}
+
+void module::list_mode_format(size_t& revision, size_t& frequency) {
+    lock_guard guard(lock_);
+    revision = default_list_mode_revision;
+    frequency = eeprom.configs.empty() ? 0 : size_t(eeprom.configs[0].adc_msps);
+    for (auto& fwr : firmware) {
+        if (fwr->device == "fippi") {
+            try {
+                revision = std::stoul(fwr->version);
+            } catch (std::exception&) {
+                xia_log(log::warning) << module_label(*this)
+                                      << "list-mode: fippi version not a revision: "
+                                      << fwr->version;
+            }
+            break;
+        }
+    }
+}
+
+void module::set_fifo_recorder(const double seconds, const size_t bytes) {
+    if (seconds < 0) {
+        throw error(number, slot, error::code::module_invalid_var,
+                    "fifo: recorder seconds out of range");
+    }
+    const size_t words = bytes / sizeof(hw::word);
+    const size_t buffers = buffer::recorder::pinned_buffers(words, fifo_buffer_words);
+    if (buffers > max_fifo_buffers) {
+        throw error(number, slot, error::code::module_invalid_var,
+                    "fifo: recorder size out of range");
+    }
+    if (fifo_pool.valid() && buffers > fifo_recorder_reserved) {
+        throw error(number, slot, error::code::module_invalid_var,
+                    "fifo: recorder size larger than the buffers reserved when the FIFO started");
+    }
+    xia_log(log::debug) << module_label(*this) << "fifo: recorder: secs=" << seconds
+                        << " bytes=" << bytes << " buffers=" << buffers;
+    fifo_recorder_bytes = bytes;
+    fifo_recorder_secs = seconds;
+    fifo_recorder.configure(words, seconds);
+}
+
+buffer::recorder::dump_result module::dump_fifo_recorder(const std::string& path,
+    const double before, const double after) {
+    return dump_fifo_recorder(path, buffer::recorder::clock::now(), before, after);
+}
+
+buffer::recorder::dump_result module::dump_fifo_recorder(const std::string& path,
+    buffer::recorder::time_point trigger, const double before, const double after) {
+    if (!fifo_recorder.enabled()) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "fifo: recorder not enabled");
+    }
+    xia_log(log::info) << module_label(*this) << "fifo: recorder dump: " << path;
+    return fifo_recorder.dump(path, trigger, before, after);
+}
+
 void module::select_port(const int port) {
     bus_guard guard(*this);
     cfg_ctrlcs &= ~(7 << 19);
@@ -1896,6 +2817,9 @@ void module::report(std::ostream& out) const {
         out << fifo_bandwidth << " Mbytes/sec";
     }
     out << std::endl
+        << "FIFO Adaptive  : " << std::boolalpha << fifo_adaptive.load() << std::endl
+        << "FIFO Recorder  : " << fifo_recorder_bytes << " bytes, " << fifo_recorder_secs
+        << " secs" << std::endl
         << std::endl
         << "Bus cycle      : " << bus_cycle_period << " usecs" << std::endl
         << std::endl;
@@ -1935,6 +2859,122 @@ void module::report(std::ostream& out) const {
     }
 }
 
+void module::get_bus_costs(bus_costs& costs) {
+    std::lock_guard<std::mutex> guard(bus_costs_lock);
+    costs = bus_op_costs;
+}
+
+void module::clear_bus_costs() {
+    std::lock_guard<std::mutex> guard(bus_costs_lock);
+    bus_op_costs.clear();
+    bus_totals.clear();
+}
+
+/*
+ * The bytes held by a variable table and its descriptors.
+ */
+template<typename Descs>
+static size_t descs_bytes(const Descs& descs) {
+    size_t bytes = descs.capacity() * sizeof(typename Descs::value_type);
+    for (auto& desc : descs) {
+        bytes += desc.name.capacity();
+    }
+    return bytes;
+}
+
+template<typename Vars>
+static size_t vars_bytes(const Vars& vars) {
+    size_t bytes = vars.capacity() * sizeof(typename Vars::value_type);
+    for (auto& var : vars) {
+        bytes += var.value.capacity() * sizeof(typename Vars::value_type::data);
+    }
+    return bytes;
+}
+
+void module::get_memory_usage(memory_usage& current, memory_usage& peak) {
+    lock_guard guard(lock_);
+    const size_t buffer_bytes = fifo_pool.size * sizeof(buffer::buffer_value);
+    current.clear();
+    current.pool_capacity = fifo_pool.number * buffer_bytes;
+    current.pool_in_use = (fifo_pool.number - fifo_pool.count()) * buffer_bytes;
+    current.queued = fifo_data.size() * sizeof(buffer::buffer_value);
+    current.recorder = fifo_recorder.size() * sizeof(buffer::buffer_value);
+    for (auto& fw : firmware) {
+        current.firmware += fw->bytes();
+    }
+    current.variables = descs_bytes(module_var_descriptors) +
+        descs_bytes(channel_var_descriptors) + vars_bytes(module_vars);
+    current.variables += channels.capacity() * sizeof(channel::channel);
+    for (auto& chan : channels) {
+        current.variables += vars_bytes(chan.vars);
+        current.fixtures += chan.adc_trace.capacity() * sizeof(hw::adc_word);
+    }
+    memory_peak.peak(current);
+    memory_usage tracked;
+    tracked.pool_in_use = (fifo_pool.number - fifo_pool.low_count()) * buffer_bytes;
+    tracked.queued = fifo_data.max_size() * sizeof(buffer::buffer_value);
+    memory_peak.peak(tracked);
+    peak = memory_peak;
+}
+
+void module::clear_memory_peaks() {
+    lock_guard guard(lock_);
+    fifo_pool.reset_low_count();
+    fifo_data.reset_max_size();
+    memory_peak.clear();
+}
+
+void module::count_hbr_request() {
+    ++bus_totals.hbr_requests;
+    auto op = bus_op::find(current_bus_op, *this);
+    if (op != nullptr) {
+        ++op->cost_.hbr_requests;
+    }
+}
+
+void module::count_bus_access(bus_access access) {
+    auto op = bus_op::find(current_bus_op, *this);
+    switch (access) {
+        case bus_access::pio_read:
+            ++bus_totals.pio_reads;
+            if (op != nullptr) {
+                ++op->cost_.pio_reads;
+            }
+            break;
+        case bus_access::pio_write:
+            ++bus_totals.pio_writes;
+            if (op != nullptr) {
+                ++op->cost_.pio_writes;
+            }
+            break;
+    }
+}
+
+void module::count_dma(const size_t size) {
+    auto bytes = size * sizeof(hw::word);
+    ++bus_totals.dma_transfers;
+    bus_totals.dma_bytes += bytes;
+    auto op = bus_op::find(current_bus_op, *this);
+    if (op != nullptr) {
+        ++op->cost_.dma_transfers;
+        op->cost_.dma_bytes += bytes;
+    }
+}
+
+module::bus_lock_type& module::bus_acquire() {
+    if (!bus_lock_.try_lock()) {
+        util::timepoint tp(true);
+        bus_lock_.lock();
+        auto usecs = size_t(tp.usecs());
+        bus_totals.bus_wait_usecs += usecs;
+        auto op = bus_op::find(current_bus_op, *this);
+        if (op != nullptr) {
+            op->cost_.bus_wait_usecs += usecs;
+        }
+    }
+    return bus_lock_;
+}
+
 void module::dma_read(const hw::address source, hw::words& values) {
     dma_read(source, values.data(), values.size());
 }
@@ -1950,6 +2990,8 @@ void module::dma_read(const hw::address source, hw::word_ptr values, const size_
         throw error(number, slot, error::code::device_dma_failure, "bus lock not held");
     }
 
+    count_dma(size);
+
     util::timepoint tp;
     tp.start();
 
@@ -1982,6 +3024,27 @@ void module::dma_read(const hw::address source, hw::word_ptr values, const size_
     xia_log(log::debug) << module_label(*this) << "dma read: done, period=" << tp;
 }
 
+void module::dma_reset() {
+    xia_log(log::info) << module_label(*this) << "dma reset";
+
+    online_check();
+
+    bus_op op(*this, "dma_reset");
+    bus_guard guard(*this);
+
+    PLX_STATUS ps = ::PlxPci_DmaChannelClose(&device->handle, 0);
+    if (ps == PLX_STATUS_IN_PROGRESS) {
+        ::PlxPci_DeviceReset(&device->handle);
+        ::PlxPci_DmaChannelClose(&device->handle, 0);
+    }
+    ps = ::PlxPci_DmaChannelOpen(&device->handle, 0, &device->dma);
+    if (ps != PLX_STATUS_OK) {
+        std::ostringstream oss;
+        oss << "DMA reset: " << pci_error_text(ps);
+        throw error(number, slot, error::code::device_dma_failure, oss.str());
+    }
+}
+
 hw::rev_tag module::get_rev_tag() const {
     return static_cast<hw::rev_tag>(revision);
 }
@@ -2042,6 +3105,15 @@ int module::pci_slot() {
     return -1;
 }
 
+int module::find_pci_bus(size_t device_number) {
+    pci_bus_handle probe;
+    PLX_STATUS ps = ::PlxPci_DeviceFind(&probe.key, uint16_t(device_number));
+    if (ps != PLX_STATUS_OK) {
+        return -1;
+    }
+    return int(probe.bus());
+}
+
 void module::start_test(const test mode) {
     xia_log(log::info) << module_label(*this) << "start-test: mode=" << int(mode);
     online_check();
@@ -2075,6 +3147,132 @@ void module::end_test() {
     log_stats("total", data_stats);
 }
 
+void module::characterize_fifo(const throughput_config& config, throughput_report& report) {
+    xia_log(log::info) << module_label(*this) << "characterize-fifo: dma-blocks="
+                       << config.dma_block_sizes.size()
+                       << " trigger-levels=" << config.trigger_levels.size()
+                       << " words=" << config.words << " max-msecs=" << config.max_msecs;
+    online_check();
+    if (config.dma_block_sizes.empty() || config.trigger_levels.empty() || config.words == 0) {
+        throw error(number, slot, error::code::invalid_value,
+                    "invalid throughput characterization settings");
+    }
+    for (auto level : config.trigger_levels) {
+        if (level < min_fifo_dma_trigger_level || level > max_fifo_dma_trigger_level) {
+            throw error(number, slot, error::code::invalid_value,
+                        "throughput trigger level out of range");
+        }
+    }
+
+    /*
+     * Latency samples per point.
+     */
+    const size_t max_latencies = 256 * 1024;
+
+    report.number = number;
+    report.slot = slot;
+    report.serial_num = serial_num;
+    report.bus_datarate = hw::pci_bus_datarate;
+    report.points.clear();
+
+    /*
+     * The points set the trigger level so the adaptive settings are held.
+     */
+    const size_t saved_trigger_level = fifo_dma_trigger_level.load();
+    const bool saved_adaptive = fifo_adaptive.exchange(false);
+
+    try {
+        for (auto block : config.dma_block_sizes) {
+            for (auto level : config.trigger_levels) {
+                throughput_point point;
+                point.dma_block_size = block;
+                point.trigger_level = level;
+
+                fifo_dma_trigger_level = level;
+                test_dma_block_size = block;
+                {
+                    std::lock_guard<std::mutex> guard(test_latency_lock);
+                    test_latencies.clear();
+                    test_latencies.reserve(max_latencies);
+                }
+                fifo_data.flush();
+
+                auto bus_start = bus_totals.get();
+                auto cpu_start = util::thread_cpu_secs(fifo_thread);
+                util::timepoint period(true);
+                test_latency_record = true;
+
+                start_test(test::lm_fifo);
+
+                /*
+                 * The data is discarded as it arrives so the buffers are
+                 * returned to the pool. The host copy is not measured.
+                 */
+                while (run_stats.dma_in.load() < config.words &&
+                       period.msecs() < config.max_msecs) {
+                    fifo_data.flush();
+                    hw::wait(1000);
+                }
+
+                end_test();
+                auto usecs = period.usecs();
+                auto cpu_end = util::thread_cpu_secs(fifo_thread);
+                /*
+                 * Let the worker finish a transfer in progress so it is
+                 * counted in this point.
+                 */
+                sync_worker_run(true);
+                test_latency_record = false;
+                auto bus_end = bus_totals.get();
+                fifo_data.flush();
+
+                point.words = run_stats.dma_in.load();
+                point.hw_overflows = run_stats.hw_overflows.load();
+                point.transfers = bus_end.dma_transfers - bus_start.dma_transfers;
+                point.secs = double(usecs) / 1e6;
+                const double mbytes = double(point.words * sizeof(hw::word)) / 1e6;
+                if (point.secs > 0) {
+                    point.mb_per_sec = mbytes / point.secs;
+                }
+                point.bus_usage = (point.mb_per_sec * 100) / double(hw::pci_bus_datarate);
+                point.cpu_secs = cpu_end - cpu_start;
+                if (mbytes > 0) {
+                    point.cpu_usecs_per_mb = (point.cpu_secs * 1e6) / mbytes;
+                }
+
+                {
+                    std::lock_guard<std::mutex> guard(test_latency_lock);
+                    std::sort(test_latencies.begin(), test_latencies.end());
+                    point.latency_p50_usecs = percentile(test_latencies, 50);
+                    point.latency_p90_usecs = percentile(test_latencies, 90);
+                    point.latency_p99_usecs = percentile(test_latencies, 99);
+                    point.latency_max_usecs = percentile(test_latencies, 100);
+                    test_latencies.clear();
+                    test_latencies.shrink_to_fit();
+                }
+
+                xia_log(log::info) << module_label(*this) << "characterize-fifo: "
+                                   << point.output();
+
+                report.points.push_back(point);
+            }
+        }
+    } catch (...) {
+        if (test_mode.load() != test::off) {
+            end_test();
+        }
+        test_latency_record = false;
+        test_dma_block_size = 0;
+        fifo_dma_trigger_level = saved_trigger_level;
+        fifo_adaptive = saved_adaptive;
+        throw;
+    }
+
+    test_dma_block_size = 0;
+    fifo_dma_trigger_level = saved_trigger_level;
+    fifo_adaptive = saved_adaptive;
+}
+
 void module::load_vars() {
     if (!vars_loaded) {
         firmware::firmware_ref vars = get("var");
@@ -2292,7 +3490,8 @@ void module::start_fifo_services() {
         if (fippi.done()) {
             hw::csr::reset(*this);
             if (!fifo_pool.valid()) {
-                fifo_pool.create(fifo_buffers, 64 * 1024);
+                fifo_recorder_reserved = fifo_recorder_buffers();
+                fifo_pool.create(fifo_buffers + fifo_recorder_reserved, fifo_buffer_words);
                 start_fifo_worker();
                 hw::run::end(*this);
             }
@@ -2301,8 +3500,10 @@ void module::start_fifo_services() {
 }
 
 void module::stop_fifo_services() {
+    stop_low_latency();
     stop_fifo_worker();
     fifo_data.flush();
+    fifo_recorder.clear();
     fifo_pool.destroy();
 }
 
@@ -2310,6 +3511,10 @@ void module::start_fifo_worker() {
     xia_log(log::debug) << module_label(*this) << std::boolalpha
                         << "FIFO worker: starting: running=" << fifo_worker_running.load();
     if (!fifo_worker_running.load()) {
+        size_t revision;
+        size_t frequency;
+        list_mode_format(revision, frequency);
+        event_stats.format(revision, frequency);
         pause_fifo_worker = true;
         fifo_worker_finished = false;
         fifo_worker_running = true;
@@ -2330,6 +3535,150 @@ void module::stop_fifo_worker() {
     }
 }
 
+void module::start_low_latency(fifo_consumer consumer, const int cpu) {
+    xia_log(log::info) << module_label(*this) << "low-latency: start: cpu=" << cpu;
+    online_check();
+    lock_guard guard(lock_);
+    if (!consumer) {
+        throw error(number, slot, error::code::invalid_value, "low-latency: no consumer");
+    }
+    if (low_latency_running.load()) {
+        throw error(number, slot, error::code::module_invalid_operation,
+                    "low-latency: already running");
+    }
+    /*
+     * Collect a worker that finished on an error.
+     */
+    if (low_latency_thread.joinable()) {
+        low_latency_thread.join();
+    }
+    size_t revision;
+    size_t frequency;
+    list_mode_format(revision, frequency);
+    try {
+        data::list_mode::event_header header;
+        data::list_mode::decode_event_header(0, revision, frequency, header);
+    } catch (pixie::error::error& e) {
+        throw error(number, slot, e.type, std::string("low-latency: ") + e.what());
+    }
+    event_stats.format(revision, frequency);
+    low_latency_consumer = consumer;
+    low_latency_stats.clear();
+    low_latency_running = true;
+    low_latency_thread =
+        std::thread(&module::low_latency_worker, this, revision, frequency);
+    if (cpu >= 0 && !util::set_thread_affinity(low_latency_thread, cpu)) {
+        xia_log(log::warning) << module_label(*this)
+                              << "low-latency: cannot pin the thread to cpu " << cpu;
+    }
+}
+
+void module::stop_low_latency() {
+    lock_guard guard(lock_);
+    if (low_latency_thread.joinable()) {
+        xia_log(log::info) << module_label(*this) << "low-latency: stop: "
+                           << low_latency_stats.output();
+        low_latency_running = false;
+        low_latency_thread.join();
+        low_latency_consumer = nullptr;
+    }
+}
+
+bool module::low_latency() const {
+    return low_latency_running.load();
+}
+
+void module::low_latency_worker(const size_t revision, const size_t frequency) {
+    using clock = std::chrono::steady_clock;
+
+    hw::memory::fifo fifo(*this);
+
+    /*
+     * The words of a partial event are held at the front of the data
+     * until the remainder arrives.
+     */
+    hw::words data(hw::fifo_size_words);
+    size_t held = 0;
+    clock::time_point held_arrival;
+
+    xia_log(log::info) << module_label(*this) << "low-latency worker: running";
+
+    try {
+        while (low_latency_running.load()) {
+            if (!online()) {
+                std::this_thread::yield();
+                continue;
+            }
+            size_t level = fifo.level();
+            if (level == 0 || level == std::numeric_limits<hw::word>::max()) {
+                std::this_thread::yield();
+                continue;
+            }
+            auto arrival = clock::now();
+            if (held == 0) {
+                held_arrival = arrival;
+            }
+            size_t read_words = std::min(level, hw::max_dma_block_size);
+            read_words = std::min(read_words, data.size() - held);
+            fifo.read(&data[held], read_words);
+            data_stats.dma_in += read_words;
+            run_stats.dma_in += read_words;
+            const size_t words = held + read_words;
+            size_t complete = 0;
+            bool bad_event = false;
+            data::list_mode::event_header header;
+            while (complete < words) {
+                data::list_mode::decode_event_header(data[complete], revision, frequency, header);
+                if (!header.valid()) {
+                    bad_event = true;
+                    break;
+                }
+                if (complete + header.event_length > words) {
+                    break;
+                }
+                complete += header.event_length;
+            }
+            if (complete > 0) {
+                event_stats.add(data.data(), complete, slot);
+                std::chrono::nanoseconds latency = clock::now() - held_arrival;
+                low_latency_stats.add(size_t(latency.count()));
+                low_latency_consumer(data.data(), complete);
+                data_stats.in += complete;
+                data_stats.out += complete;
+                run_stats.in += complete;
+                run_stats.out += complete;
+            }
+            if (bad_event) {
+                xia_log(log::error) << module_label(*this)
+                                    << "low-latency worker: bad event length, dropping "
+                                    << words - complete << " words";
+                data_stats.dropped += words - complete;
+                run_stats.dropped += words - complete;
+                held = 0;
+            } else {
+                held = words - complete;
+                if (held != 0 && complete != 0) {
+                    std::copy(data.begin() + complete, data.begin() + words, data.begin());
+                    held_arrival = arrival;
+                }
+            }
+        }
+    } catch (pixie::error::error& e) {
+        xia_log(log::error) << module_label(*this) << "low-latency worker: " << e;
+        notify_run(run_event::worker_error, std::string("low-latency worker: ") + e.what());
+    } catch (std::exception& e) {
+        xia_log(log::error) << module_label(*this) << "low-latency worker: error: " << e.what();
+        notify_run(run_event::worker_error, std::string("low-latency worker: ") + e.what());
+    } catch (...) {
+        xia_log(log::error) << module_label(*this) << "low-latency worker: unhandled exception";
+        notify_run(run_event::worker_error, "low-latency worker: unhandled exception");
+    }
+
+    low_latency_running = false;
+
+    xia_log(log::info) << module_label(*this) << "low-latency worker: finished";
+}
+
 void module::fifo_worker() {
     hw::memory::fifo fifo(*this);
 
@@ -2355,6 +3704,21 @@ void module::fifo_worker() {
 
         int requested_wait_loops = 0;
 
+        /*
+         * Error recovery state.
+         */
+        size_t read_retries = 0;
+        util::timepoint recovery_start;
+
+        /*
+         * Adaptive settings state.
+         */
+        util::timepoint tune_interval(true);
+        size_t tune_dma_in = data_stats.dma_in.load();
+        size_t tune_level = 0;
+        size_t tune_rising = 0;
+        double tune_rate = 0;
+
         sync::variable::lock_guard guard(fifo_worker_working);
 
         while (fifo_worker_running.load()) {
@@ -2366,6 +3730,16 @@ void module::fifo_worker() {
                 continue;
             }
 
+            bus_op op(*this, "fifo_worker");
+
+            /*
+             * The data loop checks if the run has ended. Check here when
+             * the data loop does not run, for example a histogram run.
+             */
+            if (pause_fifo_worker.load() || low_latency_running.load()) {
+                check_run_ended();
+            }
+
             hw::run::run_task this_run_tsk = run_task.load();
 
             /*
@@ -2389,11 +3763,21 @@ void module::fifo_worker() {
              */
             bool mode_asynchronous = run_wait != 0;
 
+            /*
+             * The adaptive settings replace the user settings while the
+             * worker is tuning.
+             */
+            size_t hold_usecs = fifo_hold_usecs.load();
+            size_t dma_trigger_level = fifo_dma_trigger_level.load();
+            if (mode_asynchronous && fifo_adaptive.load() && tuned_run_wait_usecs.load() != 0) {
+                run_wait = tuned_run_wait_usecs.load();
+                hold_usecs = tuned_hold_usecs.load();
+                dma_trigger_level = tuned_dma_trigger_level.load();
+            }
+
             if (mode_asynchronous) {
-                if (this_run_tsk == hw::run::run_task::list_mode) {
-                    wait_time = run_wait;
-                }
-                if (test_mode.load() != test::off) {
+                if (this_run_tsk == hw::run::run_task::list_mode ||
+                    test_mode.load() != test::off) {
                     wait_time = run_wait;
                 } else {
                     const size_t idle_wait_time = fifo_idle_wait_usecs.load();
@@ -2404,8 +3788,7 @@ void module::fifo_worker() {
                      */
                     if (wait_time > idle_wait_time) {
                         wait_time = idle_wait_time;
-                    } else if (wait_time < idle_wait_time &&
-                               hold_time >= fifo_hold_usecs.load()) {
+                    } else if (wait_time < idle_wait_time && hold_time >= hold_usecs) {
                         wait_time <<= 1;
                         if (wait_time > idle_wait_time) {
                             wait_time = idle_wait_time;
@@ -2430,17 +3813,14 @@ void module::fifo_worker() {
              * and reading data the hold time is reset so the wait time
              * only starts to decay once we do not see data.
              */
-            while (fifo_worker_running.load() && !pause_fifo_worker.load()) {
+            while (fifo_worker_running.load() && !pause_fifo_worker.load() &&
+                   !low_latency_running.load()) {
                 /*
                  * See if the task is still running? If not the module may
                  * have been directed to stop running by another module.
                  */
+                check_run_ended();
                 this_run_tsk = run_task.load();
-                if (this_run_tsk != hw::run::run_task::nop &&
-                    this_run_tsk != hw::run::run_task::run_stopping && !hw::run::active(*this)) {
-                    run_task = hw::run::run_task::nop;
-                    xia_log(log::info) << module_label(*this) << "FIFO worker: run not active";
-                }
                 /*
                  * Read the level of the FIFO every loop when the mode
                  * is asynchronous.
@@ -2453,6 +3833,7 @@ void module::fifo_worker() {
                     if (!fifo_full_logged) {
                         fifo_full_logged = true;
                         xia_log(log::warning) << module_label(*this) << "FIFO worker: FIFO full";
+                        notify_run(run_event::fifo_overflow, "FIFO full");
                     }
                     data_stats.hw_overflows++;
                     run_stats.hw_overflows++;
@@ -2468,8 +3849,7 @@ void module::fifo_worker() {
                  */
                 if (level == 0 ||
                     (mode_asynchronous && !requester_waiting &&
-                     hold_time < fifo_hold_usecs.load() &&
-                     level < fifo_dma_trigger_level.load())) {
+                     hold_time < hold_usecs && level < dma_trigger_level)) {
                     break;
                 }
                 if (level == std::numeric_limits<hw::word>::max()) {
@@ -2505,10 +3885,56 @@ void module::fifo_worker() {
                     if (read_words > buf->capacity()) {
                         read_words = buf->capacity();
                     }
+                    const size_t test_block = test_dma_block_size.load();
+                    if (test_block != 0 && read_words > test_block) {
+                        read_words = test_block;
+                    }
                     buf->resize(read_words);
-                    fifo.read(*buf, read_words);
+                    try {
+                        if (test_latency_record.load()) {
+                            auto dma_start = std::chrono::steady_clock::now();
+                            fifo.read(*buf, read_words);
+                            std::chrono::duration<double, std::micro> latency =
+                                std::chrono::steady_clock::now() - dma_start;
+                            std::lock_guard<std::mutex> guard(test_latency_lock);
+                            if (test_latencies.size() < test_latencies.capacity()) {
+                                test_latencies.push_back(latency.count());
+                            }
+                        } else {
+                            fifo.read(*buf, read_words);
+                        }
+                    } catch (pixie::error::error& e) {
+                        /*
+                         * Recover the DMA path and read the level
+                         * again. The buffer returns to the pool.
+                         */
+                        if (read_retries == 0) {
+                            recovery_start.restart();
+                        }
+                        if (!fifo_recover(e, read_words, read_retries)) {
+                            throw;
+                        }
+                        break;
+                    }
+                    if (read_retries != 0) {
+                        size_t usecs = recovery_start.usecs();
+                        data_stats.recoveries++;
+                        run_stats.recoveries++;
+                        data_stats.recovery_usecs += usecs;
+                        run_stats.recovery_usecs += usecs;
+                        xia_log(log::info) << module_label(*this)
+                                           << "FIFO worker: recovered: retries=" << read_retries
+                                           << " time=" << usecs << "usecs";
+                        read_retries = 0;
+                    }
                     data_stats.dma_in += read_words;
                     run_stats.dma_in += read_words;
+                    if (test_mode.load() == test::off) {
+                        event_stats.add(buf->data(), read_words, slot);
+                    }
+                    if (fifo_recorder.enabled()) {
+                        fifo_recorder.record(buf);
+                    }
                     if (queue_buf) {
                         data_stats.in += read_words;
                         run_stats.in += read_words;
@@ -2547,6 +3973,7 @@ void module::fifo_worker() {
                     if (!pool_empty_logged) {
                         xia_log(log::warning) << module_label(*this) << "FIFO worker: pool empty";
                         pool_empty_logged = true;
+                        notify_run(run_event::fifo_overflow, "pool empty");
                     }
                     break;
                 }
@@ -2583,6 +4010,53 @@ void module::fifo_worker() {
                 }
             }
 
+            /*
+             * Adapt the settings to the data flow when a run or test is
+             * active. The rate is smoothed over the measurement periods.
+             */
+            if (mode_asynchronous && fifo_adaptive.load() &&
+                (this_run_tsk == hw::run::run_task::list_mode || test_mode.load() != test::off)) {
+                auto usecs = tune_interval.usecs();
+                if (usecs >= fifo_tuning::period_usecs) {
+                    auto dma_in = data_stats.dma_in.load();
+                    double rate = (double(dma_in - tune_dma_in) * 1e6) / double(usecs);
+                    tune_rate = (tune_rate + rate) / 2;
+                    if (level > tune_level) {
+                        ++tune_rising;
+                    } else {
+                        tune_rising = 0;
+                    }
+                    const bool pool_low = fifo_pool.count() < (fifo_buffers / 4);
+                    fifo_tuning tuning;
+                    tuning.tune(tune_rate, tune_rising > 1, pool_low);
+                    if (tuning.run_wait_usecs != tuned_run_wait_usecs.load() ||
+                        tuning.hold_usecs != tuned_hold_usecs.load() ||
+                        tuning.dma_trigger_level != tuned_dma_trigger_level.load()) {
+                        xia_log(log::debug) << module_label(*this) << "FIFO worker: adapt:"
+                                            << " rate=" << size_t(tune_rate)
+                                            << " level=" << level
+                                            << " rising=" << tune_rising
+                                            << std::boolalpha << " pool-low=" << pool_low
+                                            << " run-wait=" << tuning.run_wait_usecs
+                                            << " hold=" << tuning.hold_usecs
+                                            << " dma-trigger-level=" << tuning.dma_trigger_level;
+                        tuned_hold_usecs = tuning.hold_usecs;
+                        tuned_dma_trigger_level = tuning.dma_trigger_level;
+                        tuned_run_wait_usecs = tuning.run_wait_usecs;
+                    }
+                    tune_dma_in = dma_in;
+                    tune_level = level;
+                    tune_interval.restart();
+                }
+            } else {
+                tuned_run_wait_usecs = 0;
+                tune_dma_in = data_stats.dma_in.load();
+                tune_level = 0;
+                tune_rising = 0;
+                tune_rate = 0;
+                tune_interval.restart();
+            }
+
             /*
              * Wait for a request to run. If run has been requested
              * respond so the requester is notified the work has been
@@ -2612,7 +4086,7 @@ void module::fifo_worker() {
             /*
              * Bound the lower timeout so this thread does not spin.
              */
-            if (hold_time < fifo_hold_usecs.load()) {
+            if (hold_time < hold_usecs) {
                 hold_time += wait_time;
             }
         }
@@ -2631,10 +4105,13 @@ void module::fifo_worker() {
         }
     } catch (pixie::error::error& e) {
         xia_log(log::error) << "FIFO worker: " << e;
+        notify_run(run_event::worker_error, std::string("FIFO worker: ") + e.what());
     } catch (std::exception& e) {
         xia_log(log::error) << "FIFO worker: error: " << e.what();
+        notify_run(run_event::worker_error, std::string("FIFO worker: ") + e.what());
     } catch (...) {
         xia_log(log::error) << "FIFO worker: unhandled exception";
+        notify_run(run_event::worker_error, "FIFO worker: unhandled exception");
     }
 
     level = fifo.level();
@@ -2645,6 +4122,12 @@ void module::fifo_worker() {
 }
 
 
+hw::word module::emulate_read_word(int ) {
+    return 0;
+}
+
+void module::emulate_write_word(int , const hw::word ) {}
+
 void module::calc_bus_speed() {
     const size_t count = 5000;
     util::timepoint tp;
@@ -2668,6 +4151,100 @@ void module::log_stats(const char* label, const fifo_stats& stats) {
     xia_log(log::info) << module_label(*this) << label << ": " << stats.output();
 }
 
+bool module::fifo_recover(const pixie::error::error& e, const size_t read_words, size_t& retries) {
+    data_stats.errors++;
+    run_stats.errors++;
+    /*
+     * Only DMA and FIFO errors can be recovered. A failed DMA transfer
+     * has taken the data from the FIFO so the read is counted as lost.
+     */
+    bool recoverable = false;
+    switch (e.type) {
+        case error::code::device_dma_failure:
+            data_stats.lost += read_words;
+            run_stats.lost += read_words;
+            recoverable = true;
+            break;
+        case error::code::device_dma_busy:
+        case error::code::device_fifo_failure:
+            recoverable = true;
+            break;
+        default:
+            break;
+    }
+    if (!recoverable) {
+        xia_log(log::error) << module_label(*this) << "FIFO worker: recovery failed: retries="
+                            << retries << ": " << e.what();
+        return false;
+    }
+    /*
+     * The worker keeps recovering once the retries are exhausted. The
+     * failure is counted and reported once and the worker retries at
+     * the capped backoff until the reads resume or the run ends.
+     */
+    if (retries == fifo_read_retries) {
+        data_stats.failures++;
+        run_stats.failures++;
+        xia_log(log::error) << module_label(*this) << "FIFO worker: retries exhausted: retries="
+                            << retries << ": " << e.what();
+        notify_run(run_event::worker_error,
+                   std::string("FIFO worker: retries exhausted: ") + e.what());
+    }
+    size_t backoff = fifo_recovery_backoff_usec << std::min(retries, size_t(16));
+    if (backoff > max_fifo_recovery_backoff_usec) {
+        backoff = max_fifo_recovery_backoff_usec;
+    }
+    ++retries;
+    xia_log(log::warning) << module_label(*this) << "FIFO worker: read error: retry=" << retries
+                          << " backoff=" << backoff << "usecs: " << e.what();
+    hw::wait(backoff);
+    try {
+        dma_reset();
+    } catch (pixie::error::error& re) {
+        xia_log(log::warning) << module_label(*this) << "FIFO worker: " << re;
+    }
+    return true;
+}
+
+static run_notice make_run_notice(const module& mod, const run_event event,
+                                  const hw::run::run_task task, const std::string& what) {
+    run_notice notice;
+    notice.event = event;
+    notice.number = mod.number;
+    notice.slot = mod.slot;
+    notice.task = task;
+    notice.what = what;
+    notice.when = run_notice::clock::now();
+    xia_log(log::debug) << module_label(mod) << notice.output();
+    return notice;
+}
+
+void module::notify_run(const run_event event, const std::string& what) {
+    run_notices.notify(make_run_notice(*this, event, notified_run.load(), what));
+}
+
+void module::notify_run_ended(const char* cause) {
+    auto task = notified_run.exchange(hw::run::run_task::nop);
+    if (task != hw::run::run_task::nop) {
+        run_notices.notify(make_run_notice(*this, run_event::ended, task, cause));
+    }
+}
+
+void module::check_run_ended() {
+    auto task = run_task.load();
+    if (task != hw::run::run_task::nop && task != hw::run::run_task::run_stopping &&
+        !hw::run::active(*this)) {
+        run_task = hw::run::run_task::nop;
+        xia_log(log::info) << module_label(*this) << "FIFO worker: run not active";
+        notify_run_ended("run not active");
+    }
+}
+
+size_t module::fifo_recorder_buffers() const {
+    return buffer::recorder::pinned_buffers(fifo_recorder_bytes / sizeof(hw::word),
+                                            fifo_buffer_words);
+}
+
 bool module::fifo_worker_run(size_t timeout_usecs) {
     sync::variable::lock_guard guard(fifo_worker_working);
     fifo_worker_req.notify();
@@ -256,8 +256,12 @@ void control_run_on_dsp(module::module& module, control_task control_tsk, int wa
 }
 
 void control(module::module& module, control_task control_tsk, int wait_msecs) {
+    if (module.defer_control(control_tsk)) {
+        return;
+    }
     xia_log(log::debug) << module::module_label(module, "run")
                         << "control=" << control_task_labels(control_tsk) << " wait=" << wait_msecs;
+    module::module::bus_op op(module, control_task_labels(control_tsk));
     util::timepoint tp;
     tp.start();
     if (control_task_prerun(module, control_tsk, wait_msecs)) {
@@ -272,6 +276,7 @@ void control(module::module& module, control_task control_tsk, int wait_msecs) {
 void run(module::module& module, run_mode mode, run_task run_tsk) {
     xia_log(log::debug) << module::module_label(module, "run") << "mode=" << run_mode_labels[int(mode)]
                         << " run=" << run_task_labels(run_tsk);
+    module::module::bus_op op(module, run_task_labels(run_tsk));
     start(module, mode, run_tsk, control_task::nop);
 }
 }  // namespace run
@@ -24,9 +24,14 @@
 #include <cstring>
 #include <fstream>
 
+#include <pixie/error.hpp>
 #include <pixie/log.hpp>
 #include <pixie/util.hpp>
 
+#include <pixie/data/list_mode.hpp>
+
+#include <pixie/pixie16/defs.hpp>
+#include <pixie/pixie16/memory.hpp>
 #include <pixie/pixie16/sim.hpp>
 
 namespace xia {
@@ -34,6 +39,14 @@ namespace pixie {
 namespace sim {
 module_defs mod_defs;
 
+/*
+ * The start of the DSP's variable memory.
+ */
+static const hw::address dsp_var_memory = 0x4a000;
+
+bus_timing::bus_timing()
+    : pio_read_usecs(1.0), pio_write_usecs(0.25), dma_setup_usecs(5.0), dma_mb_per_sec(100) {}
+
 struct fixture : public xia::pixie::fixture::module {
     fixture(xia::pixie::module::module& module_);
     virtual ~fixture() override;
@@ -83,9 +96,203 @@ void fixture::get_traces() {}
 void fixture::adjust_offsets() {}
 void fixture::tau_finder() {}
 
-module::module(xia::pixie::backplane::backplane& backplane_) : xia::pixie::module::module(backplane_) {}
+/*
+ * A list-mode replay source. The file is read in blocks into the staged
+ * words. The words between the head and released are in the simulated
+ * FIFO. The events after released arrive as the pacing permits.
+ */
+struct replay_source {
+    /*
+     * The file is read in blocks of this many words.
+     */
+    static const size_t block_words = 1024 * 1024;
+
+    /*
+     * A header's first word holds the event length.
+     */
+    static const size_t min_event_length = 4;
+
+    std::string name;
+    std::ifstream input;
+    replay_pacing pacing;
+    double rate;
+    double tick_secs;
+    size_t revision;
+    size_t frequency;
+
+    hw::words staged;
+    size_t head;
+    size_t released;
+    bool eof;
+
+    bool running;
+    bool have_start;
+    uint64_t start_time;
+    util::timepoint clock;
+
+    size_t words_out;
+
+    replay_source(const std::string& file, replay_pacing pacing, double rate, double tick_secs,
+                  size_t revision, size_t frequency);
+
+    void start();
+    void stop();
+    void rewind();
+    size_t level();
+    void read(hw::word_ptr values, const size_t size);
+
+private:
+    void release();
+    bool fill(size_t words);
+    static uint64_t event_time(const hw::word* event);
+};
+
+replay_source::replay_source(const std::string& file, replay_pacing pacing_, double rate_,
+                             double tick_secs_, size_t revision_, size_t frequency_)
+    : name(file), pacing(pacing_), rate(rate_), tick_secs(tick_secs_), revision(revision_),
+      frequency(frequency_), head(0), released(0),
+      eof(false), running(false), have_start(false), start_time(0), words_out(0) {
+    if (pacing == replay_pacing::scaled && rate <= 0) {
+        throw error(error::code::invalid_value, "sim: replay: invalid rate");
+    }
+    if (pacing == replay_pacing::original) {
+        rate = 1.0;
+    }
+    /*
+     * Check the list-mode format is supported.
+     */
+    data::list_mode::event_header header;
+    data::list_mode::decode_event_header(0, revision, frequency, header);
+    input.open(file, std::ios::in | std::ios::binary);
+    if (!input) {
+        throw error(error::code::file_open_failure,
+                    std::string("sim: replay open: ") + file + ": " + std::strerror(errno));
+    }
+}
+
+void replay_source::start() {
+    running = true;
+    have_start = false;
+    clock.restart();
+}
+
+void replay_source::stop() {
+    running = false;
+    clock.end();
+}
+
+void replay_source::rewind() {
+    /*
+     * The words in the FIFO remain.
+     */
+    staged.erase(staged.begin() + released, staged.end());
+    staged.erase(staged.begin(), staged.begin() + head);
+    released -= head;
+    head = 0;
+    input.clear();
+    input.seekg(0);
+    eof = false;
+}
+
+size_t replay_source::level() {
+    release();
+    return released - head;
+}
+
+void replay_source::read(hw::word_ptr values, const size_t size) {
+    if (size > released - head) {
+        throw error(error::code::device_fifo_failure, "sim: replay: FIFO read underflow");
+    }
+    std::copy(staged.begin() + head, staged.begin() + head + size, values);
+    head += size;
+    words_out += size;
+}
+
+void replay_source::release() {
+    if (!running) {
+        return;
+    }
+    const double elapsed = double(clock.usecs()) / 1e6;
+    while (true) {
+        if (!fill(min_event_length)) {
+            break;
+        }
+        const hw::word* event = &staged[released];
+        data::list_mode::event_header header;
+        data::list_mode::decode_event_header(event[0], revision, frequency, header);
+        if (!header.valid()) {
+            throw error(error::code::invalid_event_length,
+                        "sim: replay: " + name + ": bad event length: " +
+                            std::to_string(header.event_length));
+        }
+        const size_t length = header.event_length;
+        if (!fill(length)) {
+            break;
+        }
+        event = &staged[released];
+        if ((released - head) + length > hw::fifo_size_words) {
+            break;
+        }
+        if (pacing != replay_pacing::fast) {
+            uint64_t time = event_time(event);
+            if (!have_start) {
+                start_time = time;
+                have_start = true;
+            }
+            double offset = time > start_time ? double(time - start_time) * tick_secs : 0;
+            if (offset / rate > elapsed) {
+                break;
+            }
+        }
+        released += length;
+    }
+}
+
+bool replay_source::fill(size_t words) {
+    if (staged.size() - released >= words) {
+        return true;
+    }
+    if (eof) {
+        return false;
+    }
+    if (head > 0) {
+        staged.erase(staged.begin(), staged.begin() + head);
+        released -= head;
+        head = 0;
+    }
+    while (!eof && staged.size() - released < words) {
+        size_t size = staged.size();
+        staged.resize(size + block_words);
+        input.read(reinterpret_cast<char*>(staged.data() + size), block_words * sizeof(hw::word));
+        size_t got = size_t(input.gcount()) / sizeof(hw::word);
+        staged.resize(size + got);
+        if (got < block_words) {
+            eof = true;
+            xia_log(log::info) << "sim: replay: end of file: " << name;
+        }
+    }
+    return staged.size() - released >= words;
+}
+
+uint64_t replay_source::event_time(const hw::word* event) {
+    return (uint64_t(event[2] & 0xFFFF) << 32) | uint64_t(event[1]);
+}
+
+module::module(xia::pixie::backplane::backplane& backplane_)
+    : xia::pixie::module::module(backplane_), csr(0), fifo_faults(0), dma_faults(0),
+      dsp_dma_addr(0), dsp_dma_active(false), dsp_mem_addr(0), bus_nsecs(0) {}
 
-module::~module() {}
+module::~module() {
+    try {
+        stop_fifo_services();
+    } catch (pixie::error::error& e) {
+        xia_log(log::error) << e;
+    }
+}
+
+int module::find_pci_bus(size_t) {
+    return -1;
+}
 
 void module::open(size_t device_number) {
     if (vmaddr != nullptr) {
@@ -112,12 +319,21 @@ void module::open(size_t device_number) {
             config.adc_clk_div = mod_def.adc_clk_div;
             config.fpga_clk_mhz = mod_def.adc_msps / mod_def.adc_clk_div;
             eeprom.configs.resize(num_channels, config);
+            for (size_t channel = 0; channel < num_channels; ++channel) {
+                eeprom.configs[channel].index = int(channel);
+            }
+            adc_offsets.assign(num_channels, 0);
 
             var_defaults = mod_def.var_defaults;
 
             fixtures = std::make_shared<fixture>(*this);
+            run_config = hw::run::make(*this);
 
             present_ = true;
+
+            if (!mod_def.replay.empty()) {
+                replay(mod_def.replay, mod_def.replay_mode, mod_def.replay_rate);
+            }
             return;
         }
     }
@@ -127,6 +343,8 @@ void module::open(size_t device_number) {
 
 void module::close() {
     xia_log(log::info) << "sim: module: close";
+    stop_fifo_services();
+    replay_.reset();
     present_ = false;
     vmaddr = nullptr;
     pci_memory.release();
@@ -139,8 +357,13 @@ void module::probe() {
     erase_channels();
     init_values();
     init_channels();
+    if (bus_emulated) {
+        bus_guard guard(*this);
+        store_vars();
+    }
     online_ = dsp_online = fippi_fpga = comms_fpga = true;
     fixtures->online();
+    start_replay_services();
 }
 
 void module::boot(bool boot_comms, bool boot_fippi, bool boot_dsp) {
@@ -161,6 +384,20 @@ void module::boot(bool boot_comms, bool boot_fippi, bool boot_dsp) {
     init_values();
     init_channels();
     online_ = comms_fpga && fippi_fpga && dsp_online;
+    if (bus_emulated) {
+        /*
+         * The DSP starts with the variable defaults and the FiPPI is
+         * programmed as the hardware boot does.
+         */
+        {
+            bus_guard guard(*this);
+            store_vars();
+        }
+        if (online_) {
+            hw::run::control(*this, hw::run::control_task::program_fippi);
+        }
+    }
+    start_replay_services();
 }
 
 void module::initialize() {}
@@ -219,6 +456,348 @@ void module::load_var_defaults(const std::string& file) {
     input.close();
 }
 
+void module::replay(const std::string& file, replay_pacing pacing, double rate) {
+    xia_log(log::info) << sim_label() << "replay: file=" << file << " pacing=" << int(pacing)
+                       << " rate=" << rate;
+    double tick_secs = 10e-9;
+    if (!eeprom.configs.empty() && eeprom.configs[0].adc_msps == 250) {
+        tick_secs = 8e-9;
+    }
+    size_t revision;
+    size_t frequency;
+    list_mode_format(revision, frequency);
+    auto source =
+        std::make_unique<replay_source>(file, pacing, rate, tick_secs, revision, frequency);
+    {
+        bus_guard guard(*this);
+        replay_ = std::move(source);
+    }
+    start_replay_services();
+}
+
+void module::replay_stop() {
+    xia_log(log::info) << sim_label() << "replay: stop";
+    bus_guard guard(*this);
+    replay_.reset();
+}
+
+size_t module::replay_words() {
+    bus_guard guard(*this);
+    return replay_ ? replay_->words_out : 0;
+}
+
+void module::replay_end_run() {
+    xia_log(log::info) << sim_label() << "replay: end run";
+    bus_guard guard(*this);
+    csr &= ~(1 << hw::bit::RUNENA);
+    if (replay_) {
+        replay_->stop();
+    }
+}
+
+void module::inject_fault(fault type, size_t count) {
+    xia_log(log::info) << sim_label() << "inject fault: "
+                       << (type == fault::dma ? "dma" : "fifo-watermark") << " count=" << count;
+    if (type == fault::dma) {
+        dma_faults += count;
+    } else {
+        fifo_faults += count;
+    }
+}
+
+void module::adc_input_offset(size_t channel, int offset) {
+    channel_check(channel);
+    xia_log(log::info) << sim_label() << "adc input offset: channel=" << channel
+                       << " offset=" << offset;
+    bus_guard guard(*this);
+    adc_offsets[channel] = offset;
+}
+
+/*
+ * The offset DAC spans the ADC range centred on mid-scale.
+ */
+hw::adc_word module::adc_level(size_t channel) {
+    const int adc_range = 1 << eeprom.configs[channel].adc_bits;
+    const auto offset_dac =
+        channels[channel].vars[int(param::channel_var::OffsetDAC)].value[0].value;
+    int level = adc_range / 2 + ((int(offset_dac) - 32768) * adc_range) / 65536 +
+        adc_offsets[channel];
+    level = std::max(0, std::min(adc_range - 1, level));
+    return hw::adc_word(level);
+}
+
+void module::emulate_adjust_offsets() {
+    for (size_t channel = 0; channel < num_channels; ++channel) {
+        const int adc_range = 1 << eeprom.configs[channel].adc_bits;
+        const auto percent =
+            channels[channel].vars[int(param::channel_var::BaselinePercent)].value[0].value;
+        const int target = int((adc_range * percent) / 100);
+        int offset_dac =
+            32768 + ((target - adc_range / 2 - adc_offsets[channel]) * 65536) / adc_range;
+        offset_dac = std::max(0, std::min(65535, offset_dac));
+        auto& var = channels[channel].vars[int(param::channel_var::OffsetDAC)];
+        var.value[0].value = param::value_type(offset_dac);
+        var.value[0].dirty = false;
+        if (bus_emulated) {
+            dsp_memory[var.var.address + hw::address(eeprom.configs[channel].index)] =
+                hw::word(offset_dac);
+        }
+    }
+}
+
+void module::emulate_dsp_memory(bool enable) {
+    xia_log(log::info) << sim_label() << "emulate DSP memory: " << std::boolalpha << enable;
+    guard module_guard(*this);
+    bus_guard bus(*this);
+    if (enable) {
+        assign_var_addresses();
+        store_vars();
+    } else {
+        dsp_memory.clear();
+    }
+    bus_emulated = enable;
+}
+
+bool module::dsp_memory_emulated() const {
+    return bus_emulated;
+}
+
+void module::set_bus_timing(const bus_timing& timing_) {
+    bus_guard guard(*this);
+    timing = timing_;
+}
+
+double module::bus_usecs() const {
+    return double(bus_nsecs.load()) / 1000;
+}
+
+void module::clear_bus_usecs() {
+    bus_nsecs = 0;
+}
+
+void module::assign_var_addresses() {
+    /*
+     * A loaded variable file has set the addresses.
+     */
+    if (std::any_of(module_var_descriptors.begin(), module_var_descriptors.end(),
+                    [](const param::module_var_desc& desc) { return desc.address != 0; })) {
+        return;
+    }
+    hw::address addr = dsp_var_memory;
+    for (auto& desc : module_var_descriptors) {
+        desc.address = addr;
+        addr += hw::address(desc.size);
+    }
+    /*
+     * A channel variable is an array indexed by the channel.
+     */
+    for (auto& desc : channel_var_descriptors) {
+        desc.address = addr;
+        addr += hw::address(desc.size * hw::max_channels);
+    }
+    xia_log(log::info) << sim_label() << "DSP variables: addresses=0x" << std::hex
+                       << dsp_var_memory << "-0x" << addr;
+}
+
+void module::store_vars() {
+    for (auto& var : module_vars) {
+        for (size_t v = 0; v < var.value.size(); ++v) {
+            dsp_memory[var.var.address + hw::address(v)] = hw::word(var.value[v].value);
+        }
+    }
+    for (auto& channel : channels) {
+        const auto index = hw::address(eeprom.configs[channel.number].index);
+        for (auto& var : channel.vars) {
+            for (size_t v = 0; v < var.value.size(); ++v) {
+                dsp_memory[var.var.address + index + hw::address(v)] =
+                    hw::word(var.value[v].value);
+            }
+        }
+    }
+}
+
+hw::word module::dsp_load(hw::address addr) const {
+    auto mem = dsp_memory.find(addr);
+    return mem == dsp_memory.end() ? 0 : mem->second;
+}
+
+void module::model_bus_time(double usecs) {
+    bus_nsecs += uint64_t(usecs * 1000);
+}
+
+void module::model_dma_time(size_t size) {
+    double usecs = timing.dma_setup_usecs;
+    if (timing.dma_mb_per_sec > 0) {
+        usecs += double(size * sizeof(hw::word)) / timing.dma_mb_per_sec;
+    }
+    model_bus_time(usecs);
+}
+
+/*
+ * Take one of the pending faults.
+ */
+static bool take_fault(std::atomic_size_t& faults) {
+    size_t pending = faults.load();
+    while (pending > 0 && !faults.compare_exchange_weak(pending, pending - 1)) {
+    }
+    return pending > 0;
+}
+
+void module::dma_read(const hw::address source, hw::word_ptr values, const size_t size) {
+    if (replay_ && source == hw::memory::FIFO_MEM_DMA) {
+        if (take_fault(fifo_faults)) {
+            throw error(number, slot, error::code::device_fifo_failure,
+                "FIFO failed to reach watermark (injected)");
+        }
+        count_dma(size);
+        model_dma_time(size);
+        replay_->read(values, size);
+        if (take_fault(dma_faults)) {
+            throw error(number, slot, error::code::device_dma_failure,
+                "DMA read: transfer failed (injected)");
+        }
+        return;
+    }
+    /*
+     * The DSP's I/O buffer holds the ADC traces, one channel after the
+     * other, after the traces are acquired and is otherwise empty. The
+     * rest of the memory is the model if there is one.
+     */
+    if (source == hw::memory::DSP_MEM_DMA && dsp_dma_active && num_channels > 0) {
+        const bool traces = control_task.load() == hw::run::control_task::get_traces;
+        const size_t trace_words = eeprom.configs[0].max_adc_trace_length / 2;
+        count_dma(size);
+        model_dma_time(size);
+        for (size_t w = 0; w < size; ++w) {
+            const hw::address addr = dsp_dma_addr + hw::address(w);
+            if (traces && addr >= hw::memory::IO_BUFFER_ADDR) {
+                hw::word level = 0;
+                const size_t channel = (addr - hw::memory::IO_BUFFER_ADDR) / trace_words;
+                if (channel < num_channels) {
+                    level = adc_level(channel);
+                }
+                values[w] = level | (level << 16);
+            } else {
+                values[w] = bus_emulated ? dsp_load(addr) : 0;
+            }
+        }
+        dsp_dma_addr += hw::address(size);
+        return;
+    }
+    xia::pixie::module::module::dma_read(source, values, size);
+}
+
+void module::dma_reset() {
+    xia_log(log::info) << sim_label() << "dma reset";
+    bus_op op(*this, "dma_reset");
+}
+
+hw::word module::emulate_read_word(int reg) {
+    model_bus_time(timing.pio_read_usecs);
+    if (bus_emulated && reg == hw::device::WRT_DSP_MMA) {
+        return dsp_load(dsp_mem_addr++);
+    }
+    const hw::word dsp_dma_ready = dsp_dma_active ? 1 << hw::bit::EXTFIFO_WML : 0;
+    if (!replay_) {
+        return reg == hw::device::CSR ? dsp_dma_ready : 0;
+    }
+    switch (reg) {
+    case hw::device::CSR: {
+        const hw::word runena = 1 << hw::bit::RUNENA;
+        hw::word value = csr;
+        if ((csr & runena) != 0) {
+            auto task = run_task.load();
+            if (task == hw::run::run_task::list_mode || task == hw::run::run_task::histogram) {
+                value |= 1 << hw::bit::RUNACTIVE;
+            } else if (task != hw::run::run_task::run_stopping) {
+                /*
+                 * Control tasks complete immediately.
+                 */
+                csr &= ~runena;
+                value = csr;
+            }
+        }
+        if (replay_->level() > 0) {
+            value |= 1 << hw::bit::EXTFIFO_WML;
+        }
+        return value | dsp_dma_ready;
+    }
+    case hw::device::RD_WRT_FIFO_WML:
+        return hw::word(replay_->level());
+    default:
+        break;
+    }
+    return 0;
+}
+
+void module::emulate_write_word(int reg, const hw::word value) {
+    const hw::word runena = 1 << hw::bit::RUNENA;
+    model_bus_time(timing.pio_write_usecs);
+    if (bus_emulated) {
+        /*
+         * The host bus address auto-increments.
+         */
+        if (reg == hw::device::EXT_MEM_TEST) {
+            dsp_mem_addr = value;
+        } else if (reg == hw::device::WRT_DSP_MMA) {
+            dsp_memory[dsp_mem_addr++] = value;
+        }
+    }
+    switch (reg) {
+    case hw::device::CSR:
+        if ((value & runena) != 0 &&
+            control_task.load() == hw::run::control_task::adjust_offsets) {
+            emulate_adjust_offsets();
+        }
+        break;
+    case hw::device::WRT_DSP_II11:
+        dsp_dma_addr = value;
+        break;
+    case hw::device::WRT_DSP_DMAC11:
+        /*
+         * 0x905 starts a DSP DMA and 0x904 stops it.
+         */
+        dsp_dma_active = (value & 1) != 0;
+        break;
+    default:
+        break;
+    }
+    if (!replay_) {
+        return;
+    }
+    if (reg == hw::device::CSR) {
+        bool was_running = (csr & runena) != 0;
+        bool running = (value & runena) != 0;
+        csr = value & runena;
+        if (!was_running && running && run_task.load() == hw::run::run_task::list_mode) {
+            xia_log(log::info) << sim_label() << "replay: run start";
+            replay_->start();
+        } else if (!was_running && running &&
+                   control_task.load() == hw::run::control_task::fill_ext_fifo) {
+            /*
+             * The FIFO test streams the replay file from the start.
+             */
+            xia_log(log::info) << sim_label() << "replay: fill ext FIFO start";
+            replay_->rewind();
+            replay_->start();
+        } else if (was_running && !running) {
+            replay_->stop();
+        }
+    }
+}
+
+void module::start_replay_services() {
+    if (replay_ && online() && !fifo_pool.valid()) {
+        fifo_recorder_reserved = fifo_recorder_buffers();
+        fifo_pool.create(fifo_buffers + fifo_recorder_reserved, fifo_buffer_words);
+        start_fifo_worker();
+    }
+}
+
+std::string module::sim_label() const {
+    return xia::pixie::module::module_label(*this, "sim: module");
+}
+
 void crate::add_module() {
     xia_log(log::info) << "sim: module: add";
     modules.push_back(std::make_unique<module>(backplane));
@@ -226,7 +805,8 @@ void crate::add_module() {
 
 module_def::module_def()
     : device_number(0), slot(0), revision(0), eeprom_format(0), serial_num(0), num_channels(0),
-      adc_bits(0), adc_msps(0), adc_clk_div(0) {}
+      adc_bits(0), adc_msps(0), adc_clk_div(0), replay_mode(replay_pacing::original),
+      replay_rate(1.0) {}
 
 void load_module_defs(const std::string mod_def_file) {
     xia_log(log::info) << "sim: load module defs: " << mod_def_file;
@@ -282,6 +862,17 @@ void add_module_def(const std::string mod_desc, const char delimiter) {
                 mod_def.adc_clk_div = std::stoul(label_value[1]);
             } else if (label_value[0] == "var-defaults") {
                 mod_def.var_defaults = label_value[1];
+            } else if (label_value[0] == "replay") {
+                mod_def.replay = label_value[1];
+            } else if (label_value[0] == "replay-pacing") {
+                if (label_value[1] == "original") {
+                    mod_def.replay_mode = replay_pacing::original;
+                } else if (label_value[1] == "fast") {
+                    mod_def.replay_mode = replay_pacing::fast;
+                } else {
+                    mod_def.replay_mode = replay_pacing::scaled;
+                    mod_def.replay_rate = std::stod(label_value[1]);
+                }
             } else {
                 throw error(error::code::invalid_value, "invalid module definition: " + field);
             }
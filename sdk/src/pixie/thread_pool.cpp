@@ -0,0 +1,370 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file thread_pool.cpp
+ * @brief Implements a work-stealing thread pool and task groups.
+ */
+
+#include <algorithm>
+#include <chrono>
+
+#include <pixie/log.hpp>
+#include <pixie/thread_pool.hpp>
+
+namespace xia {
+namespace pixie {
+namespace thread_pool {
+/*
+ * The pool and queue of a pool thread.
+ */
+static thread_local pool* current_pool;
+static thread_local size_t current_queue;
+
+const size_t pool::max_threads = 256;
+const size_t pool::max_queued = 1024;
+
+pool::pool(size_t threads)
+    : configured(threads), running(false), pending(0), active_(0), next(0), steals(0),
+      inlined(0), stopping(false) {}
+
+pool::~pool() {
+    stop();
+}
+
+void pool::resize(size_t threads) {
+    std::lock_guard<std::mutex> guard(resize_lock);
+    if (active_.load() != 0) {
+        throw error(error::code::thread_pool_busy,
+                    "thread pool: resize: tasks active: " + std::to_string(active_.load()));
+    }
+    stop();
+    configured = threads;
+}
+
+size_t pool::size() const {
+    return threads_to_run(configured);
+}
+
+size_t pool::queued() const {
+    return pending.load();
+}
+
+size_t pool::active() const {
+    return active_.load();
+}
+
+size_t pool::stolen() const {
+    return steals.load();
+}
+
+size_t pool::ran_inline() const {
+    return inlined.load();
+}
+
+void pool::submit(task work) {
+    /*
+     * A resize cannot stop the threads once the task is active.
+     */
+    {
+        std::lock_guard<std::mutex> guard(resize_lock);
+        if (!running.load()) {
+            start();
+        }
+        ++active_;
+    }
+    const size_t q = current_pool == this ? current_queue : next++ % queues.size();
+    bool queued = false;
+    try {
+        std::lock_guard<std::mutex> guard(queues[q]->lock);
+        if (queues[q]->tasks.size() < max_queued) {
+            queues[q]->tasks.push_back(std::move(work));
+            ++pending;
+            queued = true;
+        }
+    } catch (...) {
+        --active_;
+        throw;
+    }
+    /*
+     * A full queue runs the task on the submitting thread. This holds
+     * back the submitter until the pool catches up.
+     */
+    if (!queued) {
+        ++inlined;
+        work();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+    }
+    ready.notify_one();
+}
+
+bool pool::run_one() {
+    task work;
+    if (take(current_pool == this ? current_queue : queues.size(), work)) {
+        work();
+        return true;
+    }
+    return false;
+}
+
+bool pool::take(size_t self, task& work) {
+    const size_t count = queues.size();
+    /*
+     * The thread's own queue is run in order.
+     */
+    if (self < count) {
+        auto& own = *queues[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            work = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            --pending;
+            return true;
+        }
+    }
+    /*
+     * Steal the newest task from another queue, it is the last the
+     * queue's thread would run.
+     */
+    const size_t first = self < count ? self + 1 : next.load();
+    for (size_t q = 0; q < count; ++q) {
+        const size_t victim = (first + q) % count;
+        if (victim == self) {
+            continue;
+        }
+        auto& other = *queues[victim];
+        std::lock_guard<std::mutex> guard(other.lock);
+        if (!other.tasks.empty()) {
+            work = std::move(other.tasks.back());
+            other.tasks.pop_back();
+            --pending;
+            if (self < count) {
+                ++steals;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t pool::threads_to_run(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    return std::min(threads, max_threads);
+}
+
+void pool::start() {
+    const size_t count = threads_to_run(configured);
+    xia_log(log::debug) << "thread pool: start: threads=" << count;
+    stopping = false;
+    queues.clear();
+    for (size_t q = 0; q < count; ++q) {
+        queues.push_back(std::unique_ptr<queue>(new queue));
+    }
+    for (size_t t = 0; t < count; ++t) {
+        threads.push_back(std::thread(&pool::worker, this, t));
+    }
+    running = true;
+}
+
+void pool::stop() {
+    if (!running.load()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    running = false;
+}
+
+void pool::worker(size_t self) {
+    current_pool = this;
+    current_queue = self;
+    while (true) {
+        task work;
+        if (take(self, work)) {
+            work();
+            continue;
+        }
+        /*
+         * The queued tasks are run before the thread stops.
+         */
+        std::unique_lock<std::mutex> guard(lock);
+        ready.wait(guard, [this] { return stopping || pending.load() > 0; });
+        if (stopping && pending.load() == 0) {
+            break;
+        }
+    }
+    current_pool = nullptr;
+}
+
+group::group(pool& pool__, aggregate mode_)
+    : mode(mode_), pool_(pool__), submitted(0), completed(0), cancelled_(0), cancel(false) {}
+
+group::~group() {
+    wait();
+}
+
+void group::run(task work) {
+    size_t index;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        index = submitted++;
+    }
+    try {
+        pool_.submit([this, index, work]() {
+            bool skip;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                skip = cancel;
+            }
+            if (skip) {
+                finished(nullptr, true);
+                return;
+            }
+            task_error err;
+            err.task = index;
+            err.code = error::code::success;
+            try {
+                work();
+            } catch (pixie::error::error& e) {
+                err.code = e.type;
+                err.what = e.what();
+            } catch (std::exception& e) {
+                err.code = error::code::unknown_error;
+                err.what = e.what();
+                err.exception = std::current_exception();
+            } catch (...) {
+                err.code = error::code::unknown_error;
+                err.what = "unhandled exception";
+                err.exception = std::current_exception();
+            }
+            finished(err.code == error::code::success ? nullptr : &err, false);
+        });
+    } catch (...) {
+        std::lock_guard<std::mutex> guard(lock);
+        --submitted;
+        throw;
+    }
+}
+
+void group::wait() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (completed == submitted) {
+                return;
+            }
+        }
+        if (!pool_.run_one()) {
+            std::unique_lock<std::mutex> guard(lock);
+            complete.wait_for(guard, std::chrono::milliseconds(1),
+                              [this] { return completed == submitted; });
+        }
+    }
+}
+
+bool group::wait_for(size_t usecs) {
+    std::unique_lock<std::mutex> guard(lock);
+    return complete.wait_for(guard, std::chrono::microseconds(usecs),
+                             [this] { return completed == submitted; });
+}
+
+bool group::done() {
+    std::lock_guard<std::mutex> guard(lock);
+    return completed == submitted;
+}
+
+void group::check(const std::string& label) {
+    wait();
+    auto errs = errors();
+    if (errs.empty()) {
+        return;
+    }
+    auto& first = errs.front();
+    if (first.exception) {
+        std::rethrow_exception(first.exception);
+    }
+    std::string what = label + ": " + first.what;
+    if (mode == aggregate::all) {
+        for (size_t e = 1; e < errs.size(); ++e) {
+            what += "; " + errs[e].what;
+        }
+    }
+    throw error(first.code, what);
+}
+
+bool group::failed() {
+    std::lock_guard<std::mutex> guard(lock);
+    return !errors_.empty();
+}
+
+task_errors group::errors() {
+    task_errors errs;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        errs = errors_;
+    }
+    std::sort(errs.begin(), errs.end(),
+              [](const task_error& a, const task_error& b) { return a.task < b.task; });
+    return errs;
+}
+
+size_t group::cancelled() {
+    std::lock_guard<std::mutex> guard(lock);
+    return cancelled_;
+}
+
+void group::finished(task_error* err, bool skipped) {
+    /*
+     * The task is no longer active before the group sees it finish so a
+     * pool resize after a wait is not busy.
+     */
+    --pool_.active_;
+    /*
+     * Notify with the lock held, the group can be destroyed once the
+     * last task has finished.
+     */
+    std::lock_guard<std::mutex> guard(lock);
+    if (skipped) {
+        ++cancelled_;
+    }
+    if (err != nullptr) {
+        errors_.push_back(*err);
+        if (mode == aggregate::first) {
+            cancel = true;
+        }
+    }
+    ++completed;
+    if (completed == submitted) {
+        complete.notify_all();
+    }
+}
+
+}  // namespace thread_pool
+}  // namespace pixie
+}  // namespace xia
@@ -33,6 +33,13 @@
 #include <pixie/error.hpp>
 #include <pixie/util.hpp>
 
+#if defined(_WIN64) || defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace xia {
 namespace util {
 void dequote(std::string& s) {
@@ -209,6 +216,54 @@ void timepoint::unlock() {
     locked = false;
 }
 
+bool set_thread_affinity(std::thread& thread, const int cpu) {
+    if (cpu < 0 || unsigned(cpu) >= std::thread::hardware_concurrency()) {
+        return false;
+    }
+#if defined(_WIN64) || defined(_WIN32)
+    DWORD_PTR mask = DWORD_PTR(1) << cpu;
+    return ::SetThreadAffinityMask(thread.native_handle(), mask) != 0;
+#elif defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return ::pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus) == 0;
+#else
+    (void) thread;
+    return false;
+#endif
+}
+
+double thread_cpu_secs(std::thread& thread) {
+    if (!thread.joinable()) {
+        return 0;
+    }
+#if defined(_WIN64) || defined(_WIN32)
+    FILETIME created, exited, kernel, user;
+    if (::GetThreadTimes(thread.native_handle(), &created, &exited, &kernel, &user) == 0) {
+        return 0;
+    }
+    /*
+     * The times are in 100 nanosecond units.
+     */
+    auto ticks = [](const FILETIME& ft) {
+        return (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    };
+    return double(ticks(kernel) + ticks(user)) / 1e7;
+#elif defined(__linux__)
+    clockid_t clock;
+    struct timespec ts;
+    if (::pthread_getcpuclockid(thread.native_handle(), &clock) != 0 ||
+        ::clock_gettime(clock, &ts) != 0) {
+        return 0;
+    }
+    return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+#else
+    (void) thread;
+    return 0;
+#endif
+}
+
 ieee_float::ieee_float() : value(0) {}
 
 ieee_float::ieee_float(const ieee_float& ieee) : value(ieee.value) {}
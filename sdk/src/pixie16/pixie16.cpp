@@ -20,8 +20,14 @@
  * @brief C wrappers for the C++ API that expose the same signature as the legacy code
  */
 
+#include <algorithm>
 #include <bitset>
+#include <cerrno>
 #include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include <pixie16/pixie16.h>
 
@@ -32,6 +38,7 @@
 #include <pixie/stats.hpp>
 #include <pixie/util.hpp>
 
+#include <pixie/pixie16/calibration_cache.hpp>
 #include <pixie/pixie16/crate.hpp>
 #include <pixie/pixie16/legacy.hpp>
 #include <pixie/pixie16/run.hpp>
@@ -72,9 +79,46 @@ struct stats_legacy {
 typedef stats_legacy* stats_legacy_ptr;
 
 /*
- * The crate. We only handle a single crate with the legacy API.
+ * Crate instances. The default crate is used by the API calls made on
+ * threads that have not selected a crate. Created crates are owned by the
+ * crates list until destroyed. A thread's selection and each API call hold
+ * a reference so a crate cannot be destroyed while it is in use.
  */
-static xia::pixie::crate::crate crate;
+struct pixie_crate {
+    xia::pixie::crate::crate crate;
+};
+
+typedef std::shared_ptr<pixie_crate> pixie_crate_ptr;
+typedef std::shared_ptr<xia::pixie::crate::crate> crate_ptr;
+
+static pixie_crate_ptr default_crate = std::make_shared<pixie_crate>();
+static std::mutex crates_lock;
+static std::vector<pixie_crate_ptr> crates;
+static thread_local pixie_crate_ptr selected_crate;
+
+/*
+ * Calibration cache files are read and written under this lock.
+ */
+static std::mutex calibration_cache_lock;
+
+/*
+ * The crate the calling thread has selected. Hold the returned pointer for
+ * the length of the call.
+ */
+static crate_ptr current_crate() {
+    auto& instance = selected_crate ? selected_crate : default_crate;
+    return crate_ptr(instance, &instance->crate);
+}
+
+static pixie_crate_ptr find_crate(pixie_crate_handle handle) {
+    std::lock_guard<std::mutex> guard(crates_lock);
+    for (auto& c : crates) {
+        if (c.get() == handle) {
+            return c;
+        }
+    }
+    return {};
+}
 
 stats_legacy::stats_legacy(const xia::pixie::hw::configs& configs)
     : marker_1(mark_1), marker_2(mark_2) {
@@ -94,12 +138,15 @@ static int not_supported() {
 }
 
 static void load_settings_file(xia::pixie::module::module& module, const std::string& filename) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     try {
         xia::pixie::legacy::settings settings(module);
         settings.load(filename);
         settings.import(module);
         settings.write(module);
         module.sync_vars();
+        crate.write_id();
     } catch (xia::pixie::error::error& err) {
         if (err.type == xia::pixie::error::code::module_total_invalid ||
             err.type == xia::pixie::error::code::channel_number_invalid) {
@@ -175,9 +222,12 @@ PIXIE_EXPORT unsigned int PIXIE_API Pixie16GetStatisticsSize(void) {
 PIXIE_EXPORT int PIXIE_API PixieGetHistogramLength(const unsigned short mod_num,
                                                    const unsigned short chan_num,
                                                    unsigned int* hist_length) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, mod_num);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->channel_check(chan_num);
         *hist_length = module->channels[chan_num].fixture->config.max_histogram_length;
     } catch (xia_error& e) {
@@ -199,9 +249,12 @@ PIXIE_EXPORT int PIXIE_API PixieGetHistogramLength(const unsigned short mod_num,
 PIXIE_EXPORT int PIXIE_API PixieGetTraceLength(const unsigned short mod_num,
                                                const unsigned short chan_num,
                                                unsigned int* trace_length) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, mod_num);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->channel_check(chan_num);
         *trace_length = module->channels[chan_num].fixture->config.max_adc_trace_length;
     } catch (xia_error& e) {
@@ -223,9 +276,12 @@ PIXIE_EXPORT int PIXIE_API PixieGetTraceLength(const unsigned short mod_num,
 PIXIE_EXPORT int PIXIE_API PixieGetMaxNumBaselines(const unsigned short mod_num,
                                                    const unsigned short chan_num,
                                                    unsigned int* max_num_baselines) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, mod_num);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->channel_check(chan_num);
         *max_num_baselines = module->channels[chan_num].fixture->config.max_num_baselines;
     } catch (xia_error& e) {
@@ -257,11 +313,14 @@ PIXIE_EXPORT int PIXIE_API PixieGetReturnCodeText(int return_code, char* buf,
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16AcquireADCTrace(unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16AcquireADCTrace: ModNum=" << ModNum;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->get_traces();
     } catch (xia_error& e) {
         xia_log(xia::log::error) << e;
@@ -281,6 +340,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16AcquireADCTrace(unsigned short ModNum) {
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16AcquireBaselines(unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16AcquireBaselines: ModNum=" << ModNum;
 
     try {
@@ -288,6 +349,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16AcquireBaselines(unsigned short ModNum) {
         if (ModNum == crate.num_modules) {
             for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
                 xia::pixie::crate::module_handle module(crate, mod_num);
+                xia::pixie::module::module::bus_op op(*module, __func__);
                 if (*module == xia::pixie::hw::rev_H) {
                     return not_supported();
                 }
@@ -295,6 +357,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16AcquireBaselines(unsigned short ModNum) {
             }
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
+            xia::pixie::module::module::bus_op op(*module, __func__);
             if (*module == xia::pixie::hw::rev_H) {
                 return not_supported();
             }
@@ -318,6 +381,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16AcquireBaselines(unsigned short ModNum) {
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16AdjustOffsets(unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16AdjustOffsets: ModNum=" << ModNum;
 
     try {
@@ -325,10 +390,12 @@ PIXIE_EXPORT int PIXIE_API Pixie16AdjustOffsets(unsigned short ModNum) {
         if (ModNum == crate.num_modules) {
             for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
                 xia::pixie::crate::module_handle module(crate, mod_num);
+                xia::pixie::module::module::bus_op op(*module, __func__);
                 module->adjust_offsets();
             }
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
+            xia::pixie::module::module::bus_op op(*module, __func__);
             module->adjust_offsets();
         }
     } catch (xia_error& e) {
@@ -350,6 +417,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16AdjustOffsets(unsigned short ModNum) {
 
 PIXIE_EXPORT int PIXIE_API Pixie16BLcutFinder(unsigned short ModNum, unsigned short ChanNum,
                                               unsigned int* BLcut) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16BLcutFinder: ModNum=" << ModNum << " ChanNum=" << ChanNum;
 
     try {
@@ -358,6 +427,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16BLcutFinder(unsigned short ModNum, unsigned sh
         }
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->channel_check(ChanNum);
 
         xia::pixie::channel::range channels = {size_t(ChanNum)};
@@ -385,6 +455,8 @@ static void PixieBootModule(xia::pixie::module::module& module, const char* ComF
                             const char* SPFPGAConfigFile, const char* DSPCodeFile,
                             const char* DSPParFile, const char* DSPVarFile,
                             unsigned short BootPattern) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     using firmware = xia::pixie::firmware::firmware;
     using hw_config = xia::pixie::hw::config;
 
@@ -433,6 +505,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16BootModule(const char* ComFPGAConfigFile,
                                              const char* DSPCodeFile, const char* DSPParFile,
                                              const char* DSPVarFile, unsigned short ModNum,
                                              unsigned short BootPattern) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::info) << "Pixie16BootModule: ModNum=" << ModNum << std::hex
                            << " BootPattern=0x" << BootPattern;
     xia_log(xia::log::info) << "Pixie16BootModule: ModNum=" << ModNum
@@ -488,6 +562,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16BootModule(const char* ComFPGAConfigFile,
 
 PIXIE_EXPORT int PIXIE_API Pixie16CheckExternalFIFOStatus(unsigned int* nFIFOWords,
                                                           unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16CheckExternalFIFOStatus: ModNum=" << ModNum;
 
     int result = 0;
@@ -495,6 +571,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16CheckExternalFIFOStatus(unsigned int* nFIFOWor
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         *nFIFOWords = static_cast<unsigned int>(module->read_list_mode_level());
     } catch (xia_error& e) {
         xia_log(xia::log::error) << e;
@@ -514,6 +591,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16CheckExternalFIFOStatus(unsigned int* nFIFOWor
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16CheckRunStatus(unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16CheckRunStatus: ModNum=" << ModNum;
 
     int result = 0;
@@ -521,6 +600,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16CheckRunStatus(unsigned short ModNum) {
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         if (module->run_active()) {
             result = 1;
         }
@@ -740,25 +820,30 @@ PIXIE_EXPORT int PIXIE_API Pixie16CopyDSPParameters(unsigned short BitMask,
                                                     unsigned short SourceModule,
                                                     unsigned short SourceChannel,
                                                     unsigned short* DestinationMask) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16CopyDSPParameters: Source Module=" << SourceModule
                             << " Source Channel=" << SourceChannel
                             << "  Destination Mask=" << DestinationMask << " Bit Mask=" << BitMask;
 
     try {
         crate.ready();
-        xia::pixie::crate::module_handle source(crate, SourceModule);
 
-        for (size_t dest_mod = 0; dest_mod < crate.num_modules; dest_mod++) {
-            xia::pixie::crate::module_handle dest_handle(crate, dest_mod);
+        if (DestinationMask == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "DestinationMask is NULL");
+        }
 
-            for (size_t dest_chan = 0; dest_chan < dest_handle->num_channels; dest_chan++) {
-                if (DestinationMask[dest_mod * dest_handle->num_channels + dest_chan] == 0) {
-                    continue;
+        xia::pixie::crate::crate::channel_masks masks(crate.num_modules, 0);
+        for (size_t dest_mod = 0; dest_mod < crate.num_modules; dest_mod++) {
+            const size_t num_channels = crate[dest_mod].num_channels;
+            for (size_t dest_chan = 0; dest_chan < num_channels; dest_chan++) {
+                if (DestinationMask[dest_mod * num_channels + dest_chan] != 0) {
+                    masks[dest_mod] |= uint32_t(1) << dest_chan;
                 }
-                xia::pixie::param::copy_parameters(BitMask, source->channels[dest_chan].vars,
-                                                   dest_handle->channels[dest_chan].vars);
             }
         }
+
+        crate.broadcast(SourceModule, SourceChannel, BitMask, masks);
     } catch (xia_error& e) {
         xia_log(xia::log::error) << e;
         return e.return_code();
@@ -777,6 +862,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16CopyDSPParameters(unsigned short BitMask,
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16LoadDSPParametersFromFile(const char* FileName) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16LoadDSPParametersFromFile: FileName=" << FileName;
 
     try {
@@ -803,6 +890,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16LoadDSPParametersFromFile(const char* FileName
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16EndRun(unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16EndRun: ModNum=" << ModNum;
 
     try {
@@ -810,10 +899,12 @@ PIXIE_EXPORT int PIXIE_API Pixie16EndRun(unsigned short ModNum) {
         if (ModNum == crate.num_modules) {
             for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
                 xia::pixie::crate::module_handle module(crate, mod_num);
+                xia::pixie::module::module::bus_op op(*module, __func__);
                 module->run_end();
             }
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
+            xia::pixie::module::module::bus_op op(*module, __func__);
             module->run_end();
         }
     } catch (xia_error& e) {
@@ -834,6 +925,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16EndRun(unsigned short ModNum) {
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16ExitSystem(unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16ExitSystem: ModNum=" << ModNum;
 
     try {
@@ -842,11 +935,13 @@ PIXIE_EXPORT int PIXIE_API Pixie16ExitSystem(unsigned short ModNum) {
             for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
                 xia::pixie::crate::module_handle module(crate, mod_num,
                                                         xia::pixie::crate::module_handle::present);
+                xia::pixie::module::module::bus_op op(*module, __func__);
                 module->close();
             }
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum,
                                                     xia::pixie::crate::module_handle::present);
+            xia::pixie::module::module::bus_op op(*module, __func__);
             module->close();
         }
     } catch (xia_error& e) {
@@ -868,6 +963,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16ExitSystem(unsigned short ModNum) {
 
 PIXIE_EXPORT int PIXIE_API Pixie16InitSystem(unsigned short NumModules, unsigned short* PXISlotMap,
                                              unsigned short OfflineMode) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     /*
      * Create a log file. The environment can change the level of logging.
      */
@@ -968,23 +1065,28 @@ PIXIE_EXPORT int PIXIE_API Pixie16InitSystem(unsigned short NumModules, unsigned
 PIXIE_EXPORT int PIXIE_API Pixie16ReadDataFromExternalFIFO(unsigned int* ExtFIFO_Data,
                                                            unsigned int nFIFOWords,
                                                            unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16ReadDataFromExternalFIFO: ModNum=" << ModNum
                             << " nFIFOWords=" << nFIFOWords;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
 
-        xia::pixie::hw::words data(nFIFOWords);
-        auto copied = module->read_list_mode(data);
+        if (ExtFIFO_Data == nullptr && nFIFOWords != 0) {
+            throw xia_error(xia::pixie::error::code::invalid_value,
+                            "FIFO data buffer is null");
+        }
+        auto copied = module->read_list_mode(
+            xia::util::span<xia::pixie::hw::word>(ExtFIFO_Data, nFIFOWords));
         if (copied != nFIFOWords) {
             xia_log(xia::log::error)
                 << "Failed to read FIFO words, requested nFIFOWords (" << nFIFOWords
                 << "), copied " << copied << " for Module " << ModNum
                 << ". Remaining values filled with zero.";
-        }
-        for (size_t i = 0; i < copied; i++) {
-            ExtFIFO_Data[i] = data[i];
+            std::fill(ExtFIFO_Data + copied, ExtFIFO_Data + nFIFOWords, 0);
         }
     } catch (xia_error& e) {
         xia_log(xia::log::error) << e;
@@ -1007,12 +1109,15 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadHistogramFromModule(unsigned int* Histogra
                                                           unsigned int NumWords,
                                                           unsigned short ModNum,
                                                           unsigned short ChanNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16ReadHistogramFromModule: ModNum=" << ModNum
                             << " ChanNum=" << ChanNum << " NumWords=" << NumWords;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->channel_check(ChanNum);
         auto chan = module->channels[ChanNum];
         auto read_words = NumWords;
@@ -1055,12 +1160,15 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadModuleInfo(unsigned short ModNum, unsigned
                                                  unsigned int* ModSerNum,
                                                  unsigned short* ModADCBits,
                                                  unsigned short* ModADCMSPS) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16ReadModuleInfo: ModNum=" << ModNum;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum,
                                                 xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         if (ModRev)
             *ModRev = module->revision;
         if (ModSerNum)
@@ -1084,6 +1192,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadModuleInfo(unsigned short ModNum, unsigned
 }
 
 PIXIE_EXPORT int PIXIE_API PixieGetModuleInfo(unsigned short mod_num, module_config* cfg) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "PixieReadModuleInfo: ModNum=" << mod_num;
 
     try {
@@ -1096,6 +1206,7 @@ PIXIE_EXPORT int PIXIE_API PixieGetModuleInfo(unsigned short mod_num, module_con
         crate.ready();
         xia::pixie::crate::module_handle module(crate, mod_num,
                                                 xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
 
         cfg->adc_bit_resolution = module->eeprom.configs[0].adc_bits;
         cfg->adc_sampling_frequency = module->eeprom.configs[0].adc_msps;
@@ -1140,12 +1251,15 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadSglChanADCTrace(unsigned short* Trace_Buff
                                                       unsigned int Trace_Length,
                                                       unsigned short ModNum,
                                                       unsigned short ChanNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16ReadSglChanADCTrace: ModNum=" << ModNum
                              << " ChanNum=" << ChanNum << " Trace_Length=" << Trace_Length;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->channel_check(ChanNum);
         module->read_adc(ChanNum, Trace_Buffer, Trace_Length, false);
     } catch (xia_error& e) {
@@ -1169,6 +1283,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadSglChanBaselines(double* Baselines, double
                                                        unsigned short NumBases,
                                                        unsigned short ModNum,
                                                        unsigned short ChanNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16ReadSglChanBaselines: ModNum=" << ModNum
                             << " ChanNum=" << ChanNum << " NumBases=" << NumBases;
 
@@ -1182,6 +1298,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadSglChanBaselines(double* Baselines, double
 
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->channel_check(ChanNum);
 
         xia::pixie::channel::range channels = {size_t(ChanNum)};
@@ -1211,12 +1328,15 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadSglChanBaselines(double* Baselines, double
 
 PIXIE_EXPORT int PIXIE_API Pixie16ReadSglChanPar(const char* ChanParName, double* ChanParData,
                                                  unsigned short ModNum, unsigned short ChanNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16ReadSglChanPar: ModNum=" << ModNum << " ChanNum=" << ChanNum
                             << " ChanParName=" << ChanParName;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->channel_check(ChanNum);
 
         *ChanParData = module->read(ChanParName, ChanNum);
@@ -1242,12 +1362,15 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadSglChanPar(const char* ChanParName, double
 
 PIXIE_EXPORT int PIXIE_API Pixie16ReadSglModPar(const char* ModParName, unsigned int* ModParData,
                                                 unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16ReadSglModPar: ModNum=" << ModNum
                             << " ModParName=" << ModParName;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         *ModParData = module->read(ModParName);
         xia_log(xia::log::debug) << "Pixie16ReadSglModPar: ModNum=" << ModNum
                                 << " ModParName=" << ModParName << " ModParData=" << *ModParData;
@@ -1270,6 +1393,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadSglModPar(const char* ModParName, unsigned
 
 PIXIE_EXPORT int PIXIE_API Pixie16ReadStatisticsFromModule(unsigned int* Statistics,
                                                            unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16ReadStatisticsFromModule: ModNum=" << ModNum;
 
     try {
@@ -1278,6 +1403,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadStatisticsFromModule(unsigned int* Statist
         }
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         stats_legacy_ptr legacy_stats = new (Statistics) stats_legacy(module->eeprom.configs);
         legacy_stats->validate();
         xia::pixie::stats::stats stats(*module);
@@ -1302,6 +1428,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16ReadStatisticsFromModule(unsigned int* Statist
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16SaveDSPParametersToFile(const char* FileName) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16SaveDSPParametersToFile: FileName=" << FileName;
 
     try {
@@ -1328,6 +1456,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16SaveHistogramToFile(const char* FileName, unsi
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16SetDACs(unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16SetDACs: ModNum=" << ModNum;
 
     try {
@@ -1335,10 +1465,12 @@ PIXIE_EXPORT int PIXIE_API Pixie16SetDACs(unsigned short ModNum) {
         if (ModNum == crate.num_modules) {
             for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
                 xia::pixie::crate::module_handle module(crate, mod_num);
+                xia::pixie::module::module::bus_op op(*module, __func__);
                 module->set_dacs();
             }
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
+            xia::pixie::module::module::bus_op op(*module, __func__);
             module->set_dacs();
         }
     } catch (xia_error& e) {
@@ -1359,6 +1491,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16SetDACs(unsigned short ModNum) {
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16StartHistogramRun(unsigned short ModNum, unsigned short mode) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16StartHistogramRun: ModNum=" << ModNum << " mode=" << mode;
 
     try {
@@ -1377,10 +1511,12 @@ PIXIE_EXPORT int PIXIE_API Pixie16StartHistogramRun(unsigned short ModNum, unsig
         if (ModNum == crate.num_modules) {
             for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
                 xia::pixie::crate::module_handle module(crate, mod_num);
+                xia::pixie::module::module::bus_op op(*module, __func__);
                 module->start_histograms(run_mode);
             }
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
+            xia::pixie::module::module::bus_op op(*module, __func__);
             module->start_histograms(run_mode);
         }
     } catch (xia_error& e) {
@@ -1402,6 +1538,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16StartHistogramRun(unsigned short ModNum, unsig
 
 PIXIE_EXPORT int PIXIE_API Pixie16StartListModeRun(unsigned short ModNum, unsigned short RunType,
                                                    unsigned short mode) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16StartListModeRun: ModNum=" << ModNum
                             << " RunType=" << RunType << " mode=" << mode;
 
@@ -1426,10 +1564,12 @@ PIXIE_EXPORT int PIXIE_API Pixie16StartListModeRun(unsigned short ModNum, unsign
         if (ModNum == crate.num_modules) {
             for (size_t mod_num = 0; mod_num < crate.num_modules; mod_num++) {
                 xia::pixie::crate::module_handle module(crate, mod_num);
+                xia::pixie::module::module::bus_op op(*module, __func__);
                 module->start_listmode(run_mode);
             }
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
+            xia::pixie::module::module::bus_op op(*module, __func__);
             module->start_listmode(run_mode);
         }
     } catch (xia_error& e) {
@@ -1450,11 +1590,14 @@ PIXIE_EXPORT int PIXIE_API Pixie16StartListModeRun(unsigned short ModNum, unsign
 }
 
 PIXIE_EXPORT int PIXIE_API Pixie16TauFinder(unsigned short ModNum, double* Tau) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16TauFinder: ModNum=" << ModNum;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         if (*module == xia::pixie::hw::rev_H) {
             return not_supported();
         }
@@ -1480,12 +1623,15 @@ PIXIE_EXPORT int PIXIE_API Pixie16TauFinder(unsigned short ModNum, double* Tau)
 
 PIXIE_EXPORT int PIXIE_API Pixie16WriteSglChanPar(const char* ChanParName, double ChanParData,
                                                   unsigned short ModNum, unsigned short ChanNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16WriteSglChanPar: ModNum=" << ModNum << " ChanNum=" << ChanNum
                             << " ChanParName=" << ChanParName << " ChanParData=" << ChanParData;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, ModNum);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->channel_check(ChanNum);
         module->write(ChanParName, ChanNum, ChanParData);
     } catch (xia_error& e) {
@@ -1507,6 +1653,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16WriteSglChanPar(const char* ChanParName, doubl
 
 PIXIE_EXPORT int PIXIE_API Pixie16WriteSglModPar(const char* ModParName, unsigned int ModParData,
                                                  unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "Pixie16WriteSglModPar: ModNum=" << ModNum
                             << " ModParName=" << ModParName << " ModParData=" << ModParData;
 
@@ -1517,6 +1665,7 @@ PIXIE_EXPORT int PIXIE_API Pixie16WriteSglModPar(const char* ModParName, unsigne
             bcast = true;
         } else {
             xia::pixie::crate::module_handle module(crate, ModNum);
+            xia::pixie::module::module::bus_op op(*module, __func__);
             bcast = module->write(ModParName, ModParData);
         }
         if (bcast) {
@@ -1546,6 +1695,8 @@ PIXIE_EXPORT int PIXIE_API Pixie16WriteSglModPar(const char* ModParName, unsigne
 
 PIXIE_EXPORT int PIXIE_API PixieBootCrate(const char* settings_file,
                                           const PIXIE_BOOT_MODE boot_mode) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "PixieBootCrate: settings_file=" << settings_file
                             << " boot-mode=" << boot_mode;
 
@@ -1611,18 +1762,22 @@ PIXIE_EXPORT int PIXIE_API PixieBootCrate(const char* settings_file,
 
 PIXIE_EXPORT int PIXIE_API PixieGetWorkerConfiguration(const unsigned short mod_num,
                                                        fifo_worker_config* worker_config) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "PixieGetWorkerConfiguration: Module=" << mod_num;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, mod_num,
                                                 xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        auto settings = module->get_fifo_settings();
         worker_config->bandwidth_mb_per_sec = module->fifo_bandwidth;
         worker_config->buffers = module->fifo_buffers;
-        worker_config->dma_trigger_level_bytes = module->fifo_dma_trigger_level;
-        worker_config->hold_usecs = module->fifo_hold_usecs;
+        worker_config->dma_trigger_level_bytes = settings.dma_trigger_level;
+        worker_config->hold_usecs = settings.hold_usecs;
         worker_config->idle_wait_usecs = module->fifo_idle_wait_usecs;
-        worker_config->run_wait_usecs = module->fifo_run_wait_usecs;
+        worker_config->run_wait_usecs = settings.run_wait_usecs;
     } catch (xia_error& e) {
         xia_log(xia::log::error) << e;
         return e.return_code();
@@ -1641,6 +1796,8 @@ PIXIE_EXPORT int PIXIE_API PixieRegisterFirmware(const unsigned int version, con
                                                  const int adc_msps, const int adc_bits,
                                                  const char* device, const char* path,
                                                  unsigned short ModNum) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "PixieRegisterFirmware: version=" << version
                              << " revision=" << revision << " adc_msps=" << adc_msps
                              << " adc_bits=" << adc_bits << " device=" << device << " path=" << path
@@ -1653,6 +1810,7 @@ PIXIE_EXPORT int PIXIE_API PixieRegisterFirmware(const unsigned int version, con
         if (ModNum != 0xACE) {
             xia::pixie::crate::module_handle module(crate, ModNum,
                                                     xia::pixie::crate::module_handle::present);
+            xia::pixie::module::module::bus_op op(*module, __func__);
             slot = module->slot;
         }
         std::string ver_s = std::to_string(version);
@@ -1682,12 +1840,15 @@ PIXIE_EXPORT int PIXIE_API PixieRegisterFirmware(const unsigned int version, con
 
 PIXIE_EXPORT int PIXIE_API PixieSetWorkerConfiguration(const unsigned short mod_num,
                                                        fifo_worker_config* worker_config) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "PixieGetWorkerConfiguration: Module=" << mod_num;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, mod_num,
                                                 xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         module->set_fifo_bandwidth(worker_config->bandwidth_mb_per_sec);
         module->set_fifo_buffers(worker_config->buffers);
         module->set_fifo_dma_trigger_level(worker_config->dma_trigger_level_bytes);
@@ -1707,14 +1868,98 @@ PIXIE_EXPORT int PIXIE_API PixieSetWorkerConfiguration(const unsigned short mod_
     return 0;
 }
 
+PIXIE_EXPORT int PIXIE_API PixieSetWorkerAdaptive(unsigned short mod_num, unsigned int enable) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieSetWorkerAdaptive: Module=" << mod_num
+                             << " enable=" << enable;
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        module->set_fifo_adaptive(enable != 0);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieSetFifoRecorder(unsigned short mod_num, double seconds,
+                                                size_t bytes) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieSetFifoRecorder: Module=" << mod_num
+                             << " seconds=" << seconds << " bytes=" << bytes;
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        module->set_fifo_recorder(seconds, bytes);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieDumpFifoRecorder(unsigned short mod_num, const char* file_name,
+                                                 double before, double after) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieDumpFifoRecorder: Module=" << mod_num
+                             << " file=" << (file_name == nullptr ? "(null)" : file_name)
+                             << " before=" << before << " after=" << after;
+
+    try {
+        crate.ready();
+        if (file_name == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "file name is null");
+        }
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        module->dump_fifo_recorder(file_name, before, after);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
 PIXIE_EXPORT int PIXIE_API PixieReadModuleFifoStats(unsigned short mod_num,
                                                     struct module_fifo_stats* fifo_stats) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "PixieReadModuleFifoStats: Module=" << mod_num;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, mod_num,
                                                 xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         xia::pixie::module::module::fifo_stats snapshot;
         snapshot = module->data_stats;
         fifo_stats->in = snapshot.in;
@@ -1741,12 +1986,15 @@ PIXIE_EXPORT int PIXIE_API PixieReadModuleFifoStats(unsigned short mod_num,
 
 PIXIE_EXPORT int PIXIE_API PixieReadModuleRunFifoStats(unsigned short mod_num,
                                                        struct module_fifo_stats* fifo_stats) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
     xia_log(xia::log::debug) << "PixieReadModuleRunFifoStats: Module=" << mod_num;
 
     try {
         crate.ready();
         xia::pixie::crate::module_handle module(crate, mod_num,
                                                 xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
         xia::pixie::module::module::fifo_stats snapshot;
         snapshot = module->run_stats;
         fifo_stats->in = snapshot.in;
@@ -1770,3 +2018,733 @@ PIXIE_EXPORT int PIXIE_API PixieReadModuleRunFifoStats(unsigned short mod_num,
     }
     return 0;
 }
+
+PIXIE_EXPORT int PIXIE_API PixieReadModuleFifoRecoveryStats(
+    unsigned short mod_num, struct module_fifo_recovery_stats* recovery_stats) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieReadModuleFifoRecoveryStats: Module=" << mod_num;
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        xia::pixie::module::module::fifo_stats snapshot;
+        snapshot = module->data_stats;
+        recovery_stats->errors = snapshot.errors;
+        recovery_stats->recoveries = snapshot.recoveries;
+        recovery_stats->lost = snapshot.lost;
+        recovery_stats->recovery_usecs = snapshot.recovery_usecs;
+        recovery_stats->failures = snapshot.failures;
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadModuleRunFifoRecoveryStats(
+    unsigned short mod_num, struct module_fifo_recovery_stats* recovery_stats) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieReadModuleRunFifoRecoveryStats: Module=" << mod_num;
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        xia::pixie::module::module::fifo_stats snapshot;
+        snapshot = module->run_stats;
+        recovery_stats->errors = snapshot.errors;
+        recovery_stats->recoveries = snapshot.recoveries;
+        recovery_stats->lost = snapshot.lost;
+        recovery_stats->recovery_usecs = snapshot.recovery_usecs;
+        recovery_stats->failures = snapshot.failures;
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+static void copy_memory_usage(const xia::pixie::module::module::memory_usage& from,
+                              struct module_memory_usage* to) {
+    to->pool_capacity = from.pool_capacity;
+    to->pool_in_use = from.pool_in_use;
+    to->queued = from.queued;
+    to->recorder = from.recorder;
+    to->firmware = from.firmware;
+    to->variables = from.variables;
+    to->fixtures = from.fixtures;
+    to->total = from.total();
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadModuleMemoryUsage(unsigned short mod_num,
+                                                      struct module_memory_usage* current,
+                                                      struct module_memory_usage* peak) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieReadModuleMemoryUsage: Module=" << mod_num;
+
+    try {
+        if (current == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "current is NULL");
+        }
+        if (peak == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "peak is NULL");
+        }
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        xia::pixie::module::module::memory_usage current_usage;
+        xia::pixie::module::module::memory_usage peak_usage;
+        module->get_memory_usage(current_usage, peak_usage);
+        copy_memory_usage(current_usage, current);
+        copy_memory_usage(peak_usage, peak);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieClearModuleMemoryPeaks(unsigned short mod_num) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieClearModuleMemoryPeaks: Module=" << mod_num;
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        module->clear_memory_peaks();
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieCreateCrate(int crate_id, const unsigned short* pci_buses,
+                                            unsigned short num_pci_buses,
+                                            pixie_crate_handle* handle) {
+    xia_log(xia::log::debug) << "PixieCreateCrate: crate=" << crate_id
+                             << " pci-buses=" << num_pci_buses;
+
+    try {
+        if (handle == nullptr) {
+            throw xia_error(xia_error::code::crate_invalid_param, "invalid crate handle pointer");
+        }
+        if (crate_id < 0 || crate_id > xia::pixie::crate::crate::max_id) {
+            throw xia_error(xia_error::code::crate_invalid_param, "invalid crate id");
+        }
+        if (pci_buses == nullptr && num_pci_buses != 0) {
+            throw xia_error(xia_error::code::crate_invalid_param, "invalid PCI bus list");
+        }
+        auto instance = std::make_shared<pixie_crate>();
+        instance->crate.id = crate_id;
+        for (unsigned short b = 0; b < num_pci_buses; ++b) {
+            instance->crate.pci_buses.push_back(int(pci_buses[b]));
+        }
+        std::lock_guard<std::mutex> guard(crates_lock);
+        crates.push_back(instance);
+        *handle = instance.get();
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieDestroyCrate(pixie_crate_handle handle) {
+    xia_log(xia::log::debug) << "PixieDestroyCrate";
+
+    try {
+        if (handle == default_crate.get()) {
+            throw xia_error(xia_error::code::crate_invalid_param,
+                            "default crate cannot be destroyed");
+        }
+        pixie_crate_ptr instance;
+        {
+            std::lock_guard<std::mutex> guard(crates_lock);
+            auto ci = std::find_if(crates.begin(), crates.end(),
+                                   [handle](const pixie_crate_ptr& c) {
+                                       return c.get() == handle;
+                                   });
+            if (ci == crates.end()) {
+                throw xia_error(xia_error::code::crate_invalid_param, "invalid crate handle");
+            }
+            /*
+             * The list holds a reference and so may this thread's
+             * selection. Any other reference is a thread that has the
+             * crate selected or an API call in progress.
+             */
+            long holders = selected_crate.get() == handle ? 2 : 1;
+            if ((*ci)->crate.busy() || ci->use_count() > holders) {
+                throw xia_error(xia_error::code::crate_busy, "crate in use");
+            }
+            instance = std::move(*ci);
+            crates.erase(ci);
+        }
+        if (selected_crate == instance) {
+            selected_crate.reset();
+        }
+        bool initialised = true;
+        try {
+            instance->crate.ready();
+        } catch (xia_error&) {
+            initialised = false;
+        }
+        if (initialised) {
+            instance->crate.shutdown();
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieGetDefaultCrate(pixie_crate_handle* handle) {
+    if (handle == nullptr) {
+        return xia::pixie::error::return_code(
+            xia::pixie::error::api_result(xia_error::code::crate_invalid_param));
+    }
+    *handle = default_crate.get();
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieSelectCrate(pixie_crate_handle handle) {
+    xia_log(xia::log::debug) << "PixieSelectCrate";
+
+    try {
+        if (handle == nullptr || handle == default_crate.get()) {
+            selected_crate.reset();
+        } else {
+            auto instance = find_crate(handle);
+            if (!instance) {
+                throw xia_error(xia_error::code::crate_invalid_param, "invalid crate handle");
+            }
+            selected_crate = instance;
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieGetSelectedCrate(pixie_crate_handle* handle) {
+    if (handle == nullptr) {
+        return xia::pixie::error::return_code(
+            xia::pixie::error::api_result(xia_error::code::crate_invalid_param));
+    }
+    *handle = selected_crate ? selected_crate.get() : default_crate.get();
+    return 0;
+}
+
+static void copy_bus_cost(const std::string& name,
+                          const xia::pixie::module::module::bus_cost& cost,
+                          struct module_bus_cost* out) {
+    std::strncpy(out->operation, name.c_str(), sizeof(out->operation) - 1);
+    out->operation[sizeof(out->operation) - 1] = '\0';
+    out->calls = cost.calls;
+    out->pio_reads = cost.pio_reads;
+    out->pio_writes = cost.pio_writes;
+    out->dma_transfers = cost.dma_transfers;
+    out->dma_bytes = cost.dma_bytes;
+    out->hbr_requests = cost.hbr_requests;
+    out->bus_wait_usecs = cost.bus_wait_usecs;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieSetCrateWorkers(unsigned int threads) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieSetCrateWorkers: threads=" << threads;
+
+    try {
+        xia::pixie::crate::crate::guard guard(crate);
+        try {
+            crate.workers.resize(threads);
+        } catch (xia_error& e) {
+            if (e.type != xia_error::code::thread_pool_busy) {
+                throw;
+            }
+            throw xia_error(xia_error::code::crate_busy,
+                            std::string("crate workers: ") + e.what());
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadModuleBusTotals(unsigned short mod_num,
+                                                    struct module_bus_cost* total) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieReadModuleBusTotals: Module=" << mod_num;
+
+    try {
+        if (total == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "total is NULL");
+        }
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        copy_bus_cost("total", module->bus_totals.get(), total);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadModuleBusCosts(unsigned short mod_num,
+                                                   struct module_bus_cost* costs,
+                                                   unsigned int* num_costs) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieReadModuleBusCosts: Module=" << mod_num;
+
+    try {
+        if (num_costs == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "num_costs is NULL");
+        }
+        crate.ready();
+        xia::pixie::module::module::bus_costs snapshot;
+        {
+            xia::pixie::crate::module_handle module(crate, mod_num,
+                                                    xia::pixie::crate::module_handle::present);
+            module->get_bus_costs(snapshot);
+        }
+        if (costs != nullptr) {
+            unsigned int c = 0;
+            for (auto& cost : snapshot) {
+                if (c >= *num_costs) {
+                    break;
+                }
+                copy_bus_cost(cost.first, cost.second, &costs[c]);
+                ++c;
+            }
+        }
+        *num_costs = static_cast<unsigned int>(snapshot.size());
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieClearModuleBusCosts(unsigned short mod_num) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieClearModuleBusCosts: Module=" << mod_num;
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        module->clear_bus_costs();
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieStartLowLatency(unsigned short mod_num,
+                                                pixie_fifo_consumer consumer, void* user,
+                                                int cpu) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieStartLowLatency: Module=" << mod_num << " cpu=" << cpu;
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        if (consumer == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "consumer is NULL");
+        }
+        module->start_low_latency(
+            [mod_num, consumer, user](const xia::pixie::hw::word* data, const size_t length) {
+                consumer(mod_num, data, static_cast<unsigned int>(length), user);
+            },
+            cpu);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieStopLowLatency(unsigned short mod_num) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieStopLowLatency: Module=" << mod_num;
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        module->stop_low_latency();
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadModuleLatencyStats(unsigned short mod_num,
+                                                       struct module_latency_stats* stats) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieReadModuleLatencyStats: Module=" << mod_num;
+
+    try {
+        crate.ready();
+        if (stats == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "latency stats is NULL");
+        }
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        xia::pixie::module::module::latency_histogram snapshot;
+        snapshot = module->low_latency_stats;
+        stats->count = snapshot.count;
+        stats->min_usecs = snapshot.min_nsecs / 1000;
+        stats->max_usecs = snapshot.max_nsecs / 1000;
+        stats->mean_usecs = snapshot.mean_usecs();
+        static_assert(PIXIE_API_LATENCY_BINS ==
+                          xia::pixie::module::module::latency_histogram::bins,
+                      "latency histogram bins mismatch");
+        for (size_t b = 0; b < PIXIE_API_LATENCY_BINS; ++b) {
+            stats->bins[b] = snapshot.counts[b];
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieReadModuleEventCounts(unsigned short mod_num,
+                                                      struct module_event_counts* counts) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieReadModuleEventCounts: Module=" << mod_num;
+
+    try {
+        crate.ready();
+        if (counts == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "event counts pointer is NULL");
+        }
+        xia::pixie::crate::module_handle module(crate, mod_num,
+                                                xia::pixie::crate::module_handle::present);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        static_assert(PIXIE_API_EVENT_CHANNELS == xia::pixie::hw::max_channels,
+                      "event count channels mismatch");
+        auto& stats = module->event_stats;
+        for (size_t ch = 0; ch < size_t(PIXIE_API_EVENT_CHANNELS); ++ch) {
+            counts->events[ch] = stats.channels[ch].events;
+            counts->bytes[ch] = stats.channels[ch].bytes;
+            counts->last_time[ch] = stats.channels[ch].last_time;
+        }
+        counts->total_events = stats.events;
+        counts->other_slots = stats.other_slots;
+        counts->bad_headers = stats.bad_headers;
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieEndRunDrain(unsigned short mod_num, const char* file_name,
+                                            struct module_drain_counts* counts) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieEndRunDrain: Module=" << mod_num
+                             << " file=" << (file_name == nullptr ? "NULL" : file_name);
+
+    try {
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        std::ofstream output;
+        xia::pixie::module::module::fifo_consumer consumer;
+        if (file_name != nullptr) {
+            output.open(file_name, std::ios::binary | std::ios::app);
+            if (!output) {
+                throw xia_error(xia_error::code::file_create_failure,
+                                std::string("drain file open: ") + file_name + ": " +
+                                    std::strerror(errno));
+            }
+            consumer = [&output](const xia::pixie::hw::word* data, const size_t length) {
+                output.write(reinterpret_cast<const char*>(data),
+                             length * sizeof(xia::pixie::hw::word));
+            };
+        }
+        xia::pixie::module::module::drain_counts drained;
+        module->run_end_drain(drained, consumer);
+        if (output.is_open()) {
+            output.close();
+            if (!output) {
+                throw xia_error(xia_error::code::file_create_failure,
+                                std::string("drain file write: ") + file_name);
+            }
+        }
+        if (counts != nullptr) {
+            counts->dma_in = drained.dma_in;
+            counts->in = drained.in;
+            counts->dropped = drained.dropped;
+            counts->lost = drained.lost;
+            counts->drained = drained.drained;
+            counts->written = drained.consumed;
+            counts->queued = drained.queued;
+            counts->usecs = drained.usecs;
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+static void save_calibration(xia::pixie::module::module& module, const std::string& file_name) {
+    std::lock_guard<std::mutex> guard(calibration_cache_lock);
+    xia::pixie::calibration_cache::cache cache;
+    cache.load(file_name);
+    cache.record(module);
+    cache.save(file_name);
+}
+
+PIXIE_EXPORT int PIXIE_API PixieRestoreCalibration(unsigned short mod_num, const char* file_name,
+                                                   struct module_calibration_counts* counts) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieRestoreCalibration: Module=" << mod_num
+                             << " file=" << (file_name == nullptr ? "NULL" : file_name);
+
+    try {
+        if (file_name == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "file name is NULL");
+        }
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        /*
+         * Restoring can recalibrate so only hold the lock to load and save.
+         */
+        xia::pixie::calibration_cache::cache cache;
+        {
+            std::lock_guard<std::mutex> guard(calibration_cache_lock);
+            cache.load(file_name);
+        }
+        xia::pixie::calibration_cache::counts restored;
+        cache.restore(*module, restored);
+        if (restored.recalibrated > 0) {
+            save_calibration(*module, file_name);
+        }
+        if (counts != nullptr) {
+            counts->channels = restored.channels;
+            counts->restored = restored.restored;
+            counts->missing = restored.missing;
+            counts->failed = restored.failed;
+            counts->recalibrated = restored.recalibrated;
+            counts->unverified = restored.unverified;
+            counts->usecs = restored.usecs;
+        }
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieSaveCalibration(unsigned short mod_num, const char* file_name) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieSaveCalibration: Module=" << mod_num
+                             << " file=" << (file_name == nullptr ? "NULL" : file_name);
+
+    try {
+        if (file_name == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "file name is NULL");
+        }
+        crate.ready();
+        xia::pixie::crate::module_handle module(crate, mod_num);
+        xia::pixie::module::module::bus_op op(*module, __func__);
+        save_calibration(*module, file_name);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+    return 0;
+}
+
+PIXIE_EXPORT int PIXIE_API PixieBroadcastChannelParameters(const char* const* names,
+                                                           const double* values,
+                                                           unsigned int count,
+                                                           const unsigned int* channel_masks,
+                                                           unsigned short num_masks) {
+    auto crate_ref = current_crate();
+    auto& crate = *crate_ref;
+    xia_log(xia::log::debug) << "PixieBroadcastChannelParameters: count=" << count
+                             << " num_masks=" << num_masks;
+
+    try {
+        crate.ready();
+
+        if (names == nullptr || values == nullptr) {
+            throw xia_error(xia_error::code::invalid_value, "names or values is NULL");
+        }
+
+        xia::pixie::module::module::param_values params;
+        for (unsigned int p = 0; p < count; ++p) {
+            if (names[p] == nullptr) {
+                throw xia_error(xia_error::code::invalid_value, "parameter name is NULL");
+            }
+            params.push_back(std::make_pair(std::string(names[p]), values[p]));
+        }
+
+        xia::pixie::crate::crate::channel_masks masks;
+        if (channel_masks != nullptr) {
+            masks.assign(channel_masks, channel_masks + num_masks);
+        }
+
+        crate.broadcast(params, masks);
+    } catch (xia_error& e) {
+        xia_log(xia::log::error) << e;
+        return e.return_code();
+    } catch (std::bad_alloc& e) {
+        xia_log(xia::log::error) << "bad allocation: " << e.what();
+        return xia::pixie::error::return_code_bad_alloc_error();
+    } catch (std::exception& e) {
+        xia_log(xia::log::error) << "unknown error: " << e.what();
+        return xia::pixie::error::return_code_unknown_error();
+    } catch (...) {
+        xia_log(xia::log::error) << "unknown error: unhandled exception";
+        return xia::pixie::error::return_code_unknown_error();
+    }
+
+    return 0;
+}
@@ -0,0 +1,563 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file buffer_bench.cpp
+ * @brief Benchmarks the buffer pool and queue under contention.
+ *
+ * A producer thread emulates the FIFO worker. It requests buffers from
+ * the pool, fills them and pushes them to the queue at a rate, compacting
+ * the queue when the pool runs low. Consumer threads emulate the list-mode
+ * reads and copy varied amounts from the queue.
+ *
+ * The words are numbered so each read is checked and the age of the data
+ * read is the time since it was pushed. A queue implementation is
+ * benchmarked by running the harness with its types.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pixie/buffer.hpp>
+#include <pixie/error.hpp>
+#include <pixie/log.hpp>
+#include <pixie/util.hpp>
+
+#include <args/args.hxx>
+
+using error = xia::pixie::error::error;
+
+typedef std::chrono::steady_clock clock_type;
+
+static double usecs_since(clock_type::time_point start) {
+    return std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+}
+
+/*
+ * The harness settings. Sizes are in words.
+ */
+struct settings {
+    double secs;
+    double rate_mb_per_sec;
+    size_t block_min;
+    size_t block_max;
+    size_t buffers;
+    size_t buffer_words;
+    size_t consumers;
+    size_t read_min;
+    size_t read_max;
+    size_t poll_usecs;
+    bool time_locks;
+    unsigned int seed;
+
+    settings();
+};
+
+settings::settings()
+    : secs(2), rate_mb_per_sec(0), block_min(256), block_max(64 * 1024), buffers(100),
+      buffer_words(64 * 1024), consumers(1), read_min(1024), read_max(64 * 1024),
+      poll_usecs(100), time_locks(true), seed(1) {}
+
+/*
+ * A sample of times in microseconds.
+ */
+struct samples {
+    std::vector<double> values;
+
+    samples();
+
+    void add(double usecs);
+    void merge(const samples& other);
+    double percentile(double p);
+    double mean() const;
+    double max();
+    void output(std::ostream& out, const char* label);
+};
+
+samples::samples() {
+    values.reserve(1024 * 1024);
+}
+
+void samples::add(double usecs) {
+    values.push_back(usecs);
+}
+
+void samples::merge(const samples& other) {
+    values.insert(values.end(), other.values.begin(), other.values.end());
+}
+
+double samples::percentile(double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    auto nth = values.begin() + size_t(p / 100 * double(values.size() - 1));
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+double samples::mean() const {
+    if (values.empty()) {
+        return 0;
+    }
+    return std::accumulate(values.begin(), values.end(), 0.0) / double(values.size());
+}
+
+double samples::max() {
+    return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+}
+
+void samples::output(std::ostream& out, const char* label) {
+    xia::util::ostream_guard flags(out);
+    out << "  " << std::left << std::setw(14) << label << std::right << std::fixed
+        << std::setprecision(2) << " n=" << values.size() << " mean=" << mean()
+        << " p50=" << percentile(50) << " p90=" << percentile(90) << " p99=" << percentile(99)
+        << " p99.9=" << percentile(99.9) << " max=" << max() << " usecs" << std::endl;
+}
+
+/*
+ * The push log is a ring of the first word and time of each push. The
+ * data in the queue is from the last pushes so the ring is larger than
+ * the pool.
+ */
+struct push_log {
+    struct entry {
+        std::atomic<uint64_t> first_word;
+        std::atomic<int64_t> nsecs;
+    };
+
+    std::vector<entry> ring;
+    std::atomic<uint64_t> pushes;
+
+    push_log(size_t size);
+
+    void add(uint64_t first_word, clock_type::time_point when);
+    bool find(uint64_t word, clock_type::time_point& when);
+};
+
+push_log::push_log(size_t size) : ring(size), pushes(0) {}
+
+void push_log::add(uint64_t first_word, clock_type::time_point when) {
+    auto& e = ring[pushes.load() % ring.size()];
+    e.first_word = first_word;
+    e.nsecs = when.time_since_epoch().count();
+    pushes.fetch_add(1, std::memory_order_release);
+}
+
+bool push_log::find(uint64_t word, clock_type::time_point& when) {
+    const uint64_t last = pushes.load(std::memory_order_acquire);
+    uint64_t low = last > ring.size() ? last - ring.size() : 0;
+    uint64_t high = last;
+    /*
+     * Binary search for the last push starting at or before the word.
+     */
+    while (high - low > 1) {
+        uint64_t mid = low + (high - low) / 2;
+        if (ring[mid % ring.size()].first_word.load() <= word) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == high || ring[low % ring.size()].first_word.load() > word) {
+        return false;
+    }
+    when = clock_type::time_point(clock_type::duration(ring[low % ring.size()].nsecs.load()));
+    return true;
+}
+
+/*
+ * The producer's results.
+ */
+struct producer_stats {
+    uint64_t words;
+    size_t pushes;
+    size_t stalls;
+    double secs;
+    samples request;
+    samples push;
+    samples compact;
+
+    producer_stats();
+};
+
+producer_stats::producer_stats() : words(0), pushes(0), stalls(0), secs(0) {}
+
+/*
+ * A consumer's results.
+ */
+struct consumer_stats {
+    uint64_t words;
+    size_t reads;
+    size_t short_reads;
+    size_t idle;
+    size_t errors;
+    double secs;
+    samples copy;
+    samples age;
+
+    consumer_stats();
+};
+
+consumer_stats::consumer_stats()
+    : words(0), reads(0), short_reads(0), idle(0), errors(0), secs(0) {}
+
+/*
+ * The harness for a pool and queue implementation.
+ */
+template<typename Pool, typename Queue>
+struct harness {
+    /*
+     * The words are numbered with 32 bits.
+     */
+    static constexpr uint64_t max_words = uint64_t(1) << 32;
+
+    const settings cfg;
+
+    Pool pool;
+    Queue queue;
+    push_log log;
+
+    std::atomic_bool stop;
+    std::atomic_bool producer_done;
+
+    producer_stats producer;
+    std::vector<consumer_stats> consumers;
+
+    xia::buffer::lock_stats pool_locks;
+    xia::buffer::lock_stats queue_locks;
+    double secs;
+
+    harness(const settings& cfg);
+
+    void run();
+    void output(std::ostream& out);
+
+private:
+    void produce();
+    void consume(consumer_stats& stats, unsigned int seed);
+};
+
+template<typename Pool, typename Queue>
+harness<Pool, Queue>::harness(const settings& cfg_)
+    : cfg(cfg_), log(cfg_.buffers * 4 + 1024), stop(false), producer_done(false),
+      consumers(cfg_.consumers), secs(0) {}
+
+template<typename Pool, typename Queue>
+void harness<Pool, Queue>::run() {
+    pool.create(cfg.buffers, cfg.buffer_words);
+    pool.time_locks(cfg.time_locks);
+    queue.time_locks(cfg.time_locks);
+    pool.clear_lock_counts();
+    queue.clear_lock_counts();
+
+    auto start = clock_type::now();
+
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < consumers.size(); ++c) {
+        threads.emplace_back([this, c] { consume(consumers[c], cfg.seed + 1 + unsigned(c)); });
+    }
+    std::thread producer_thread([this] { produce(); });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(cfg.secs));
+    stop = true;
+    producer_thread.join();
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    secs = usecs_since(start) / 1e6;
+    pool_locks = pool.lock_counts();
+    queue_locks = queue.lock_counts();
+
+    queue.flush();
+    pool.destroy();
+}
+
+template<typename Pool, typename Queue>
+void harness<Pool, Queue>::produce() {
+    std::mt19937 gen(cfg.seed);
+    std::uniform_int_distribution<size_t> block(cfg.block_min, cfg.block_max);
+    const double words_per_sec = cfg.rate_mb_per_sec * 1e6 / sizeof(xia::buffer::buffer_value);
+    const auto start = clock_type::now();
+    uint64_t word = 0;
+    while (!stop.load() && word + cfg.block_max < max_words) {
+        if (words_per_sec > 0) {
+            const double ahead = double(word) / words_per_sec - usecs_since(start) / 1e6;
+            if (ahead > 0) {
+                if (ahead > 50e-6) {
+                    std::this_thread::sleep_for(std::chrono::duration<double>(ahead));
+                } else {
+                    std::this_thread::yield();
+                }
+                continue;
+            }
+        }
+        /*
+         * The FIFO worker compacts the queue when the pool is low and
+         * keeps a buffer in reserve.
+         */
+        const size_t count = pool.count();
+        if (count < 4 && count > 1) {
+            auto compact_start = clock_type::now();
+            queue.compact();
+            producer.compact.add(usecs_since(compact_start));
+        }
+        if (pool.count() <= 1) {
+            ++producer.stalls;
+            std::this_thread::yield();
+            continue;
+        }
+        auto request_start = clock_type::now();
+        xia::buffer::handle buf = pool.request();
+        producer.request.add(usecs_since(request_start));
+        const size_t words = std::min(block(gen), buf->capacity());
+        buf->resize(words);
+        std::iota(buf->begin(), buf->end(), xia::buffer::buffer_value(word));
+        auto push_start = clock_type::now();
+        log.add(word, push_start);
+        queue.push(buf);
+        producer.push.add(usecs_since(push_start));
+        word += words;
+        ++producer.pushes;
+    }
+    producer.words = word;
+    producer.secs = usecs_since(start) / 1e6;
+    producer_done = true;
+}
+
+template<typename Pool, typename Queue>
+void harness<Pool, Queue>::consume(consumer_stats& stats, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<size_t> read(cfg.read_min, cfg.read_max);
+    xia::buffer::buffer data(cfg.read_max);
+    const auto start = clock_type::now();
+    uint64_t next = 0;
+    while (true) {
+        const size_t available = queue.size();
+        if (available == 0) {
+            if (producer_done.load()) {
+                break;
+            }
+            ++stats.idle;
+            std::this_thread::sleep_for(std::chrono::microseconds(cfg.poll_usecs));
+            continue;
+        }
+        const size_t words = std::min(read(gen), available);
+        auto copy_start = clock_type::now();
+        try {
+            queue.copy(data.data(), words);
+        } catch (error& e) {
+            /*
+             * Another consumer read the data.
+             */
+            if (e.type != xia::pixie::error::code::buffer_pool_not_enough) {
+                throw;
+            }
+            ++stats.short_reads;
+            continue;
+        }
+        auto now = clock_type::now();
+        stats.copy.add(std::chrono::duration<double, std::micro>(now - copy_start).count());
+        /*
+         * The words are numbered from 0. The 64 bit number of the first
+         * word is within a pool of the last word pushed.
+         */
+        const uint64_t first = data[0];
+        clock_type::time_point pushed;
+        if (log.find(first, pushed)) {
+            stats.age.add(std::chrono::duration<double, std::micro>(now - pushed).count());
+        }
+        for (size_t w = 1; w < words; ++w) {
+            if (data[w] != xia::buffer::buffer_value(first + w)) {
+                ++stats.errors;
+                break;
+            }
+        }
+        if (cfg.consumers == 1 && first != next) {
+            ++stats.errors;
+        }
+        next = first + words;
+        stats.words += words;
+        ++stats.reads;
+    }
+    stats.secs = usecs_since(start) / 1e6;
+}
+
+static void output_locks(std::ostream& out, const char* label,
+                         const xia::buffer::lock_stats& locks, double secs, bool timed) {
+    xia::util::ostream_guard flags(out);
+    const double acquires = locks.acquires == 0 ? 1 : double(locks.acquires);
+    out << label << " lock: acquires=" << locks.acquires << std::fixed << std::setprecision(2)
+        << " contended=" << double(locks.contended) * 100 / acquires << "% wait-mean="
+        << double(locks.wait_nsecs) / 1000 / acquires << "usecs";
+    if (timed) {
+        out << " hold-mean=" << double(locks.hold_nsecs) / 1000 / acquires
+            << "usecs hold-max=" << double(locks.max_hold_nsecs) / 1000
+            << "usecs held=" << double(locks.hold_nsecs) / 1e7 / secs << '%';
+    }
+    out << std::endl;
+}
+
+template<typename Pool, typename Queue>
+void harness<Pool, Queue>::output(std::ostream& out) {
+    xia::util::ostream_guard flags(out);
+    const double mb = 1e6 / sizeof(xia::buffer::buffer_value);
+    out << std::fixed << std::setprecision(2);
+    out << "producer: words=" << producer.words << " pushes=" << producer.pushes
+        << " rate=" << double(producer.words) / mb / producer.secs
+        << "MB/s stalls=" << producer.stalls << " compactions=" << producer.compact.values.size()
+        << std::endl;
+    producer.request.output(out, "request");
+    producer.push.output(out, "push");
+    producer.compact.output(out, "compact");
+
+    consumer_stats total;
+    for (auto& c : consumers) {
+        total.words += c.words;
+        total.reads += c.reads;
+        total.short_reads += c.short_reads;
+        total.idle += c.idle;
+        total.errors += c.errors;
+        total.secs = std::max(total.secs, c.secs);
+        total.copy.merge(c.copy);
+        total.age.merge(c.age);
+    }
+    out << "consumers: " << consumers.size() << " words=" << total.words
+        << " reads=" << total.reads
+        << " rate=" << double(total.words) / mb / std::max(total.secs, 1e-9)
+        << "MB/s short-reads=" << total.short_reads << " idle=" << total.idle
+        << " errors=" << total.errors << std::endl;
+    total.copy.output(out, "copy");
+    total.age.output(out, "data age");
+
+    output_locks(out, "pool", pool_locks, secs, cfg.time_locks);
+    output_locks(out, "queue", queue_locks, secs, cfg.time_locks);
+}
+
+int main(int argc, char* argv[]) {
+    args::ArgumentParser parser("Benchmarks the buffer pool and queue under contention.");
+    args::HelpFlag help_flag(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<double> secs_flag(parser, "secs", "Run period (default 2)", {'t', "secs"});
+    args::ValueFlag<double> rate_flag(parser, "MB/s", "Producer rate, 0 is unpaced (default 0)",
+                                      {'r', "rate"});
+    args::ValueFlag<size_t> block_min_flag(parser, "words", "Smallest push (default 256)",
+                                           {"block-min"});
+    args::ValueFlag<size_t> block_max_flag(parser, "words", "Largest push (default 65536)",
+                                           {"block-max"});
+    args::ValueFlag<size_t> buffers_flag(parser, "number", "Pool buffers (default 100)",
+                                         {'b', "buffers"});
+    args::ValueFlag<size_t> buffer_words_flag(parser, "words", "Buffer size (default 65536)",
+                                              {"buffer-words"});
+    args::ValueFlag<size_t> consumers_flag(parser, "number", "Consumer threads (default 1)",
+                                           {'c', "consumers"});
+    args::ValueFlag<size_t> read_min_flag(parser, "words", "Smallest read (default 1024)",
+                                          {"read-min"});
+    args::ValueFlag<size_t> read_max_flag(parser, "words", "Largest read (default 65536)",
+                                          {"read-max"});
+    args::ValueFlag<size_t> poll_flag(parser, "usecs", "Consumer idle poll (default 100)",
+                                      {'p', "poll"});
+    args::ValueFlag<unsigned int> seed_flag(parser, "seed", "Random seed (default 1)",
+                                            {"seed"});
+    args::Flag untimed_flag(parser, "untimed", "Do not time the lock holds", {"untimed-locks"});
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help&) {
+        std::cout << parser;
+        return EXIT_SUCCESS;
+    } catch (args::Error& e) {
+        std::cerr << e.what() << std::endl << parser;
+        return EXIT_FAILURE;
+    }
+
+    settings cfg;
+    if (secs_flag) {
+        cfg.secs = args::get(secs_flag);
+    }
+    if (rate_flag) {
+        cfg.rate_mb_per_sec = args::get(rate_flag);
+    }
+    if (block_min_flag) {
+        cfg.block_min = args::get(block_min_flag);
+    }
+    if (block_max_flag) {
+        cfg.block_max = args::get(block_max_flag);
+    }
+    if (buffers_flag) {
+        cfg.buffers = args::get(buffers_flag);
+    }
+    if (buffer_words_flag) {
+        cfg.buffer_words = args::get(buffer_words_flag);
+    }
+    if (consumers_flag) {
+        cfg.consumers = args::get(consumers_flag);
+    }
+    if (read_min_flag) {
+        cfg.read_min = args::get(read_min_flag);
+    }
+    if (read_max_flag) {
+        cfg.read_max = args::get(read_max_flag);
+    }
+    if (poll_flag) {
+        cfg.poll_usecs = args::get(poll_flag);
+    }
+    if (seed_flag) {
+        cfg.seed = args::get(seed_flag);
+    }
+    cfg.time_locks = !untimed_flag;
+
+    if (cfg.secs <= 0 || cfg.block_min == 0 || cfg.block_min > cfg.block_max ||
+        cfg.read_min == 0 || cfg.read_min > cfg.read_max || cfg.buffers < 4 ||
+        cfg.buffer_words == 0 || cfg.consumers == 0) {
+        std::cerr << "error: invalid settings" << std::endl << parser;
+        return EXIT_FAILURE;
+    }
+
+    xia::logging::start("log", "stdout", false);
+    xia::logging::set_level(xia::log::level::off);
+
+    int status = EXIT_SUCCESS;
+
+    try {
+        harness<xia::buffer::pool, xia::buffer::queue> bench(cfg);
+        std::cout << "secs=" << cfg.secs << " rate=" << cfg.rate_mb_per_sec
+                  << "MB/s block=" << cfg.block_min << '-' << cfg.block_max
+                  << " buffers=" << cfg.buffers << 'x' << cfg.buffer_words
+                  << " consumers=" << cfg.consumers << " read=" << cfg.read_min << '-'
+                  << cfg.read_max << " poll=" << cfg.poll_usecs << "usecs" << std::endl;
+        bench.run();
+        bench.output(std::cout);
+    } catch (error& e) {
+        std::cerr << "error: " << e << std::endl;
+        status = EXIT_FAILURE;
+    } catch (std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        status = EXIT_FAILURE;
+    }
+
+    xia::logging::stop("log");
+
+    return status;
+}
@@ -0,0 +1,322 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file config_bench.cpp
+ * @brief Benchmarks the configuration paths on the simulator.
+ *
+ * The simulated modules model the DSP memory and the bus timing so the
+ * variable reads and writes take the same bus path as the hardware. Each
+ * path reports the wall time and the bus accesses per call.
+ */
+
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pixie/log.hpp>
+#include <pixie/stats.hpp>
+#include <pixie/util.hpp>
+
+#include <pixie/pixie16/channel.hpp>
+#include <pixie/pixie16/crate.hpp>
+#include <pixie/pixie16/sim.hpp>
+
+#include <args/args.hxx>
+
+using error = xia::pixie::error::error;
+
+namespace pixie = xia::pixie;
+
+/*
+ * The firmware the simulated modules are set up with. The files are not
+ * loaded.
+ */
+static const std::vector<std::string> firmware_defs = {
+    "version=sim, revision=15, adc-msps=500, adc-bits=14, device=sys, file=sim-sys.bin",
+    "version=sim, revision=15, adc-msps=500, adc-bits=14, device=fippi, file=sim-fippi.bin",
+    "version=sim, revision=15, adc-msps=500, adc-bits=14, device=dsp, file=sim-dsp.ldr",
+    "version=sim, revision=15, adc-msps=500, adc-bits=14, device=var, file=sim-dsp.var"};
+
+/*
+ * A benchmarked path's results summed over the calls.
+ */
+struct result {
+    std::string name;
+    size_t calls;
+    uint64_t wall_usecs;
+    double bus_usecs;
+    pixie::module::module::bus_cost bus;
+
+    result(const std::string& name_);
+
+    void output(std::ostream& out) const;
+    static void header(std::ostream& out);
+};
+
+result::result(const std::string& name_) : name(name_), calls(0), wall_usecs(0), bus_usecs(0) {}
+
+void result::header(std::ostream& out) {
+    out << std::left << std::setw(16) << "path" << std::right << std::setw(8) << "calls"
+        << std::setw(12) << "wall-usecs" << std::setw(12) << "bus-usecs" << std::setw(11)
+        << "pio-reads" << std::setw(11) << "pio-writes" << std::setw(6) << "dma"
+        << std::setw(11) << "dma-bytes" << std::endl;
+}
+
+void result::output(std::ostream& out) const {
+    xia::util::ostream_guard flags(out);
+    const double n = calls == 0 ? 1 : double(calls);
+    out << std::left << std::setw(16) << name << std::right << std::setw(8) << calls
+        << std::fixed << std::setprecision(1) << std::setw(12) << double(wall_usecs) / n
+        << std::setw(12) << bus_usecs / n << std::setw(11) << double(bus.pio_reads) / n
+        << std::setw(11) << double(bus.pio_writes) / n << std::setw(6)
+        << double(bus.dma_transfers) / n << std::setw(11) << double(bus.dma_bytes) / n
+        << std::endl;
+}
+
+typedef std::vector<result> results;
+
+/*
+ * Run a path and add its wall time and the bus accesses of all modules to
+ * the result.
+ */
+static void measure(pixie::crate::crate& crate, result& res, size_t calls,
+                    std::function<void()> path) {
+    for (auto& mod : crate.modules) {
+        mod->clear_bus_costs();
+        dynamic_cast<pixie::sim::module&>(*mod).clear_bus_usecs();
+    }
+    xia::util::timepoint wall(true);
+    path();
+    wall.end();
+    res.calls += calls;
+    res.wall_usecs += wall.usecs();
+    for (auto& mod : crate.modules) {
+        res.bus += mod->bus_totals.get();
+        res.bus_usecs += dynamic_cast<pixie::sim::module&>(*mod).bus_usecs();
+    }
+}
+
+static void setup(pixie::sim::crate& crate, size_t modules, const pixie::sim::bus_timing& timing) {
+    for (size_t m = 0; m < modules; ++m) {
+        std::ostringstream def;
+        def << "device-number=" << m << " slot=" << m + 2
+            << " revision=15 eeprom-format=1 serial-num=" << 1000 + m
+            << " num-channels=16 adc-bits=14 adc-msps=500 adc-clk-div=5";
+        pixie::sim::add_module_def(def.str());
+    }
+    for (auto& def : firmware_defs) {
+        auto fw = pixie::firmware::parse(def, ',');
+        pixie::firmware::add(crate.firmware, fw);
+    }
+    crate.initialize(false);
+    crate.set_firmware();
+    crate.probe();
+    for (auto& mod : crate.modules) {
+        auto& sim_mod = dynamic_cast<pixie::sim::module&>(*mod);
+        sim_mod.set_bus_timing(timing);
+        sim_mod.emulate_dsp_memory();
+    }
+}
+
+static void bench(pixie::sim::crate& crate, size_t iterations, size_t writes,
+                  const std::string& config_file, results& res) {
+    pixie::module::number_slots loaded;
+
+    res.emplace_back("boot");
+    for (size_t i = 0; i < iterations; ++i) {
+        measure(crate, res.back(), 1, [&crate] { crate.boot(); });
+    }
+
+    res.emplace_back("export_json");
+    for (size_t i = 0; i < iterations; ++i) {
+        measure(crate, res.back(), 1, [&crate, &config_file] {
+            crate.export_config(config_file);
+        });
+    }
+
+    res.emplace_back("import_config");
+    for (size_t i = 0; i < iterations; ++i) {
+        measure(crate, res.back(), 1, [&crate, &config_file, &loaded] {
+            crate.import_config(config_file, loaded);
+        });
+    }
+
+    res.emplace_back("sync_vars:from");
+    for (size_t i = 0; i < iterations; ++i) {
+        measure(crate, res.back(), crate.modules.size(), [&crate] {
+            for (auto& mod : crate.modules) {
+                mod->sync_vars(pixie::module::module::sync_from_dsp);
+            }
+        });
+    }
+
+    /*
+     * Dirty a variable of each channel, the sync writes them.
+     */
+    res.emplace_back("sync_vars:to");
+    for (size_t i = 0; i < iterations; ++i) {
+        for (auto& mod : crate.modules) {
+            for (size_t chan = 0; chan < mod->num_channels; ++chan) {
+                mod->write_var(pixie::param::channel_var::FastThresh,
+                               pixie::param::value_type(100 + i), chan, 0, false);
+            }
+        }
+        measure(crate, res.back(), crate.modules.size(), [&crate] {
+            for (auto& mod : crate.modules) {
+                mod->sync_vars(pixie::module::module::sync_to_dsp);
+            }
+        });
+    }
+
+    res.emplace_back("param_write");
+    for (size_t i = 0; i < iterations; ++i) {
+        measure(crate, res.back(), writes * crate.modules.size(), [&crate, writes] {
+            for (auto& mod : crate.modules) {
+                for (size_t w = 0; w < writes; ++w) {
+                    mod->write("TRIGGER_THRESHOLD", w % mod->num_channels,
+                               double(10 + w % 100));
+                }
+            }
+        });
+    }
+
+    res.emplace_back("stats::read");
+    for (size_t i = 0; i < iterations; ++i) {
+        measure(crate, res.back(), crate.modules.size(), [&crate] {
+            for (auto& mod : crate.modules) {
+                pixie::stats::stats stats(*mod);
+                pixie::stats::read(*mod, stats);
+            }
+        });
+    }
+
+    res.emplace_back("baselines");
+    for (size_t i = 0; i < iterations; ++i) {
+        measure(crate, res.back(), crate.modules.size(), [&crate] {
+            for (auto& mod : crate.modules) {
+                pixie::channel::range chans(mod->num_channels);
+                for (size_t chan = 0; chan < chans.size(); ++chan) {
+                    chans[chan] = chan;
+                }
+                pixie::channel::baseline::channels_values values(chans.size());
+                mod->acquire_baselines();
+                mod->bl_get(chans, values, false);
+            }
+        });
+    }
+}
+
+int main(int argc, char* argv[]) {
+    args::ArgumentParser parser("Benchmarks the configuration paths on the simulator.");
+    args::HelpFlag help_flag(parser, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<size_t> modules_flag(parser, "modules", "Number of modules (default 4)",
+                                         {'m', "modules"}, 4);
+    args::ValueFlag<size_t> iterations_flag(parser, "iterations",
+                                            "Iterations of each path (default 10)",
+                                            {'i', "iterations"}, 10);
+    args::ValueFlag<size_t> writes_flag(parser, "writes",
+                                        "Parameter writes per module an iteration (default 100)",
+                                        {'w', "writes"}, 100);
+    args::ValueFlag<double> pio_read_flag(parser, "usecs", "Modeled PIO read time",
+                                          {"pio-read"});
+    args::ValueFlag<double> pio_write_flag(parser, "usecs", "Modeled PIO write time",
+                                           {"pio-write"});
+    args::ValueFlag<double> dma_setup_flag(parser, "usecs", "Modeled DMA setup time",
+                                           {"dma-setup"});
+    args::ValueFlag<double> dma_rate_flag(parser, "MB/s", "Modeled DMA rate", {"dma-rate"});
+    args::ValueFlag<std::string> log_flag(parser, "file", "Log file (default none)",
+                                          {'l', "log"});
+    args::ValueFlag<std::string> config_flag(
+        parser, "file", "The exported and imported configuration (default config-bench.json)",
+        {'c', "config"}, "config-bench.json");
+
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (args::Help&) {
+        std::cout << parser;
+        return EXIT_SUCCESS;
+    } catch (args::Error& e) {
+        std::cerr << e.what() << std::endl << parser;
+        return EXIT_FAILURE;
+    }
+
+    const size_t modules = args::get(modules_flag);
+    if (modules == 0 || modules > pixie::hw::max_slots - 2) {
+        std::cerr << "error: invalid number of modules: " << modules << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    pixie::sim::bus_timing timing;
+    if (pio_read_flag) {
+        timing.pio_read_usecs = args::get(pio_read_flag);
+    }
+    if (pio_write_flag) {
+        timing.pio_write_usecs = args::get(pio_write_flag);
+    }
+    if (dma_setup_flag) {
+        timing.dma_setup_usecs = args::get(dma_setup_flag);
+    }
+    if (dma_rate_flag) {
+        timing.dma_mb_per_sec = args::get(dma_rate_flag);
+    }
+
+    if (log_flag) {
+        xia::logging::start("log", args::get(log_flag), false);
+        xia::logging::set_level(xia::log::info);
+    } else {
+        xia::logging::start("log", "stdout", false);
+        xia::logging::set_level(xia::log::level::off);
+    }
+
+    const std::string config_file = args::get(config_flag);
+    int status = EXIT_SUCCESS;
+
+    try {
+        pixie::sim::crate crate;
+        setup(crate, modules, timing);
+
+        results res;
+        bench(crate, args::get(iterations_flag), args::get(writes_flag), config_file, res);
+
+        std::cout << "modules=" << modules << " iterations=" << args::get(iterations_flag)
+                  << " pio-read=" << timing.pio_read_usecs
+                  << "usecs pio-write=" << timing.pio_write_usecs
+                  << "usecs dma-setup=" << timing.dma_setup_usecs
+                  << "usecs dma-rate=" << timing.dma_mb_per_sec << "MB/s" << std::endl
+                  << "Per call:" << std::endl;
+        result::header(std::cout);
+        for (auto& r : res) {
+            r.output(std::cout);
+        }
+    } catch (error& e) {
+        std::cerr << "error: " << e << std::endl;
+        status = EXIT_FAILURE;
+    } catch (std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        status = EXIT_FAILURE;
+    }
+
+    std::remove(config_file.c_str());
+    xia::logging::stop("log");
+
+    return status;
+}
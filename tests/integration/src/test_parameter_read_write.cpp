@@ -713,3 +713,51 @@ TEST_SUITE("Channel Parameter Reads and Writes") {
         }
     }
 }
+
+TEST_SUITE("Parameter Broadcast") {
+    TEST_CASE("Name and value pairs") {
+        for (auto& mod : crate.modules) {
+            for (size_t channel = 0; channel < mod->num_channels; ++channel) {
+                mod->write_var("FastLength", 12, channel);
+            }
+        }
+        const double unselected = crate[0].read("BINFACTOR", 1);
+        for (auto& mod : crate.modules) {
+            mod->clear_bus_costs();
+        }
+        crate.broadcast({{"TRIGGER_THRESHOLD", 0.5}, {"BINFACTOR", 5}}, {0x5, 0, 0xFFFF});
+        CHECK(crate[0].read("TRIGGER_THRESHOLD", 0) == crate[0].read("TRIGGER_THRESHOLD", 2));
+        CHECK(crate[0].read("BINFACTOR", 0) == 5);
+        CHECK(crate[0].read("BINFACTOR", 2) == 5);
+        CHECK(crate[0].read("BINFACTOR", 1) == unselected);
+        for (size_t channel = 0; channel < crate[2].num_channels; ++channel) {
+            CHECK(crate[2].read("TRIGGER_THRESHOLD", channel) == 0.5);
+            CHECK(crate[2].read("BINFACTOR", channel) == 5);
+        }
+        xia::pixie::module::module::bus_costs costs;
+        crate[2].get_bus_costs(costs);
+        CHECK(costs["broadcast"].calls == 1);
+        CHECK(costs["program_fippi"].calls == 1);
+        crate[1].get_bus_costs(costs);
+        CHECK(costs.count("broadcast") == 0);
+    }
+    TEST_CASE("Copy source channel") {
+        crate[1].write("TRIGGER_THRESHOLD", 3, 2);
+        crate[1].write("BINFACTOR", 3, 4);
+        const double expected = crate[1].read("TRIGGER_THRESHOLD", 3);
+        const double binfactor = crate[1].read("BINFACTOR", 0);
+        crate.broadcast(1, 3, xia::pixie::param::trigger_mask, {0, 0x3});
+        CHECK(crate[1].read("TRIGGER_THRESHOLD", 0) == expected);
+        CHECK(crate[1].read("TRIGGER_THRESHOLD", 1) == expected);
+        CHECK(crate[1].read("TRIGGER_THRESHOLD", 3) == expected);
+        CHECK(crate[1].read("BINFACTOR", 0) == binfactor);
+    }
+    TEST_CASE("Invalid") {
+        CHECK_THROWS_AS(crate.broadcast({{"NOT_A_PARAM", 1}}), xia::pixie::error::error);
+        CHECK_THROWS_AS(crate.broadcast({{"BINFACTOR", 1}}, {1, 1, 1, 1}),
+                        xia::pixie::error::error);
+        CHECK_THROWS_AS(crate.broadcast({{"BINFACTOR", 1}}, {0x10000}), xia::pixie::error::error);
+        CHECK_THROWS_AS(crate.broadcast(1, 16, xia::pixie::param::trigger_mask),
+                        xia::pixie::error::error);
+    }
+}
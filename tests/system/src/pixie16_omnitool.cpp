@@ -21,6 +21,7 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fstream>
 #include <future>
@@ -29,6 +30,7 @@
 #include <numeric>
 #include <regex>
 #include <sstream>
+#include <thread>
 
 #include <pixie/config.hpp>
 #include <pixie/log.hpp>
@@ -407,7 +409,7 @@ static const command test_cmd = {
     {},
     "init,probe",
     "Test control, default mode is 'off'",
-    "test [-m mode (off/lmfifo)] module(s)"
+    "test [-m mode (off/lmfifo/throughput)] module(s)"
 };
 
 command_handler_decl(var_read);
@@ -1072,64 +1074,53 @@ void module_threads(xia::pixie::crate::crate& crate, std::vector<size_t>& mod_nu
     if (workers.size() != mod_nums.size()) {
         throw std::runtime_error("workers and modules counts mismatch");
     }
-    using promise_error = std::promise<error::code>;
-    using future_error = std::future<error::code>;
-    std::vector<promise_error> promises(mod_nums.size());
-    std::vector<future_error> futures;
+    /*
+     * The workers are not short crate operations, they run until the
+     * command ends. Each has a dedicated thread so every module runs for
+     * the whole command whatever the size of the crate's pool.
+     */
+    struct outcome {
+        error::code code = error::code::success;
+        std::string what;
+    };
+    std::vector<outcome> outcomes(mod_nums.size());
+    std::atomic_size_t finished(0);
     std::vector<std::thread> threads;
     for (size_t m = 0; m < mod_nums.size(); ++m) {
         auto module = crate.modules[mod_nums[m]];
         auto& worker = workers[m];
-        futures.push_back(future_error(promises[m].get_future()));
-        threads.push_back(std::thread([m, &promises, module, &worker] {
+        auto& result = outcomes[m];
+        worker.running = true;
+        threads.push_back(std::thread([module, &worker, &result, &finished] {
             try {
-                worker.running = true;
                 worker.worker(*module);
-                promises[m].set_value(error::code::success);
             } catch (xia::pixie::error::error& e) {
-                promises[m].set_value(e.type);
+                result.code = e.type;
+                result.what = e.what();
+            } catch (std::exception& e) {
+                result.code = error::code::unknown_error;
+                result.what = e.what();
             } catch (...) {
-                try {
-                    promises[m].set_exception(std::current_exception());
-                } catch (...) {
-                }
+                result.code = error::code::unknown_error;
+                result.what = "unhandled exception";
             }
+            worker.period.stop();
             worker.running = false;
+            ++finished;
         }));
     }
-    error::code first_error = error::code::success;
-    size_t finished = 0;
     size_t show_secs = 5;
     xia::util::timepoint duration(true);
     xia::util::timepoint interval(true);
-    while (finished != threads.size()) {
-        finished = threads.size();
-        for (size_t t = 0; t < threads.size(); ++t) {
-            auto& future = futures[t];
-            if (future.valid()) {
-                auto zero = std::chrono::seconds(0);
-                if (future.wait_for(zero) == std::future_status::ready) {
-                    workers[t].period.stop();
-                    error::code e = future.get();
-                    if (e != error::code::success) {
-                        std::cout << "module " << t
-                                  << ": error: " << xia::pixie::error::api_result_text(e)
-                                  << std::endl;
-                    }
-                    if (first_error == error::code::success) {
-                        first_error = e;
-                    }
-                    threads[t].join();
-                } else {
-                    --finished;
-                }
-            }
-        }
+    while (finished.load() != threads.size()) {
         xia::pixie::hw::wait(20 * 1000);
         if (show_performance && interval.secs() > show_secs) {
             auto secs = interval.secs();
             interval.restart();
-            std::cout << "running: " << threads.size() - finished << std::endl;
+            std::cout << "running: "
+                      << std::count_if(workers.begin(), workers.end(),
+                                       [](const W& w) { return w.running.load(); })
+                      << std::endl;
             size_t all_total = 0;
             for (auto& w : workers) {
                 if (w.period.secs() > 0) {
@@ -1160,8 +1151,25 @@ void module_threads(xia::pixie::crate::crate& crate, std::vector<size_t>& mod_nu
             xia_log(xia::log::info) << oss.str();
         }
     }
-    if (first_error != error::code::success) {
-        throw error(first_error, error_message);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const outcome* first = nullptr;
+    std::string whats;
+    for (size_t m = 0; m < outcomes.size(); ++m) {
+        auto& result = outcomes[m];
+        if (result.code != error::code::success) {
+            std::cout << "module " << m << ": error: " << result.what << std::endl;
+            if (first == nullptr) {
+                first = &result;
+            } else {
+                whats += "; ";
+            }
+            whats += result.what;
+        }
+    }
+    if (first != nullptr) {
+        throw error(first->code, error_message + ": " + whats);
     }
 }
 
@@ -2100,6 +2108,22 @@ void test_fifo_worker::worker(xia::pixie::module::module& module) {
     }
 }
 
+struct test_throughput_worker : public module_thread_worker {
+    xia::pixie::module::module::throughput_config config;
+    xia::pixie::module::module::throughput_report report;
+
+    void worker(xia::pixie::module::module& module);
+};
+
+void test_throughput_worker::worker(xia::pixie::module::module& module) {
+    period.start();
+    module.characterize_fifo(config, report);
+    period.end();
+    for (auto& point : report.points) {
+        total += point.words;
+    }
+}
+
 static void test(
     xia::pixie::crate::crate& crate, args_commands_iter& ci, args_commands_iter& ce,
     bool verbose) {
@@ -2112,12 +2136,26 @@ static void test(
     if (!mode_opt.empty()) {
         if (mode_opt == "lmfifo") {
             mode = xia::pixie::module::module::test::lm_fifo;
-        } else if (mode_opt != "off") {
+        } else if (mode_opt != "off" && mode_opt != "throughput") {
             throw std::runtime_error(std::string("invalid test mode: " + mode_opt));
         }
     }
     module_range mod_nums;
     modules_option(mod_nums, mod_nums_opt, crate.num_modules);
+    if (mode_opt == "throughput") {
+        auto tests = std::vector<test_throughput_worker>(mod_nums.size());
+        set_num_slot(crate, mod_nums, tests);
+        for (auto& t : tests) {
+            t.config.dma_block_sizes = {0, 1024, 4096, 8192};
+            t.config.trigger_levels = {512, 1024, 4096, 8192};
+        }
+        std::cout << "Test: throughput" << std::endl;
+        module_threads(crate, mod_nums, tests, "fifo throughput test error; see log");
+        for (auto& t : tests) {
+            std::cout << t.report.output();
+        }
+        return;
+    }
     size_t bytes = 500 * 1024 * 1000;
     auto tests = std::vector<test_fifo_worker>(mod_nums.size());
     set_num_slot(crate, mod_nums, tests);
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/** @file test_batch.hpp
+ * @brief Columnar batches for the data stage unit tests
+ */
+
+#ifndef PIXIE_UNIT_TEST_BATCH_H
+#define PIXIE_UNIT_TEST_BATCH_H
+
+#include <pixie/data/columnar.hpp>
+#include <pixie/data/list_mode.hpp>
+
+namespace xia {
+namespace test {
+/*
+ * Fill a batch with `count` events of crate 0. The events alternate
+ * between slots 2 and 3 and each slot's events cycle over channels 0 to
+ * 3. The fill function sets the event's other fields.
+ */
+template<typename Fill>
+void make_batch(pixie::data::columnar::batch& events, size_t count, Fill fill) {
+    events.clear();
+    for (size_t e = 0; e < count; ++e) {
+        pixie::data::list_mode::record rec;
+        rec.crate_id = 0;
+        rec.slot_id = 2 + (e % 2);
+        rec.channel_number = (e / 2) % 4;
+        fill(e, rec);
+        events.append(rec);
+    }
+}
+}  // namespace test
+}  // namespace xia
+
+#endif  // PIXIE_UNIT_TEST_BATCH_H
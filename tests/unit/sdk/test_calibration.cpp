@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_calibration.cpp
+ * @brief Tests related to the calibration namespace
+ */
+
+#include <cstdio>
+
+#include <doctest/doctest.h>
+
+#include <pixie/data/calibration.hpp>
+#include <pixie/error.hpp>
+
+#include "test_batch.hpp"
+#include "test_files.hpp"
+
+namespace calibration = xia::pixie::data::calibration;
+namespace columnar = xia::pixie::data::columnar;
+namespace list_mode = xia::pixie::data::list_mode;
+
+static void make_batch(columnar::batch& events, size_t count) {
+    xia::test::make_batch(events, count, [](size_t e, list_mode::record& rec) {
+        rec.energy = double(100 + e);
+        rec.time = list_mode::record::time_type(double(e) * 1e-6);
+        rec.qdc = {1, 2, 3, 4, 5, 6, 7, uint32_t(e)};
+        if ((e % 3) == 0) {
+            rec.trace = {uint32_t(e), uint32_t(e + 1)};
+            rec.trace_length = rec.trace.size();
+        }
+    });
+}
+
+TEST_SUITE("xia::pixie::data::calibration") {
+    TEST_CASE("Table") {
+        calibration::table table;
+        CHECK(table.size() == 0);
+        CHECK(table.has(0, 2, 0) == false);
+        CHECK(table.energy(0, 2, 0, 100) == 100);
+        table.set_energy(0, 2, 0, {1, 2});
+        CHECK(table.energy(0, 2, 0, 100) == 201);
+        table.set_gain(0, 2, 0, 0.5, 10);
+        CHECK(table.energy(0, 2, 0, 100) == doctest::Approx(110.5));
+        table.set_energy(0, 2, 1, {0, 0, 1, 0.5});
+        CHECK(table.energy(0, 2, 1, 2) == 8);
+        CHECK(table.size() == 2);
+        CHECK(table.get(0, 2, 0).gain == 0.5);
+        CHECK_THROWS_AS(table.get(0, 3, 0), calibration::error);
+        CHECK_THROWS_AS(table.set_energy(0, 2, 0, {}), calibration::error);
+        CHECK_THROWS_AS(table.set_energy(0, 2, 0, {1, 2, 3, 4, 5}), calibration::error);
+        CHECK_THROWS_AS(table.set_gain(16, 2, 0, 1), calibration::error);
+        CHECK_THROWS_AS(table.set_gain(0, 64, 0, 1), calibration::error);
+        CHECK(table.has(0, 64, 0) == false);
+        table.clear();
+        CHECK(table.size() == 0);
+        CHECK(table.energy(0, 2, 0, 100) == 100);
+    }
+    TEST_CASE("Group by channel") {
+        columnar::batch events;
+        make_batch(events, 64);
+        std::vector<list_mode::record> before(events.size);
+        for (size_t e = 0; e < events.size; ++e) {
+            events.get(e, before[e]);
+        }
+        events.group_by_channel();
+        CHECK(events.size == 64);
+        size_t changes = 0;
+        for (size_t e = 1; e < events.size; ++e) {
+            auto key = [&events](size_t n) { return events.slot[n] * 16 + events.channel[n]; };
+            CHECK(key(e - 1) <= key(e));
+            if (key(e - 1) != key(e)) {
+                ++changes;
+                CHECK(events.time[e - 1] > events.time[e]);
+            }
+        }
+        CHECK(changes == 7);
+        for (size_t e = 0; e < events.size; ++e) {
+            list_mode::record rec;
+            events.get(e, rec);
+            auto& orig = before[size_t(rec.energy - 100)];
+            CHECK(rec.slot_id == orig.slot_id);
+            CHECK(rec.channel_number == orig.channel_number);
+            CHECK(rec.qdc == orig.qdc);
+            CHECK(rec.trace == orig.trace);
+        }
+        events.clear(columnar::column::energy);
+        CHECK_THROWS_AS(events.group_by_channel(), columnar::error);
+    }
+    TEST_CASE("Apply") {
+        calibration::table table;
+        table.set_energy(0, 2, 0, {1, 2});
+        table.set_energy(0, 3, 1, {0, 0.5});
+        table.set_gain(0, 3, 1, 2, 1);
+        table.set_qdc_gain(0, 2, 0, 0.25);
+        columnar::batch events;
+        make_batch(events, 100);
+        columnar::batch grouped;
+        make_batch(grouped, 100);
+        grouped.group_by_channel();
+        table.apply(events);
+        table.apply(grouped);
+        std::vector<double> qdc;
+        table.apply_qdc(events, qdc);
+        REQUIRE(qdc.size() == events.size * columnar::qdc_sums);
+        size_t calibrated = 0;
+        for (size_t e = 0; e < events.size; ++e) {
+            const double raw = double(100 + e);
+            double expected = raw;
+            double qdc_gain = 1;
+            if (events.slot[e] == 2 && events.channel[e] == 0) {
+                expected = 1 + 2 * raw;
+                qdc_gain = 0.25;
+                ++calibrated;
+            } else if (events.slot[e] == 3 && events.channel[e] == 1) {
+                expected = 2 * (0.5 * raw) + 1;
+                ++calibrated;
+            }
+            CHECK(events.energy[e] == doctest::Approx(expected));
+            CHECK(qdc[e * columnar::qdc_sums] == doctest::Approx(qdc_gain));
+            CHECK(qdc[e * columnar::qdc_sums + 7] == doctest::Approx(qdc_gain * e));
+        }
+        CHECK(calibrated == 26);
+        double sum = 0;
+        double grouped_sum = 0;
+        for (size_t e = 0; e < events.size; ++e) {
+            sum += events.energy[e];
+            grouped_sum += grouped.energy[e];
+        }
+        CHECK(sum == doctest::Approx(grouped_sum));
+        columnar::batch no_energy;
+        no_energy.clear(columnar::column::crate | columnar::column::slot);
+        CHECK_THROWS_AS(table.apply(no_energy), calibration::error);
+    }
+    TEST_CASE("Load and save") {
+        const std::string name = xia::test::temp_file_name("calibration");
+        calibration::table table;
+        table.set_energy(0, 2, 0, {1, 2, 3});
+        table.set_gain(0, 2, 0, 0.5, 2);
+        table.set_qdc_gain(1, 5, 15, 3);
+        table.save(name);
+        calibration::table loaded;
+        loaded.load(name);
+        std::remove(name.c_str());
+        REQUIRE(loaded.size() == 2);
+        CHECK(loaded.get(0, 2, 0).energy[2] == 3);
+        CHECK(loaded.get(1, 5, 15).qdc_gain == 3);
+        CHECK(loaded.energy(0, 2, 0, 10) == table.energy(0, 2, 0, 10));
+        CHECK_THROWS_AS(loaded.load(name), calibration::error);
+        CHECK(loaded.size() == 2);
+    }
+}
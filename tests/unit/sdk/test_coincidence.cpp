@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_coincidence.cpp
+ * @brief Tests related to the coincidence namespace
+ */
+
+#include <sstream>
+
+#include <doctest/doctest.h>
+
+#include <pixie/data/coincidence.hpp>
+#include <pixie/error.hpp>
+
+namespace coincidence = xia::pixie::data::coincidence;
+namespace list_mode = xia::pixie::data::list_mode;
+
+static const size_t revision = 34688;
+static const size_t frequency = 100;
+
+/*
+ * A 100 MSPS event, the time is in clock ticks. The trace samples make the
+ * events different lengths.
+ */
+static list_mode::buffer make_event(uint32_t slot, uint32_t channel, uint64_t time,
+                                    uint32_t samples = 0) {
+    const uint32_t header_length = 4;
+    const uint32_t event_length = header_length + samples / 2;
+    list_mode::buffer event = {
+        channel | (slot << 4) | (header_length << 12) | (event_length << 17),
+        uint32_t(time & 0xFFFFFFFF), uint32_t((time >> 32) & 0xFFFF),
+        (samples << 16) | (1000 + channel)};
+    for (uint32_t s = 0; s < samples / 2; ++s) {
+        event.push_back((s << 16) | s);
+    }
+    return event;
+}
+
+static void append(list_mode::buffer& data, const list_mode::buffer& event) {
+    data.insert(data.end(), event.begin(), event.end());
+}
+
+/*
+ * Push the data in blocks that split events.
+ */
+static void push_blocks(coincidence::trigger& trig, size_t stream,
+                        const list_mode::buffer& data, size_t block) {
+    for (size_t pos = 0; pos < data.size(); pos += block) {
+        trig.push(stream, data.data() + pos, std::min(block, data.size() - pos));
+    }
+}
+
+TEST_SUITE("xia::pixie::data::coincidence") {
+    TEST_CASE("Config") {
+        coincidence::config cfg;
+        cfg.window = -1;
+        CHECK_THROWS_AS(coincidence::trigger trig(cfg), coincidence::error);
+        cfg = coincidence::config();
+        cfg.multiplicity = 0;
+        CHECK_THROWS_AS(coincidence::trigger trig(cfg), coincidence::error);
+        cfg = coincidence::config();
+        coincidence::channel_group group;
+        group.channels = {coincidence::channel(0, 2, 0)};
+        group.multiplicity = 2;
+        cfg.groups = {group};
+        CHECK_THROWS_AS(coincidence::trigger trig(cfg), coincidence::error);
+        group.channels = {coincidence::channel(16, 2, 0)};
+        group.multiplicity = 1;
+        cfg.groups = {group};
+        CHECK_THROWS_AS(coincidence::trigger trig(cfg), coincidence::error);
+        coincidence::trigger trig;
+        CHECK_THROWS_AS(trig.add_stream(revision, 123), coincidence::error);
+        CHECK_THROWS_AS(trig.push(0, list_mode::buffer{}), coincidence::error);
+        CHECK(trig.add_stream(revision, frequency) == 0);
+        CHECK(trig.streams() == 1);
+    }
+    TEST_CASE("Multiplicity") {
+        coincidence::config cfg;
+        cfg.window = 100e-9;
+        coincidence::trigger trig(cfg);
+        auto mod_a = trig.add_stream(revision, frequency);
+        auto mod_b = trig.add_stream(revision, frequency);
+
+        auto a1 = make_event(2, 0, 100);
+        auto a2 = make_event(2, 1, 1000, 10);
+        auto a3 = make_event(2, 0, 5000, 6);
+        auto a4 = make_event(2, 3, 0x100000008ULL);
+        auto b1 = make_event(3, 0, 105, 8);
+        auto b2 = make_event(3, 0, 3000);
+        auto b3 = make_event(3, 5, 5010);
+        auto b4 = make_event(3, 5, 0x100000000ULL, 4);
+
+        list_mode::buffer data_a;
+        for (auto& e : {a1, a2, a3, a4}) {
+            append(data_a, e);
+        }
+        list_mode::buffer data_b;
+        for (auto& e : {b1, b2, b3, b4}) {
+            append(data_b, e);
+        }
+
+        list_mode::buffer out;
+        push_blocks(trig, mod_a, data_a, 3);
+        trig.process(out);
+        CHECK(out.empty());
+        CHECK(trig.stats().events == 0);
+
+        push_blocks(trig, mod_b, data_b, 5);
+        trig.flush(out);
+
+        list_mode::buffer expected;
+        for (auto& e : {a1, b1, a3, b3, b4, a4}) {
+            append(expected, e);
+        }
+        CHECK(out == expected);
+
+        auto stats = trig.stats();
+        CHECK(stats.events == 8);
+        CHECK(stats.accepted_events == 6);
+        CHECK(stats.rejected_events == 2);
+        CHECK(stats.accepted_groups == 3);
+        CHECK(stats.rejected_groups == 2);
+        CHECK(stats.words_in == data_a.size() + data_b.size());
+        CHECK(stats.words_out == expected.size());
+        CHECK(stats.out_of_order == 0);
+        CHECK(stats.forced == 0);
+
+        std::ostringstream oss;
+        stats.output(oss);
+        CHECK(oss.str().find("accept=75%") != std::string::npos);
+
+        trig.clear();
+        CHECK(trig.stats().events == 0);
+        CHECK(trig.stats().words_in == 0);
+        CHECK(trig.streams() == 2);
+    }
+    TEST_CASE("Channel groups") {
+        coincidence::config cfg;
+        cfg.window = 100e-9;
+        cfg.multiplicity = 1;
+        coincidence::channel_group group;
+        group.channels = {coincidence::channel(0, 3, 0), coincidence::channel(0, 3, 1)};
+        group.multiplicity = 2;
+        cfg.groups = {group};
+        coincidence::trigger trig(cfg);
+        auto mod_a = trig.add_stream(revision, frequency);
+        auto mod_b = trig.add_stream(revision, frequency);
+
+        list_mode::buffer data_a;
+        append(data_a, make_event(2, 0, 100));
+        append(data_a, make_event(2, 0, 2000));
+        list_mode::buffer data_b;
+        append(data_b, make_event(3, 0, 102));
+        append(data_b, make_event(3, 0, 2001));
+        append(data_b, make_event(3, 0, 2002));
+        append(data_b, make_event(3, 1, 2003));
+
+        trig.push(mod_a, data_a);
+        trig.push(mod_b, data_b);
+        list_mode::buffer out;
+        trig.flush(out);
+
+        auto stats = trig.stats();
+        CHECK(stats.accepted_groups == 1);
+        CHECK(stats.rejected_groups == 1);
+        CHECK(stats.accepted_events == 4);
+        CHECK(out.size() == 16);
+        CHECK(out[1] == 2000);
+        CHECK(out[13] == 2003);
+    }
+    TEST_CASE("Quiet stream") {
+        coincidence::config cfg;
+        cfg.max_pending = 4;
+        coincidence::trigger trig(cfg);
+        auto mod_a = trig.add_stream(revision, frequency);
+        trig.add_stream(revision, frequency);
+
+        list_mode::buffer data;
+        for (uint64_t t = 0; t < 6; ++t) {
+            append(data, make_event(2, 0, t * 100));
+            append(data, make_event(2, 1, t * 100 + 1));
+        }
+        trig.push(mod_a, data);
+        list_mode::buffer out;
+        trig.process(out);
+        auto stats = trig.stats();
+        CHECK(stats.forced == 9);
+        CHECK(stats.events == 9);
+        trig.flush(out);
+        stats = trig.stats();
+        CHECK(stats.events == 12);
+        CHECK(stats.accepted_groups == 6);
+        CHECK(out == data);
+    }
+    TEST_CASE("Bad data") {
+        coincidence::trigger trig;
+        auto mod = trig.add_stream(revision, frequency);
+        auto event = make_event(2, 0, 100);
+        event[0] &= ~(0x3FFFU << 17);
+        CHECK_THROWS_WITH_AS(trig.push(mod, event),
+            "coincidence: bad event: header-length=4 event-length=0", coincidence::error);
+    }
+}
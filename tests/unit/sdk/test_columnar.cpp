@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_columnar.cpp
+ * @brief Tests related to the columnar namespace
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <doctest/doctest.h>
+
+#include <pixie/data/columnar.hpp>
+#include <pixie/error.hpp>
+
+#include "test_files.hpp"
+
+namespace columnar = xia::pixie::data::columnar;
+namespace list_mode = xia::pixie::data::list_mode;
+
+static list_mode::records make_records(size_t count) {
+    list_mode::records recs;
+    for (size_t r = 0; r < count; ++r) {
+        list_mode::record rec;
+        rec.crate_id = 0;
+        rec.slot_id = 2 + (r % 3);
+        rec.channel_number = r % 16;
+        rec.energy = double(100 + r);
+        rec.cfd_fractional_time = list_mode::record::time_type(2e-9);
+        rec.filter_time = list_mode::record::time_type(double(r) * 1e-6);
+        rec.time = rec.filter_time + rec.cfd_fractional_time;
+        rec.cfd_trigger_source = r % 2;
+        rec.finish_code = (r % 5) == 0;
+        if ((r % 4) == 0) {
+            rec.qdc = {1, 2, 3, 4, 5, 6, 7, r};
+            rec.energy_sums = {10, 20, r};
+            rec.filter_baseline = 3.5;
+        }
+        if ((r % 7) == 0) {
+            rec.trace = {r, r + 1, r + 2, r + 3};
+            rec.trace_length = rec.trace.size();
+        }
+        recs.push_back(rec);
+    }
+    return recs;
+}
+
+static void remove_files(const std::string& name) {
+    std::remove(name.c_str());
+    std::remove(columnar::trace_stream_name(name).c_str());
+}
+
+TEST_SUITE("xia::pixie::data::columnar") {
+    TEST_CASE("Write and read") {
+        const std::string name = xia::test::temp_file_name("columnar");
+        auto recs = make_records(1000);
+        {
+            columnar::writer writer(name, 128);
+            writer.write(recs);
+            CHECK(writer.events() == recs.size());
+            writer.close();
+            CHECK(writer.chunks() == 8);
+        }
+        columnar::reader reader(name);
+        CHECK(reader.index().size() == 8);
+        CHECK(reader.events() == recs.size());
+
+        SUBCASE("All columns") {
+            columnar::batch batch;
+            size_t event = 0;
+            while (reader.read(batch)) {
+                for (size_t e = 0; e < batch.size; ++e, ++event) {
+                    list_mode::record rec;
+                    batch.get(e, rec);
+                    auto& expected = recs[event];
+                    CHECK(rec == expected);
+                    CHECK(rec.cfd_fractional_time == expected.cfd_fractional_time);
+                    CHECK(rec.cfd_trigger_source == expected.cfd_trigger_source);
+                    CHECK(rec.finish_code == expected.finish_code);
+                    CHECK(rec.trace == expected.trace);
+                    if (!expected.qdc.empty()) {
+                        CHECK(rec.qdc == expected.qdc);
+                        CHECK(rec.energy_sums == expected.energy_sums);
+                        CHECK(rec.filter_baseline == expected.filter_baseline);
+                    }
+                }
+            }
+            CHECK(event == recs.size());
+        }
+        SUBCASE("Projection") {
+            columnar::batch batch;
+            REQUIRE(reader.read(batch, columnar::column::energy | columnar::column::channel));
+            CHECK(batch.size == 128);
+            CHECK(batch.energy.size() == 128);
+            CHECK(batch.channel.size() == 128);
+            CHECK(batch.time.empty());
+            CHECK(batch.qdc.empty());
+            CHECK(batch.trace.empty());
+            CHECK(batch.energy[5] == recs[5].energy);
+        }
+        SUBCASE("Chunk skipping") {
+            columnar::filter select;
+            select.time_range(300e-6, 400e-6);
+            columnar::batch batch;
+            size_t chunks = 0;
+            while (reader.read(batch, columnar::column::time, select)) {
+                CHECK(batch.time.front() <= 400e-6);
+                CHECK(batch.time.back() >= 300e-6);
+                ++chunks;
+            }
+            CHECK(chunks == 2);
+            reader.rewind();
+            select = columnar::filter();
+            select.slots(5, 14);
+            CHECK_FALSE(reader.read(batch, columnar::column::time, select));
+        }
+        SUBCASE("No index") {
+            auto& last = reader.index().back();
+            auto end = last.offset + 64 + last.length;
+            const std::string copy = xia::test::temp_file_name("columnar");
+            {
+                std::ifstream in(name, std::ios::binary);
+                std::vector<char> bytes(
+                    (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                std::ofstream out(copy, std::ios::binary);
+                out.write(bytes.data(), std::streamsize(end));
+                std::ifstream tin(columnar::trace_stream_name(name), std::ios::binary);
+                std::ofstream tout(columnar::trace_stream_name(copy), std::ios::binary);
+                tout << tin.rdbuf();
+            }
+            columnar::reader scanned(copy);
+            CHECK(scanned.index().size() == 8);
+            CHECK(scanned.events() == recs.size());
+            columnar::batch batch;
+            scanned.read_chunk(7, batch);
+            list_mode::record rec;
+            batch.get(batch.size - 1, rec);
+            CHECK(rec == recs.back());
+            remove_files(copy);
+        }
+        remove_files(name);
+    }
+
+    TEST_CASE("Decoded data") {
+        const std::string name = xia::test::temp_file_name("columnar");
+        list_mode::buffer data;
+        for (uint32_t e = 0; e < 10; ++e) {
+            data.insert(data.end(), {(4 << 17) | (4 << 12) | (2 << 4) | (e % 16), 1000 * e, 0,
+                                     200 + e});
+        }
+        list_mode::buffer leftovers;
+        {
+            columnar::writer writer(name);
+            writer.write(data.data(), data.size() - 2, 34688, 250, leftovers);
+            CHECK(leftovers.size() == 2);
+        }
+        columnar::reader reader(name);
+        columnar::batch batch;
+        REQUIRE(reader.read(batch));
+        CHECK(batch.size == 9);
+        CHECK(batch.energy[3] == 203);
+        CHECK(batch.slot[3] == 2);
+        CHECK(batch.channel[3] == 3);
+        CHECK_FALSE(batch.has(columnar::column::qdc));
+        remove_files(name);
+    }
+
+    TEST_CASE("Invalid file") {
+        const std::string name = xia::test::temp_file_name("columnar");
+        {
+            std::ofstream out(name, std::ios::binary);
+            out << "this is not a columnar file at all";
+        }
+        CHECK_THROWS_AS(columnar::reader reader(name), xia::pixie::error::error);
+        remove_files(name);
+        CHECK_THROWS_AS(columnar::reader reader(name), xia::pixie::error::error);
+    }
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_files.hpp
+ * @brief Scratch file names for the unit tests
+ */
+
+#ifndef PIXIE_UNIT_TEST_FILES_H
+#define PIXIE_UNIT_TEST_FILES_H
+
+#include <atomic>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+
+#ifndef PIXIE_UNIT_TEST_FILES_DIR
+#define PIXIE_UNIT_TEST_FILES_DIR "."
+#endif
+
+namespace xia {
+namespace test {
+/*
+ * Return a file name under the unit test build directory. The name is
+ * unique to the call so tests and concurrent runs do not share files.
+ * The caller removes the file.
+ */
+inline std::string temp_file_name(const std::string& label) {
+    static std::atomic<unsigned int> count(0);
+    static const unsigned int run = std::random_device{}();
+    std::ostringstream oss;
+    oss << PIXIE_UNIT_TEST_FILES_DIR << '/' << label << '-' << std::hex << std::setfill('0')
+        << std::setw(8) << run << '-' << std::dec << count++;
+    return oss.str();
+}
+}  // namespace test
+}  // namespace xia
+
+#endif  // PIXIE_UNIT_TEST_FILES_H
@@ -327,6 +327,87 @@ TEST_SUITE("xia::pixie::list_mode") {
         }
     }
 
+    TEST_CASE("Event header") {
+        event_header header;
+        SUBCASE("34688-250") {
+            decode_event_header(2149990442, 34688, 250, header);
+            CHECK(header.event_length == 19);
+            CHECK(header.header_length == 4);
+            CHECK(header.slot_id == 2);
+            CHECK(header.channel_number == 10);
+            CHECK(header.crate_id == 0);
+        }
+        SUBCASE("46540-250") {
+            decode_event_header(2151882890, 46540, 250, header);
+            CHECK(header.event_length == 33);
+            CHECK(header.header_length == 18);
+            CHECK(header.slot_id == 2);
+            CHECK(header.channel_number == 10);
+        }
+        SUBCASE("Invalid revision") {
+            CHECK_THROWS_AS(decode_event_header(2149990442, 1000, 250, header),
+                            xia::pixie::error::error);
+        }
+    }
+
+    TEST_CASE("Partitioned decoding") {
+        /*
+         * 100 MSPS header only events of slots 2 and 3 interleaved by channel.
+         */
+        buffer data;
+        for (uint32_t e = 0; e < 12; ++e) {
+            uint32_t slot = 2 + (e % 2);
+            uint32_t channel = e % 3;
+            data.push_back(channel | (slot << 4) | (4 << 12) | (4 << 17));
+            data.push_back(1000 + e);
+            data.push_back(0);
+            data.push_back(100 + e);
+        }
+        records recs;
+        buffer leftover;
+        decode_data_block(data.data(), data.size(), 34688, 100, recs, leftover);
+
+        partitioned_records parts(16);
+        parts.add_module(0, 2, 16);
+        CHECK(parts.size() == 16);
+        /*
+         * Split the last event to check the leftovers.
+         */
+        decode_data_block(data.data(), data.size() - 2, 34688, 100, parts, leftover);
+        CHECK(leftover.size() == 2);
+        CHECK(parts.events() == 11);
+        buffer last(leftover);
+        last.insert(last.end(), data.end() - 2, data.end());
+        decode_data_block(last.data(), last.size(), 34688, 100, parts, leftover);
+        CHECK(leftover.empty());
+        CHECK(parts.events() == recs.size());
+        CHECK(parts.size() == 19);
+        CHECK(parts.get(0, 2, 0).capacity() >= 16);
+
+        for (size_t p = 0; p < parts.size(); ++p) {
+            auto& part = parts[p];
+            records expected;
+            for (auto& rec : recs) {
+                if (rec.slot_id == part.slot_id && rec.channel_number == part.channel_number) {
+                    expected.push_back(rec);
+                }
+            }
+            CHECK(part.recs == expected);
+        }
+        CHECK(parts.get(0, 3, 1).size() == 2);
+        CHECK(parts.get(0, 3, 1)[0].energy == 101);
+        CHECK(parts.get(0, 3, 1)[1].energy == 107);
+        CHECK_FALSE(parts.has(0, 3, 3));
+        CHECK_THROWS_AS(parts.get(0, 3, 3), xia::pixie::error::error);
+        CHECK_THROWS_AS(parts.add_channel(16, 2, 0), xia::pixie::error::error);
+        CHECK_THROWS_AS(parts[19], xia::pixie::error::error);
+
+        parts.clear();
+        CHECK(parts.events() == 0);
+        CHECK(parts.size() == 19);
+        CHECK(parts.get(0, 2, 0).capacity() >= 16);
+    }
+
     TEST_CASE("17562-100") {
         records recs;
         buffer leftover;
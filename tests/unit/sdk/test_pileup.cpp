@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pileup.cpp
+ * @brief Tests related to the pileup namespace
+ */
+
+#include <random>
+
+#include <doctest/doctest.h>
+
+#include <pixie/data/pileup.hpp>
+#include <pixie/error.hpp>
+
+namespace pileup = xia::pixie::data::pileup;
+namespace list_mode = xia::pixie::data::list_mode;
+
+/*
+ * Poisson events with a non-extending dead time. Returns the live time.
+ */
+static double make_events(pileup::estimator& est, double rate, double dead, double secs,
+                          size_t& detected, size_t& recorded) {
+    std::mt19937 gen(1234);
+    std::exponential_distribution<double> interval(rate);
+    double time = 0;
+    double dead_until = 0;
+    double first = -1;
+    double last = 0;
+    detected = 0;
+    recorded = 0;
+    while (true) {
+        time += interval(gen);
+        if (time > secs) {
+            break;
+        }
+        ++detected;
+        if (time >= dead_until) {
+            est.add(0, 2, 3, time);
+            dead_until = time + dead;
+            if (first < 0) {
+                first = time;
+            }
+            last = time;
+            ++recorded;
+        }
+    }
+    return (last - first) - double(recorded - 1) * dead;
+}
+
+TEST_SUITE("xia::pixie::data::pileup") {
+    TEST_CASE("Config") {
+        pileup::config cfg;
+        cfg.bins = 0;
+        CHECK_THROWS_AS(pileup::estimator est(cfg), pileup::error);
+        cfg = pileup::config();
+        cfg.windows = {-1};
+        CHECK_THROWS_AS(pileup::estimator est(cfg), pileup::error);
+        pileup::estimator est;
+        CHECK_THROWS_AS(est.add_channel(16, 2, 0), pileup::error);
+        CHECK_THROWS_AS(est.get(0, 2, 0), pileup::error);
+    }
+    TEST_CASE("Intervals and pile-up") {
+        pileup::config cfg;
+        cfg.windows = {150e-9, 1e-6};
+        cfg.bin_width = 100e-9;
+        cfg.bins = 10;
+        pileup::estimator est(cfg);
+        est.add_module(0, 2, 16);
+        CHECK(est.channels().size() == 16);
+        const double times[] = {1e-6, 1.1e-6, 1.65e-6, 3e-6, 2e-6};
+        for (auto time : times) {
+            est.add(0, 2, 5, time);
+        }
+        list_mode::record rec;
+        rec.slot_id = 4;
+        est.add(rec);
+        CHECK(est.unknown() == 1);
+        /*
+         * Out of the channel key's range and not truncated to crate 0.
+         */
+        rec.crate_id = 256;
+        rec.slot_id = 2;
+        rec.channel_number = 5;
+        est.add(rec);
+        CHECK(est.unknown() == 2);
+        auto& chan = est.get(0, 2, 5);
+        CHECK(chan.events == 4);
+        CHECK(chan.out_of_order == 1);
+        CHECK(chan.span() == doctest::Approx(2e-6));
+        CHECK(chan.pileups[0] == 1);
+        CHECK(chan.pileups[1] == 2);
+        CHECK(chan.intervals[1] == 1);
+        CHECK(chan.intervals[5] == 1);
+        CHECK(chan.intervals[10] == 1);
+        CHECK(chan.pileup_fraction(1) == doctest::Approx(0.5));
+        CHECK_THROWS_AS(chan.pileup_fraction(2), pileup::error);
+        est.clear();
+        CHECK(est.get(0, 2, 5).events == 0);
+        CHECK(est.get(0, 2, 5).intervals[1] == 0);
+    }
+    TEST_CASE("Dead time") {
+        pileup::config cfg;
+        cfg.resolving_time = 3e-6;
+        pileup::estimator est(cfg);
+        est.add_channel(0, 2, 3);
+        const double rate = 100e3;
+        const double dead = 2e-6;
+        size_t detected = 0;
+        size_t recorded = 0;
+        const double live = make_events(est, rate, dead, 2.0, detected, recorded);
+        auto& chan = est.get(0, 2, 3);
+        CHECK(chan.events == recorded);
+        CHECK(chan.true_rate() == doctest::Approx(rate).epsilon(0.02));
+        CHECK(chan.observed_rate() < chan.true_rate());
+        CHECK(chan.dead_time() == doctest::Approx(dead).epsilon(0.1));
+        CHECK(chan.dead_fraction() == doctest::Approx(1 - double(recorded) / detected).epsilon(0.1));
+        CHECK(chan.live_time() == doctest::Approx(live).epsilon(0.02));
+
+        xia::pixie::hw::config hw_cfg;
+        hw_cfg.adc_msps = 100;
+        hw_cfg.adc_clk_div = 1;
+        xia::pixie::stats::channel stats(hw_cfg);
+        const uint64_t live_ticks = uint64_t(live / 10e-9);
+        const uint64_t peaks = uint64_t(rate * live);
+        stats.live_time_a = xia::pixie::param::value_type(live_ticks >> 32);
+        stats.live_time_b = xia::pixie::param::value_type(live_ticks);
+        stats.fast_peaks_a = xia::pixie::param::value_type(peaks >> 32);
+        stats.fast_peaks_b = xia::pixie::param::value_type(peaks);
+        auto check = est.check(0, 2, 3, stats);
+        CHECK(check.stats_live_time == doctest::Approx(live).epsilon(0.001));
+        CHECK(check.stats_rate == doctest::Approx(rate).epsilon(0.001));
+        CHECK(check.agrees(0.05));
+        CHECK_FALSE(check.agrees(0.0001));
+        xia::pixie::stats::channel empty(hw_cfg);
+        CHECK_FALSE(est.check(0, 2, 3, empty).agrees(0.05));
+    }
+}
@@ -20,8 +20,11 @@
  * @brief
  */
 
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <doctest/doctest.h>
 
@@ -65,3 +68,74 @@ TEST_SUITE("Pixie16Api: Bit manipulation functions.") {
         CHECK(APP32_TstBit(19, 1 << 19));
     }
 }
+
+TEST_SUITE("Pixie16Api: Crate handles") {
+    TEST_CASE("Default crate") {
+        pixie_crate_handle def = nullptr;
+        pixie_crate_handle sel = nullptr;
+        CHECK(PixieGetDefaultCrate(&def) == 0);
+        CHECK(def != nullptr);
+        CHECK(PixieGetSelectedCrate(&sel) == 0);
+        CHECK(sel == def);
+        CHECK(PixieDestroyCrate(def) == -102);
+        CHECK(PixieGetDefaultCrate(nullptr) == -102);
+    }
+    TEST_CASE("Create, select and destroy") {
+        pixie_crate_handle def = nullptr;
+        pixie_crate_handle crate_1 = nullptr;
+        pixie_crate_handle crate_2 = nullptr;
+        pixie_crate_handle sel = nullptr;
+        unsigned short buses[] = {3, 4};
+        CHECK(PixieGetDefaultCrate(&def) == 0);
+        CHECK(PixieCreateCrate(1, nullptr, 0, &crate_1) == 0);
+        CHECK(PixieCreateCrate(2, buses, 2, &crate_2) == 0);
+        CHECK(PixieCreateCrate(3, nullptr, 2, &sel) == -102);
+        CHECK(PixieCreateCrate(16, nullptr, 0, &sel) == -102);
+        CHECK(crate_1 != crate_2);
+        CHECK(crate_1 != def);
+        CHECK(PixieSelectCrate(crate_1) == 0);
+        CHECK(PixieGetSelectedCrate(&sel) == 0);
+        CHECK(sel == crate_1);
+        CHECK(Pixie16CheckRunStatus(0) == -101);
+        CHECK(PixieSelectCrate(crate_2) == 0);
+        CHECK(PixieGetSelectedCrate(&sel) == 0);
+        CHECK(sel == crate_2);
+        CHECK(PixieDestroyCrate(crate_2) == 0);
+        CHECK(PixieGetSelectedCrate(&sel) == 0);
+        CHECK(sel == def);
+        CHECK(PixieSelectCrate(crate_2) == -102);
+        CHECK(PixieDestroyCrate(crate_2) == -102);
+        CHECK(PixieSelectCrate(crate_1) == 0);
+        CHECK(PixieSelectCrate(nullptr) == 0);
+        CHECK(PixieGetSelectedCrate(&sel) == 0);
+        CHECK(sel == def);
+        CHECK(PixieDestroyCrate(crate_1) == 0);
+    }
+    TEST_CASE("Destroy a crate selected on another thread") {
+        pixie_crate_handle crate_1 = nullptr;
+        CHECK(PixieCreateCrate(1, nullptr, 0, &crate_1) == 0);
+        std::mutex lock;
+        std::condition_variable cv;
+        bool selected = false;
+        bool release = false;
+        std::thread user([&] {
+            PixieSelectCrate(crate_1);
+            std::unique_lock<std::mutex> guard(lock);
+            selected = true;
+            cv.notify_all();
+            cv.wait(guard, [&] { return release; });
+        });
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cv.wait(guard, [&] { return selected; });
+        }
+        CHECK(PixieDestroyCrate(crate_1) == -103);
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            release = true;
+            cv.notify_all();
+        }
+        user.join();
+        CHECK(PixieDestroyCrate(crate_1) == 0);
+    }
+}
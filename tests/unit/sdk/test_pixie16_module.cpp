@@ -20,15 +20,27 @@
  * @brief
  */
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+
 #include <doctest/doctest.h>
 
 #include <pixie/error.hpp>
 #include <pixie/log.hpp>
+#include <pixie/stats.hpp>
+#include <pixie/util.hpp>
+
+#include <pixie/data/list_mode.hpp>
 
+#include <pixie/pixie16/calibration_cache.hpp>
 #include <pixie/pixie16/defs.hpp>
 #include <pixie/pixie16/module.hpp>
 #include <pixie/pixie16/sim.hpp>
 
+#include "test_files.hpp"
+
 using crate_error = xia::pixie::crate::error;
 
 static const std::vector<std::string> module_def = {
@@ -41,6 +53,39 @@ static const std::vector<std::string> module_def = {
 
 static const size_t test_modules = module_def.size();
 
+/*
+ * Write a list-mode file of 4 word events for slot 2. The events are
+ * `tick` clock ticks apart.
+ */
+static xia::pixie::hw::words make_replay_file(const std::string& name, size_t events,
+                                              uint64_t tick) {
+    xia::pixie::hw::words data;
+    for (size_t e = 0; e < events; ++e) {
+        uint64_t time = 1000 + e * tick;
+        data.push_back((4 << 17) | (4 << 12) | (2 << 4) | (e % 16));
+        data.push_back(uint32_t(time));
+        data.push_back(uint32_t(time >> 32) & 0xFFFF);
+        data.push_back(e & 0xFFFF);
+    }
+    std::ofstream out(name, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(data[0]));
+    return data;
+}
+
+static xia::pixie::hw::words read_replay(xia::pixie::module::module& module, size_t words) {
+    xia::pixie::hw::words data;
+    size_t polls = 1000;
+    while (data.size() < words && polls-- > 0) {
+        xia::pixie::hw::words values;
+        module.read_list_mode(values);
+        data.insert(data.end(), values.begin(), values.end());
+        if (data.size() < words) {
+            xia::pixie::hw::wait(5000);
+        }
+    }
+    return data;
+}
+
 static void test_setup() {
     xia::logging::start("log", "stdout", false);
     xia::logging::set_level(xia::log::level::off);
@@ -163,6 +208,29 @@ TEST_SUITE("Crate: modules") {
                                  "module: num=0,slot=2: fifo: bandwidth value out of range",
                                  crate_error);
         }
+        SUBCASE("FIFO adaptive") {
+            CHECK(crate[0].fifo_adaptive == false);
+            CHECK_NOTHROW(crate[0].set_fifo_adaptive(true));
+            CHECK(crate[0].fifo_adaptive == true);
+            module::module::fifo_tuning tuning;
+            tuning.tune(400, false, false);
+            CHECK(tuning.run_wait_usecs == 2500);
+            CHECK(tuning.hold_usecs == 5000);
+            CHECK(tuning.dma_trigger_level == module::module::min_fifo_dma_trigger_level);
+            tuning.tune(8e6, false, false);
+            CHECK(tuning.run_wait_usecs == 2048);
+            CHECK(tuning.hold_usecs == 4096);
+            CHECK(tuning.dma_trigger_level == module::module::max_fifo_dma_trigger_level);
+            tuning.tune(8e6, true, false);
+            CHECK(tuning.run_wait_usecs == 1024);
+            tuning.tune(1e6, false, false);
+            CHECK(tuning.run_wait_usecs == 2500);
+            CHECK(tuning.dma_trigger_level == 2560);
+            tuning.tune(400, false, true);
+            CHECK(tuning.run_wait_usecs == 5000);
+            CHECK(tuning.hold_usecs == 10000);
+            CHECK(tuning.dma_trigger_level == module::module::max_fifo_dma_trigger_level);
+        }
     }
     TEST_CASE("assign slots") {
         using namespace xia::pixie;
@@ -278,6 +346,826 @@ TEST_SUITE("Crate: modules") {
             CHECK_NOTHROW(crate[0].run_end());
         }
     }
+    TEST_CASE("multiple crates") {
+        using namespace xia::pixie;
+        sim::crate crate_0;
+        sim::crate crate_1;
+        crate_1.id = 1;
+        CHECK_NOTHROW(crate_0.initialize());
+        CHECK_NOTHROW(crate_1.initialize());
+        CHECK(crate_0.num_modules == test_modules);
+        CHECK(crate_1.num_modules == test_modules);
+        CHECK(&crate_0[0] != &crate_1[0]);
+        CHECK_NOTHROW(crate_0.boot());
+        CHECK_NOTHROW(crate_1.boot());
+        CHECK(crate_0[0].read_var(param::module_var::CrateID, 0, false) == 0);
+        CHECK(crate_1[0].read_var(param::module_var::CrateID, 0, false) == 1);
+        CHECK(crate_1[test_modules - 1].read_var(param::module_var::CrateID, 0, false) == 1);
+        crate_1.id = crate::crate::max_id + 1;
+        CHECK_THROWS_WITH_AS(crate_1.write_id(), "crate id out of range", error::error);
+        CHECK_NOTHROW(crate_0[0].set_fifo_buffers(50));
+        CHECK(crate_1[0].fifo_buffers == module::module::default_fifo_buffers);
+        CHECK_NOTHROW(crate_0.shutdown());
+        CHECK_NOTHROW(crate_1.probe());
+        CHECK(crate_1.num_modules == test_modules);
+        CHECK_NOTHROW(crate_1.shutdown());
+    }
+    TEST_CASE("broadcast") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        CHECK_NOTHROW(crate.boot());
+        SUBCASE("every module and channel") {
+            CHECK_NOTHROW(crate.broadcast({{"BINFACTOR", 5}, {"BASELINE_PERCENT", 20}}));
+            for (auto& module : crate.modules) {
+                for (size_t channel = 0; channel < module->num_channels; ++channel) {
+                    CHECK(module->read("BINFACTOR", channel) == 5);
+                    CHECK(module->read("BASELINE_PERCENT", channel) == 20);
+                }
+            }
+        }
+        SUBCASE("copy source channel") {
+            CHECK_NOTHROW(crate[1].write("BASELINE_PERCENT", 3, 30));
+            CHECK_NOTHROW(crate[1].write("BINFACTOR", 3, 4));
+            const double binfactor = crate[0].read("BINFACTOR", 0);
+            CHECK_NOTHROW(crate.broadcast(1, 3, param::baseline_control_mask));
+            for (auto& module : crate.modules) {
+                for (size_t channel = 0; channel < module->num_channels; ++channel) {
+                    CHECK(module->read("BASELINE_PERCENT", channel) == 30);
+                }
+            }
+            CHECK(crate[0].read("BINFACTOR", 0) == binfactor);
+        }
+        SUBCASE("error per module") {
+            /*
+             * Channel 16 is only in the 32 channel module.
+             */
+            const uint32_t channel_16 = uint32_t(1) << 16;
+            const double binfactor = crate[0].read("BINFACTOR", 0);
+            try {
+                crate.broadcast({{"BINFACTOR", 6}}, {channel_16, channel_16, channel_16});
+                CHECK(false);
+            } catch (error::error& e) {
+                const std::string what = e.what();
+                CHECK(e.type == error::code::channel_number_invalid);
+                CHECK(what.find("slot=2") != std::string::npos);
+                CHECK(what.find("slot=6") != std::string::npos);
+                CHECK(what.find("slot=10") == std::string::npos);
+            }
+            CHECK(crate[0].read("BINFACTOR", 0) == binfactor);
+            CHECK(crate[1].read("BINFACTOR", 0) == binfactor);
+            CHECK(crate[2].read("BINFACTOR", 16) == 6);
+            CHECK(crate[2].read("BINFACTOR", 15) == binfactor);
+        }
+    }
+    TEST_CASE("event counts") {
+        using namespace xia::pixie;
+        /*
+         * Two 6 word events of slot 2 and one 4 word event of slot 3.
+         */
+        hw::words data = {
+            (6 << 17) | (4 << 12) | (2 << 4) | 1, 100, 0x10000 | 2, 0, 0, 0,
+            (6 << 17) | (4 << 12) | (2 << 4) | 5, 200, 3, 0, 0, 0,
+            (4 << 17) | (4 << 12) | (3 << 4) | 5, 300, 4, 0};
+        module::module::event_counts counts;
+        counts.add(data.data(), data.size(), 2);
+        CHECK(counts.events == 0);
+        counts.format(34688, 500);
+        SUBCASE("whole") {
+            counts.add(data.data(), data.size(), 2);
+        }
+        SUBCASE("split") {
+            for (size_t w = 0; w < data.size(); ++w) {
+                counts.add(&data[w], 1, 2);
+            }
+        }
+        CHECK(counts.events == 3);
+        CHECK(counts.other_slots == 1);
+        CHECK(counts.bad_headers == 0);
+        CHECK(counts.channels[1].events == 1);
+        CHECK(counts.channels[1].bytes == 24);
+        CHECK(counts.channels[1].last_time == ((uint64_t(2) << 32) | 100));
+        CHECK(counts.channels[5].events == 1);
+        CHECK(counts.channels[5].last_time == ((uint64_t(3) << 32) | 200));
+        hw::words bad = {(1 << 17) | 2, 0, 0, 0};
+        counts.add(bad.data(), bad.size(), 2);
+        counts.add(data.data(), data.size(), 2);
+        CHECK(counts.bad_headers == 1);
+        CHECK(counts.events == 3);
+        counts.clear();
+        counts.add(data.data(), data.size(), 2);
+        CHECK(counts.events == 3);
+        CHECK(counts.bad_headers == 0);
+        /*
+         * The 32 channel modules use wider channel and slot fields.
+         */
+        hw::words wide = {(4 << 17) | (4 << 12) | (3 << 6) | 20, 1, 0, 0};
+        counts.format(46540, 250);
+        counts.add(wide.data(), wide.size(), 3);
+        CHECK(counts.channels[20].events == 1);
+        /*
+         * Older firmware has a shorter event length field.
+         */
+        hw::words old = {(1u << 30) | (4 << 17) | (4 << 12) | (2 << 4) | 7, 1, 0, 0};
+        counts.format(17562, 100);
+        counts.add(old.data(), old.size(), 2);
+        CHECK(counts.channels[7].events == 1);
+        CHECK(counts.bad_headers == 0);
+        counts.format(1, 100);
+        counts.add(data.data(), data.size(), 2);
+        CHECK(counts.channels[1].events == 1);
+    }
+    TEST_CASE("list-mode replay") {
+        using namespace xia::pixie;
+        const std::string name = xia::test::temp_file_name("replay");
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        SUBCASE("fast") {
+            auto recorded = make_replay_file(name, 50000, 100);
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            auto replayed = read_replay(module, recorded.size());
+            CHECK_NOTHROW(module.run_end());
+            CHECK(module.replay_words() == recorded.size());
+            CHECK(replayed == recorded);
+            CHECK(module.data_stats.dma_in == recorded.size());
+            CHECK(module.bus_totals.dma_bytes == recorded.size() * sizeof(hw::word));
+            CHECK(module.event_stats.events == 50000);
+            CHECK(module.event_stats.other_slots == 0);
+            CHECK(module.event_stats.bad_headers == 0);
+            for (size_t ch = 0; ch < 16; ++ch) {
+                CHECK(module.event_stats.channels[ch].events == 50000 / 16);
+                CHECK(module.event_stats.channels[ch].bytes == (50000 / 16) * 4 * sizeof(hw::word));
+            }
+            CHECK(module.event_stats.channels[15].last_time == 1000 + 49999 * 100);
+        }
+        SUBCASE("in place") {
+            auto recorded = make_replay_file(name, 5000, 100);
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            hw::words replayed(recorded.size());
+            xia::util::span<hw::word> view(replayed);
+            size_t filled = 0;
+            size_t polls = 1000;
+            while (filled < replayed.size() && polls-- > 0) {
+                auto level = std::min(module.read_list_mode_level(), replayed.size() - filled);
+                filled += module.read_list_mode(view.subspan(filled, level));
+                if (filled < replayed.size()) {
+                    hw::wait(5000);
+                }
+            }
+            CHECK_NOTHROW(module.run_end());
+            CHECK(filled == recorded.size());
+            CHECK(replayed == recorded);
+            namespace list_mode = xia::pixie::data::list_mode;
+            list_mode::partitioned_records parts(recorded.size() / 16 + 1);
+            list_mode::buffer leftovers;
+            list_mode::decode_data_block(xia::util::span<const hw::word>(view), 34688, 100,
+                                         parts, leftovers);
+            CHECK(leftovers.empty());
+            CHECK(parts.size() == 16);
+            CHECK(parts.events() == 5000);
+            CHECK(parts.get(0, 2, 15).back().energy == 4991);
+        }
+        SUBCASE("adaptive") {
+            auto recorded = make_replay_file(name, 50000, 100);
+            CHECK_NOTHROW(module.set_fifo_run_wait(module::module::max_fifo_run_wait_usec));
+            CHECK_NOTHROW(module.set_fifo_hold(module::module::max_fifo_hold_usec));
+            CHECK_NOTHROW(module.set_fifo_dma_trigger_level(module::module::max_fifo_dma_trigger_level));
+            CHECK_NOTHROW(module.set_fifo_adaptive(true));
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            auto replayed = read_replay(module, recorded.size());
+            xia::pixie::hw::wait(2 * module::module::fifo_tuning::period_usecs);
+            auto settings = module.get_fifo_settings();
+            CHECK(settings.run_wait_usecs >= module::module::min_fifo_run_wait_usec);
+            CHECK(settings.run_wait_usecs < module::module::max_fifo_run_wait_usec);
+            CHECK(settings.hold_usecs >= module::module::min_fifo_hold_usec);
+            CHECK(settings.dma_trigger_level >= module::module::min_fifo_dma_trigger_level);
+            CHECK(settings.dma_trigger_level <= module::module::max_fifo_dma_trigger_level);
+            CHECK_NOTHROW(module.run_end());
+            CHECK(replayed == recorded);
+            CHECK_NOTHROW(module.set_fifo_adaptive(false));
+            CHECK(module.fifo_run_wait_usecs == module::module::max_fifo_run_wait_usec);
+            CHECK(module.fifo_hold_usecs == module::module::max_fifo_hold_usec);
+            CHECK(module.fifo_dma_trigger_level == module::module::max_fifo_dma_trigger_level);
+            settings = module.get_fifo_settings();
+            CHECK(settings.run_wait_usecs == module::module::max_fifo_run_wait_usec);
+            CHECK(settings.hold_usecs == module::module::max_fifo_hold_usec);
+            CHECK(settings.dma_trigger_level == module::module::max_fifo_dma_trigger_level);
+        }
+        SUBCASE("low latency") {
+            auto recorded = make_replay_file(name, 2000, 1000);
+            std::mutex lock;
+            hw::words consumed;
+            size_t calls = 0;
+            bool whole_events = true;
+            auto consumer = [&](const hw::word* data, const size_t length) {
+                std::lock_guard<std::mutex> guard(lock);
+                consumed.insert(consumed.end(), data, data + length);
+                ++calls;
+                if (length % 4 != 0) {
+                    whole_events = false;
+                }
+            };
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            CHECK_THROWS_AS(module.start_low_latency(nullptr), module::error);
+            CHECK_NOTHROW(module.start_low_latency(consumer, 0));
+            CHECK(module.low_latency());
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            size_t polls = 1000;
+            while (polls-- > 0) {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (consumed.size() >= recorded.size()) {
+                        break;
+                    }
+                }
+                hw::wait(2000);
+            }
+            CHECK_NOTHROW(module.run_end());
+            CHECK_NOTHROW(module.stop_low_latency());
+            CHECK_FALSE(module.low_latency());
+            CHECK(consumed == recorded);
+            CHECK(whole_events);
+            CHECK(module.low_latency_stats.count == calls);
+            CHECK(module.low_latency_stats.min_nsecs <= module.low_latency_stats.max_nsecs);
+            CHECK(module.read_list_mode_level() == 0);
+        }
+        SUBCASE("flight recorder") {
+            auto recorded = make_replay_file(name, 50000, 100);
+            const std::string dump_name = xia::test::temp_file_name("recorder");
+            CHECK_THROWS_AS(module.dump_fifo_recorder(dump_name, 1, 0), module::error);
+            CHECK_THROWS_AS(module.set_fifo_recorder(-1, 0), module::error);
+            CHECK_NOTHROW(module.set_fifo_recorder(10, 2 * 1024 * 1024));
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            CHECK_THROWS_AS(module.set_fifo_recorder(10, 4 * 1024 * 1024), module::error);
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            auto replayed = read_replay(module, recorded.size());
+            CHECK_NOTHROW(module.run_end());
+            CHECK(replayed == recorded);
+            auto result = module.dump_fifo_recorder(dump_name, 60, 0);
+            const size_t words = result.get();
+            CHECK(words > 0);
+            CHECK(words <= recorded.size());
+            hw::words dumped(words);
+            std::ifstream in(dump_name, std::ios::binary);
+            in.read(reinterpret_cast<char*>(dumped.data()), words * sizeof(hw::word));
+            CHECK(hw::words(recorded.end() - words, recorded.end()) == dumped);
+            in.close();
+            std::remove(dump_name.c_str());
+        }
+        SUBCASE("drain") {
+            auto recorded = make_replay_file(name, 2000, 100);
+            CHECK_NOTHROW(module.set_fifo_run_wait(module::module::max_fifo_run_wait_usec));
+            CHECK_NOTHROW(module.set_fifo_hold(module::module::max_fifo_hold_usec));
+            CHECK_NOTHROW(
+                module.set_fifo_dma_trigger_level(module::module::max_fifo_dma_trigger_level));
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            hw::words drained;
+            auto consumer = [&drained](const hw::word* data, const size_t length) {
+                drained.insert(drained.end(), data, data + length);
+            };
+            module::module::drain_counts counts;
+            CHECK_NOTHROW(module.run_end_drain(counts, consumer));
+            CHECK(drained == recorded);
+            CHECK(counts.dma_in == recorded.size());
+            CHECK(counts.in == recorded.size());
+            CHECK(counts.consumed == recorded.size());
+            CHECK(counts.drained <= counts.dma_in);
+            CHECK(counts.queued == 0);
+            CHECK(module.replay_words() == recorded.size());
+            CHECK(module.read_list_mode_level() == 0);
+        }
+        SUBCASE("drain to the queue") {
+            auto recorded = make_replay_file(name, 2000, 100);
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            module::module::drain_counts counts;
+            CHECK_NOTHROW(module.run_end_drain(counts));
+            CHECK(counts.consumed == 0);
+            CHECK(counts.queued + module.run_stats.out == recorded.size());
+            auto replayed = read_replay(module, recorded.size());
+            CHECK(replayed == recorded);
+        }
+        SUBCASE("read errors") {
+            auto recorded = make_replay_file(name, 50000, 100);
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            module.clear_bus_costs();
+            module.inject_fault(sim::fault::fifo_watermark, 2);
+            module.inject_fault(sim::fault::dma);
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            hw::words replayed;
+            size_t polls = 1000;
+            while (polls-- > 0) {
+                hw::words values;
+                module.read_list_mode(values);
+                replayed.insert(replayed.end(), values.begin(), values.end());
+                if (module.replay_words() == recorded.size() &&
+                    replayed.size() + module.run_stats.lost == recorded.size()) {
+                    break;
+                }
+                hw::wait(5000);
+            }
+            CHECK_NOTHROW(module.run_end());
+            CHECK(module.run_stats.errors == 3);
+            CHECK(module.run_stats.recoveries == 1);
+            CHECK(module.run_stats.lost > 0);
+            CHECK(replayed.size() + module.run_stats.lost == recorded.size());
+            CHECK(hw::words(recorded.end() - replayed.size(), recorded.end()) == replayed);
+            module::module::bus_costs costs;
+            module.get_bus_costs(costs);
+            CHECK(costs["dma_reset"].calls == 3);
+        }
+        SUBCASE("read errors exhaust the retries") {
+            auto recorded = make_replay_file(name, 50000, 100);
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            module.inject_fault(sim::fault::fifo_watermark,
+                                module::module::fifo_read_retries + 2);
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            hw::words replayed;
+            size_t polls = 1000;
+            while (polls-- > 0) {
+                hw::words values;
+                module.read_list_mode(values);
+                replayed.insert(replayed.end(), values.begin(), values.end());
+                if (module.replay_words() == recorded.size() &&
+                    replayed.size() + module.run_stats.lost == recorded.size()) {
+                    break;
+                }
+                hw::wait(5000);
+            }
+            module::run_notice notice;
+            bool worker_error = false;
+            size_t sequence = 0;
+            while (module.run_notices.wait(notice, sequence, 1000)) {
+                sequence = notice.sequence;
+                if (notice.event == module::run_event::worker_error) {
+                    worker_error = true;
+                }
+            }
+            CHECK(worker_error);
+            CHECK_NOTHROW(module.run_end());
+            CHECK(module.run_stats.errors == module::module::fifo_read_retries + 2);
+            CHECK(module.run_stats.failures == 1);
+            CHECK(module.run_stats.recoveries == 1);
+            CHECK(module.run_stats.lost == 0);
+            CHECK(replayed == recorded);
+        }
+        SUBCASE("scaled") {
+            /*
+             * 20 events 5 msecs apart replayed at 5 times the rate.
+             */
+            auto recorded = make_replay_file(name, 20, 500000);
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::scaled, 5));
+            xia::util::timepoint tp(true);
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            auto replayed = read_replay(module, recorded.size());
+            tp.end();
+            CHECK_NOTHROW(module.run_end());
+            CHECK(replayed == recorded);
+            CHECK(tp.msecs() >= 19);
+        }
+        SUBCASE("run end") {
+            auto recorded = make_replay_file(name, 20, 10000000);
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::original));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            auto replayed = read_replay(module, 4);
+            CHECK_NOTHROW(module.run_end());
+            CHECK(module.replay_words() < recorded.size());
+        }
+        CHECK_NOTHROW(module.replay_stop());
+        std::remove(name.c_str());
+    }
+    TEST_CASE("FIFO throughput characterization") {
+        using namespace xia::pixie;
+        const std::string name = xia::test::temp_file_name("replay");
+        auto recorded = make_replay_file(name, 50000, 100);
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        for (auto& module : crate.modules) {
+            CHECK_NOTHROW(dynamic_cast<sim::module&>(*module).replay(name, sim::replay_pacing::fast));
+        }
+        module::module::throughput_config config;
+        config.words = 100000;
+        config.max_msecs = 5000;
+        SUBCASE("Invalid") {
+            config.trigger_levels = {16};
+            module::module::throughput_report report;
+            CHECK_THROWS_AS(crate[0].characterize_fifo(config, report), module::error);
+        }
+        SUBCASE("Module sweep") {
+            config.dma_block_sizes = {0, 1024};
+            config.trigger_levels = {512, 4096};
+            module::module::throughput_report report;
+            CHECK_NOTHROW(crate[0].characterize_fifo(config, report));
+            REQUIRE(report.points.size() == 4);
+            CHECK(report.slot == crate[0].slot);
+            CHECK(report.bus_datarate == hw::pci_bus_datarate);
+            for (auto& point : report.points) {
+                CHECK(point.words >= config.words);
+                CHECK(point.transfers > 0);
+                CHECK(point.mb_per_sec > 0);
+                CHECK(point.latency_p50_usecs <= point.latency_p99_usecs);
+                CHECK(point.latency_p99_usecs <= point.latency_max_usecs);
+            }
+            CHECK(report.points[2].dma_block_size == 1024);
+            CHECK(report.points[2].transfers >= report.points[2].words / 1024);
+            CHECK(report.best().mb_per_sec > 0);
+            CHECK(crate[0].fifo_dma_trigger_level == module::module::default_fifo_dma_trigger_level);
+        }
+        SUBCASE("Crate concurrent") {
+            module::module::throughput_reports reports;
+            CHECK_NOTHROW(crate.characterize_fifo(config, reports));
+            REQUIRE(reports.size() == test_modules);
+            for (auto& report : reports) {
+                REQUIRE(report.points.size() == 1);
+                CHECK(report.points[0].words >= config.words);
+            }
+        }
+        for (auto& module : crate.modules) {
+            CHECK_NOTHROW(dynamic_cast<sim::module&>(*module).replay_stop());
+        }
+        std::remove(name.c_str());
+    }
+    TEST_CASE("latency histogram") {
+        using namespace xia::pixie;
+        module::module::latency_histogram hist;
+        hist.add(500);
+        hist.add(1500);
+        hist.add(3000);
+        hist.add(100000);
+        hist.add(size_t(1) << 62);
+        CHECK(hist.count == 5);
+        CHECK(hist.counts[0] == 1);
+        CHECK(hist.counts[1] == 1);
+        CHECK(hist.counts[2] == 1);
+        CHECK(hist.counts[7] == 1);
+        CHECK(hist.counts[module::module::latency_histogram::bins - 1] == 1);
+        CHECK(hist.min_nsecs == 500);
+        CHECK(hist.percentile(50) == 4);
+        module::module::latency_histogram copy(hist);
+        CHECK(copy.count == 5);
+        hist.clear();
+        CHECK(hist.count == 0);
+        CHECK(hist.percentile(50) == 0);
+    }
+    TEST_CASE("bus costs") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = crate[0];
+        module.clear_bus_costs();
+        {
+            module::module::bus_op outer(module, "outer");
+            module.read_word(0);
+            {
+                module::module::bus_op inner(module, "inner");
+                module.write_word(0, 1);
+                module.write_word(0, 2);
+            }
+            {
+                module::module::bus_op other(crate[1], "other");
+                module.read_word(0);
+            }
+        }
+        module::module::bus_costs costs;
+        module.get_bus_costs(costs);
+        REQUIRE(costs.count("outer") == 1);
+        REQUIRE(costs.count("inner") == 1);
+        CHECK(costs["outer"].calls == 1);
+        CHECK(costs["outer"].pio_reads == 2);
+        CHECK(costs["outer"].pio_writes == 2);
+        CHECK(costs["inner"].calls == 1);
+        CHECK(costs["inner"].pio_reads == 0);
+        CHECK(costs["inner"].pio_writes == 2);
+        CHECK(costs.count("other") == 0);
+        CHECK(module.bus_totals.pio_reads >= 2);
+        CHECK(module.bus_totals.pio_writes >= 2);
+        crate[1].get_bus_costs(costs);
+        REQUIRE(costs.count("other") == 1);
+        CHECK(costs["other"].pio_reads == 0);
+        module.clear_bus_costs();
+        module.get_bus_costs(costs);
+        CHECK(costs.count("outer") == 0);
+    }
+    TEST_CASE("calibration cache") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        for (size_t chan = 0; chan < module.num_channels; ++chan) {
+            module.write_var(param::channel_var::BaselinePercent, 10, chan);
+        }
+        const std::string file = xia::test::temp_file_name("calibration-cache");
+        std::remove(file.c_str());
+        calibration_cache::counts counts;
+        SUBCASE("baseline check") {
+            int baseline;
+            hw::adc_trace trace(1000, 1638);
+            CHECK(calibration_cache::baseline_valid(trace, 14, 10, 2, baseline));
+            CHECK(baseline == 1638);
+            std::fill(trace.begin(), trace.begin() + 100, 9000);
+            CHECK(calibration_cache::baseline_valid(trace, 14, 10, 2, baseline));
+            trace.assign(1000, 0);
+            CHECK_FALSE(calibration_cache::baseline_valid(trace, 14, 0, 2, baseline));
+            trace.assign(1000, 4000);
+            CHECK_FALSE(calibration_cache::baseline_valid(trace, 14, 10, 2, baseline));
+            CHECK_FALSE(calibration_cache::baseline_valid(hw::adc_trace(), 14, 10, 2, baseline));
+        }
+        SUBCASE("first start") {
+            calibration_cache::cache cache;
+            CHECK_FALSE(cache.load(file));
+            CHECK_FALSE(cache.has(module));
+            cache.restore(module, counts);
+            CHECK(counts.channels == module.num_channels);
+            CHECK(counts.missing == module.num_channels);
+            CHECK(counts.recalibrated == module.num_channels);
+            CHECK(counts.unverified == 0);
+            CHECK(counts.restored == 0);
+            CHECK(cache.has(module));
+            CHECK_FALSE(cache.has(crate[1]));
+            CHECK(cache.get(module).serial_num == 1034);
+            CHECK_THROWS_AS(cache.get(crate[1]), calibration_cache::error);
+        }
+        SUBCASE("restart") {
+            calibration_cache::cache cache;
+            cache.restore(module, counts);
+            auto offset_dac = module.read_var(param::channel_var::OffsetDAC, 0);
+            module.write_var(param::channel_var::BLcut, 17, 0);
+            cache.record(module);
+            CHECK_NOTHROW(cache.save(file));
+            for (size_t chan = 0; chan < module.num_channels; ++chan) {
+                module.write_var(param::channel_var::OffsetDAC, 0, chan);
+                module.write_var(param::channel_var::BLcut, 0, chan);
+            }
+            calibration_cache::cache restarted;
+            CHECK(restarted.load(file));
+            CHECK(restarted.size() == 1);
+            restarted.restore(module, counts);
+            CHECK(counts.restored == module.num_channels);
+            CHECK(counts.failed == 0);
+            CHECK(counts.missing == 0);
+            CHECK(counts.recalibrated == 0);
+            CHECK(module.read_var(param::channel_var::OffsetDAC, 0) == offset_dac);
+            CHECK(module.read_var(param::channel_var::BLcut, 0) == 17);
+        }
+        SUBCASE("failed channel") {
+            calibration_cache::cache cache;
+            cache.restore(module, counts);
+            auto offset_dac_0 = module.read_var(param::channel_var::OffsetDAC, 0);
+            auto offset_dac_3 = module.read_var(param::channel_var::OffsetDAC, 3);
+            module.adc_input_offset(3, 1000);
+            cache.restore(module, counts);
+            CHECK(counts.restored == module.num_channels - 1);
+            CHECK(counts.failed == 1);
+            CHECK(counts.recalibrated == 1);
+            CHECK(counts.unverified == 0);
+            CHECK(module.read_var(param::channel_var::OffsetDAC, 0) == offset_dac_0);
+            CHECK(module.read_var(param::channel_var::OffsetDAC, 3) != offset_dac_3);
+            CHECK(cache.get(module).find(3)->offset_dac ==
+                  module.read_var(param::channel_var::OffsetDAC, 3));
+        }
+        SUBCASE("changed settings") {
+            calibration_cache::cache cache;
+            cache.restore(module, counts);
+            module.write_var(param::channel_var::BaselinePercent, 20, 5);
+            cache.restore(module, counts);
+            CHECK(counts.restored == module.num_channels - 1);
+            CHECK(counts.missing == 1);
+            CHECK(counts.recalibrated == 1);
+            CHECK(counts.unverified == 0);
+        }
+        SUBCASE("CSRA bits") {
+            calibration_cache::cache cache;
+            cache.restore(module, counts);
+            auto csra = module.read_var(param::channel_var::ChanCSRa, 5);
+            module.write_var(param::channel_var::ChanCSRa, csra ^ (1 << hw::bit::CCSRA_GOOD), 5);
+            cache.restore(module, counts);
+            CHECK(counts.restored == module.num_channels);
+            CHECK(counts.missing == 0);
+            module.write_var(param::channel_var::ChanCSRa, csra ^ (1 << hw::bit::CCSRA_POLARITY),
+                             5);
+            cache.restore(module, counts);
+            CHECK(counts.restored == module.num_channels - 1);
+            CHECK(counts.missing == 1);
+            CHECK(cache.get(module).find(5)->settings.at("ChanCSRa") ==
+                  ((csra ^ (1 << hw::bit::CCSRA_POLARITY)) &
+                   (1 << hw::bit::CCSRA_POLARITY | 1 << hw::bit::CCSRA_ENARELAY)));
+        }
+        SUBCASE("unverified channel") {
+            calibration_cache::cache cache;
+            module.adc_input_offset(3, 1 << 16);
+            cache.restore(module, counts);
+            CHECK(counts.recalibrated == module.num_channels);
+            CHECK(counts.unverified == 1);
+            CHECK(cache.get(module).find(3) == nullptr);
+            CHECK(cache.get(module).find(2) != nullptr);
+            cache.restore(module, counts, false);
+            CHECK(counts.missing == 1);
+        }
+        SUBCASE("invalid file") {
+            {
+                std::ofstream out(file);
+                out << "{\"format\": 99, \"modules\": []}";
+            }
+            calibration_cache::cache cache;
+            CHECK_THROWS_AS(cache.load(file), calibration_cache::error);
+            {
+                std::ofstream out(file);
+                out << "not json";
+            }
+            CHECK_THROWS_AS(cache.load(file), calibration_cache::error);
+        }
+        std::remove(file.c_str());
+    }
+    TEST_CASE("DSP memory model") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        CHECK_FALSE(module.dsp_memory_emulated());
+        module.write_var(param::channel_var::BaselinePercent, 10, 3);
+        module.clear_bus_costs();
+        module.write_var(param::channel_var::BaselinePercent, 20, 3);
+        CHECK(module.bus_totals.pio_writes == 0);
+
+        CHECK_NOTHROW(module.emulate_dsp_memory());
+        CHECK(module.dsp_memory_emulated());
+        CHECK(module.channel_var_descriptors[0].address != 0);
+        module.clear_bus_costs();
+        module.clear_bus_usecs();
+        module.write_var(param::channel_var::BaselinePercent, 30, 3);
+        CHECK(module.bus_totals.pio_writes > 0);
+        CHECK(module.bus_usecs() > 0);
+        CHECK(module.read_var(param::channel_var::BaselinePercent, 3, 0, false) == 30);
+        CHECK(module.read_var(param::channel_var::BaselinePercent, 2, 0) == 0);
+        CHECK(module.read_var(param::channel_var::BaselinePercent, 3, 0) == 30);
+
+        SUBCASE("sync") {
+            module.write_var(param::module_var::HostIO, 1234, 0, false);
+            module.sync_vars(module::module::sync_from_dsp);
+            CHECK(module.read_var(param::module_var::HostIO, 0, false) == 0);
+            module.write_var(param::module_var::HostIO, 1234, 0, false);
+            module.clear_bus_costs();
+            module.sync_vars(module::module::sync_to_dsp);
+            CHECK(module.bus_totals.pio_writes > 0);
+            module.write_var(param::module_var::HostIO, 0, 0, false);
+            CHECK(module.read_var(param::module_var::HostIO, 0) == 1234);
+        }
+        SUBCASE("stats") {
+            stats::stats stats(module);
+            module.clear_bus_costs();
+            CHECK_NOTHROW(stats::read(module, stats));
+            CHECK(module.bus_totals.dma_transfers + module.bus_totals.pio_reads > 0);
+        }
+        SUBCASE("timing") {
+            sim::bus_timing timing;
+            timing.pio_read_usecs = 0;
+            timing.pio_write_usecs = 0;
+            timing.dma_setup_usecs = 0;
+            module.set_bus_timing(timing);
+            module.clear_bus_usecs();
+            module.write_var(param::channel_var::BaselinePercent, 40, 3);
+            CHECK(module.bus_usecs() == 0);
+        }
+        SUBCASE("disable") {
+            module.emulate_dsp_memory(false);
+            module.clear_bus_costs();
+            module.write_var(param::channel_var::BaselinePercent, 50, 3);
+            CHECK(module.bus_totals.pio_writes == 0);
+        }
+    }
+    TEST_CASE("memory usage") {
+        using namespace xia::pixie;
+        const std::string name = xia::test::temp_file_name("replay");
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        module::module::memory_usage current;
+        module::module::memory_usage peak;
+        CHECK_NOTHROW(module.get_memory_usage(current, peak));
+        CHECK(current.pool_in_use == 0);
+        CHECK(current.queued == 0);
+        CHECK(current.variables > 0);
+        CHECK(current.total() >= current.pool_capacity + current.variables);
+        CHECK(peak.variables == current.variables);
+
+        auto recorded = make_replay_file(name, 5000, 100);
+        const size_t recorded_bytes = recorded.size() * sizeof(hw::word);
+        CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+        CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+        size_t polls = 1000;
+        while (module.read_list_mode_level() < recorded.size() && polls-- > 0) {
+            hw::wait(5000);
+        }
+        CHECK_NOTHROW(module.get_memory_usage(current, peak));
+        CHECK(current.pool_capacity ==
+              module.fifo_buffers * module::module::fifo_buffer_words * sizeof(hw::word));
+        CHECK(current.queued == recorded_bytes);
+        CHECK(current.pool_in_use >= recorded_bytes);
+        auto replayed = read_replay(module, recorded.size());
+        CHECK_NOTHROW(module.run_end());
+        CHECK(replayed == recorded);
+
+        CHECK_NOTHROW(module.get_memory_usage(current, peak));
+        CHECK(current.queued == 0);
+        CHECK(peak.queued == recorded_bytes);
+        CHECK(peak.pool_in_use >= recorded_bytes);
+        CHECK(current.output().find("queued=0") != std::string::npos);
+
+        CHECK_NOTHROW(module.clear_memory_peaks());
+        CHECK_NOTHROW(module.get_memory_usage(current, peak));
+        CHECK(peak.queued == 0);
+        CHECK(peak.pool_capacity == current.pool_capacity);
+        CHECK_NOTHROW(module.replay_stop());
+        std::remove(name.c_str());
+    }
+    TEST_CASE("run notices") {
+        using namespace xia::pixie;
+        sim::crate crate;
+        CHECK_NOTHROW(crate.initialize());
+        CHECK_NOTHROW(crate.probe());
+        auto& module = dynamic_cast<sim::module&>(crate[0]);
+        std::mutex heard_lock;
+        std::vector<module::run_notice> heard;
+        auto handle = module.run_notices.add([&heard_lock, &heard](const module::run_notice& n) {
+            std::lock_guard<std::mutex> guard(heard_lock);
+            heard.push_back(n);
+        });
+        module::run_notice notice;
+        SUBCASE("list-mode") {
+            const std::string name = xia::test::temp_file_name("replay");
+            auto recorded = make_replay_file(name, 1000, 100);
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            CHECK_NOTHROW(module.start_listmode(hw::run::run_mode::new_run));
+            CHECK(module.run_notices.wait(notice, 0, 1000000));
+            CHECK(notice.event == module::run_event::started);
+            CHECK(notice.sequence == 1);
+            CHECK(notice.task == hw::run::run_task::list_mode);
+            CHECK(notice.slot == module.slot);
+            auto replayed = read_replay(module, recorded.size());
+            CHECK_NOTHROW(module.run_end());
+            CHECK(replayed == recorded);
+            CHECK(module.run_notices.wait(notice, notice.sequence, 1000000));
+            CHECK(notice.event == module::run_event::ended);
+            CHECK(notice.sequence == 2);
+            CHECK(notice.task == hw::run::run_task::list_mode);
+            CHECK(notice.what == "run-end");
+            CHECK_FALSE(module.run_notices.wait(notice, 2, 1000));
+            CHECK(crate.run_notices.wait(notice, 0, 1000));
+            CHECK(notice.event == module::run_event::started);
+            CHECK(notice.number == module.number);
+            CHECK(crate.run_notices.sequence() == 2);
+            std::lock_guard<std::mutex> guard(heard_lock);
+            CHECK(heard.size() == 2);
+            CHECK_NOTHROW(module.replay_stop());
+            std::remove(name.c_str());
+        }
+        SUBCASE("ended in the module") {
+            const std::string name = xia::test::temp_file_name("replay");
+            make_replay_file(name, 100, 100);
+            CHECK_NOTHROW(module.replay(name, sim::replay_pacing::fast));
+            CHECK_NOTHROW(module.start_histograms(hw::run::run_mode::new_run));
+            CHECK(module.run_notices.wait(notice, 0, 1000000));
+            CHECK(notice.event == module::run_event::started);
+            CHECK(notice.task == hw::run::run_task::histogram);
+            CHECK_FALSE(module.run_notices.wait(notice, notice.sequence, 100000));
+            module.replay_end_run();
+            CHECK(module.run_notices.wait(notice, notice.sequence, 5000000));
+            CHECK(notice.event == module::run_event::ended);
+            CHECK(notice.task == hw::run::run_task::histogram);
+            CHECK(notice.what == "run not active");
+            CHECK(module.run_task == hw::run::run_task::nop);
+            CHECK_NOTHROW(module.run_end());
+            CHECK(module.run_notices.sequence() == 2);
+            CHECK_NOTHROW(module.replay_stop());
+            std::remove(name.c_str());
+        }
+        SUBCASE("held notices") {
+            module::run_notifier notifier;
+            for (size_t n = 0; n < module::run_notifier::max_notices + 6; ++n) {
+                module::run_notice raised;
+                raised.event = module::run_event::fifo_overflow;
+                notifier.notify(raised);
+            }
+            CHECK(notifier.wait(notice, 0, 1000));
+            CHECK(notice.sequence == 7);
+            CHECK(notifier.wait(notice, 20, 1000));
+            CHECK(notice.sequence == 21);
+            CHECK(notice.output().find("event=fifo-overflow") != std::string::npos);
+        }
+        module.run_notices.remove(handle);
+    }
     TEST_CASE("TEARDOWN") {
         xia::logging::stop("log");
     }
@@ -20,11 +20,15 @@
  * @brief Defines tests for the threaded FIFO buffer readout.
  */
 
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 
 #include <doctest/doctest.h>
 #include <pixie/buffer.hpp>
 
+#include "test_files.hpp"
+
 TEST_SUITE("xia::buffer") {
     TEST_CASE("pool create/destroy") {
         SUBCASE("no actions") {
@@ -118,6 +122,9 @@ TEST_SUITE("xia::buffer") {
             CHECK(pool.count() == pool.number - 3 * 10 + 4);
             handles[0].push_back(pool.request());
             CHECK(pool.count() == pool.number - 3 * 10 + 3);
+            CHECK(pool.low_count() == pool.number - 3 * 10);
+            pool.reset_low_count();
+            CHECK(pool.low_count() == pool.count());
             std::vector<xia::buffer::handle> remaining;
             while (!pool.empty()) {
                 remaining.push_back(pool.request());
@@ -192,6 +199,9 @@ TEST_SUITE("xia::buffer") {
             }
             CHECK(queue.size() == total);
             CHECK(queue.count() == 5);
+            CHECK(queue.max_size() == 10 * 10 + 45 * 100);
+            queue.reset_max_size();
+            CHECK(queue.max_size() == total);
         }
         SUBCASE("compact to one") {
             xia::buffer::queue queue;
@@ -392,4 +402,130 @@ TEST_SUITE("xia::buffer") {
         }
         pool.destroy();
     }
+    TEST_CASE("lock counts") {
+        xia::buffer::pool pool;
+        xia::buffer::queue queue;
+        pool.create(10, 1024);
+        CHECK(pool.lock_counts().acquires == 1);
+        pool.clear_lock_counts();
+        {
+            xia::buffer::handle buf = pool.request();
+            buf->resize(100);
+            queue.push(buf);
+        }
+        xia::buffer::buffer data(50);
+        CHECK(queue.copy(data) == 50);
+        auto counts = pool.lock_counts();
+        CHECK(counts.acquires == 1);
+        CHECK(counts.contended == 0);
+        CHECK(counts.hold_nsecs == 0);
+        CHECK(queue.lock_counts().acquires == 2);
+        queue.time_locks(true);
+        queue.clear_lock_counts();
+        CHECK(queue.copy(data) == 50);
+        counts = queue.lock_counts();
+        CHECK(counts.acquires == 1);
+        CHECK(counts.hold_nsecs == counts.max_hold_nsecs);
+        queue.time_locks(false);
+        queue.flush();
+        CHECK(pool.full());
+        CHECK(pool.lock_counts().acquires == 2);
+        pool.destroy();
+    }
+    TEST_CASE("recorder") {
+        xia::buffer::pool pool;
+        pool.create(20, 1024);
+        SUBCASE("bounds") {
+            xia::buffer::recorder recorder;
+            CHECK_FALSE(recorder.enabled());
+            CHECK_THROWS_AS(recorder.configure(4, -1), xia::buffer::error);
+            CHECK(xia::buffer::recorder::pinned_buffers(2048, 1024) == 4);
+            xia::buffer::handle buf = pool.request();
+            buf->resize(600);
+            recorder.record(buf);
+            CHECK(recorder.count() == 0);
+            recorder.configure(4 * 600, 1);
+            CHECK(recorder.enabled());
+            auto now = xia::buffer::recorder::clock::now();
+            for (size_t b = 0; b < 6; ++b) {
+                buf = pool.request();
+                buf->resize(600);
+                recorder.record(buf, now);
+            }
+            buf.reset();
+            CHECK(recorder.count() == 4);
+            CHECK(recorder.size() == 4 * 600);
+            CHECK(pool.count() == pool.number - 4);
+            buf = pool.request();
+            buf->resize(10);
+            recorder.record(buf, now + std::chrono::seconds(2));
+            CHECK(recorder.count() == 1);
+            CHECK(recorder.size() == 10);
+            buf.reset();
+            CHECK(pool.full());
+            recorder.clear();
+            CHECK(recorder.count() == 0);
+        }
+        SUBCASE("small buffers are copied") {
+            xia::buffer::recorder recorder;
+            xia::buffer::queue queue;
+            recorder.configure(25, 0);
+            for (size_t b = 0; b < 3; ++b) {
+                xia::buffer::handle buf = pool.request();
+                buf->resize(10, xia::buffer::buffer_value(b));
+                recorder.record(buf);
+                queue.push(buf);
+            }
+            CHECK(recorder.count() == 2);
+            CHECK(recorder.size() == 20);
+            queue.compact();
+            CHECK(queue.count() == 1);
+            CHECK(pool.count() == pool.number - 1);
+            queue.flush();
+            CHECK(pool.full());
+            recorder.clear();
+        }
+        SUBCASE("shared with a queue") {
+            xia::buffer::recorder recorder;
+            xia::buffer::queue queue;
+            recorder.configure(10 * 1024, 0);
+            for (size_t b = 0; b < 3; ++b) {
+                xia::buffer::handle buf = pool.request();
+                buf->resize(600, xia::buffer::buffer_value(b));
+                recorder.record(buf);
+                queue.push(buf);
+            }
+            queue.compact();
+            CHECK(queue.count() == 3);
+            xia::buffer::buffer data(700);
+            CHECK(queue.copy(data) == 700);
+            CHECK(data[699] == 1);
+            CHECK(queue.size() == 1100);
+            xia::buffer::handle tail = queue.pop();
+            CHECK(tail->size() == 500);
+            CHECK(tail->front() == 1);
+            tail.reset();
+            CHECK(queue.size() == 600);
+            CHECK(recorder.size() == 1800);
+            CHECK(pool.count() == pool.number - 3);
+            const std::string name = xia::test::temp_file_name("recorder");
+            auto result = recorder.dump(name, xia::buffer::recorder::clock::now(), 10, 0);
+            CHECK(result.get() == 1800);
+            std::ifstream in(name, std::ios::binary);
+            xia::buffer::buffer dumped(1800);
+            in.read(reinterpret_cast<char*>(dumped.data()), 1800 * sizeof(dumped[0]));
+            CHECK(in.gcount() == 1800 * sizeof(dumped[0]));
+            for (size_t w = 0; w < dumped.size(); ++w) {
+                CHECK(dumped[w] == w / 600);
+            }
+            in.close();
+            std::remove(name.c_str());
+            CHECK_THROWS_AS(recorder.dump(name, xia::buffer::recorder::clock::now(), -1, 0),
+                            xia::buffer::error);
+            queue.flush();
+            recorder.clear();
+            CHECK(pool.full());
+        }
+        pool.destroy();
+    }
 }
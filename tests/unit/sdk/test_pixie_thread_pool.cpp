@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_pixie_thread_pool.cpp
+ * @brief Defines tests for the thread pool and task groups.
+ */
+
+#include <atomic>
+#include <set>
+#include <stdexcept>
+
+#include <doctest/doctest.h>
+#include <pixie/thread_pool.hpp>
+
+TEST_SUITE("xia::pixie::thread_pool") {
+    TEST_CASE("pool") {
+        using namespace xia::pixie::thread_pool;
+        SUBCASE("size") {
+            pool workers(3);
+            CHECK(workers.size() == 3);
+            CHECK_NOTHROW(workers.resize(0));
+            CHECK(workers.size() >= 1);
+            CHECK_NOTHROW(workers.resize(100000));
+            CHECK(workers.size() == pool::max_threads);
+        }
+        SUBCASE("tasks") {
+            pool workers(4);
+            std::atomic_size_t count(0);
+            group tasks(workers);
+            for (size_t t = 0; t < 1000; ++t) {
+                tasks.run([&count] { ++count; });
+            }
+            tasks.wait();
+            CHECK(tasks.done());
+            CHECK(count == 1000);
+            CHECK_FALSE(tasks.failed());
+            CHECK_NOTHROW(tasks.check("tasks"));
+            CHECK(workers.queued() == 0);
+        }
+        SUBCASE("fewer threads than tasks") {
+            pool workers(1);
+            std::atomic_size_t count(0);
+            group tasks(workers);
+            for (size_t t = 0; t < 16; ++t) {
+                tasks.run([&count] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    ++count;
+                });
+            }
+            tasks.wait();
+            CHECK(count == 16);
+        }
+        SUBCASE("nested groups") {
+            pool workers(2);
+            std::atomic_size_t count(0);
+            group outer(workers);
+            for (size_t t = 0; t < 8; ++t) {
+                outer.run([&workers, &count] {
+                    group inner(workers);
+                    for (size_t i = 0; i < 8; ++i) {
+                        inner.run([&count] { ++count; });
+                    }
+                    inner.check("inner");
+                });
+            }
+            CHECK_NOTHROW(outer.check("outer"));
+            CHECK(count == 64);
+        }
+        SUBCASE("resize") {
+            pool workers(2);
+            std::atomic_size_t count(0);
+            {
+                group tasks(workers);
+                for (size_t t = 0; t < 10; ++t) {
+                    tasks.run([&count] { ++count; });
+                }
+            }
+            CHECK(count == 10);
+            CHECK_NOTHROW(workers.resize(5));
+            group tasks(workers);
+            for (size_t t = 0; t < 10; ++t) {
+                tasks.run([&count] { ++count; });
+            }
+            tasks.wait();
+            CHECK(count == 20);
+            CHECK(workers.active() == 0);
+        }
+        SUBCASE("bounded queues") {
+            pool workers(1);
+            std::atomic_bool release(false);
+            std::atomic_size_t count(0);
+            std::atomic_size_t on_submitter(0);
+            const auto submitter = std::this_thread::get_id();
+            group tasks(workers);
+            tasks.run([&release] {
+                while (!release.load()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+            while (workers.queued() != 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            for (size_t t = 0; t < pool::max_queued + 10; ++t) {
+                tasks.run([&count, &on_submitter, submitter] {
+                    if (std::this_thread::get_id() == submitter) {
+                        ++on_submitter;
+                    }
+                    ++count;
+                });
+            }
+            CHECK(workers.queued() == pool::max_queued);
+            CHECK(workers.ran_inline() == 10);
+            CHECK(on_submitter == 10);
+            release = true;
+            tasks.wait();
+            CHECK(count == pool::max_queued + 10);
+        }
+        SUBCASE("resize while busy") {
+            pool workers(2);
+            std::atomic_bool release(false);
+            group tasks(workers);
+            tasks.run([&release] {
+                while (!release.load()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+            CHECK(workers.active() == 1);
+            CHECK_THROWS_AS(workers.resize(4), error);
+            CHECK(workers.size() == 2);
+            release = true;
+            tasks.wait();
+            CHECK(workers.active() == 0);
+            CHECK_NOTHROW(workers.resize(4));
+            CHECK(workers.size() == 4);
+        }
+    }
+    TEST_CASE("errors") {
+        using namespace xia::pixie::thread_pool;
+        using xia::pixie::error::code;
+        pool workers(2);
+        SUBCASE("all") {
+            group tasks(workers, aggregate::all);
+            std::atomic_size_t count(0);
+            for (size_t t = 0; t < 6; ++t) {
+                tasks.run([t, &count] {
+                    ++count;
+                    if (t == 1) {
+                        throw error(code::module_offline, "one");
+                    }
+                    if (t == 4) {
+                        throw error(code::device_boot_failure, "four");
+                    }
+                });
+            }
+            tasks.wait();
+            CHECK(count == 6);
+            CHECK(tasks.failed());
+            auto errs = tasks.errors();
+            REQUIRE(errs.size() == 2);
+            CHECK(errs[0].task == 1);
+            CHECK(errs[0].code == code::module_offline);
+            CHECK(errs[1].task == 4);
+            CHECK(errs[1].code == code::device_boot_failure);
+            try {
+                tasks.check("all");
+                CHECK(false);
+            } catch (error& e) {
+                CHECK(e.type == code::module_offline);
+                CHECK(std::string(e.what()) == "all: one; four");
+            }
+        }
+        SUBCASE("first") {
+            pool single(1);
+            group tasks(single, aggregate::first);
+            std::atomic_size_t count(0);
+            for (size_t t = 0; t < 10; ++t) {
+                tasks.run([t, &count] {
+                    ++count;
+                    if (t == 0) {
+                        throw error(code::module_offline, "zero");
+                    }
+                });
+            }
+            tasks.wait();
+            CHECK(count + tasks.cancelled() == 10);
+            CHECK(tasks.errors().size() == 1);
+            CHECK_THROWS_WITH_AS(tasks.check("first"), "first: zero", error);
+        }
+        SUBCASE("other exceptions") {
+            group tasks(workers);
+            tasks.run([] { throw std::runtime_error("runtime"); });
+            tasks.wait();
+            auto errs = tasks.errors();
+            REQUIRE(errs.size() == 1);
+            CHECK(errs[0].code == code::unknown_error);
+            CHECK_THROWS_AS(tasks.check("other"), std::runtime_error);
+        }
+    }
+}
@@ -136,6 +136,38 @@ TEST_SUITE("xia::util") {
         }
     }
 
+    TEST_CASE("span") {
+        std::vector<unsigned int> values = {1, 2, 3, 4, 5};
+        xia::util::span<unsigned int> view(values);
+        CHECK(view.size() == 5);
+        CHECK(view.data() == values.data());
+        view[1] = 20;
+        CHECK(values[1] == 20);
+        SUBCASE("subspan") {
+            auto sub = view.subspan(3);
+            CHECK(sub.size() == 2);
+            CHECK(sub[0] == 4);
+            CHECK(view.subspan(1, 2).size() == 2);
+            CHECK(view.subspan(4, 10).size() == 1);
+            CHECK(view.subspan(6).empty());
+        }
+        SUBCASE("const") {
+            const std::vector<unsigned int>& cvalues = values;
+            xia::util::span<const unsigned int> cview(cvalues);
+            xia::util::span<const unsigned int> converted(view);
+            CHECK(cview.data() == converted.data());
+            unsigned int sum = 0;
+            for (auto v : cview) {
+                sum += v;
+            }
+            CHECK(sum == 33);
+        }
+        SUBCASE("empty") {
+            xia::util::span<unsigned int> none;
+            CHECK(none.empty());
+            CHECK(none.begin() == none.end());
+        }
+    }
     TEST_CASE("crc32") {
         std::vector<unsigned char> vec_val = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
         const uint32_t expected = 0xcbf43926;
@@ -160,4 +192,27 @@ TEST_SUITE("xia::util") {
             CHECK(chksum3.value == 0);
         }
     }
+    TEST_CASE("thread_cpu_secs") {
+        std::thread idle;
+        CHECK(xia::util::thread_cpu_secs(idle) == 0);
+#if defined(__linux__) || defined(_WIN64) || defined(_WIN32)
+        std::atomic_bool spun(false);
+        std::atomic_bool stop(false);
+        std::thread busy([&spun, &stop] {
+            xia::util::timepoint period(true);
+            while (period.msecs() < 50) {
+            }
+            spun = true;
+            while (!stop.load()) {
+                std::this_thread::yield();
+            }
+        });
+        while (!spun.load()) {
+            std::this_thread::yield();
+        }
+        CHECK(xia::util::thread_cpu_secs(busy) > 0);
+        stop = true;
+        busy.join();
+#endif
+    }
 }
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+/*
+ * Copyright 2021 XIA LLC, All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file test_psd.cpp
+ * @brief Tests related to the psd namespace
+ */
+
+#include <cmath>
+
+#include <doctest/doctest.h>
+
+#include <pixie/data/psd.hpp>
+#include <pixie/error.hpp>
+
+#include "test_batch.hpp"
+
+namespace psd = xia::pixie::data::psd;
+namespace columnar = xia::pixie::data::columnar;
+namespace list_mode = xia::pixie::data::list_mode;
+
+/*
+ * Events alternate between a fast pulse with a tail of 1/4 of the total
+ * and a slow pulse with a tail of 1/2. Every 5th event has no total.
+ */
+static void make_batch(columnar::batch& events, size_t count) {
+    xia::test::make_batch(events, count, [](size_t e, list_mode::record& rec) {
+        rec.energy = double(100 * (e % 10));
+        if ((e % 5) == 4) {
+            rec.qdc = {7, 0, 0, 0, 0, 0, 0, 0};
+        } else if ((e % 2) == 0) {
+            rec.qdc = {7, 30, 0, 10, 0, 0, 0, 0};
+        } else {
+            rec.qdc = {7, 20, 0, 5, 5, 5, 5, 0};
+        }
+    });
+}
+
+/*
+ * A baseline of 100 with 10 samples of 200 in the total gate before the
+ * tail and the tail samples of 200 in the tail gate.
+ */
+static void make_trace(list_mode::record& rec, size_t tail_samples) {
+    rec.trace.assign(80, 100);
+    for (size_t s = 10; s < 20; ++s) {
+        rec.trace[s] = 200;
+    }
+    for (size_t s = 25; s < 25 + tail_samples; ++s) {
+        rec.trace[s] = 200;
+    }
+    rec.trace_length = rec.trace.size();
+}
+
+TEST_SUITE("xia::pixie::data::psd") {
+    TEST_CASE("Config") {
+        psd::config cfg;
+        cfg.psd_bins = 0;
+        CHECK_THROWS_AS(psd::analyzer ana(cfg), psd::error);
+        cfg = psd::config();
+        cfg.energy_max = cfg.energy_min;
+        CHECK_THROWS_AS(psd::analyzer ana(cfg), psd::error);
+        cfg = psd::config();
+        cfg.source = psd::source::trace;
+        cfg.trace.baseline_length = 0;
+        CHECK_THROWS_AS(psd::analyzer ana(cfg), psd::error);
+        CHECK(psd::trace_gates().length() == 70);
+    }
+    TEST_CASE("Histogram") {
+        psd::histogram hist;
+        hist.setup(10, 0, 100, 4, 0, 1);
+        hist.fill(15, 0.3);
+        hist.fill(99.9, 0.99);
+        hist.fill(100, 0.5);
+        hist.fill(50, -0.1);
+        CHECK(hist.at(1, 1) == 1);
+        CHECK(hist.at(9, 3) == 1);
+        CHECK(hist.total() == 2);
+        CHECK(hist.outside == 2);
+        CHECK_THROWS_AS(hist.at(10, 0), psd::error);
+        hist.clear();
+        CHECK(hist.total() == 0);
+        CHECK(hist.outside == 0);
+    }
+    TEST_CASE("QDC ratios") {
+        columnar::batch events;
+        make_batch(events, 20);
+        psd::analyzer ana;
+        std::vector<double> ratios;
+        ana.ratios(events, ratios);
+        REQUIRE(ratios.size() == 20);
+        for (size_t e = 0; e < ratios.size(); ++e) {
+            if ((e % 5) == 4) {
+                CHECK(std::isnan(ratios[e]));
+            } else if ((e % 2) == 0) {
+                CHECK(ratios[e] == doctest::Approx(0.25));
+            } else {
+                CHECK(ratios[e] == doctest::Approx(0.5));
+            }
+        }
+        psd::config cfg;
+        cfg.qdc.tail = {-0.5, 0, 0, 1, 0, 0, 0, 0};
+        psd::analyzer weighted(cfg);
+        weighted.ratios(events, ratios);
+        CHECK(ratios[0] == doctest::Approx((10 - 3.5) / 40));
+        columnar::batch no_qdc;
+        no_qdc.clear(columnar::column::energy);
+        CHECK_THROWS_AS(ana.ratios(no_qdc, ratios), psd::error);
+    }
+    TEST_CASE("Trace ratios") {
+        columnar::batch events;
+        events.clear();
+        list_mode::record rec;
+        make_trace(rec, 10);
+        events.append(rec);
+        make_trace(rec, 30);
+        events.append(rec);
+        rec.trace.resize(50);
+        rec.trace_length = rec.trace.size();
+        events.append(rec);
+        psd::config cfg;
+        cfg.source = psd::source::trace;
+        psd::analyzer ana(cfg);
+        std::vector<double> ratios;
+        ana.ratios(events, ratios);
+        REQUIRE(ratios.size() == 3);
+        CHECK(ratios[0] == doctest::Approx(0.5));
+        CHECK(ratios[1] == doctest::Approx(0.75));
+        CHECK(std::isnan(ratios[2]));
+    }
+    TEST_CASE("Channel histograms") {
+        columnar::batch events;
+        make_batch(events, 400);
+        xia::pixie::thread_pool::pool shared(2);
+        for (size_t threads : {1, 3, 0}) {
+            psd::config cfg;
+            cfg.energy_bins = 10;
+            cfg.energy_max = 1000;
+            cfg.psd_bins = 4;
+            cfg.threads = threads;
+            /*
+             * Threads of 0 fills on the shared pool.
+             */
+            psd::analyzer ana(cfg, threads == 0 ? &shared : nullptr);
+            ana.analyze(events);
+            ana.analyze(events);
+            CHECK(ana.channels().size() == 8);
+            uint64_t counted = 0;
+            uint64_t invalid = 0;
+            for (auto& chan : ana.channels()) {
+                counted += chan.hist.total() + chan.hist.outside;
+                invalid += chan.invalid;
+            }
+            CHECK(counted == 640);
+            CHECK(invalid == 160);
+            /*
+             * Slot 2 has the even events, fast pulses, energies of 0, 200,
+             * 600 and 800 with 400 having no total.
+             */
+            auto& fast = ana.get(0, 2, 0).hist;
+            CHECK(fast.at(0, 1) == 20);
+            CHECK(fast.at(2, 1) == 20);
+            CHECK(fast.at(4, 1) == 0);
+            CHECK(fast.at(2, 2) == 0);
+            auto& slow = ana.get(0, 3, 1).hist;
+            CHECK(slow.at(1, 2) == 20);
+            CHECK(slow.at(1, 1) == 0);
+            CHECK(ana.get(0, 3, 1).invalid == 20);
+            CHECK_THROWS_AS(ana.get(0, 4, 0), psd::error);
+            ana.clear();
+            CHECK(ana.get(0, 2, 0).hist.total() == 0);
+            CHECK(ana.get(0, 3, 1).invalid == 0);
+        }
+        columnar::batch no_energy;
+        no_energy.clear(columnar::column::qdc | columnar::column::crate |
+                        columnar::column::slot | columnar::column::channel);
+        psd::analyzer ana;
+        CHECK_THROWS_AS(ana.analyze(no_energy), psd::error);
+    }
+}